@@ -50,6 +50,16 @@ class TDA {
     return parser.parse_account(parser.read_response(response));
   }
 
+  // the raw response, for callers that parse on their own schedule; safe
+  // from several threads once the user principals are loaded
+  auto fetchAccount(const std::string &accountNumber) -> std::string {
+    return client.get_account(accountNumber);
+  }
+
+  auto parseAccount(const std::string &response) const -> Account {
+    return parser.parse_account(parser.read_response(response));
+  }
+
   auto getAllAccounts() -> Account {
     std::string response = client.get_all_accounts();
     return parser.parse_all_accounts(parser.read_response(response));
@@ -94,6 +104,24 @@ class TDA {
     return num;
   }
 
+  // the broker's id for the order, empty if it was not accepted; status is
+  // the HTTP status, 0 when no response came back
+  auto placeOrder(const std::string &accountNumber, const Order &order,
+                  long *status = nullptr) const -> std::string {
+    return client.place_order(accountNumber, order, status);
+  }
+
+  auto cancelOrder(const std::string &accountNumber,
+                   const std::string &orderId) const -> bool {
+    return client.cancel_order(accountNumber, orderId);
+  }
+
+  // the raw order, for OrderBook::reconcile
+  auto getOrder(const std::string &accountNumber,
+                const std::string &orderId) const -> std::string {
+    return client.get_order(accountNumber, orderId);
+  }
+
   auto parseOptionSymbol(const std::string &symbol) const -> std::string {
     return parser.parse_option_symbol(symbol);
   }
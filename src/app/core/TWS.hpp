@@ -1,7 +1,11 @@
 #ifndef TraderWorkstationApiInterface_hpp
 #define TraderWorkstationApiInterface_hpp
 
-#include "service/InteractiveBrokers/Client.hpp"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "service/InteractiveBrokers/ConnectionPool.hpp"
 
 namespace premia {
 namespace tws {
@@ -10,6 +14,10 @@ class TWS {
  private:
   TWS() = default;
 
+  static constexpr const char* kContractCacheFile = "assets/ib_contracts.tsv";
+
+  std::unique_ptr<ConnectionPool> pool;
+
  public:
   TWS(TWS const&) = delete;
   void operator=(TWS const&) = delete;
@@ -19,35 +27,32 @@ class TWS {
   }
 
   // functions
-  auto runClient(std::string host, int port, int clientId) -> void {
-    std::string options = "";
-    constexpr auto MAX_ATTEMPTS = 10;
-    constexpr auto SLEEP_TIME = 5;
-    unsigned attempt = 0;
-
+  // Opens `connections` sessions on consecutive client ids starting at
+  // clientId; each reconnects on its own thread, so this returns at once.
+  auto runClient(std::string host, int port, int clientId,
+                 int connections = 4) -> void {
     if (port <= 0) port = 7496;
 
-    for (;;) {
-      ++attempt;
-      printf("Attempt %u of %u\n", attempt, MAX_ATTEMPTS);
-      Client client;
-
-      if (!options.empty()) {
-        client.setConnectOptions(options);
-      }
+    std::vector<Endpoint> endpoints;
+    for (int i = 0; i < connections; ++i) {
+      endpoints.push_back(Endpoint{host, port, clientId + i});
+    }
 
-      client.connect(host.c_str(), port, clientId);
-      while (client.isConnected()) {
-        client.processMessages();
-      }
+    PoolOptions options;
+    options.contract_file = kContractCacheFile;
+    // the connections share one account's market data allowance
+    options.lines_per_connection = 100 / std::max(connections, 1);
 
-      if (attempt >= MAX_ATTEMPTS) {
-        break;
-      }
-    }
+    pool.reset();
+    pool = std::make_unique<ConnectionPool>(std::move(endpoints), options);
+    pool->Start();
   }
+
+  auto stopClient() -> void { pool.reset(); }
+
+  auto getPool() -> ConnectionPool* { return pool.get(); }
 };
 }  // namespace tws
 }  // namespace premia
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,139 @@
+#include "account_refresher.h"
+
+#include <exception>
+#include <utility>
+
+namespace premia {
+
+const tda::Account& AccountSnapshot::get(const std::string& accountId) const {
+  for (size_t i = 0; i < accountIds.size(); ++i) {
+    if (accountIds[i] == accountId && accounts[i]) return *accounts[i];
+  }
+  return household;
+}
+
+AccountRefresher::AccountRefresher(Fetch fetch, Parse parse, size_t threads)
+    : fetch(std::move(fetch)),
+      parse(std::move(parse)),
+      pool(threads),
+      snapshot(std::make_shared<AccountSnapshot>()) {}
+
+AccountRefresher::~AccountRefresher() { stop(); }
+
+void AccountRefresher::setAccounts(const std::vector<std::string>& ids) {
+  std::lock_guard<std::mutex> lock(mutex);
+  accountIds = ids;
+}
+
+void AccountRefresher::setInterval(std::chrono::milliseconds every) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    interval = every;
+  }
+  wake.notify_all();
+}
+
+void AccountRefresher::start() {
+  if (thread.joinable()) return;
+  thread = std::thread(&AccountRefresher::loop, this);
+}
+
+void AccountRefresher::stop() {
+  if (!thread.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  thread.join();
+  stopping = false;
+}
+
+void AccountRefresher::requestRefresh() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    woken = true;
+  }
+  wake.notify_all();
+}
+
+std::shared_ptr<const AccountSnapshot> AccountRefresher::getSnapshot() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return snapshot;
+}
+
+void AccountRefresher::loop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!stopping) {
+    woken = false;
+    lock.unlock();
+    refresh();
+    lock.lock();
+    // an interval change also wakes the wait, to start the new one
+    wake.wait_for(lock, interval, [this] { return stopping || woken; });
+  }
+}
+
+void AccountRefresher::refresh() {
+  std::lock_guard<std::mutex> one(refreshing);
+  std::vector<std::string> ids;
+  std::shared_ptr<const AccountSnapshot> last;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ids = accountIds;
+    last = snapshot;
+  }
+
+  const size_t n = ids.size();
+  std::vector<std::string> responses(n);
+  std::vector<size_t> hashes(n);
+  std::vector<std::shared_ptr<const tda::Account>> parsed(n);
+  std::vector<char> fetched(n, 0);
+  pool.run(n, [&](size_t, size_t i) {
+    try {
+      responses[i] = fetch(ids[i]);
+      if (responses[i].empty()) return;
+      fetched[i] = 1;
+      hashes[i] = std::hash<std::string>()(responses[i]);
+      auto cached = cache.find(ids[i]);
+      if (cached != cache.end() && cached->second.hash == hashes[i]) return;
+      parsed[i] = std::make_shared<const tda::Account>(parse(responses[i]));
+    } catch (const std::exception&) {
+      fetched[i] = 0;
+      parsed[i].reset();
+    }
+  });
+
+  bool changed = ids != last->accountIds;
+  std::unordered_map<std::string, Cached> kept;
+  auto next = std::make_shared<AccountSnapshot>();
+  next->accountIds = ids;
+  for (size_t i = 0; i < n; ++i) {
+    Cached entry;
+    auto cached = cache.find(ids[i]);
+    if (cached != cache.end()) entry = cached->second;
+    if (parsed[i]) {
+      entry = {hashes[i], parsed[i]};
+      changed = true;
+    }
+    bool stale = !fetched[i];
+    if (i >= last->stale.size() || last->stale[i] != stale) changed = true;
+    next->accounts.push_back(entry.account);
+    next->stale.push_back(stale);
+    if (entry.account) kept.emplace(ids[i], std::move(entry));
+  }
+  cache.swap(kept);
+  if (!changed) return;
+
+  for (const auto& account : next->accounts) {
+    if (account) next->household.merge(*account);
+  }
+  next->household.set_account_variable("accountId",
+                                       AccountSnapshot::kHouseholdId);
+  next->version = last->version + 1;
+  next->refreshed = std::chrono::system_clock::now();
+  std::lock_guard<std::mutex> lock(mutex);
+  snapshot = std::move(next);
+}
+
+}  // namespace premia
@@ -0,0 +1,97 @@
+#ifndef AccountRefresher_hpp
+#define AccountRefresher_hpp
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "model/options/worker_pool.h"
+#include "service/TDAmeritrade/data/Account.hpp"
+
+namespace premia {
+
+// Every linked account as of one refresh, and all of them merged. Never
+// changed once published, so the UI can hold one across frames.
+struct AccountSnapshot {
+  uint64_t version = 0;  // 0 until the first refresh lands
+  std::chrono::system_clock::time_point refreshed;
+  std::vector<std::string> accountIds;
+  // line up with accountIds; shared with later snapshots while unchanged
+  std::vector<std::shared_ptr<const tda::Account>> accounts;
+  // the last fetch of the account failed, so it is from an earlier refresh
+  std::vector<bool> stale;
+  // every account merged, with kHouseholdId as its accountId
+  tda::Account household;
+
+  static constexpr const char* kHouseholdId = "All accounts";
+
+  // the household for an empty or unknown id
+  const tda::Account& get(const std::string& accountId) const;
+};
+
+// Pulls the linked accounts off the UI thread and publishes snapshots.
+//
+// Each refresh fetches every account at once on its own pool, the requests
+// being network bound, then parses only the responses whose hash differs
+// from the last one parsed for that account. When nothing changed no
+// snapshot is published. start() refreshes on a background thread every
+// interval; requestRefresh() wakes it early.
+class AccountRefresher {
+ public:
+  using Fetch = std::function<std::string(const std::string& accountId)>;
+  using Parse = std::function<tda::Account(const std::string& response)>;
+
+  // fetch and parse are called from the pool, several at a time; an empty
+  // response or an exception from either keeps the account as it was
+  AccountRefresher(Fetch fetch, Parse parse, size_t threads = 4);
+  ~AccountRefresher();
+  AccountRefresher(const AccountRefresher&) = delete;
+  AccountRefresher& operator=(const AccountRefresher&) = delete;
+
+  void setAccounts(const std::vector<std::string>& accountIds);
+  void setInterval(std::chrono::milliseconds interval);
+  void start();
+  void stop();
+  void requestRefresh();
+  // one refresh on the calling thread, what the background thread runs
+  void refresh();
+
+  std::shared_ptr<const AccountSnapshot> getSnapshot() const;
+
+ private:
+  struct Cached {
+    size_t hash = 0;
+    std::shared_ptr<const tda::Account> account;
+  };
+
+  void loop();
+
+  Fetch fetch;
+  Parse parse;
+  WorkerPool pool;
+
+  mutable std::mutex mutex;
+  std::condition_variable wake;
+  std::vector<std::string> accountIds;
+  std::chrono::milliseconds interval{15000};
+  bool stopping = false;
+  bool woken = false;
+  std::shared_ptr<const AccountSnapshot> snapshot;
+  std::thread thread;
+
+  // held through a refresh, so one runs at a time; guards cache
+  std::mutex refreshing;
+  std::unordered_map<std::string, Cached> cache;
+};
+
+}  // namespace premia
+
+#endif
@@ -57,4 +57,13 @@ void ChartModel::fetchPriceHistory(const std::string& ticker,
   initCandles();
   active = true;
 }
+
+void ChartModel::appendCandles(const std::vector<tda::Candle>& newCandles) {
+  for (const auto& candle : newCandles) {
+    candles.push_back(candle);
+    datesVec.push_back(candle.raw_datetime * 0.001);
+    volumeVec.push_back(candle.volume);
+  }
+  if (!newCandles.empty()) active = true;
+}
 }  // namespace premia
\ No newline at end of file
@@ -24,6 +24,8 @@ class ChartModel : public Model {
   void fetchPriceHistory(const std::string& ticker, tda::PeriodType ptype,
                          int period_amt, tda::FrequencyType ftype, int freq_amt,
                          bool ext);
+  // appends finished bars from a live feed such as tws::BarAggregator
+  void appendCandles(const std::vector<tda::Candle>& newCandles);
 
  private:
   void initCandles();
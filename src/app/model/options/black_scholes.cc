@@ -0,0 +1,263 @@
+#include "black_scholes.h"
+
+#include <cmath>
+
+#include "black_scholes_kernel.h"
+
+namespace premia {
+
+#if defined(PREMIA_SIMD_X86)
+namespace bs_kernel {
+void priceAllAvx2(const Args& args);
+void priceAllAvx512(const Args& args);
+void solveAllAvx2(const IvArgs& args);
+void solveAllAvx512(const IvArgs& args);
+}  // namespace bs_kernel
+#endif
+
+namespace {
+
+struct ScalarLane {
+  using Mask = bool;
+  static constexpr size_t kWidth = 1;
+  double v;
+
+  static ScalarLane set(double x) { return {x}; }
+  static ScalarLane load(const double* p) { return {*p}; }
+  void store(double* p) const { *p = v; }
+
+  friend ScalarLane operator+(ScalarLane a, ScalarLane b) {
+    return {a.v + b.v};
+  }
+  friend ScalarLane operator-(ScalarLane a, ScalarLane b) {
+    return {a.v - b.v};
+  }
+  friend ScalarLane operator*(ScalarLane a, ScalarLane b) {
+    return {a.v * b.v};
+  }
+  friend ScalarLane operator/(ScalarLane a, ScalarLane b) {
+    return {a.v / b.v};
+  }
+  friend ScalarLane operator-(ScalarLane a) { return {-a.v}; }
+  friend ScalarLane fmadd(ScalarLane a, ScalarLane b, ScalarLane c) {
+    return {a.v * b.v + c.v};
+  }
+  friend ScalarLane sqrt(ScalarLane a) { return {std::sqrt(a.v)}; }
+  friend ScalarLane abs(ScalarLane a) { return {std::fabs(a.v)}; }
+  friend ScalarLane round(ScalarLane a) { return {std::nearbyint(a.v)}; }
+  friend bool less(ScalarLane a, ScalarLane b) { return a.v < b.v; }
+  friend bool greater(ScalarLane a, ScalarLane b) { return a.v > b.v; }
+  static bool maskAnd(bool a, bool b) { return a && b; }
+  friend ScalarLane select(bool m, ScalarLane a, ScalarLane b) {
+    return m ? a : b;
+  }
+  friend ScalarLane ldexp2(ScalarLane r, ScalarLane n) {
+    return {std::ldexp(r.v, static_cast<int>(n.v))};
+  }
+  friend ScalarLane frexp2(ScalarLane x, ScalarLane* e) {
+    int exponent;
+    double mantissa = std::frexp(x.v, &exponent);
+    e->v = exponent;
+    return {mantissa};
+  }
+};
+
+bs_kernel::Args kernelArgs(const OptionBatch& batch, GreeksBatch* out) {
+  out->resize(batch.size());
+  return bs_kernel::Args{batch.size(),       batch.spot,
+                         batch.rate,         batch.dividend,
+                         batch.strike.data(), batch.years.data(),
+                         batch.vol.data(),    batch.sign.data(),
+                         out->price.data(),   out->delta.data(),
+                         out->gamma.data(),   out->vega.data(),
+                         out->theta.data(),   out->vanna.data(),
+                         out->volga.data(),   out->charm.data()};
+}
+
+constexpr double kIvTolerance = 1e-10;
+constexpr int kIvMaxIterations = 64;
+
+double normCdf(double x) { return 0.5 * std::erfc(-x / std::sqrt(2.0)); }
+
+}  // namespace
+
+void OptionBatch::add(double strikePrice, double yearsToExpiry,
+                      double volatility, bool call) {
+  strike.push_back(strikePrice);
+  years.push_back(yearsToExpiry);
+  vol.push_back(volatility);
+  sign.push_back(call ? 1.0 : -1.0);
+}
+
+void OptionBatch::clear() {
+  strike.clear();
+  years.clear();
+  vol.clear();
+  sign.clear();
+}
+
+void GreeksBatch::resize(size_t n) {
+  price.resize(n);
+  delta.resize(n);
+  gamma.resize(n);
+  vega.resize(n);
+  theta.resize(n);
+  vanna.resize(n);
+  volga.resize(n);
+  charm.resize(n);
+}
+
+void ImpliedVolBatch::resize(size_t n) {
+  vol.resize(n);
+  status.resize(n);
+  iterations.resize(n);
+  work.resize(bs_kernel::ivWorkSize(n));
+}
+
+SimdLevel detectSimdLevel() {
+#if defined(PREMIA_SIMD_X86)
+  static const SimdLevel level = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512dq")) {
+      return SimdLevel::kAvx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return SimdLevel::kAvx2;
+    }
+    return SimdLevel::kScalar;
+  }();
+  return level;
+#else
+  return SimdLevel::kScalar;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kAvx512:
+      return "avx512";
+    case SimdLevel::kAvx2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+void priceBatch(const OptionBatch& batch, GreeksBatch* out) {
+  priceBatch(batch, out, detectSimdLevel());
+}
+
+void priceBatch(const OptionBatch& batch, GreeksBatch* out,
+                SimdLevel level) {
+  bs_kernel::Args args = kernelArgs(batch, out);
+  if (args.n == 0) return;
+  if (level > detectSimdLevel()) level = detectSimdLevel();
+
+#if defined(PREMIA_SIMD_X86)
+  if (level == SimdLevel::kAvx512) {
+    bs_kernel::priceAllAvx512(args);
+    return;
+  }
+  if (level == SimdLevel::kAvx2) {
+    bs_kernel::priceAllAvx2(args);
+    return;
+  }
+#endif
+  bs_kernel::priceAll<ScalarLane>(args);
+}
+
+void solveImpliedVol(const OptionBatch& batch,
+                     const std::vector<double>& prices, ImpliedVolBatch* out) {
+  solveImpliedVol(batch, prices, out, detectSimdLevel());
+}
+
+void solveImpliedVol(const OptionBatch& batch,
+                     const std::vector<double>& prices, ImpliedVolBatch* out,
+                     SimdLevel level) {
+  size_t n = batch.size() < prices.size() ? batch.size() : prices.size();
+  out->resize(n);
+  if (n == 0) return;
+  if (level > detectSimdLevel()) level = detectSimdLevel();
+
+  bs_kernel::IvArgs args{n,
+                         batch.spot,
+                         batch.rate,
+                         batch.dividend,
+                         kIvTolerance,
+                         kIvMaxIterations,
+                         batch.strike.data(),
+                         batch.years.data(),
+                         batch.sign.data(),
+                         prices.data(),
+                         batch.vol.data(),
+                         out->vol.data(),
+                         out->status.data(),
+                         out->iterations.data(),
+                         out->work.data()};
+#if defined(PREMIA_SIMD_X86)
+  if (level == SimdLevel::kAvx512) {
+    bs_kernel::solveAllAvx512(args);
+    return;
+  }
+  if (level == SimdLevel::kAvx2) {
+    bs_kernel::solveAllAvx2(args);
+    return;
+  }
+#endif
+  bs_kernel::solveAll<ScalarLane>(args);
+}
+
+void priceReference(const OptionBatch& batch, GreeksBatch* out) {
+  out->resize(batch.size());
+  const double s = batch.spot;
+  const double r = batch.rate;
+  const double q = batch.dividend;
+
+  for (size_t i = 0; i < batch.size(); ++i) {
+    const double k = batch.strike[i];
+    const double t = batch.years[i];
+    const double v = batch.vol[i];
+    const bool call = batch.sign[i] > 0;
+
+    if (t <= 0 || v <= 0 || k <= 0) {
+      double intrinsic = call ? s - k : k - s;
+      out->price[i] = intrinsic > 0 ? intrinsic : 0.0;
+      out->delta[i] = intrinsic > 0 ? (call ? 1.0 : -1.0) : 0.0;
+      out->gamma[i] = out->vega[i] = out->theta[i] = 0.0;
+      out->vanna[i] = out->volga[i] = out->charm[i] = 0.0;
+      continue;
+    }
+
+    double d1 = (std::log(s / k) + (r - q + v * v / 2) * t) /
+                (v * std::sqrt(t));
+    double d2 = d1 - v * std::sqrt(t);
+    double pdf = std::exp(-d1 * d1 / 2) / 2.50662827463100050242;
+    double dq = std::exp(-q * t);
+    double dr = std::exp(-r * t);
+
+    if (call) {
+      out->price[i] = s * dq * normCdf(d1) - k * dr * normCdf(d2);
+      out->delta[i] = dq * normCdf(d1);
+      out->theta[i] = -s * dq * pdf * v / (2 * std::sqrt(t)) -
+                      r * k * dr * normCdf(d2) + q * s * dq * normCdf(d1);
+      out->charm[i] = q * dq * normCdf(d1) -
+                      dq * pdf * (2 * (r - q) * t - d2 * v * std::sqrt(t)) /
+                          (2 * t * v * std::sqrt(t));
+    } else {
+      out->price[i] = k * dr * normCdf(-d2) - s * dq * normCdf(-d1);
+      out->delta[i] = -dq * normCdf(-d1);
+      out->theta[i] = -s * dq * pdf * v / (2 * std::sqrt(t)) +
+                      r * k * dr * normCdf(-d2) - q * s * dq * normCdf(-d1);
+      out->charm[i] = -q * dq * normCdf(-d1) -
+                      dq * pdf * (2 * (r - q) * t - d2 * v * std::sqrt(t)) /
+                          (2 * t * v * std::sqrt(t));
+    }
+    out->gamma[i] = dq * pdf / (s * v * std::sqrt(t));
+    out->vega[i] = s * dq * pdf * std::sqrt(t);
+    out->vanna[i] = -dq * pdf * d2 / v;
+    out->volga[i] = out->vega[i] * d1 * d2 / v;
+  }
+}
+
+}  // namespace premia
@@ -0,0 +1,91 @@
+#ifndef BlackScholes_hpp
+#define BlackScholes_hpp
+
+#include <cstddef>
+#include <vector>
+
+namespace premia {
+
+// Options on one underlying, column by column. sign is +1 for calls and -1
+// for puts; years and vol are annualized, vol as a fraction (0.2 = 20%).
+struct OptionBatch {
+  double spot = 0.0;
+  double rate = 0.0;
+  double dividend = 0.0;
+  std::vector<double> strike;
+  std::vector<double> years;
+  std::vector<double> vol;
+  std::vector<double> sign;
+
+  void add(double strikePrice, double yearsToExpiry, double volatility,
+           bool call);
+  void clear();
+  size_t size() const { return strike.size(); }
+};
+
+// Black-Scholes-Merton value and greeks of each option in a batch. vega and
+// volga are per unit of vol, theta and charm per year, charm being the
+// delta lost per year as expiry nears.
+struct GreeksBatch {
+  std::vector<double> price;
+  std::vector<double> delta;
+  std::vector<double> gamma;
+  std::vector<double> vega;
+  std::vector<double> theta;
+  std::vector<double> vanna;
+  std::vector<double> volga;
+  std::vector<double> charm;
+
+  void resize(size_t n);
+  size_t size() const { return price.size(); }
+};
+
+enum class IvStatus {
+  kConverged,
+  kNotConverged,   // iteration cap hit; vol is the best bracket midpoint
+  kBelowIntrinsic, // under the discounted intrinsic value, no vol fits
+  kAboveMaximum,   // at or over S e^-qT (calls) or K e^-rT (puts)
+  kInvalid         // no time, no strike or no price
+};
+
+// One implied vol per option of a batch; NaN where no vol fits the price.
+struct ImpliedVolBatch {
+  std::vector<double> vol;
+  std::vector<IvStatus> status;
+  std::vector<int> iterations;
+  // solver scratch, kept so that reusing a batch does not reallocate
+  std::vector<double> work;
+
+  void resize(size_t n);
+  size_t size() const { return vol.size(); }
+};
+
+enum class SimdLevel { kScalar, kAvx2, kAvx512 };
+
+// Widest kernel both this build and this CPU support.
+SimdLevel detectSimdLevel();
+const char* simdLevelName(SimdLevel level);
+
+// Prices a whole batch, 8, 4 or 1 options per step depending on the level.
+// Options with no time, vol or strike are worth intrinsic, with a delta of
+// 0 or +-1 and no other greeks. Levels above detectSimdLevel() fall back.
+void priceBatch(const OptionBatch& batch, GreeksBatch* out);
+void priceBatch(const OptionBatch& batch, GreeksBatch* out, SimdLevel level);
+
+// Implied vol of each option from prices[i] (e.g. our own mids, or with
+// batch.spot shifted for a scenario). batch.vol is the starting guess where
+// positive, so the previous solve warm-starts the next one. A vol counts as
+// converged once the next Newton step would move it less than 1e-10.
+void solveImpliedVol(const OptionBatch& batch,
+                     const std::vector<double>& prices, ImpliedVolBatch* out);
+void solveImpliedVol(const OptionBatch& batch,
+                     const std::vector<double>& prices, ImpliedVolBatch* out,
+                     SimdLevel level);
+
+// The textbook formulas one option at a time on std::erfc, std::exp and
+// std::log; the kernels are checked against it.
+void priceReference(const OptionBatch& batch, GreeksBatch* out);
+
+}  // namespace premia
+
+#endif
@@ -0,0 +1,85 @@
+// Built with -mavx2 -mfma; only called after detectSimdLevel() saw both.
+
+#include <immintrin.h>
+
+#include "black_scholes_kernel.h"
+
+namespace premia {
+namespace bs_kernel {
+
+namespace {
+
+struct Avx2Lane {
+  using Mask = __m256d;
+  static constexpr size_t kWidth = 4;
+  __m256d v;
+
+  static Avx2Lane set(double x) { return {_mm256_set1_pd(x)}; }
+  static Avx2Lane load(const double* p) { return {_mm256_loadu_pd(p)}; }
+  void store(double* p) const { _mm256_storeu_pd(p, v); }
+
+  friend Avx2Lane operator+(Avx2Lane a, Avx2Lane b) {
+    return {_mm256_add_pd(a.v, b.v)};
+  }
+  friend Avx2Lane operator-(Avx2Lane a, Avx2Lane b) {
+    return {_mm256_sub_pd(a.v, b.v)};
+  }
+  friend Avx2Lane operator*(Avx2Lane a, Avx2Lane b) {
+    return {_mm256_mul_pd(a.v, b.v)};
+  }
+  friend Avx2Lane operator/(Avx2Lane a, Avx2Lane b) {
+    return {_mm256_div_pd(a.v, b.v)};
+  }
+  friend Avx2Lane operator-(Avx2Lane a) {
+    return {_mm256_xor_pd(a.v, _mm256_set1_pd(-0.0))};
+  }
+  friend Avx2Lane fmadd(Avx2Lane a, Avx2Lane b, Avx2Lane c) {
+    return {_mm256_fmadd_pd(a.v, b.v, c.v)};
+  }
+  friend Avx2Lane sqrt(Avx2Lane a) { return {_mm256_sqrt_pd(a.v)}; }
+  friend Avx2Lane abs(Avx2Lane a) {
+    return {_mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v)};
+  }
+  friend Avx2Lane round(Avx2Lane a) {
+    return {_mm256_round_pd(a.v, _MM_FROUND_TO_NEAREST_INT |
+                                     _MM_FROUND_NO_EXC)};
+  }
+  friend Mask less(Avx2Lane a, Avx2Lane b) {
+    return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ);
+  }
+  friend Mask greater(Avx2Lane a, Avx2Lane b) {
+    return _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ);
+  }
+  static Mask maskAnd(Mask a, Mask b) { return _mm256_and_pd(a, b); }
+  friend Avx2Lane select(Mask m, Avx2Lane a, Avx2Lane b) {
+    return {_mm256_blendv_pd(b.v, a.v, m)};
+  }
+  // 2^n built in the exponent field: n + 2^52 + 1023 leaves the biased
+  // exponent in the low mantissa bits, which shift up into place
+  friend Avx2Lane ldexp2(Avx2Lane r, Avx2Lane n) {
+    __m256d biased = _mm256_add_pd(n.v, _mm256_set1_pd(4503599627371519.0));
+    __m256i bits = _mm256_slli_epi64(_mm256_castpd_si256(biased), 52);
+    return {_mm256_mul_pd(r.v, _mm256_castsi256_pd(bits))};
+  }
+  friend Avx2Lane frexp2(Avx2Lane x, Avx2Lane* e) {
+    __m256i bits = _mm256_castpd_si256(x.v);
+    __m256i exponent = _mm256_or_si256(
+        _mm256_srli_epi64(bits, 52),
+        _mm256_set1_epi64x(0x4330000000000000LL));
+    e->v = _mm256_sub_pd(_mm256_castsi256_pd(exponent),
+                         _mm256_set1_pd(4503599627371518.0));
+    __m256i mantissa = _mm256_or_si256(
+        _mm256_and_si256(bits, _mm256_set1_epi64x(0x000fffffffffffffLL)),
+        _mm256_set1_epi64x(0x3fe0000000000000LL));
+    return {_mm256_castsi256_pd(mantissa)};
+  }
+};
+
+}  // namespace
+
+void priceAllAvx2(const Args& args) { priceAll<Avx2Lane>(args); }
+
+void solveAllAvx2(const IvArgs& args) { solveAll<Avx2Lane>(args); }
+
+}  // namespace bs_kernel
+}  // namespace premia
@@ -0,0 +1,75 @@
+// Built with -mavx512f -mavx512dq -mfma; only called after
+// detectSimdLevel() saw AVX-512F and DQ.
+
+#include <immintrin.h>
+
+#include "black_scholes_kernel.h"
+
+namespace premia {
+namespace bs_kernel {
+
+namespace {
+
+struct Avx512Lane {
+  using Mask = __mmask8;
+  static constexpr size_t kWidth = 8;
+  __m512d v;
+
+  static Avx512Lane set(double x) { return {_mm512_set1_pd(x)}; }
+  static Avx512Lane load(const double* p) { return {_mm512_loadu_pd(p)}; }
+  void store(double* p) const { _mm512_storeu_pd(p, v); }
+
+  friend Avx512Lane operator+(Avx512Lane a, Avx512Lane b) {
+    return {_mm512_add_pd(a.v, b.v)};
+  }
+  friend Avx512Lane operator-(Avx512Lane a, Avx512Lane b) {
+    return {_mm512_sub_pd(a.v, b.v)};
+  }
+  friend Avx512Lane operator*(Avx512Lane a, Avx512Lane b) {
+    return {_mm512_mul_pd(a.v, b.v)};
+  }
+  friend Avx512Lane operator/(Avx512Lane a, Avx512Lane b) {
+    return {_mm512_div_pd(a.v, b.v)};
+  }
+  friend Avx512Lane operator-(Avx512Lane a) {
+    return {_mm512_xor_pd(a.v, _mm512_set1_pd(-0.0))};
+  }
+  friend Avx512Lane fmadd(Avx512Lane a, Avx512Lane b, Avx512Lane c) {
+    return {_mm512_fmadd_pd(a.v, b.v, c.v)};
+  }
+  friend Avx512Lane sqrt(Avx512Lane a) { return {_mm512_sqrt_pd(a.v)}; }
+  friend Avx512Lane abs(Avx512Lane a) { return {_mm512_abs_pd(a.v)}; }
+  friend Avx512Lane round(Avx512Lane a) {
+    return {_mm512_roundscale_pd(a.v, _MM_FROUND_TO_NEAREST_INT |
+                                          _MM_FROUND_NO_EXC)};
+  }
+  friend Mask less(Avx512Lane a, Avx512Lane b) {
+    return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ);
+  }
+  friend Mask greater(Avx512Lane a, Avx512Lane b) {
+    return _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ);
+  }
+  static Mask maskAnd(Mask a, Mask b) { return a & b; }
+  friend Avx512Lane select(Mask m, Avx512Lane a, Avx512Lane b) {
+    return {_mm512_mask_blend_pd(m, b.v, a.v)};
+  }
+  friend Avx512Lane ldexp2(Avx512Lane r, Avx512Lane n) {
+    return {_mm512_scalef_pd(r.v, n.v)};
+  }
+  // getexp gives floor(log2 x), one less than frexp's exponent
+  friend Avx512Lane frexp2(Avx512Lane x, Avx512Lane* e) {
+    e->v = _mm512_add_pd(_mm512_getexp_pd(x.v), _mm512_set1_pd(1.0));
+    return {_mm512_getmant_pd(x.v, _MM_MANT_NORM_p5_1, _MM_MANT_SIGN_zero)};
+  }
+};
+
+}  // namespace
+
+void priceAllAvx512(const Args& args) { priceAll<Avx512Lane>(args); }
+
+void solveAllAvx512(const IvArgs& args) {
+  solveAll<Avx512Lane>(args);
+}
+
+}  // namespace bs_kernel
+}  // namespace premia
@@ -0,0 +1,522 @@
+#ifndef BlackScholesKernel_hpp
+#define BlackScholesKernel_hpp
+
+// Black-Scholes batch kernels (pricing and implied vol) written once
+// against a "lane" type, then compiled per instruction set:
+// black_scholes.cc instantiates them for plain doubles,
+// black_scholes_avx2.cc and black_scholes_avx512.cc for 4 and 8 wide
+// vectors. Each of those files defines its lane type in an unnamed
+// namespace, so no instantiation built with wide instructions can be
+// picked up by code that runs on older CPUs. The plain helpers below are in
+// an unnamed namespace for the same reason: an inline function compiled in
+// every file would be merged by the linker, possibly into the AVX-512 copy.
+//
+// A lane L provides:
+//   L::kWidth, L::Mask
+//   L::set(double), L::load(const double*), store(double*)
+//   + - * / and unary -, fmadd(a, b, c) = a * b + c
+//   L::maskAnd(Mask, Mask), since masks may be plain bool or a bare vector
+//   sqrt, abs, round (to nearest), less, greater, select
+//   ldexp2(r, n) = r * 2^n for integral n in [-1022, 1023]
+//   frexp2(x, &e): mantissa in [0.5, 1) and exponent of a positive x
+
+#include <cstddef>
+#include <limits>
+
+#include "black_scholes.h"
+
+namespace premia {
+namespace bs_kernel {
+
+struct Args {
+  size_t n;
+  double spot;
+  double rate;
+  double dividend;
+  const double* strike;
+  const double* years;
+  const double* vol;
+  const double* sign;
+  double* price;
+  double* delta;
+  double* gamma;
+  double* vega;
+  double* theta;
+  double* vanna;
+  double* volga;
+  double* charm;
+};
+
+struct IvArgs {
+  size_t n;
+  double spot;
+  double rate;
+  double dividend;
+  double tolerance;
+  int max_iterations;
+  const double* strike;
+  const double* years;
+  const double* sign;
+  const double* price;
+  const double* guess;
+  double* vol;
+  IvStatus* status;
+  int* iterations;
+  double* work;  // ivWorkSize(n) doubles of scratch
+};
+
+// Solver state, one padded column each.
+enum IvColumn {
+  kIvStrike,
+  kIvYears,
+  kIvSign,
+  kIvTarget,
+  kIvVol,
+  kIvSqrtT,
+  kIvSdq,
+  kIvKdr,
+  kIvRatio,
+  kIvMoneyness,
+  kIvLo,
+  kIvHi,
+  kIvBounds,  // 0 inside the no-arbitrage bounds, else why not
+  kIvDone,
+  kIvIndex,  // which option a slot holds, -1 for none
+  kIvColumns
+};
+
+namespace {
+
+inline size_t ivPadded(size_t n) { return (n + 15) / 16 * 16; }
+inline size_t ivWorkSize(size_t n) { return ivPadded(n) * kIvColumns; }
+
+}  // namespace
+
+// e^x, Cephes' Pade form after reducing x by multiples of ln 2; within
+// 2 ulp. Large x is clamped to the top of the normal range and x below
+// -700 gives 0, since results near the bottom turn into subnormals further
+// on, and those are slow enough on x86 to dominate a batch.
+template <class L>
+L expv(L x) {
+  auto underflow = less(x, L::set(-700.0));
+  x = select(underflow, L::set(-700.0), x);
+  x = select(greater(x, L::set(709.0)), L::set(709.0), x);
+  L n = round(x * L::set(1.4426950408889634073599));
+  L r = fmadd(n, L::set(-6.93145751953125e-1), x);
+  r = fmadd(n, L::set(-1.42860682030941723212e-6), r);
+
+  L rr = r * r;
+  L p = r * fmadd(fmadd(L::set(1.26177193074810590878e-4), rr,
+                        L::set(3.02994407707441961300e-2)),
+                  rr, L::set(9.99999999999999999910e-1));
+  L q = fmadd(fmadd(fmadd(L::set(3.00198505138664455042e-6), rr,
+                          L::set(2.52448340349684104192e-3)),
+                    rr, L::set(2.27265548208155028766e-1)),
+              rr, L::set(2.00000000000000000009e0));
+  L e = L::set(1.0) + L::set(2.0) * p / (q - p);
+  return select(underflow, L::set(0.0), ldexp2(e, n));
+}
+
+// ln x for positive normal x, Cephes' rational form on the mantissa.
+template <class L>
+L logv(L x) {
+  L e;
+  L m = frexp2(x, &e);
+  auto low = less(m, L::set(0.70710678118654752440));
+  m = select(low, m + m, m);
+  e = select(low, e - L::set(1.0), e);
+  L f = m - L::set(1.0);
+
+  L z = f * f;
+  L p = fmadd(f, L::set(1.01875663804580931796e-4),
+              L::set(4.97494994976747001425e-1));
+  p = fmadd(p, f, L::set(4.70579119878881725854e0));
+  p = fmadd(p, f, L::set(1.44989225341610930846e1));
+  p = fmadd(p, f, L::set(1.79368678507819816313e1));
+  p = fmadd(p, f, L::set(7.70838733755885391666e0));
+  L q = f + L::set(1.12873587189167450590e1);
+  q = fmadd(q, f, L::set(4.52279145837532221105e1));
+  q = fmadd(q, f, L::set(8.29875266912776603211e1));
+  q = fmadd(q, f, L::set(7.11544750618563894466e1));
+  q = fmadd(q, f, L::set(2.31251620126765340583e1));
+
+  L y = f * (z * p / q);
+  y = fmadd(e, L::set(-2.121944400546905827679e-4), y);
+  y = fmadd(z, L::set(-0.5), y);
+  L result = f + y;
+  return fmadd(e, L::set(0.693359375), result);
+}
+
+// Standard normal CDF of x given e = exp(-x^2 / 2), which the caller
+// already has for the density. Hart's rational form below 7.07 and a
+// continued fraction above (West, "Better approximations to cumulative
+// normal functions"), both within double precision. The continued fraction
+// a + 1/(a + 2/(a + 3/(a + 4/(a + 0.65)))) is multiplied out so either
+// branch costs a single division.
+template <class L>
+L normCdf(L x, L e) {
+  L a = abs(x);
+  L num = fmadd(L::set(3.52624965998911e-2), a, L::set(0.700383064443688));
+  num = fmadd(num, a, L::set(6.37396220353165));
+  num = fmadd(num, a, L::set(33.912866078383));
+  num = fmadd(num, a, L::set(112.079291497871));
+  num = fmadd(num, a, L::set(221.213596169931));
+  num = fmadd(num, a, L::set(220.206867912376));
+  L den = fmadd(L::set(8.83883476483184e-2), a, L::set(1.75566716318264));
+  den = fmadd(den, a, L::set(16.064177579207));
+  den = fmadd(den, a, L::set(86.7807322029461));
+  den = fmadd(den, a, L::set(296.564248779674));
+  den = fmadd(den, a, L::set(637.333633378831));
+  den = fmadd(den, a, L::set(793.826512519948));
+  den = fmadd(den, a, L::set(440.413735824752));
+
+  L c4 = a + L::set(0.65);
+  L p3 = fmadd(a, c4, L::set(4.0));
+  L p2 = fmadd(a, p3, L::set(3.0) * c4);
+  L p1 = fmadd(a, p2, L::set(2.0) * p3);
+  // 1 / (a + p2 / p1) = p1 / (a p1 + p2)
+  L tailDen = fmadd(a, p1, p2) * L::set(2.506628274631);
+
+  auto body = less(a, L::set(7.07106781186547));
+  L lower = e * select(body, num, p1) / select(body, den, tailDen);
+  return select(greater(x, L::set(0.0)), L::set(1.0) - lower, lower);
+}
+
+// Prices options [begin, begin + L::kWidth) of args.
+template <class L>
+void priceLanes(const Args& args, size_t begin) {
+  const L zero = L::set(0.0);
+  const L one = L::set(1.0);
+  const L half = L::set(0.5);
+  const L s = L::set(args.spot);
+  const L r = L::set(args.rate);
+  const L q = L::set(args.dividend);
+
+  L k = L::load(args.strike + begin);
+  L t = L::load(args.years + begin);
+  L v = L::load(args.vol + begin);
+  L w = L::load(args.sign + begin);
+
+  // expired, vol-less or strike-less lanes are priced with harmless inputs
+  // and overwritten with intrinsic value at the end
+  auto live = L::maskAnd(L::maskAnd(greater(t, zero), greater(v, zero)),
+                         greater(k, zero));
+  k = select(live, k, one);
+  t = select(live, t, one);
+  v = select(live, v, one);
+
+  L sqrtT = sqrt(t);
+  L vs = v * sqrtT;
+  L dq = expv(-(q * t));
+  L dr = expv(-(r * t));
+  L sdq = s * dq;
+  L kdr = k * dr;
+
+  L d1 = (logv(s / k) + fmadd(half * v, v, r - q) * t) / vs;
+  L d2 = d1 - vs;
+  // exp(-d2^2 / 2) = exp(-d1^2 / 2) * S e^-qT / (K e^-rT)
+  L e1 = expv(-(half * d1 * d1));
+  L e2 = e1 * sdq / kdr;
+  L pdf = e1 * L::set(0.39894228040143267794);
+  L nd1 = normCdf(w * d1, e1);
+  L nd2 = normCdf(w * d2, e2);
+
+  L price = w * (sdq * nd1 - kdr * nd2);
+  L delta = w * dq * nd1;
+  L gamma = dq * pdf / (s * vs);
+  L vega = sdq * pdf * sqrtT;
+  L theta = -(sdq * pdf * v) / (L::set(2.0) * sqrtT) -
+            w * r * kdr * nd2 + w * q * sdq * nd1;
+  L vanna = -(dq * pdf * d2) / v;
+  L volga = vega * d1 * d2 / v;
+  L charm = w * q * dq * nd1 -
+            dq * pdf * (L::set(2.0) * (r - q) * t - d2 * vs) /
+                (L::set(2.0) * t * vs);
+
+  L intrinsic = w * (s - L::load(args.strike + begin));
+  L itm = select(greater(intrinsic, zero), w, zero);
+  select(live, price, select(greater(intrinsic, zero), intrinsic, zero))
+      .store(args.price + begin);
+  select(live, delta, itm).store(args.delta + begin);
+  select(live, gamma, zero).store(args.gamma + begin);
+  select(live, vega, zero).store(args.vega + begin);
+  select(live, theta, zero).store(args.theta + begin);
+  select(live, vanna, zero).store(args.vanna + begin);
+  select(live, volga, zero).store(args.volga + begin);
+  select(live, charm, zero).store(args.charm + begin);
+}
+
+// Whole batch; a partial last step runs on a padded copy.
+template <class L>
+void priceAll(const Args& args) {
+  const size_t width = L::kWidth;
+  size_t full = args.n - args.n % width;
+  for (size_t i = 0; i < full; i += width) priceLanes<L>(args, i);
+  if (full == args.n) return;
+
+  double in[4][16] = {};
+  double out[8][16];
+  size_t rest = args.n - full;
+  for (size_t j = 0; j < rest; ++j) {
+    in[0][j] = args.strike[full + j];
+    in[1][j] = args.years[full + j];
+    in[2][j] = args.vol[full + j];
+    in[3][j] = args.sign[full + j];
+  }
+  Args tail = args;
+  tail.strike = in[0];
+  tail.years = in[1];
+  tail.vol = in[2];
+  tail.sign = in[3];
+  double** outputs[8] = {&tail.price, &tail.delta, &tail.gamma, &tail.vega,
+                         &tail.theta, &tail.vanna, &tail.volga, &tail.charm};
+  for (int c = 0; c < 8; ++c) *outputs[c] = out[c];
+  priceLanes<L>(tail, 0);
+
+  double* targets[8] = {args.price, args.delta, args.gamma, args.vega,
+                        args.theta, args.vanna, args.volga, args.charm};
+  for (int c = 0; c < 8; ++c) {
+    for (size_t j = 0; j < rest; ++j) targets[c][full + j] = out[c][j];
+  }
+}
+
+// Implied vols by Halley's method on price, safeguarded by a bracket: each
+// option keeps [lo, hi] around the root and takes the step when it lands
+// inside, else bisects. In-the-money options are solved as the
+// out-of-the-money option of the other side, by parity, and start from
+// Corrado-Miller near the money or a tail asymptote away from it, which
+// leaves most of them two or three passes from the root. An option stops
+// once its step is under args.tolerance, its price matches to 1e-12 or its
+// bracket is under 1e-12.
+template <class L>
+void setupLanes(double* const* col, const IvArgs& args, size_t begin) {
+  const L zero = L::set(0.0);
+  const L one = L::set(1.0);
+  const L half = L::set(0.5);
+  const L s = L::set(args.spot);
+
+  L k = L::load(col[kIvStrike] + begin);
+  L t = L::load(col[kIvYears] + begin);
+  L w = L::load(col[kIvSign] + begin);
+  L price = L::load(col[kIvTarget] + begin);
+  L guess = L::load(col[kIvVol] + begin);
+
+  auto valid = L::maskAnd(greater(t, zero), greater(k, zero));
+  k = select(valid, k, one);
+  t = select(valid, t, one);
+
+  L sqrtT = sqrt(t);
+  L sdq = s * expv(-(L::set(args.dividend) * t));
+  L kdr = k * expv(-(L::set(args.rate) * t));
+  L ratio = sdq / kdr;
+  L moneyness = logv(ratio);
+  L forward = w * (sdq - kdr);
+  auto itm = greater(forward, zero);
+  L target = select(itm, price - forward, price);
+  w = select(itm, -w, w);
+  L upper = select(greater(w, zero), sdq, kdr);
+  auto priced = L::maskAnd(valid, greater(price, zero));
+  auto overIntrinsic = greater(target, zero);
+  auto underMaximum = less(target, upper);
+  auto live = L::maskAnd(priced, L::maskAnd(overIntrinsic, underMaximum));
+  L bounds = select(underMaximum, zero, L::set(3.0));
+  bounds = select(overIntrinsic, bounds, L::set(2.0));
+  bounds = select(priced, bounds, one);
+  target = select(live, target, half * upper);
+
+  // Corrado-Miller near the money: sqrt(2 pi) / (S + K) times
+  // X + sqrt(X^2 - (S - K)^2 / pi), X = C - (S - K) / 2, on discounted S, K
+  L gap = sdq - kdr;
+  L call = select(greater(w, zero), target, target + gap);
+  L x = call - half * gap;
+  L disc = x * x - gap * gap * L::set(0.31830988618379067154);
+  L corrado = L::set(2.50662827463100050242) *
+              (x + sqrt(select(greater(disc, zero), disc, zero))) /
+              ((sdq + kdr) * sqrtT);
+
+  // far from it, where that has no root, the normalized price b behaves
+  // like s^3 / (x^2 sqrt(2 pi)) exp(-x^2 / 2s^2) for x = ln F/K and
+  // s = vol sqrt(T); a few fixed-point rounds solve that for s
+  L x2 = moneyness * moneyness;
+  L logB = logv(target / sqrt(sdq * kdr));
+  L tail = sqrt(x2 / (L::set(-2.0) * logB));
+  for (int i = 0; i < 3; ++i) {
+    L prefactor =
+        logv(tail * tail * tail / (x2 * L::set(2.50662827463100050242)));
+    L denom = L::set(2.0) * (prefactor - logB);
+    tail = select(greater(denom, zero), sqrt(x2 / denom), tail);
+  }
+  tail = tail / sqrtT;
+
+  // vega peaks at sqrt(2 |ln F/K| / T), the fallback start
+  L inflection = sqrt(L::set(2.0) * abs(moneyness) / t);
+  L floor = L::set(0.01);
+  L v = select(greater(inflection, floor), inflection, floor);
+  v = select(L::maskAnd(greater(tail, floor), less(tail, L::set(20.0))), tail,
+             v);
+  v = select(L::maskAnd(greater(disc, zero), greater(corrado, floor)),
+             corrado, v);
+  v = select(greater(guess, zero), guess, v);
+
+  w.store(col[kIvSign] + begin);
+  target.store(col[kIvTarget] + begin);
+  v.store(col[kIvVol] + begin);
+  sqrtT.store(col[kIvSqrtT] + begin);
+  sdq.store(col[kIvSdq] + begin);
+  kdr.store(col[kIvKdr] + begin);
+  ratio.store(col[kIvRatio] + begin);
+  moneyness.store(col[kIvMoneyness] + begin);
+  zero.store(col[kIvLo] + begin);
+  L::set(20.0).store(col[kIvHi] + begin);
+  bounds.store(col[kIvBounds] + begin);
+  select(live, zero, one).store(col[kIvDone] + begin);
+}
+
+// One pass over slots [begin, begin + L::kWidth).
+template <class L>
+void stepLanes(double* const* col, const IvArgs& args, size_t begin) {
+  const L zero = L::set(0.0);
+  const L one = L::set(1.0);
+  const L half = L::set(0.5);
+
+  L v = L::load(col[kIvVol] + begin);
+  L sqrtT = L::load(col[kIvSqrtT] + begin);
+  L sdq = L::load(col[kIvSdq] + begin);
+  L kdr = L::load(col[kIvKdr] + begin);
+  L w = L::load(col[kIvSign] + begin);
+  L target = L::load(col[kIvTarget] + begin);
+  L moneyness = L::load(col[kIvMoneyness] + begin);
+  L lo = L::load(col[kIvLo] + begin);
+  L hi = L::load(col[kIvHi] + begin);
+  L done = L::load(col[kIvDone] + begin);
+
+  L vs = v * sqrtT;
+  L d1 = moneyness / vs + half * vs;
+  L d2 = d1 - vs;
+  L e1 = expv(-(half * d1 * d1));
+  L e2 = e1 * L::load(col[kIvRatio] + begin);
+  L model = w * (sdq * normCdf(w * d1, e1) - kdr * normCdf(w * d2, e2));
+  L vega = sdq * e1 * L::set(0.39894228040143267794) * sqrtT;
+
+  // Halley: the Newton step corrected by volga = vega d1 d2 / v
+  L diff = model - target;
+  hi = select(greater(diff, zero), v, hi);
+  lo = select(less(diff, zero), v, lo);
+  L newton = diff / vega;
+  L correction = one - half * newton * d1 * d2 / v;
+  correction = select(greater(correction, half), correction, half);
+  L delta = newton / correction;
+  L settled = select(less(abs(delta), L::set(args.tolerance)), one, zero);
+  settled = select(less(abs(diff), L::set(1e-12) * target), one, settled);
+  settled = select(less(hi - lo, L::set(1e-12)), one, settled);
+
+  L step = v - delta;
+  L next = select(L::maskAnd(greater(step, lo), less(step, hi)), step,
+                  half * (lo + hi));
+  auto moving = less(done, half);
+  select(moving, select(greater(settled, half), v, next), v)
+      .store(col[kIvVol] + begin);
+  select(moving, lo, L::load(col[kIvLo] + begin)).store(col[kIvLo] + begin);
+  select(moving, hi, L::load(col[kIvHi] + begin)).store(col[kIvHi] + begin);
+  select(moving, settled, done).store(col[kIvDone] + begin);
+}
+
+namespace {
+
+// Writes out what slot i holds.
+inline void flushSlot(double* const* col, const IvArgs& args, size_t i) {
+  if (col[kIvIndex][i] < 0) return;
+  size_t option = static_cast<size_t>(col[kIvIndex][i]);
+  args.vol[option] = col[kIvVol][i];
+  args.status[option] = args.iterations[option] < 0 ? IvStatus::kNotConverged
+                                                    : IvStatus::kConverged;
+  col[kIvIndex][i] = -1.0;
+}
+
+}  // namespace
+
+// Options are set up in slots of width L::kWidth. Every pass sweeps all
+// slots that still have a moving option, so the long dependency chain of
+// one group overlaps with the next; once at most half the active slots are
+// moving, the finished ones are written out and the rest packed to the
+// front, so a few slow options do not keep whole groups iterating.
+template <class L>
+void solveAll(const IvArgs& args) {
+  const size_t width = L::kWidth;
+  const size_t padded = ivPadded(args.n);
+  double* col[kIvColumns];
+  for (int c = 0; c < kIvColumns; ++c) col[c] = args.work + c * padded;
+
+  const double* inputs[5] = {args.strike, args.years, args.sign, args.price,
+                             args.guess};
+  for (int c = 0; c < 5; ++c) {
+    for (size_t i = 0; i < args.n; ++i) col[c][i] = inputs[c][i];
+    for (size_t i = args.n; i < padded; ++i) col[c][i] = 0.0;
+  }
+  for (size_t i = 0; i < padded; i += width) setupLanes<L>(col, args, i);
+
+  const IvStatus outside[] = {IvStatus::kConverged, IvStatus::kInvalid,
+                              IvStatus::kBelowIntrinsic,
+                              IvStatus::kAboveMaximum};
+  for (size_t i = 0; i < padded; ++i) {
+    col[kIvIndex][i] = i < args.n ? static_cast<double>(i) : -1.0;
+    if (i >= args.n) continue;
+    args.iterations[i] = -1;
+    int bounds = static_cast<int>(col[kIvBounds][i]);
+    if (bounds != 0) {
+      args.vol[i] = std::numeric_limits<double>::quiet_NaN();
+      args.status[i] = outside[bounds];
+      args.iterations[i] = 0;
+      col[kIvIndex][i] = -1.0;
+    }
+  }
+
+  // the state a pass reads and writes, which is all compaction has to move
+  const int moved[] = {kIvSign, kIvTarget, kIvVol,       kIvSqrtT,
+                       kIvSdq,  kIvKdr,    kIvRatio,     kIvMoneyness,
+                       kIvLo,   kIvHi,     kIvDone,      kIvIndex};
+  size_t active = padded;
+  for (int pass = 1; pass <= args.max_iterations; ++pass) {
+    size_t moving = 0;
+    for (size_t i = 0; i < active; i += width) {
+      bool settled = true;
+      for (size_t j = 0; j < width; ++j) {
+        if (col[kIvDone][i + j] == 0.0) settled = false;
+      }
+      if (settled) continue;
+      stepLanes<L>(col, args, i);
+      for (size_t j = i; j < i + width; ++j) {
+        if (col[kIvDone][j] == 0.0) {
+          ++moving;
+        } else if (col[kIvIndex][j] >= 0) {
+          int& iterations =
+              args.iterations[static_cast<size_t>(col[kIvIndex][j])];
+          if (iterations < 0) iterations = pass;
+        }
+      }
+    }
+    if (moving == 0) break;
+    if (moving * 2 > active) continue;
+
+    size_t next = 0;
+    for (size_t i = 0; i < active; ++i) {
+      if (col[kIvDone][i] != 0.0) {
+        flushSlot(col, args, i);
+        continue;
+      }
+      for (int c : moved) col[c][next] = col[c][i];
+      ++next;
+    }
+    active = (next + width - 1) / width * width;
+    for (; next < active; ++next) {
+      col[kIvDone][next] = 1.0;
+      col[kIvIndex][next] = -1.0;
+    }
+  }
+  for (size_t i = 0; i < active; ++i) flushSlot(col, args, i);
+}
+
+}  // namespace bs_kernel
+}  // namespace premia
+
+#endif
@@ -0,0 +1,301 @@
+#include "gamma_exposure.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace premia {
+namespace {
+
+constexpr double kSharesPerContract = 100.0;
+constexpr double kDaysPerYear = 365.0;
+// the flip is refined until it moves less than this fraction of spot
+constexpr double kFlipTolerance = 1e-5;
+constexpr int kFlipIterations = 20;
+
+// The distinct strikes of a chain, ascending, and where each contract's
+// falls among them; SIZE_MAX for a strike that is not a price.
+void mapStrikes(const OptionBatch& chain, std::vector<double>* strikes,
+                std::vector<size_t>* slots) {
+  strikes->clear();
+  for (double k : chain.strike) {
+    if (k > 0 && std::isfinite(k)) strikes->push_back(k);
+  }
+  std::sort(strikes->begin(), strikes->end());
+  strikes->erase(std::unique(strikes->begin(), strikes->end()),
+                 strikes->end());
+  slots->clear();
+  for (double k : chain.strike) {
+    auto slot = std::lower_bound(strikes->begin(), strikes->end(), k);
+    slots->push_back(slot != strikes->end() && *slot == k
+                         ? slot - strikes->begin()
+                         : SIZE_MAX);
+  }
+}
+
+}  // namespace
+
+ExposureGrid ExposureGrid::around(double spot, double width, size_t points,
+                                  std::vector<double> days) {
+  ExposureGrid grid;
+  grid.days = std::move(days);
+  if (points == 1) {
+    grid.spots.push_back(spot);
+    return grid;
+  }
+  double low = spot * (1 - width);
+  double step = 2 * spot * width / (points - 1);
+  for (size_t i = 0; i < points; ++i) grid.spots.push_back(low + step * i);
+  return grid;
+}
+
+bool ExposureProfile::stale(double spot) const {
+  if (spots.size() < 2) return spots.empty() || spot != this->spot;
+  return !(std::fabs(spot - this->spot) < spots[1] - spots[0]);
+}
+
+void ExposureSums::assign(size_t n) {
+  gamma.assign(n, 0.0);
+  callGamma.assign(n, 0.0);
+  putGamma.assign(n, 0.0);
+  vanna.assign(n, 0.0);
+  charm.assign(n, 0.0);
+  vega.assign(n, 0.0);
+  volga.assign(n, 0.0);
+}
+
+void ExposureBook::reset(const OptionBatch& chain,
+                         const std::vector<double>& openInterest,
+                         const std::vector<size_t>& expiryIndex,
+                         size_t expiries) {
+  this->chain = chain;
+  this->openInterest = openInterest;
+  this->expiryIndex = expiryIndex;
+  mapStrikes(chain, &strikes, &strikeSlot);
+  byExpiry.assign(expiries);
+  byStrike.assign(strikes.size());
+  setSpot(chain.spot);
+}
+
+void ExposureBook::setSpot(double spot) {
+  chain.spot = spot;
+  contracts.assign(chain.size());
+  priceBatch(chain, &greeks);
+  for (size_t i = 0; i < chain.size(); ++i) store(i, i);
+  resum();
+}
+
+void ExposureBook::update(size_t contract, double vol, double openInterest) {
+  if (contract >= chain.size()) return;
+  apply(contract, -1.0);
+  if (!std::isnan(vol)) chain.vol[contract] = vol;
+  if (!std::isnan(openInterest)) this->openInterest[contract] = openInterest;
+  price(contract);
+  apply(contract, 1.0);
+  if (++updates >= chain.size()) resum();
+}
+
+void ExposureBook::price(size_t contract) {
+  single.spot = chain.spot;
+  single.rate = chain.rate;
+  single.dividend = chain.dividend;
+  single.clear();
+  single.add(chain.strike[contract], chain.years[contract],
+             chain.vol[contract], chain.sign[contract] > 0);
+  priceBatch(single, &greeks);
+  store(contract, 0);
+}
+
+// Turns row `row` of greeks into the contract's contribution.
+void ExposureBook::store(size_t contract, size_t row) {
+  const double spot = chain.spot;
+  double shares =
+      kSharesPerContract * openInterest[contract] * chain.sign[contract];
+  contracts.gamma[contract] = shares * greeks.gamma[row] * spot * spot / 100;
+  contracts.vanna[contract] = shares * greeks.vanna[row] * spot / 100;
+  contracts.charm[contract] = shares * greeks.charm[row] * spot / kDaysPerYear;
+  contracts.vega[contract] = shares * greeks.vega[row] / 100;
+  contracts.volga[contract] = shares * greeks.volga[row] / 10000;
+}
+
+void ExposureBook::apply(size_t contract, double scale) {
+  auto add = [&](ExposureSums* sums, size_t at) {
+    double gamma = scale * contracts.gamma[contract];
+    sums->gamma[at] += gamma;
+    if (chain.sign[contract] > 0) {
+      sums->callGamma[at] += gamma;
+    } else {
+      sums->putGamma[at] += gamma;
+    }
+    sums->vanna[at] += scale * contracts.vanna[contract];
+    sums->charm[at] += scale * contracts.charm[contract];
+    sums->vega[at] += scale * contracts.vega[contract];
+    sums->volga[at] += scale * contracts.volga[contract];
+  };
+  if (strikeSlot[contract] == SIZE_MAX) return;
+  add(&total, 0);
+  add(&byStrike, strikeSlot[contract]);
+  if (expiryIndex[contract] < byExpiry.gamma.size()) {
+    add(&byExpiry, expiryIndex[contract]);
+  }
+}
+
+void ExposureBook::resum() {
+  total.assign(1);
+  byExpiry.assign(byExpiry.gamma.size());
+  byStrike.assign(byStrike.gamma.size());
+  for (size_t i = 0; i < chain.size(); ++i) apply(i, 1.0);
+  updates = 0;
+}
+
+ExposureEngine::ExposureEngine(WorkerPool* pool)
+    : pool(pool), workers(pool->size()) {}
+
+void ExposureEngine::compute(const OptionBatch& chain,
+                             const std::vector<double>& openInterest,
+                             const ExposureGrid& grid, ExposureProfile* out) {
+  this->chain = &chain;
+  this->openInterest = &openInterest;
+  profile = out;
+
+  out->spot = chain.spot;
+  out->spots = grid.spots;
+  out->days = grid.days;
+  mapStrikes(chain, &out->strikes, &strikeSlot);
+
+  size_t scenarios = grid.spots.size() * grid.days.size();
+  size_t perScenario = out->strikes.size();
+  out->gamma.assign(scenarios, 0.0);
+  out->vanna.assign(scenarios, 0.0);
+  out->charm.assign(scenarios, 0.0);
+  out->strikeGamma.assign(scenarios * perScenario, 0.0);
+  out->strikeVanna.assign(scenarios * perScenario, 0.0);
+  out->strikeCharm.assign(scenarios * perScenario, 0.0);
+  out->flip.assign(grid.days.size(),
+                   std::numeric_limits<double>::quiet_NaN());
+
+  for (auto& worker : workers) {
+    worker.batch = chain;
+    worker.day = SIZE_MAX;
+  }
+  if (chain.size() > 0 && scenarios > 0) {
+    pool->run(scenarios, [this](size_t worker, size_t index) {
+      evaluate(workers[worker], index);
+    });
+    pool->run(grid.days.size(), [this](size_t worker, size_t day) {
+      refineFlip(workers[worker], day);
+    });
+  }
+
+  this->chain = nullptr;
+  this->openInterest = nullptr;
+  profile = nullptr;
+}
+
+// Only years moves with the date, so a worker that stays on one date
+// shifts it once.
+void ExposureEngine::prepare(Worker& worker, size_t day) {
+  if (worker.day == day) return;
+  double shift = profile->days[day] / kDaysPerYear;
+  for (size_t i = 0; i < chain->size(); ++i) {
+    worker.batch.years[i] = chain->years[i] - shift;
+  }
+  worker.day = day;
+}
+
+double ExposureEngine::totalGamma(Worker& worker, size_t day, double spot) {
+  prepare(worker, day);
+  worker.batch.spot = spot;
+  priceBatch(worker.batch, &worker.greeks);
+  double total = 0.0;
+  for (size_t i = 0; i < chain->size(); ++i) {
+    if (strikeSlot[i] == SIZE_MAX) continue;
+    total += (*openInterest)[i] * chain->sign[i] * worker.greeks.gamma[i];
+  }
+  return total * kSharesPerContract * spot * spot / 100;
+}
+
+void ExposureEngine::evaluate(Worker& worker, size_t index) {
+  size_t day = index / profile->spots.size();
+  double spot = profile->spots[index % profile->spots.size()];
+  prepare(worker, day);
+  worker.batch.spot = spot;
+  priceBatch(worker.batch, &worker.greeks);
+
+  const double gammaScale = spot * spot / 100;
+  const double vannaScale = spot / 100;
+  const double charmScale = spot / kDaysPerYear;
+  const GreeksBatch& greeks = worker.greeks;
+  size_t base = index * profile->strikes.size();
+  double gamma = 0.0;
+  double vanna = 0.0;
+  double charm = 0.0;
+  for (size_t i = 0; i < chain->size(); ++i) {
+    double shares = kSharesPerContract * (*openInterest)[i] * chain->sign[i];
+    if (shares == 0 || strikeSlot[i] == SIZE_MAX) continue;
+    double g = shares * greeks.gamma[i] * gammaScale;
+    double v = shares * greeks.vanna[i] * vannaScale;
+    double c = shares * greeks.charm[i] * charmScale;
+    profile->strikeGamma[base + strikeSlot[i]] += g;
+    profile->strikeVanna[base + strikeSlot[i]] += v;
+    profile->strikeCharm[base + strikeSlot[i]] += c;
+    gamma += g;
+    vanna += v;
+    charm += c;
+  }
+  profile->gamma[index] = gamma;
+  profile->vanna[index] = vanna;
+  profile->charm[index] = charm;
+}
+
+// Takes the sign change on the grid closest to the chain's spot and closes
+// in on it by false position (Illinois variant).
+void ExposureEngine::refineFlip(Worker& worker, size_t day) {
+  const std::vector<double>& spots = profile->spots;
+  size_t best = SIZE_MAX;
+  double bestDistance = std::numeric_limits<double>::infinity();
+  for (size_t s = 0; s + 1 < spots.size(); ++s) {
+    double a = profile->gamma[profile->scenario(day, s)];
+    double b = profile->gamma[profile->scenario(day, s + 1)];
+    if ((a < 0) == (b < 0) && a != 0) continue;
+    double distance = std::min(std::fabs(spots[s] - chain->spot),
+                               std::fabs(spots[s + 1] - chain->spot));
+    if (distance < bestDistance) {
+      best = s;
+      bestDistance = distance;
+    }
+  }
+  if (best == SIZE_MAX) return;
+
+  double lo = spots[best];
+  double hi = spots[best + 1];
+  double fLo = profile->gamma[profile->scenario(day, best)];
+  double fHi = profile->gamma[profile->scenario(day, best + 1)];
+  if (fLo == 0) {
+    profile->flip[day] = lo;
+    return;
+  }
+  int side = 0;
+  double x = lo;
+  for (int i = 0; i < kFlipIterations; ++i) {
+    double previous = x;
+    x = (lo * fHi - hi * fLo) / (fHi - fLo);
+    double fx = totalGamma(worker, day, x);
+    if (fx == 0 || std::fabs(x - previous) < kFlipTolerance * x) break;
+    if ((fx < 0) == (fLo < 0)) {
+      lo = x;
+      fLo = fx;
+      if (side == -1) fHi /= 2;
+      side = -1;
+    } else {
+      hi = x;
+      fHi = fx;
+      if (side == 1) fLo /= 2;
+      side = 1;
+    }
+  }
+  profile->flip[day] = x;
+}
+
+}  // namespace premia
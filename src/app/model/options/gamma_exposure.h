@@ -0,0 +1,157 @@
+#ifndef GammaExposure_hpp
+#define GammaExposure_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "model/options/black_scholes.h"
+#include "model/options/worker_pool.h"
+
+namespace premia {
+
+// The scenarios to revalue a chain under: every spot at every date.
+struct ExposureGrid {
+  std::vector<double> spots;
+  std::vector<double> days;  // days forward from now, 0 for today
+
+  // `points` spots spread evenly over spot * (1 +- width)
+  static ExposureGrid around(double spot, double width, size_t points,
+                             std::vector<double> days = {0.0});
+};
+
+// Dealer exposure, with dealers taken to be long calls and short puts and
+// each contract counting 100 shares of open interest:
+//   gamma - dollars of delta bought per 1% move up in spot
+//   vanna - dollars of delta bought per 1 point rise in implied vol
+//   charm - dollars of delta bought per calendar day that passes
+// Scenarios are stored day-major, scenario(d, s) = d * spots.size() + s.
+struct ExposureProfile {
+  double spot = 0.0;  // the chain's
+  std::vector<double> spots;
+  std::vector<double> days;
+  std::vector<double> strikes;  // distinct strikes of the chain, ascending
+
+  std::vector<double> gamma;  // one per scenario, summed over the chain
+  std::vector<double> vanna;
+  std::vector<double> charm;
+  // strikes.size() per scenario, summed over expiries
+  std::vector<double> strikeGamma;
+  std::vector<double> strikeVanna;
+  std::vector<double> strikeCharm;
+
+  // per day, the spot nearest to the chain's where total gamma changes
+  // sign; NaN when it keeps one sign across the grid
+  std::vector<double> flip;
+
+  size_t scenario(size_t day, size_t spot) const {
+    return day * spots.size() + spot;
+  }
+  // whether spot is a grid step or more from the spot this was built at,
+  // or nothing was built yet; closer moves fall between the same points
+  bool stale(double spot) const;
+};
+
+// Dealer exposure sums in the ExposureProfile units, plus vega in dollars
+// per vol point and volga in dollars of vega per vol point.
+struct ExposureSums {
+  std::vector<double> gamma;
+  std::vector<double> callGamma;
+  std::vector<double> putGamma;
+  std::vector<double> vanna;
+  std::vector<double> charm;
+  std::vector<double> vega;
+  std::vector<double> volga;
+
+  void assign(size_t n);
+};
+
+// Live dealer exposure of one chain at its current spot.
+//
+// Every contract's contribution is kept next to the per-expiry, per-strike
+// and total sums, so a vol or open interest change on one contract reprices
+// only that contract and moves the sums by the difference. The sums are
+// rebuilt from the contributions once every size() updates, which keeps the
+// rounding of the differences from drifting while staying O(1) amortized.
+// Everything scales with spot, so only setSpot() and reset() touch the
+// whole chain.
+class ExposureBook {
+ public:
+  // expiryIndex lines up with chain and is < expiries
+  void reset(const OptionBatch& chain, const std::vector<double>& openInterest,
+             const std::vector<size_t>& expiryIndex, size_t expiries);
+  void setSpot(double spot);
+  // NaN keeps the current vol or open interest
+  void update(size_t contract, double vol, double openInterest);
+
+  size_t size() const { return chain.size(); }
+  // the chain with every update applied, for ExposureEngine
+  const OptionBatch& getChain() const { return chain; }
+  const std::vector<double>& getOpenInterest() const { return openInterest; }
+  const std::vector<double>& getStrikes() const { return strikes; }
+
+  const ExposureSums& getTotal() const { return total; }  // size 1
+  const ExposureSums& getByExpiry() const { return byExpiry; }
+  const ExposureSums& getByStrike() const { return byStrike; }  // as strikes
+
+ private:
+  void price(size_t contract);
+  void store(size_t contract, size_t row);
+  void apply(size_t contract, double scale);
+  void resum();
+
+  OptionBatch chain;
+  std::vector<double> openInterest;
+  std::vector<size_t> expiryIndex;
+  std::vector<size_t> strikeSlot;
+  std::vector<double> strikes;
+  ExposureSums contracts;
+  ExposureSums total;
+  ExposureSums byExpiry;
+  ExposureSums byStrike;
+  size_t updates = 0;
+
+  OptionBatch single;
+  GreeksBatch greeks;
+};
+
+// Revalues a chain over an ExposureGrid on a WorkerPool.
+//
+// Each scenario is one task, which prices the whole chain with priceBatch()
+// in its worker's scratch batch, so the pool scales with the grid and the
+// kernel with the chain. One compute() at a time.
+class ExposureEngine {
+ public:
+  explicit ExposureEngine(WorkerPool* pool);
+
+  // openInterest lines up with chain; chain.vol is kept at every scenario
+  // (sticky strike) and options that expire before a date carry nothing
+  void compute(const OptionBatch& chain,
+               const std::vector<double>& openInterest,
+               const ExposureGrid& grid, ExposureProfile* out);
+
+ private:
+  struct Worker {
+    OptionBatch batch;
+    GreeksBatch greeks;
+    size_t day = SIZE_MAX;  // which date batch.years is shifted to
+  };
+
+  void prepare(Worker& worker, size_t day);
+  double totalGamma(Worker& worker, size_t day, double spot);
+  void evaluate(Worker& worker, size_t index);
+  void refineFlip(Worker& worker, size_t day);
+
+  WorkerPool* pool;
+  std::vector<Worker> workers;
+
+  // the inputs of the compute() in progress
+  const OptionBatch* chain = nullptr;
+  const std::vector<double>* openInterest = nullptr;
+  ExposureProfile* profile = nullptr;
+  std::vector<size_t> strikeSlot;
+};
+
+}  // namespace premia
+
+#endif
@@ -1,6 +1,31 @@
 #include "options_model.h"
 
+#include <chrono>
+#include <cstdlib>
+#include <unordered_map>
+
 namespace premia {
+namespace {
+
+constexpr double kMsPerYear = 365 * 24 * 60 * 60 * 1000.0;
+constexpr double kProfileWidth = 0.15;
+constexpr size_t kProfilePoints = 61;
+
+// NaN when the text is not a number, so the callers pick their own default
+double readNumber(const std::string& text) {
+  char* end = nullptr;
+  double value = std::strtod(text.c_str(), &end);
+  return end == text.c_str() ? std::nan("") : value;
+}
+
+double readField(const std::unordered_map<std::string, std::string>& raw,
+                 const char* key) {
+  auto it = raw.find(key);
+  return it == raw.end() ? std::nan("") : readNumber(it->second);
+}
+
+}  // namespace
+
 bool OptionsModel::isActive() const { return active; }
 
 tda::OptionChain& OptionsModel::getOptionChainData() {
@@ -38,7 +63,6 @@ void OptionsModel::fetchOptionChain(const std::string &ticker, const std::string
     datetimeEpochArray.clear();
     datetime_array.clear();
     datetimeArray.clear();
-    gammaAtExpiryArray.clear();
   }
 
   optionChainData = tda::TDA::getInstance().getOptionChain(
@@ -58,110 +82,204 @@ void OptionsModel::fetchOptionChain(const std::string &ticker, const std::string
     datetime_array.push_back(eachOption.datetime.data());
     datetimeArray.push_back(eachOption.datetime);
   }
+  loadOptionBatch();
   active = true;
 }
 
-void OptionsModel::calculateGammaExposure() {
-  for (const auto& eachOption : callOptionArray) {
-    auto const& date = eachOption.datetime;
-    auto daysTilExpiry = boost::lexical_cast<int>(date.substr(11, date.size()));
-    for (const auto& eachStrike : eachOption.strikePriceObj) {
-      double strikeGammaExposure = 100;
-      double gamma =
-          boost::lexical_cast<double>(eachStrike.raw_option.at("gamma"));
-      if (std::isnan(gamma)) {
-        gamma = 0.0;
-      }
-      strikeGammaExposure *= gamma;
-      strikeGammaExposure *=
-          boost::lexical_cast<double>(eachStrike.raw_option.at("openInterest"));
-      naiveGammaExposure += strikeGammaExposure;
-      callGammaAtExpiryArray.push_back(naiveGammaExposure);
-      gammaAtExpiryArray.push_back(naiveGammaExposure);
-      double vega =
-          boost::lexical_cast<double>(eachStrike.raw_option.at("vega"));
-      vegaExposureArray.push_back(vega);
-
-      // vanna
-      double stockPrice = boost::lexical_cast<double>(
-          optionChainData.getUnderlyingDataVariable("mark"));
-      double volatility =
-          boost::lexical_cast<double>(eachStrike.raw_option.at("volatility"));
-      double strikePrice = boost::lexical_cast<double>(eachStrike.strikePrice);
-      double vannaPartOne =
-          (log(stockPrice / strikePrice) + (volatility / 2) * daysTilExpiry) /
-          (volatility * sqrt(daysTilExpiry));
-      double partOneSqr = pow(vannaPartOne, 2) / 2;
-      double vannaPartTwo = exp(-partOneSqr) * (1 / (2 * 3.14));
-      double vannaPartThree =
-          sqrt(daysTilExpiry) * vannaPartTwo * (1 - vannaPartTwo);
-      if (vannaPartThree != 0) {
-        naiveVannaExposureArray.push_back(vannaPartThree);
-      }
+void OptionsModel::loadOptionBatch() {
+  optionBatch.clear();
+  openInterest.clear();
+  midPrice.clear();
+  expiryIndex.clear();
+  contractIndex.clear();
 
-      double volgaPartOne = vannaPartOne - (volatility * sqrt(daysTilExpiry));
-      double volgaPartTwo = vega * (volgaPartOne / volatility);
-      if (volgaPartTwo != 0 && !std::isinf(volgaPartTwo)) {
-        volgaExposureArray.push_back(volgaPartTwo);
-      }
-    }
+  optionBatch.spot =
+      readNumber(optionChainData.getUnderlyingDataVariable("mark"));
+  if (!(optionBatch.spot > 0)) {
+    optionBatch.spot = readNumber(
+        optionChainData.getOptionChainDataVariable("underlyingPrice"));
   }
+  double rate =
+      readNumber(optionChainData.getOptionChainDataVariable("interestRate"));
+  optionBatch.rate = std::isfinite(rate) ? rate / 100 : 0.0;
+
+  std::unordered_map<std::string, size_t> dateIndex;
+  for (size_t i = 0; i < datetimeArray.size(); ++i) {
+    dateIndex.emplace(datetimeArray[i], i);
+  }
+  double now = std::chrono::duration<double, std::milli>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count();
+
+  auto addSide = [&](const std::vector<tda::OptionsDateTimeObj>& side,
+                     bool call) {
+    for (const auto& eachOption : side) {
+      auto date = dateIndex.find(eachOption.datetime);
+      if (date == dateIndex.end()) continue;
+      for (const auto& eachStrike : eachOption.strikePriceObj) {
+        const auto& raw = eachStrike.raw_option;
+        // TDA reports a missing vol as NaN or -999
+        double volatility = readField(raw, "volatility") / 100;
+        if (!(volatility > 0)) volatility = 0.0;
+        double years = (readField(raw, "expirationDate") - now) / kMsPerYear;
+        if (std::isnan(years)) {
+          years = readField(raw, "daysToExpiration") / 365;
+        }
+        if (std::isnan(years)) years = 0.0;
+        double interest = readField(raw, "openInterest");
+        double bid = readField(raw, "bid");
+        double ask = readField(raw, "ask");
+        double mid = bid > 0 && ask >= bid ? (bid + ask) / 2
+                                           : readField(raw, "mark");
 
-  for (const auto& eachOption : putOptionArray) {
-    int i = 0;
-    auto const& date = eachOption.datetime;
-    for (const auto& eachStrike : eachOption.strikePriceObj) {
-      double strikeGammaExposure = -100;
-      double gamma =
-          boost::lexical_cast<double>(eachStrike.raw_option.at("gamma"));
-      if (std::isnan(gamma)) {
-        gamma = 0.0;
+        auto symbol = raw.find("symbol");
+        if (symbol != raw.end()) {
+          contractIndex.emplace(symbol->second, optionBatch.size());
+        }
+        optionBatch.add(readNumber(eachStrike.strikePrice), years, volatility,
+                        call);
+        openInterest.push_back(std::isfinite(interest) ? interest : 0.0);
+        midPrice.push_back(mid);
+        expiryIndex.push_back(date->second);
       }
-      strikeGammaExposure *= gamma;
-      strikeGammaExposure *=
-          boost::lexical_cast<double>(eachStrike.raw_option.at("openInterest"));
-      naiveGammaExposure += strikeGammaExposure;
-      putGammaAtExpiryArray.push_back(naiveGammaExposure);
-      gammaAtExpiryArray[i] += naiveGammaExposure;
-      double vol =
-          boost::lexical_cast<double>(eachStrike.raw_option.at("vega"));
-      vegaExposureArray[i] = (vol + vegaExposureArray[i]) / 2;
-      i++;
     }
+  };
+  addSide(callOptionArray, true);
+  addSide(putOptionArray, false);
+}
+
+void OptionsModel::calculateGammaExposure() {
+  fitVolSurface();
+  exposureBook.reset(optionBatch, openInterest, expiryIndex,
+                     datetimeArray.size());
+  computeExposureProfile();
+}
+
+// One smile per expiry from the calls above the forward and the puts below
+// it, where the quotes are most liquid.
+void OptionsModel::fitVolSurface() {
+  std::vector<SmileQuotes> smiles(datetimeArray.size());
+  const double carry = optionBatch.rate - optionBatch.dividend;
+  for (size_t i = 0; i < optionBatch.size(); ++i) {
+    SmileQuotes& smile = smiles[expiryIndex[i]];
+    double years = optionBatch.years[i];
+    smile.years = years;
+    double forward = optionBatch.spot * std::exp(carry * years);
+    bool call = optionBatch.sign[i] > 0;
+    if (call != (optionBatch.strike[i] >= forward)) continue;
+    if (!(optionBatch.vol[i] > 0)) continue;
+    smile.strike.push_back(optionBatch.strike[i]);
+    smile.vol.push_back(optionBatch.vol[i]);
   }
+  volSurface.fit(optionBatch.spot, optionBatch.rate, optionBatch.dividend,
+                 smiles, &workerPool);
+
+  for (size_t i = 0; i < optionBatch.size(); ++i) {
+    if (optionBatch.vol[i] > 0) continue;
+    double vol = volSurface.vol(optionBatch.strike[i], optionBatch.years[i]);
+    if (std::isfinite(vol)) optionBatch.vol[i] = vol;
+  }
+}
+
+void OptionsModel::updateOption(const std::string& symbol, double volatility,
+                                double openInterest) {
+  auto contract = contractIndex.find(symbol);
+  if (contract == contractIndex.end()) return;
+  // TDA reports a missing vol as NaN or -999
+  double vol = volatility / 100;
+  if (!std::isnan(vol) && !(vol > 0)) vol = 0.0;
+  exposureBook.update(contract->second, vol, openInterest);
+}
+
+void OptionsModel::updateSpot(double spot) {
+  if (!(spot > 0) || spot == exposureBook.getChain().spot) return;
+  exposureBook.setSpot(spot);
+  // a tick inside the current grid step leaves the profile where it is
+  if (exposureProfile.stale(spot)) computeExposureProfile();
+}
+
+bool OptionsModel::startStrategySearch(const StrategyQuery& query) {
+  if (pendingSearch.valid()) return false;
+  // a copy of the chain, which fetches and streamed quotes keep changing
+  pendingSearch = std::async(
+      std::launch::async, [this, query, chain = optionBatch,
+                           price = midPrice, expiries = expiryIndex]() {
+        strategySearch.load(chain, price, expiries);
+        return strategySearch.search(query);
+      });
+  return true;
+}
+
+bool OptionsModel::pollStrategySearch(std::vector<Strategy>* strategies) {
+  if (!pendingSearch.valid() ||
+      pendingSearch.wait_for(std::chrono::seconds(0)) !=
+          std::future_status::ready) {
+    return false;
+  }
+  *strategies = pendingSearch.get();
+  return true;
 }
 
-double& OptionsModel::getGammaExposure() { return naiveGammaExposure; }
+bool OptionsModel::isSearching() const { return pendingSearch.valid(); }
 
-double& OptionsModel::getGammaAtExpiry(int i) {
-  return gammaAtExpiryArray.at(i);
+void OptionsModel::computeExposureProfile() {
+  const OptionBatch& chain = exposureBook.getChain();
+  if (!(chain.spot > 0)) return;
+  exposureEngine.compute(chain, exposureBook.getOpenInterest(),
+                         ExposureGrid::around(chain.spot, kProfileWidth,
+                                              kProfilePoints, {0.0, 1.0, 7.0}),
+                         &exposureProfile);
 }
 
-std::vector<double>& OptionsModel::getGammaAtExpiryList() {
-  return gammaAtExpiryArray;
+double OptionsModel::getGammaExposure() const {
+  return exposureBook.getTotal().gamma.empty()
+             ? 0.0
+             : exposureBook.getTotal().gamma[0];
 }
 
-std::vector<double>& OptionsModel::getCallGammaAtExpiryList() {
-  return callGammaAtExpiryArray;
+double OptionsModel::getGammaAtExpiry(int i) const {
+  return exposureBook.getByExpiry().gamma.at(i);
 }
 
-std::vector<double>& OptionsModel::getPutGammaAtExpiryList() {
-  return putGammaAtExpiryArray;
+const std::vector<double>& OptionsModel::getGammaAtExpiryList() const {
+  return exposureBook.getByExpiry().gamma;
 }
 
-std::vector<double>& OptionsModel::getNaiveVannaExposureList() {
-  return naiveVannaExposureArray;
+const std::vector<double>& OptionsModel::getCallGammaAtExpiryList() const {
+  return exposureBook.getByExpiry().callGamma;
+}
+
+const std::vector<double>& OptionsModel::getPutGammaAtExpiryList() const {
+  return exposureBook.getByExpiry().putGamma;
+}
+
+const std::vector<double>& OptionsModel::getNaiveVannaExposureList() const {
+  return exposureBook.getByExpiry().vanna;
 }
 
 std::vector<double>& OptionsModel::getDatetimeEpochArray() {
   return datetimeEpochArray;
 }
 
-std::vector<double>& OptionsModel::getVegaExposureArray() {
-  return vegaExposureArray;
+const std::vector<double>& OptionsModel::getVegaExposureArray() const {
+  return exposureBook.getByExpiry().vega;
+}
+
+const std::vector<double>& OptionsModel::getVolgaExposureArray() const {
+  return exposureBook.getByExpiry().volga;
+}
+
+const OptionBatch& OptionsModel::getOptionBatch() const {
+  return optionBatch;
+}
+
+const VolSurface& OptionsModel::getVolSurface() const { return volSurface; }
+
+const ExposureBook& OptionsModel::getExposureBook() const {
+  return exposureBook;
 }
 
-std::vector<double>& OptionsModel::getVolgaExposureArray() {
-  return volgaExposureArray;
+const ExposureProfile& OptionsModel::getExposureProfile() const {
+  return exposureProfile;
 }
 }  // namespace premia
\ No newline at end of file
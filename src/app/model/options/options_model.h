@@ -2,11 +2,18 @@
 #define OptionsModel_hpp
 
 #include <cmath>
+#include <future>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "metatypes.h"
 #include "model/model.h"
+#include "model/options/black_scholes.h"
+#include "model/options/gamma_exposure.h"
+#include "model/options/strategy_search.h"
+#include "model/options/vol_surface.h"
+#include "model/options/worker_pool.h"
 #include "core/TDA.hpp"
 
 
@@ -14,7 +21,6 @@ namespace premia {
 class OptionsModel : public Model {
  private:
   bool active = false;
-  double naiveGammaExposure = 0.0;
   std::string tickerSymbol;
   tda::OptionChain optionChainData;
   std::vector<tda::OptionsDateTimeObj> callOptionArray;
@@ -22,17 +28,40 @@ class OptionsModel : public Model {
   std::vector<tda::OptionsDateTimeObj> optionsDateTimeObj;
   std::vector<const char*> datetime_array;
 
-  std::vector<double> gammaAtExpiryArray;
-  std::vector<double> callGammaAtExpiryArray;
-  std::vector<double> putGammaAtExpiryArray;
-
   std::vector<std::string> datetimeArray;
   std::vector<double> datetimeEpochArray;
 
-  std::vector<double> naiveVannaExposureArray;
-  std::vector<double> volgaExposureArray;
+  // every strike of the chain, parsed once per fetch; openInterest,
+  // midPrice, expiryIndex (into datetimeArray) and contractIndex line up
+  // with the batch
+  OptionBatch optionBatch;
+  std::vector<double> openInterest;
+  std::vector<double> midPrice;
+  std::vector<size_t> expiryIndex;
+  std::unordered_map<std::string, size_t> contractIndex;
+
+  // shared by the surface fit and the exposure profile
+  WorkerPool workerPool;
+  // SVI smiles fitted to the out-of-the-money vols of each expiry; fills
+  // in contracts TDA has no vol for
+  VolSurface volSurface;
+  // live exposure at spot, moved contract by contract on updateOption()
+  ExposureBook exposureBook;
+  // dealer exposure over spot +- 15% today, tomorrow and in a week; only
+  // rebuilt once spot moves a grid step, so it lags vol and open interest
+  // updates until then
+  ExposureEngine exposureEngine{&workerPool};
+  ExposureProfile exposureProfile;
+  // the strategy search runs off the UI thread, which keeps using
+  // workerPool meanwhile, so it gets threads of its own
+  WorkerPool searchPool;
+  StrategySearch strategySearch{&searchPool};
+  // declared last so that it is waited on before the search goes away
+  std::future<std::vector<Strategy>> pendingSearch;
 
-  std::vector<double> vegaExposureArray;
+  void loadOptionBatch();
+  void fitVolSurface();
+  void computeExposureProfile();
 
  public:
   bool isActive() const;
@@ -50,19 +79,36 @@ class OptionsModel : public Model {
                         const std::string& expMonth,
                         const std::string& optionType);
   void calculateGammaExposure();
-  double& getGammaExposure();
-  double& getGammaAtExpiry(int i);
-  std::vector<double>& getGammaAtExpiryList();
-  std::vector<double>& getCallGammaAtExpiryList();
-  std::vector<double>& getPutGammaAtExpiryList();
+  // a streamed quote for one contract by its TDA symbol, in TDA units
+  // (vol in percent); NaN leaves a field as it was
+  void updateOption(const std::string& symbol, double volatility,
+                    double openInterest);
+  void updateSpot(double spot);
+  // starts looking for the best single-expiry spreads on the fetched chain
+  // at mid prices; false while the last search is still running
+  bool startStrategySearch(const StrategyQuery& query);
+  // true once the started search is done, with its results best first
+  bool pollStrategySearch(std::vector<Strategy>* strategies);
+  bool isSearching() const;
 
-  std::vector<double>& getNaiveVannaExposureList();
+  double getGammaExposure() const;
+  double getGammaAtExpiry(int i) const;
+  const std::vector<double>& getGammaAtExpiryList() const;
+  const std::vector<double>& getCallGammaAtExpiryList() const;
+  const std::vector<double>& getPutGammaAtExpiryList() const;
+
+  const std::vector<double>& getNaiveVannaExposureList() const;
 
   std::vector<double>& getDatetimeEpochArray();
 
-  std::vector<double>& getVegaExposureArray();
+  const std::vector<double>& getVegaExposureArray() const;
+
+  const std::vector<double>& getVolgaExposureArray() const;
 
-  std::vector<double>& getVolgaExposureArray();
+  const OptionBatch& getOptionBatch() const;
+  const VolSurface& getVolSurface() const;
+  const ExposureBook& getExposureBook() const;
+  const ExposureProfile& getExposureProfile() const;
 };
 }  // namespace premia
 
@@ -0,0 +1,379 @@
+#include "strategy_search.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+
+namespace premia {
+namespace {
+
+constexpr double kSharesPerContract = 100.0;
+constexpr size_t kTableSize = 4096;
+// the distribution table spans this many standard deviations either side
+constexpr double kTableSpan = 8.0;
+// a spread risking less than a cent a share rests on a crossed or stale
+// quote, not on a trade anyone would get filled at
+constexpr double kMinRisk = 0.01;
+
+double normCdf(double x) { return 0.5 * std::erfc(-x / std::sqrt(2.0)); }
+
+// min-heap on score, so front() is the one to beat
+bool better(const Strategy& a, const Strategy& b) { return a.score > b.score; }
+
+}  // namespace
+
+struct StrategySearch::Expiry {
+  double years = 0.0;
+  double forward = 0.0;
+  double vol = 0.0;
+  std::vector<double> strikes;  // ascending
+  std::vector<size_t> call;     // contract at each strike, SIZE_MAX if none
+  std::vector<size_t> put;
+  // the best credit of a call spread sold at or above each strike, for
+  // bounding iron condors; rebuilt for every query's maxWidth
+  std::vector<double> bestCallCredit;
+
+  // P(spot at expiry <= x), uniform in x over [low, low + step * size)
+  double low = 0.0;
+  double step = 0.0;
+  std::vector<double> cdf;
+
+  double below(double x) const {
+    if (cdf.empty()) return x < forward ? 0.0 : 1.0;
+    double at = (x - low) / step;
+    if (!(at > 0)) return 0.0;
+    if (at >= cdf.size() - 1) return 1.0;
+    size_t i = static_cast<size_t>(at);
+    double frac = at - i;
+    return cdf[i] + frac * (cdf[i + 1] - cdf[i]);
+  }
+};
+
+struct StrategySearch::Worker {
+  std::vector<Strategy> heap;
+};
+
+StrategySearch::StrategySearch(WorkerPool* pool)
+    : pool(pool), workers(pool->size()) {}
+
+StrategySearch::~StrategySearch() = default;
+
+void StrategySearch::load(const OptionBatch& chain,
+                          const std::vector<double>& price,
+                          const std::vector<size_t>& expiryIndex) {
+  this->chain = chain;
+  this->price = price;
+  priceBatch(chain, &greeks);
+
+  std::map<size_t, std::map<double, std::pair<size_t, size_t>>> grouped;
+  std::map<size_t, double> years;
+  for (size_t i = 0; i < chain.size(); ++i) {
+    if (!(price[i] > 0) || !(chain.strike[i] > 0) || !(chain.years[i] > 0)) {
+      continue;
+    }
+    auto& slot = grouped[expiryIndex[i]]
+                     .emplace(chain.strike[i],
+                              std::make_pair(SIZE_MAX, SIZE_MAX))
+                     .first->second;
+    (chain.sign[i] > 0 ? slot.first : slot.second) = i;
+    years[expiryIndex[i]] = chain.years[i];
+  }
+
+  expiries.clear();
+  for (const auto& [index, strikes] : grouped) {
+    Expiry expiry;
+    expiry.years = years[index];
+    expiry.forward =
+        chain.spot * std::exp((chain.rate - chain.dividend) * expiry.years);
+    double nearest = std::numeric_limits<double>::infinity();
+    for (const auto& [strike, contracts] : strikes) {
+      expiry.strikes.push_back(strike);
+      expiry.call.push_back(contracts.first);
+      expiry.put.push_back(contracts.second);
+      for (size_t contract : {contracts.first, contracts.second}) {
+        if (contract == SIZE_MAX || !(chain.vol[contract] > 0)) continue;
+        double distance = std::fabs(strike - expiry.forward);
+        if (distance < nearest) {
+          nearest = distance;
+          expiry.vol = chain.vol[contract];
+        }
+      }
+    }
+
+    double sd = expiry.vol * std::sqrt(expiry.years);
+    if (sd > 0) {
+      expiry.low = expiry.forward * std::exp(-kTableSpan * sd);
+      double high = expiry.forward * std::exp(kTableSpan * sd);
+      expiry.step = (high - expiry.low) / (kTableSize - 1);
+      expiry.cdf.resize(kTableSize);
+      for (size_t i = 0; i < kTableSize; ++i) {
+        double x = expiry.low + expiry.step * i;
+        expiry.cdf[i] =
+            x > 0 ? normCdf((std::log(x / expiry.forward) + sd * sd / 2) / sd)
+                  : 0.0;
+      }
+    }
+    expiries.push_back(std::move(expiry));
+  }
+}
+
+std::vector<Strategy> StrategySearch::search(const StrategyQuery& query) {
+  const size_t width = std::max<size_t>(query.maxWidth, 1);
+  std::vector<Task> tasks;
+  for (size_t e = 0; e < expiries.size(); ++e) {
+    Expiry& expiry = expiries[e];
+    const size_t n = expiry.strikes.size();
+    expiry.bestCallCredit.assign(n + 1, -std::numeric_limits<double>::max());
+    for (size_t k = n; k-- > 0;) {
+      double best = expiry.bestCallCredit[k + 1];
+      if (expiry.call[k] != SIZE_MAX) {
+        for (size_t l = k + 1; l < n && l <= k + width; ++l) {
+          if (expiry.call[l] == SIZE_MAX) continue;
+          best = std::max(best,
+                          price[expiry.call[k]] - price[expiry.call[l]]);
+        }
+      }
+      expiry.bestCallCredit[k] = best;
+    }
+    for (StrategyKind kind : query.kinds) {
+      for (size_t i = 0; i < n; ++i) tasks.push_back({e, kind, i});
+    }
+  }
+
+  for (Worker& worker : workers) worker.heap.clear();
+  if (query.topK > 0) {
+    pool->run(tasks.size(), [&](size_t worker, size_t index) {
+      run(workers[worker], query, tasks[index]);
+    });
+  }
+
+  std::vector<Strategy> best;
+  for (Worker& worker : workers) {
+    best.insert(best.end(), worker.heap.begin(), worker.heap.end());
+  }
+  std::sort(best.begin(), best.end(),
+            [](const Strategy& a, const Strategy& b) {
+              if (a.score != b.score) return a.score > b.score;
+              if (a.expiry != b.expiry) return a.expiry < b.expiry;
+              for (size_t i = 0; i < a.legCount && i < b.legCount; ++i) {
+                if (a.legs[i].contract != b.legs[i].contract) {
+                  return a.legs[i].contract < b.legs[i].contract;
+                }
+                if (a.legs[i].quantity != b.legs[i].quantity) {
+                  return a.legs[i].quantity < b.legs[i].quantity;
+                }
+              }
+              return a.legCount < b.legCount;
+            });
+  if (best.size() > query.topK) best.resize(query.topK);
+
+  for (Strategy& strategy : best) {
+    for (size_t i = 0; i < strategy.legCount; ++i) {
+      const StrategyLeg& leg = strategy.legs[i];
+      double units = leg.quantity * kSharesPerContract;
+      strategy.delta += units * greeks.delta[leg.contract];
+      strategy.gamma += units * greeks.gamma[leg.contract];
+      strategy.theta += units * greeks.theta[leg.contract];
+      strategy.vega += units * greeks.vega[leg.contract];
+    }
+  }
+  return best;
+}
+
+void StrategySearch::run(Worker& worker, const StrategyQuery& query,
+                         const Task& task) {
+  const Expiry& expiry = expiries[task.expiry];
+  const size_t n = expiry.strikes.size();
+  const size_t i = task.first;
+  const size_t width = std::max<size_t>(query.maxWidth, 1);
+  const size_t last = std::min(n, i + width + 1);
+
+  Strategy candidate;
+  candidate.kind = task.kind;
+  candidate.expiry = task.expiry;
+  // offers the legs and their mirror image, the same spread sold
+  auto both = [&](std::initializer_list<StrategyLeg> legs) {
+    for (const StrategyLeg& leg : legs) {
+      if (leg.contract == SIZE_MAX) return;
+    }
+    for (double side : {1.0, -1.0}) {
+      candidate.legCount = 0;
+      for (const StrategyLeg& leg : legs) {
+        candidate.legs[candidate.legCount++] = {leg.contract,
+                                                side * leg.quantity};
+      }
+      offer(worker, query, expiry, &candidate);
+    }
+  };
+
+  switch (task.kind) {
+    case StrategyKind::kVertical:
+      for (size_t j = i + 1; j < last; ++j) {
+        both({{expiry.call[i], 1.0}, {expiry.call[j], -1.0}});
+        both({{expiry.put[i], 1.0}, {expiry.put[j], -1.0}});
+      }
+      break;
+    case StrategyKind::kStraddle:
+      both({{expiry.put[i], 1.0}, {expiry.call[i], 1.0}});
+      break;
+    case StrategyKind::kStrangle:
+      for (size_t j = i + 1; j < last; ++j) {
+        both({{expiry.put[i], 1.0}, {expiry.call[j], 1.0}});
+      }
+      break;
+    case StrategyKind::kButterfly:
+      for (size_t w = 1; w <= width && w <= i && i + w < n; ++w) {
+        both({{expiry.call[i - w], 1.0},
+              {expiry.call[i], -2.0},
+              {expiry.call[i + w], 1.0}});
+        both({{expiry.put[i - w], 1.0},
+              {expiry.put[i], -2.0},
+              {expiry.put[i + w], 1.0}});
+      }
+      break;
+    case StrategyKind::kIronCondor:
+      if (expiry.put[i] == SIZE_MAX) break;
+      for (size_t j = i + 1; j < last; ++j) {
+        if (expiry.put[j] == SIZE_MAX) continue;
+        // the most a short condor on this put spread can collect bounds
+        // its score; skip the call side when that cannot make the heap
+        double putCredit = price[expiry.put[j]] - price[expiry.put[i]];
+        double credit = putCredit + expiry.bestCallCredit[j];
+        double putWidth = expiry.strikes[j] - expiry.strikes[i];
+        double bound =
+            query.objective == StrategyObjective::kProbabilityOfProfit
+                ? 1 - expiry.below(expiry.strikes[j] - credit)
+            : putWidth > credit ? credit / (putWidth - credit)
+                                : std::numeric_limits<double>::infinity();
+        bool full = worker.heap.size() >= query.topK;
+        bool shortCondorOut =
+            (full && bound <= worker.heap.front().score) ||
+            (putWidth - credit) * kSharesPerContract > query.maxLoss;
+
+        for (size_t k = j; k < n; ++k) {
+          if (expiry.call[k] == SIZE_MAX) continue;
+          for (size_t l = k + 1; l < n && l <= k + width; ++l) {
+            if (expiry.call[l] == SIZE_MAX) continue;
+            for (double side : {-1.0, 1.0}) {
+              if (side < 0 && shortCondorOut) continue;
+              candidate.legCount = 4;
+              candidate.legs[0] = {expiry.put[i], -side};
+              candidate.legs[1] = {expiry.put[j], side};
+              candidate.legs[2] = {expiry.call[k], side};
+              candidate.legs[3] = {expiry.call[l], -side};
+              offer(worker, query, expiry, &candidate);
+            }
+          }
+        }
+      }
+      break;
+  }
+}
+
+// Values the candidate's expiry payoff at 0 and at each strike, where it
+// can bend, and keeps it if it makes the worker's heap.
+void StrategySearch::offer(Worker& worker, const StrategyQuery& query,
+                           const Expiry& expiry, Strategy* candidate) {
+  double nodes[5] = {0.0};
+  size_t count = 1;
+  double cost = 0.0;
+  double slope = 0.0;  // past the highest strike
+  for (size_t i = 0; i < candidate->legCount; ++i) {
+    const StrategyLeg& leg = candidate->legs[i];
+    cost += leg.quantity * price[leg.contract];
+    if (chain.sign[leg.contract] > 0) slope += leg.quantity;
+    // insertion sort; there are at most four strikes
+    size_t at = count++;
+    double strike = chain.strike[leg.contract];
+    for (; at > 1 && nodes[at - 1] > strike; --at) nodes[at] = nodes[at - 1];
+    nodes[at] = strike;
+  }
+  count = std::unique(nodes, nodes + count) - nodes;
+
+  double value[5];
+  for (size_t n = 0; n < count; ++n) {
+    double payoff = -cost;
+    for (size_t i = 0; i < candidate->legCount; ++i) {
+      const StrategyLeg& leg = candidate->legs[i];
+      double k = chain.strike[leg.contract];
+      double intrinsic =
+          chain.sign[leg.contract] > 0 ? nodes[n] - k : k - nodes[n];
+      if (intrinsic > 0) payoff += leg.quantity * intrinsic;
+    }
+    value[n] = payoff;
+  }
+
+  double high = *std::max_element(value, value + count);
+  double low = *std::min_element(value, value + count);
+  double maxGain =
+      slope > 0 ? std::numeric_limits<double>::infinity() : high;
+  double maxLoss =
+      slope < 0 ? std::numeric_limits<double>::infinity() : -low;
+  if (!(maxLoss >= kMinRisk) || !(maxGain > 0)) return;
+  if (maxLoss * kSharesPerContract > query.maxLoss) return;
+  if (query.objective == StrategyObjective::kReturnOnRisk &&
+      !std::isfinite(maxGain)) {
+    return;
+  }
+
+  double probability = 0.0;
+  double first = std::numeric_limits<double>::quiet_NaN();
+  double lastRoot = first;
+  auto root = [&](double x) {
+    if (std::isnan(first)) first = x;
+    lastRoot = x;
+  };
+  for (size_t n = 0; n + 1 < count; ++n) {
+    double a = nodes[n];
+    double b = nodes[n + 1];
+    double va = value[n];
+    double vb = value[n + 1];
+    if ((va > 0) != (vb > 0)) {
+      double x = a + (b - a) * va / (va - vb);
+      root(x);
+      probability += va > 0 ? expiry.below(x) - expiry.below(a)
+                            : expiry.below(b) - expiry.below(x);
+    } else if (va > 0) {
+      probability += expiry.below(b) - expiry.below(a);
+    }
+  }
+  double end = nodes[count - 1];
+  double vEnd = value[count - 1];
+  if (vEnd > 0 && slope >= 0) {
+    probability += 1 - expiry.below(end);
+  } else if (vEnd > 0) {
+    double x = end - vEnd / slope;
+    root(x);
+    probability += expiry.below(x) - expiry.below(end);
+  } else if (slope > 0) {
+    double x = end - vEnd / slope;
+    root(x);
+    probability += 1 - expiry.below(x);
+  }
+  if (probability < query.minProbability) return;
+
+  double score = query.objective == StrategyObjective::kProbabilityOfProfit
+                     ? probability
+                     : maxGain / maxLoss;
+  bool full = worker.heap.size() >= query.topK;
+  if (full && !(score > worker.heap.front().score)) return;
+
+  candidate->cost = cost * kSharesPerContract;
+  candidate->maxGain = maxGain * kSharesPerContract;
+  candidate->maxLoss = maxLoss * kSharesPerContract;
+  candidate->breakevenLow = first;
+  candidate->breakevenHigh =
+      lastRoot != first ? lastRoot : std::numeric_limits<double>::quiet_NaN();
+  candidate->probability = probability;
+  candidate->score = score;
+  if (full) {
+    std::pop_heap(worker.heap.begin(), worker.heap.end(), better);
+    worker.heap.back() = *candidate;
+  } else {
+    worker.heap.push_back(*candidate);
+  }
+  std::push_heap(worker.heap.begin(), worker.heap.end(), better);
+}
+
+}  // namespace premia
@@ -0,0 +1,112 @@
+#ifndef StrategySearch_hpp
+#define StrategySearch_hpp
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "model/options/black_scholes.h"
+#include "model/options/worker_pool.h"
+
+namespace premia {
+
+enum class StrategyKind {
+  kVertical,
+  kStraddle,
+  kStrangle,
+  kButterfly,
+  kIronCondor,
+};
+
+enum class StrategyObjective {
+  kProbabilityOfProfit,
+  // max gain over max loss, among spreads with both bounded
+  kReturnOnRisk,
+};
+
+struct StrategyQuery {
+  std::vector<StrategyKind> kinds;
+  StrategyObjective objective = StrategyObjective::kProbabilityOfProfit;
+  size_t topK = 20;
+  // most strikes between the two legs of a vertical, strangle or condor
+  // wing, and from the body of a butterfly to its wings
+  size_t maxWidth = 10;
+  double maxLoss = std::numeric_limits<double>::infinity();  // dollars
+  double minProbability = 0.0;
+};
+
+struct StrategyLeg {
+  size_t contract = 0;    // into the loaded chain
+  double quantity = 0.0;  // contracts, negative when sold
+};
+
+// One spread, in dollars for a single unit of it.
+struct Strategy {
+  StrategyKind kind = StrategyKind::kVertical;
+  size_t expiry = 0;
+  std::array<StrategyLeg, 4> legs;
+  size_t legCount = 0;
+
+  double cost = 0.0;  // paid to open, negative for a credit
+  double maxGain = 0.0;
+  double maxLoss = 0.0;  // infinity when unbounded
+  double breakevenLow = std::numeric_limits<double>::quiet_NaN();
+  double breakevenHigh = std::numeric_limits<double>::quiet_NaN();
+  double probability = 0.0;  // of expiring with a profit
+  double score = 0.0;
+
+  double delta = 0.0;
+  double gamma = 0.0;
+  double theta = 0.0;
+  double vega = 0.0;
+};
+
+// Enumerates and ranks single-expiry spreads over an option chain.
+//
+// Every spread here pays a piecewise linear amount at expiry with kinks at
+// its strikes, so its max gain and loss, breakevens and probability of
+// profit come exactly from its value at those strikes. The probability is
+// under a lognormal terminal spot at the expiry's forward and at-the-money
+// vol, read from a distribution table built once per expiry, so ranking a
+// candidate costs no transcendental calls. Each (expiry, kind, first
+// strike) is a task on the pool; workers keep their own top-K heaps and
+// skip whole groups of iron condors once their best possible score cannot
+// enter the heap. The greeks of the survivors are summed from one
+// priceBatch() of the chain made at load().
+class StrategySearch {
+ public:
+  explicit StrategySearch(WorkerPool* pool);
+  ~StrategySearch();
+
+  // price lines up with chain, NaN or <= 0 where a contract has no quote;
+  // expiryIndex groups the contracts into expiries
+  void load(const OptionBatch& chain, const std::vector<double>& price,
+            const std::vector<size_t>& expiryIndex);
+  // best first
+  std::vector<Strategy> search(const StrategyQuery& query);
+
+ private:
+  struct Expiry;
+  struct Worker;
+  struct Task {
+    size_t expiry;
+    StrategyKind kind;
+    size_t first;  // strike index the enumeration starts from
+  };
+
+  void run(Worker& worker, const StrategyQuery& query, const Task& task);
+  void offer(Worker& worker, const StrategyQuery& query, const Expiry& expiry,
+             Strategy* candidate);
+
+  WorkerPool* pool;
+  std::vector<Expiry> expiries;
+  std::vector<Worker> workers;
+  OptionBatch chain;
+  std::vector<double> price;
+  GreeksBatch greeks;
+};
+
+}  // namespace premia
+
+#endif
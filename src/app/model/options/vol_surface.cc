@@ -0,0 +1,316 @@
+#include "vol_surface.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace premia {
+namespace {
+
+constexpr size_t kMinQuotes = 5;
+constexpr int kMaxIterations = 400;
+// a warm start must be the same expiry a little later
+constexpr double kWarmStartYears = 3.0 / 365;
+// the simplex stops once it spans less than this in (m, ln sigma), or
+// its values agree to this fraction
+constexpr double kSimplexTolerance = 1e-6;
+constexpr double kValueTolerance = 1e-9;
+
+struct Quote {
+  double k;
+  double w;       // total variance
+  double weight;
+};
+
+// The best (a, d, c) of w = a + d * y + c * sqrt(y^2 + 1), y = (k - m) / s,
+// inside 0 <= c <= 4s, |d| <= min(c, 4s - c), 0 <= a <= max w; the raw SVI
+// constraints in these coordinates.
+struct Inner {
+  double a = 0.0;
+  double d = 0.0;
+  double c = 0.0;
+  double sse = std::numeric_limits<double>::infinity();
+};
+
+Inner solveInner(const std::vector<Quote>& quotes, double m, double s,
+                 double maxW) {
+  double s1 = 0, sy = 0, sz = 0, syy = 0, syz = 0, szz = 0;
+  double sw = 0, swy = 0, swz = 0;
+  for (const Quote& q : quotes) {
+    double y = (q.k - m) / s;
+    double z = std::sqrt(y * y + 1);
+    s1 += q.weight;
+    sy += q.weight * y;
+    sz += q.weight * z;
+    syy += q.weight * y * y;
+    syz += q.weight * y * z;
+    szz += q.weight * z * z;
+    sw += q.weight * q.w;
+    swy += q.weight * q.w * y;
+    swz += q.weight * q.w * z;
+  }
+
+  Inner inner;
+  // Cramer's rule on the normal equations
+  double det = s1 * (syy * szz - syz * syz) - sy * (sy * szz - syz * sz) +
+               sz * (sy * syz - syy * sz);
+  if (std::fabs(det) > 1e-300) {
+    inner.a = (sw * (syy * szz - syz * syz) - sy * (swy * szz - syz * swz) +
+               sz * (swy * syz - syy * swz)) /
+              det;
+    inner.d = (s1 * (swy * szz - swz * syz) - sw * (sy * szz - syz * sz) +
+               sz * (sy * swz - swy * sz)) /
+              det;
+    inner.c = (s1 * (syy * swz - syz * swy) - sy * (sy * swz - swy * sz) +
+               sw * (sy * syz - syy * sz)) /
+              det;
+  }
+  bool feasible = inner.c >= 0 && inner.c <= 4 * s &&
+                  std::fabs(inner.d) <= std::min(inner.c, 4 * s - inner.c) &&
+                  inner.a >= 0 && inner.a <= maxW;
+  if (!feasible) {
+    // settle c, then d with a free, then a
+    inner.c = std::min(std::max(inner.c, 0.0), 4 * s);
+    double det2 = s1 * syy - sy * sy;
+    inner.d = std::fabs(det2) > 1e-300
+                  ? (s1 * (swy - inner.c * syz) - sy * (sw - inner.c * sz)) /
+                        det2
+                  : 0.0;
+    double dMax = std::min(inner.c, 4 * s - inner.c);
+    inner.d = std::min(std::max(inner.d, -dMax), dMax);
+    inner.a = (sw - inner.d * sy - inner.c * sz) / s1;
+    inner.a = std::min(std::max(inner.a, 0.0), maxW);
+  }
+
+  inner.sse = 0.0;
+  for (const Quote& q : quotes) {
+    double y = (q.k - m) / s;
+    double r = inner.a + inner.d * y + inner.c * std::sqrt(y * y + 1) - q.w;
+    inner.sse += q.weight * r * r;
+  }
+  return inner;
+}
+
+SviParams toParams(const Inner& inner, double m, double s) {
+  SviParams params;
+  params.a = inner.a;
+  params.b = inner.c / s;
+  params.rho = inner.c > 0 ? inner.d / inner.c : 0.0;
+  params.m = m;
+  params.sigma = s;
+  return params;
+}
+
+SmileFit fitSmile(const SmileQuotes& smile, double forward,
+                  const SmileFit* warm) {
+  SmileFit fit;
+  fit.years = smile.years;
+  fit.forward = forward;
+
+  const double t = smile.years;
+  std::vector<Quote> quotes;
+  double maxW = 0.0;
+  for (size_t i = 0; i < smile.strike.size() && i < smile.vol.size(); ++i) {
+    double v = smile.vol[i];
+    if (!(v > 0) || !(smile.strike[i] > 0)) continue;
+    double k = std::log(smile.strike[i] / forward);
+    double weight;
+    if (smile.weight.size() == smile.strike.size()) {
+      weight = smile.weight[i];
+    } else {
+      double d1 = -k / (v * std::sqrt(t)) + v * std::sqrt(t) / 2;
+      weight = std::exp(-d1 * d1 / 2);
+    }
+    if (!(weight > 0)) continue;
+    quotes.push_back({k, v * v * t, weight});
+    maxW = std::max(maxW, v * v * t);
+  }
+
+  double total = 0.0;
+  double weights = 0.0;
+  for (const Quote& q : quotes) {
+    total += q.weight * q.w;
+    weights += q.weight;
+  }
+  if (quotes.size() < kMinQuotes) {
+    fit.params.a = weights > 0 ? total / weights : 0.0;
+    fit.params.b = 0.0;
+    return fit;
+  }
+
+  // Nelder-Mead over (m, ln sigma)
+  auto objective = [&](const double* x) {
+    return solveInner(quotes, x[0], std::exp(x[1]), maxW).sse;
+  };
+  double start[2];
+  double step[2];
+  if (warm != nullptr && warm->fitted) {
+    start[0] = warm->params.m;
+    start[1] = std::log(warm->params.sigma);
+    step[0] = 0.001;
+    step[1] = 0.005;
+  } else {
+    auto lowest = std::min_element(
+        quotes.begin(), quotes.end(),
+        [](const Quote& x, const Quote& y) { return x.w < y.w; });
+    start[0] = lowest->k;
+    start[1] = std::log(0.1);
+    step[0] = 0.1;
+    step[1] = 0.5;
+  }
+  double simplex[3][2] = {{start[0], start[1]},
+                          {start[0] + step[0], start[1]},
+                          {start[0], start[1] + step[1]}};
+  double value[3];
+  for (int i = 0; i < 3; ++i) value[i] = objective(simplex[i]);
+
+  int iteration = 0;
+  for (; iteration < kMaxIterations; ++iteration) {
+    int order[3] = {0, 1, 2};
+    std::sort(order, order + 3,
+              [&](int x, int y) { return value[x] < value[y]; });
+    double* best = simplex[order[0]];
+    double* worst = simplex[order[2]];
+    double size = std::max(std::fabs(simplex[order[1]][0] - best[0]) +
+                               std::fabs(simplex[order[1]][1] - best[1]),
+                           std::fabs(worst[0] - best[0]) +
+                               std::fabs(worst[1] - best[1]));
+    double spread = value[order[2]] - value[order[0]];
+    if (size < kSimplexTolerance ||
+        spread <= kValueTolerance * value[order[0]]) {
+      break;
+    }
+
+    double centroid[2] = {(best[0] + simplex[order[1]][0]) / 2,
+                          (best[1] + simplex[order[1]][1]) / 2};
+    auto along = [&](double scale, double* out) {
+      out[0] = centroid[0] + scale * (worst[0] - centroid[0]);
+      out[1] = centroid[1] + scale * (worst[1] - centroid[1]);
+      return objective(out);
+    };
+    double reflected[2];
+    double fr = along(-1.0, reflected);
+    if (fr < value[order[0]]) {
+      double expanded[2];
+      double fe = along(-2.0, expanded);
+      const double* keep = fe < fr ? expanded : reflected;
+      worst[0] = keep[0];
+      worst[1] = keep[1];
+      value[order[2]] = std::min(fe, fr);
+    } else if (fr < value[order[1]]) {
+      worst[0] = reflected[0];
+      worst[1] = reflected[1];
+      value[order[2]] = fr;
+    } else {
+      double contracted[2];
+      double fc = fr < value[order[2]] ? along(-0.5, contracted)
+                                       : along(0.5, contracted);
+      if (fc < std::min(fr, value[order[2]])) {
+        worst[0] = contracted[0];
+        worst[1] = contracted[1];
+        value[order[2]] = fc;
+      } else {
+        for (int i = 1; i < 3; ++i) {
+          double* vertex = simplex[order[i]];
+          vertex[0] = (vertex[0] + best[0]) / 2;
+          vertex[1] = (vertex[1] + best[1]) / 2;
+          value[order[i]] = objective(vertex);
+        }
+      }
+    }
+  }
+
+  int best = static_cast<int>(std::min_element(value, value + 3) - value);
+  double m = simplex[best][0];
+  double s = std::exp(simplex[best][1]);
+  fit.params = toParams(solveInner(quotes, m, s, maxW), m, s);
+  fit.fitted = true;
+  fit.iterations = iteration;
+
+  double error = 0.0;
+  for (const Quote& q : quotes) {
+    double r = std::sqrt(std::max(fit.params.variance(q.k), 0.0) / t) -
+               std::sqrt(q.w / t);
+    error += q.weight * r * r;
+  }
+  fit.rmse = std::sqrt(error / weights);
+  return fit;
+}
+
+}  // namespace
+
+double SviParams::variance(double k) const {
+  double x = k - m;
+  return a + b * (rho * x + std::sqrt(x * x + sigma * sigma));
+}
+
+void VolSurface::fit(double spot, double rate, double dividend,
+                     const std::vector<SmileQuotes>& smiles,
+                     WorkerPool* pool) {
+  this->spot = spot;
+  this->rate = rate;
+  this->dividend = dividend;
+
+  std::vector<SmileFit> previous;
+  previous.swap(fits);
+  std::vector<const SmileQuotes*> live;
+  for (const SmileQuotes& smile : smiles) {
+    if (smile.years > 0) live.push_back(&smile);
+  }
+  fits.resize(live.size());
+
+  pool->run(live.size(), [&](size_t, size_t i) {
+    const SmileQuotes& smile = *live[i];
+    const SmileFit* warm = nullptr;
+    for (const SmileFit& last : previous) {
+      double gap = smile.years - last.years;
+      if (gap <= 0 && gap > -kWarmStartYears &&
+          (warm == nullptr || last.years < warm->years)) {
+        warm = &last;
+      }
+    }
+    fits[i] = fitSmile(smile, forward(smile.years), warm);
+  });
+  std::sort(fits.begin(), fits.end(),
+            [](const SmileFit& x, const SmileFit& y) {
+              return x.years < y.years;
+            });
+}
+
+void VolSurface::clear() { fits.clear(); }
+
+double VolSurface::forward(double years) const {
+  return spot * std::exp((rate - dividend) * years);
+}
+
+double VolSurface::totalVariance(double strike, double years) const {
+  if (fits.empty() || !(strike > 0) || !(years > 0)) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  const double k = std::log(strike / forward(years));
+  double below = std::max(fits[0].params.variance(k), 0.0);
+  if (years <= fits[0].years) return below * years / fits[0].years;
+  for (size_t j = 1; j < fits.size(); ++j) {
+    double above = std::max(fits[j].params.variance(k), below);
+    if (years <= fits[j].years) {
+      double x = (years - fits[j - 1].years) /
+                 (fits[j].years - fits[j - 1].years);
+      return below + x * (above - below);
+    }
+    below = above;
+  }
+  return below * years / fits.back().years;
+}
+
+double VolSurface::vol(double strike, double years) const {
+  return std::sqrt(totalVariance(strike, years) / years);
+}
+
+void VolSurface::applyTo(OptionBatch* batch) const {
+  for (size_t i = 0; i < batch->size(); ++i) {
+    double v = vol(batch->strike[i], batch->years[i]);
+    if (std::isfinite(v)) batch->vol[i] = v;
+  }
+}
+
+}  // namespace premia
@@ -0,0 +1,79 @@
+#ifndef VolSurface_hpp
+#define VolSurface_hpp
+
+#include <cstddef>
+#include <vector>
+
+#include "model/options/black_scholes.h"
+#include "model/options/worker_pool.h"
+
+namespace premia {
+
+// Raw SVI total variance in log forward moneyness k = ln(K / F):
+//   w(k) = a + b * (rho * (k - m) + sqrt((k - m)^2 + sigma^2))
+struct SviParams {
+  double a = 0.0;
+  double b = 0.0;
+  double rho = 0.0;
+  double m = 0.0;
+  double sigma = 0.1;
+
+  double variance(double k) const;
+};
+
+// The implied vols of one expiry. Weights default to the normalized vega
+// of each quote, so the far wings count for less than the money.
+struct SmileQuotes {
+  double years = 0.0;
+  std::vector<double> strike;
+  std::vector<double> vol;
+  std::vector<double> weight;  // empty or one per strike
+};
+
+struct SmileFit {
+  double years = 0.0;
+  double forward = 0.0;
+  SviParams params;
+  bool fitted = false;  // false when too few quotes; params are then flat
+  int iterations = 0;   // simplex steps the fit took
+  double rmse = 0.0;    // weighted, in vol
+};
+
+// A vol surface fitted one SVI smile per expiry.
+//
+// Every smile is held to b >= 0, |rho| < 1, a >= 0 and the Lee wing bound
+// b * (1 + |rho|) <= 4, so none of them has butterfly arbitrage in the
+// wings or negative variance. For given (m, sigma) the remaining three
+// parameters are a linear least squares problem, so only (m, sigma) are
+// searched, by Nelder-Mead. Each smile starts from the last fit of the same
+// expiry when there is one, which usually needs a fraction of the steps.
+// Between expiries the total variance is interpolated linearly in time at
+// fixed moneyness, after taking the running maximum over earlier expiries
+// so that it never falls with time.
+class VolSurface {
+ public:
+  // smiles in any order; they are fitted in parallel on pool
+  void fit(double spot, double rate, double dividend,
+           const std::vector<SmileQuotes>& smiles, WorkerPool* pool);
+  void clear();
+
+  bool empty() const { return fits.empty(); }
+  double vol(double strike, double years) const;
+  double totalVariance(double strike, double years) const;
+  // replaces every vol in the batch with the surface's
+  void applyTo(OptionBatch* batch) const;
+
+  const std::vector<SmileFit>& getFits() const { return fits; }  // by years
+
+ private:
+  double forward(double years) const;
+
+  double spot = 0.0;
+  double rate = 0.0;
+  double dividend = 0.0;
+  std::vector<SmileFit> fits;
+};
+
+}  // namespace premia
+
+#endif
@@ -0,0 +1,55 @@
+#include "worker_pool.h"
+
+namespace premia {
+
+WorkerPool::WorkerPool(size_t threads) {
+  for (size_t id = 1; id < threads; ++id) {
+    this->threads.emplace_back(&WorkerPool::loop, this, id);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto& thread : threads) thread.join();
+}
+
+void WorkerPool::run(size_t n, const Task& work) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    task = &work;
+    count = n;
+    next = 0;
+    busy = threads.size();
+    ++generation;
+  }
+  wake.notify_all();
+  drain(0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [this] { return busy == 0; });
+  task = nullptr;
+}
+
+void WorkerPool::drain(size_t worker) {
+  for (size_t i = next++; i < count; i = next++) (*task)(worker, i);
+}
+
+void WorkerPool::loop(size_t worker) {
+  uint64_t seen = 0;
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    wake.wait(lock, [&] { return stopping || generation != seen; });
+    if (stopping) return;
+    seen = generation;
+    lock.unlock();
+    drain(worker);
+    lock.lock();
+    if (--busy == 0) finished.notify_one();
+  }
+}
+
+}  // namespace premia
@@ -0,0 +1,53 @@
+#ifndef WorkerPool_hpp
+#define WorkerPool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace premia {
+
+// A fixed set of threads that split a range of independent tasks.
+//
+// run() hands the indices out one at a time to the workers and the calling
+// thread, and returns once all of them are done. Each task is told which
+// worker runs it, in [0, size()), so callers can keep per-worker scratch
+// without locking. The threads are kept between calls so a refresh does not
+// pay for thread start-up. One run() at a time.
+class WorkerPool {
+ public:
+  using Task = std::function<void(size_t worker, size_t index)>;
+
+  // threads counts the caller, so 1 runs everything inline
+  explicit WorkerPool(size_t threads = std::thread::hardware_concurrency());
+  ~WorkerPool();
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  size_t size() const { return threads.size() + 1; }
+  void run(size_t count, const Task& task);
+
+ private:
+  void drain(size_t worker);
+  void loop(size_t worker);
+
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  const Task* task = nullptr;
+  size_t count = 0;
+  std::atomic<size_t> next{0};
+  size_t busy = 0;
+  uint64_t generation = 0;
+  bool stopping = false;
+};
+
+}  // namespace premia
+
+#endif
@@ -0,0 +1,536 @@
+#include "order_book.h"
+
+#include <algorithm>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <cstdlib>
+#include <exception>
+#include <sstream>
+
+namespace premia {
+
+namespace {
+
+using json = boost::property_tree::ptree;
+
+constexpr uint16_t bit(OrderState state) {
+  return static_cast<uint16_t>(1u << static_cast<unsigned>(state));
+}
+
+// the states each state may move to, by OrderState
+constexpr uint16_t kNext[] = {
+    // PendingSubmit
+    bit(OrderState::Unknown) | bit(OrderState::Accepted) |
+        bit(OrderState::Rejected),
+    // Unknown, settled by reconcile() to whatever the broker says
+    bit(OrderState::Accepted) | bit(OrderState::Working) |
+        bit(OrderState::PartiallyFilled) | bit(OrderState::Filled) |
+        bit(OrderState::PendingCancel) | bit(OrderState::Canceled) |
+        bit(OrderState::PendingReplace) | bit(OrderState::Replaced) |
+        bit(OrderState::Rejected) | bit(OrderState::Expired),
+    // Accepted
+    bit(OrderState::Working) | bit(OrderState::PartiallyFilled) |
+        bit(OrderState::Filled) | bit(OrderState::PendingCancel) |
+        bit(OrderState::Canceled) | bit(OrderState::PendingReplace) |
+        bit(OrderState::Rejected) | bit(OrderState::Expired),
+    // Working
+    bit(OrderState::PartiallyFilled) | bit(OrderState::Filled) |
+        bit(OrderState::PendingCancel) | bit(OrderState::Canceled) |
+        bit(OrderState::PendingReplace) | bit(OrderState::Expired),
+    // PartiallyFilled
+    bit(OrderState::PartiallyFilled) | bit(OrderState::Filled) |
+        bit(OrderState::PendingCancel) | bit(OrderState::Canceled) |
+        bit(OrderState::PendingReplace) | bit(OrderState::Expired),
+    // Filled
+    0,
+    // PendingCancel
+    bit(OrderState::Working) | bit(OrderState::PartiallyFilled) |
+        bit(OrderState::Filled) | bit(OrderState::Canceled) |
+        bit(OrderState::Expired),
+    // Canceled
+    0,
+    // PendingReplace
+    bit(OrderState::Working) | bit(OrderState::PartiallyFilled) |
+        bit(OrderState::Filled) | bit(OrderState::Replaced) |
+        bit(OrderState::Canceled),
+    // Replaced
+    0,
+    // Rejected
+    0,
+    // Expired
+    0};
+
+// the text of the first <tag> at or after from, or empty
+std::string tagText(const std::string& xml, const std::string& tag,
+                    size_t from = 0) {
+  const std::string open = "<" + tag + ">";
+  size_t start = xml.find(open, from);
+  if (start == std::string::npos) return "";
+  start += open.size();
+  size_t end = xml.find('<', start);
+  if (end == std::string::npos) return "";
+  return xml.substr(start, end - start);
+}
+
+double toNumber(const std::string& text) {
+  return text.empty() ? 0.0 : std::strtod(text.c_str(), nullptr);
+}
+
+// a status the order endpoints report, as a state
+std::optional<OrderState> parseStatus(const std::string& status,
+                                      double filled) {
+  if (status == "WORKING") {
+    return filled > 0 ? OrderState::PartiallyFilled : OrderState::Working;
+  }
+  if (status == "ACCEPTED" || status == "QUEUED" ||
+      status == "PENDING_ACTIVATION" || status.rfind("AWAITING_", 0) == 0) {
+    return OrderState::Accepted;
+  }
+  if (status == "FILLED") return OrderState::Filled;
+  if (status == "PENDING_CANCEL") return OrderState::PendingCancel;
+  if (status == "CANCELED") return OrderState::Canceled;
+  if (status == "PENDING_REPLACE") return OrderState::PendingReplace;
+  if (status == "REPLACED") return OrderState::Replaced;
+  if (status == "REJECTED") return OrderState::Rejected;
+  if (status == "EXPIRED") return OrderState::Expired;
+  return std::nullopt;
+}
+
+double percentile(std::vector<double> samples, double p) {
+  if (samples.empty()) return 0.0;
+  auto at = samples.begin() + static_cast<std::ptrdiff_t>(
+                                  p * static_cast<double>(samples.size() - 1));
+  std::nth_element(samples.begin(), at, samples.end());
+  return *at;
+}
+
+}  // namespace
+
+const char* toString(OrderState state) {
+  switch (state) {
+    case OrderState::PendingSubmit:
+      return "Pending Submit";
+    case OrderState::Unknown:
+      return "Unknown";
+    case OrderState::Accepted:
+      return "Accepted";
+    case OrderState::Working:
+      return "Working";
+    case OrderState::PartiallyFilled:
+      return "Partially Filled";
+    case OrderState::Filled:
+      return "Filled";
+    case OrderState::PendingCancel:
+      return "Pending Cancel";
+    case OrderState::Canceled:
+      return "Canceled";
+    case OrderState::PendingReplace:
+      return "Pending Replace";
+    case OrderState::Replaced:
+      return "Replaced";
+    case OrderState::Rejected:
+      return "Rejected";
+    case OrderState::Expired:
+      return "Expired";
+  }
+  return "";
+}
+
+bool isTerminal(OrderState state) {
+  return kNext[static_cast<size_t>(state)] == 0;
+}
+
+bool canTransition(OrderState from, OrderState to) {
+  return (kNext[static_cast<size_t>(from)] & bit(to)) != 0;
+}
+
+OrderBook::OrderBook(Submit submit, Cancel cancel)
+    : submitOrder(std::move(submit)), cancelOrder(std::move(cancel)) {}
+
+uint64_t OrderBook::submit(const OrderTicket& ticket) {
+  auto created = OrderRecord::Clock::now();
+  uint64_t id = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    OrderRecord record;
+    record.clientId = id = records.size() + 1;
+    record.ticket = ticket;
+    record.created = record.updated = created;
+    records.push_back(std::move(record));
+    open.insert(id);
+    ++submitting;
+    ++version;
+  }
+
+  SubmitReply reply;
+  try {
+    reply = submitOrder(ticket);
+  } catch (const std::exception&) {
+    // a timeout or a dropped connection says nothing about the order
+    reply = SubmitReply();
+  }
+  auto acknowledged = OrderRecord::Clock::now();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  --submitting;
+  OrderRecord& record = records[id - 1];
+  record.acknowledged = acknowledged;
+  if (latencies.size() < kLatencySamples) latencies.push_back(0.0);
+  latencies[latencyCount++ % kLatencySamples] =
+      std::chrono::duration<double, std::micro>(acknowledged - created)
+          .count();
+
+  const std::string& brokerId = reply.brokerId;
+  if (brokerId.empty()) {
+    bool refused = reply.status >= 400 && reply.status < 500;
+    setState(record, refused ? OrderState::Rejected : OrderState::Unknown);
+  } else {
+    record.brokerId = brokerId;
+    byBrokerId[brokerId] = id;
+    setState(record, OrderState::Accepted);
+    auto held = early.find(brokerId);
+    if (held != early.end()) {
+      for (const Event& event : held->second) apply(record, event);
+      early.erase(held);
+    }
+  }
+  // whatever is still held belongs to orders placed elsewhere
+  if (submitting == 0) {
+    for (const auto& [key, events] : early) discarded += events.size();
+    early.clear();
+  }
+  return id;
+}
+
+bool OrderBook::cancel(uint64_t clientId) {
+  std::string accountId;
+  std::string brokerId;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (clientId == 0 || clientId > records.size()) return false;
+    const OrderRecord& record = records[clientId - 1];
+    if (record.brokerId.empty() ||
+        !canTransition(record.state, OrderState::PendingCancel)) {
+      return false;
+    }
+    accountId = record.ticket.accountId;
+    brokerId = record.brokerId;
+  }
+
+  bool accepted = false;
+  try {
+    accepted = cancelOrder(accountId, brokerId);
+  } catch (const std::exception&) {
+    accepted = false;
+  }
+  if (!accepted) return false;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  OrderRecord& record = records[clientId - 1];
+  // the stream may have finished the order while the request was out
+  if (canTransition(record.state, OrderState::PendingCancel)) {
+    setState(record, OrderState::PendingCancel);
+  }
+  return true;
+}
+
+void OrderBook::applyStreamMessage(const std::string& frame) {
+  json root;
+  try {
+    std::istringstream input(frame);
+    boost::property_tree::read_json(input, root);
+  } catch (const boost::property_tree::ptree_error&) {
+    return;
+  }
+  auto data = root.get_child_optional("data");
+  if (!data) return;
+  for (const auto& [key, service] : *data) {
+    if (service.get<std::string>("service", "") != "ACCT_ACTIVITY") continue;
+    auto content = service.get_child_optional("content");
+    if (!content) continue;
+    // field 1 is the account, 2 the message type and 3 its XML
+    for (const auto& [index, message] : *content) {
+      applyActivity(message.get<std::string>("2", ""),
+                    message.get<std::string>("3", ""));
+    }
+  }
+}
+
+bool OrderBook::applyActivity(const std::string& messageType,
+                              const std::string& xml) {
+  Event event;
+  if (messageType == "OrderEntryRequest") {
+    event.next = OrderState::Accepted;
+  } else if (messageType == "OrderRoute" || messageType == "OrderActivation") {
+    event.next = OrderState::Working;
+  } else if (messageType == "OrderPartialFill" || messageType == "OrderFill") {
+    event.next = messageType == "OrderFill" ? OrderState::Filled
+                                            : OrderState::PartiallyFilled;
+    size_t execution = xml.find("<ExecutionInformation>");
+    if (execution != std::string::npos) {
+      size_t end = xml.find("</ExecutionInformation>", execution);
+      // a tag found past the block belongs to something else
+      auto field = [&](const std::string& tag) {
+        size_t at = xml.find("<" + tag + ">", execution);
+        return at < end ? tagText(xml, tag, at) : std::string();
+      };
+      event.quantity = toNumber(field("Quantity"));
+      event.price = toNumber(field("ExecutionPrice"));
+      event.execution = field("ID");
+      if (event.execution.empty()) event.execution = field("Timestamp");
+    }
+  } else if (messageType == "OrderCancelRequest") {
+    event.next = OrderState::PendingCancel;
+  } else if (messageType == "UROUT") {
+    event.next = OrderState::Canceled;
+  } else if (messageType == "OrderCancelReplaceRequest") {
+    event.next = OrderState::PendingReplace;
+  } else if (messageType == "OrderRejection") {
+    event.next = OrderState::Rejected;
+  } else if (messageType == "TooLateToCancel") {
+    // back to whatever it was before the cancel, found when applied
+    event.next = OrderState::PendingCancel;
+    event.resume = true;
+  } else {
+    return false;
+  }
+
+  const std::string brokerId = tagText(xml, "OrderKey");
+  if (brokerId.empty()) return false;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  OrderRecord* record = lookup(brokerId);
+  if (record == nullptr) {
+    if (submitting == 0) return false;
+    early[brokerId].push_back(event);
+    return true;
+  }
+  return apply(*record, event);
+}
+
+void OrderBook::reconcile(const std::string& response) {
+  json root;
+  try {
+    std::istringstream input(response);
+    boost::property_tree::read_json(input, root);
+  } catch (const boost::property_tree::ptree_error&) {
+    return;
+  }
+  std::vector<const json*> orders;
+  if (root.get_child_optional("orderId")) {
+    orders.push_back(&root);
+  } else {
+    for (const auto& [key, order] : root) orders.push_back(&order);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const json* order : orders) {
+    std::string brokerId = order->get<std::string>("orderId", "");
+    double filled = order->get<double>("filledQuantity", 0.0);
+    auto state = parseStatus(order->get<std::string>("status", ""), filled);
+    if (brokerId.empty() || !state) continue;
+
+    OrderRecord* record = lookup(brokerId);
+    if (record == nullptr) {
+      OrderTicket ticket;
+      ticket.accountId = order->get<std::string>("accountId", "");
+      ticket.orderType = order->get<std::string>("orderType", "");
+      ticket.duration = order->get<std::string>("duration", "");
+      ticket.session = order->get<std::string>("session", "");
+      ticket.quantity = order->get<double>("quantity", 0.0);
+      ticket.price = order->get<double>("price", 0.0);
+      auto legs = order->get_child_optional("orderLegCollection");
+      if (legs && !legs->empty()) {
+        const json& leg = legs->front().second;
+        ticket.instruction = leg.get<std::string>("instruction", "");
+        ticket.symbol = leg.get<std::string>("instrument.symbol", "");
+        ticket.assetType = leg.get<std::string>("instrument.assetType", "");
+      }
+
+      // our own submit that went unanswered, else one placed elsewhere
+      record = unresolved(ticket);
+      if (record == nullptr) {
+        OrderRecord adopted;
+        adopted.clientId = records.size() + 1;
+        adopted.ticket = std::move(ticket);
+        adopted.created = adopted.updated = OrderRecord::Clock::now();
+        open.insert(adopted.clientId);
+        records.push_back(std::move(adopted));
+        record = &records.back();
+      }
+      record->brokerId = brokerId;
+      byBrokerId[brokerId] = record->clientId;
+      ++version;
+    }
+    if (record->filledQuantity != filled) {
+      record->filledQuantity = filled;
+      ++version;
+    }
+    // the broker's word stands, legal step or not
+    if (record->state != *state) setState(*record, *state);
+  }
+}
+
+std::optional<OrderRecord> OrderBook::find(uint64_t clientId) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (clientId == 0 || clientId > records.size()) return std::nullopt;
+  return records[clientId - 1];
+}
+
+std::optional<OrderRecord> OrderBook::findByBrokerId(
+    const std::string& brokerId) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = byBrokerId.find(brokerId);
+  if (it == byBrokerId.end()) return std::nullopt;
+  return records[it->second - 1];
+}
+
+std::vector<OrderRecord> OrderBook::getOpenOrders() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<OrderRecord> orders;
+  orders.reserve(open.size());
+  for (uint64_t id : open) orders.push_back(records[id - 1]);
+  std::sort(orders.begin(), orders.end(),
+            [](const OrderRecord& a, const OrderRecord& b) {
+              return a.clientId < b.clientId;
+            });
+  return orders;
+}
+
+std::vector<std::pair<std::string, std::string>> OrderBook::getOpenBrokerIds()
+    const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<std::pair<std::string, std::string>> ids;
+  std::unordered_set<std::string> unresolvedAccounts;
+  for (uint64_t id : open) {
+    const OrderRecord& record = records[id - 1];
+    if (!record.brokerId.empty()) {
+      ids.emplace_back(record.ticket.accountId, record.brokerId);
+    } else if (record.state == OrderState::Unknown &&
+               unresolvedAccounts.insert(record.ticket.accountId).second) {
+      ids.emplace_back(record.ticket.accountId, "");
+    }
+  }
+  return ids;
+}
+
+uint64_t OrderBook::getVersion() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return version;
+}
+
+size_t OrderBook::getDroppedEvents() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return dropped;
+}
+
+size_t OrderBook::getDiscardedEvents() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return discarded;
+}
+
+SubmitLatency OrderBook::getSubmitLatency() const {
+  std::vector<double> samples;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    samples = latencies;
+  }
+  SubmitLatency latency;
+  latency.samples = samples.size();
+  latency.p50 = percentile(samples, 0.50);
+  latency.p99 = percentile(samples, 0.99);
+  return latency;
+}
+
+OrderRecord* OrderBook::lookup(const std::string& brokerId) {
+  auto it = byBrokerId.find(brokerId);
+  return it == byBrokerId.end() ? nullptr : &records[it->second - 1];
+}
+
+OrderRecord* OrderBook::unresolved(const OrderTicket& ticket) {
+  OrderRecord* oldest = nullptr;
+  for (uint64_t id : open) {
+    OrderRecord& record = records[id - 1];
+    if (record.state != OrderState::Unknown) continue;
+    const OrderTicket& sent = record.ticket;
+    if (sent.accountId != ticket.accountId || sent.symbol != ticket.symbol ||
+        sent.instruction != ticket.instruction ||
+        sent.orderType != ticket.orderType ||
+        sent.quantity != ticket.quantity || sent.price != ticket.price) {
+      continue;
+    }
+    if (oldest == nullptr || id < oldest->clientId) oldest = &record;
+  }
+  return oldest;
+}
+
+bool OrderBook::apply(OrderRecord& record, const Event& event) {
+  OrderState next = event.next;
+  if (event.resume) {
+    // the order carries on as it was
+    if (record.state != OrderState::PendingCancel) {
+      ++dropped;
+      return false;
+    }
+    auto before = beforeCancel.find(record.clientId);
+    next = before != beforeCancel.end() ? before->second : OrderState::Working;
+    setState(record, next);
+    return true;
+  }
+  // repeats are expected, a partial fill being the one that carries news
+  if (next == record.state && next != OrderState::PartiallyFilled) {
+    return true;
+  }
+  if (!canTransition(record.state, next)) {
+    ++dropped;
+    return false;
+  }
+
+  if (next == OrderState::PartiallyFilled || next == OrderState::Filled) {
+    // the streamer replays recent messages after a reconnect
+    if (!event.execution.empty() &&
+        !executions[record.clientId].insert(event.execution).second) {
+      return true;
+    }
+    double quantity = event.quantity;
+    if (next == OrderState::Filled && quantity <= 0) {
+      quantity = record.remaining();
+    }
+    if (record.ticket.quantity > 0) {
+      quantity = std::min(quantity, record.remaining());
+    }
+    double total = record.filledQuantity + quantity;
+    if (quantity > 0 && total > 0) {
+      record.averageFillPrice = (record.averageFillPrice *
+                                     record.filledQuantity +
+                                 event.price * quantity) /
+                                total;
+      record.filledQuantity = total;
+    }
+    if (next == OrderState::PartiallyFilled &&
+        record.filledQuantity >= record.ticket.quantity) {
+      next = OrderState::Filled;
+    }
+  }
+  setState(record, next);
+  return true;
+}
+
+void OrderBook::setState(OrderRecord& record, OrderState next) {
+  if (next == OrderState::PendingCancel) {
+    beforeCancel[record.clientId] = record.state;
+  } else {
+    beforeCancel.erase(record.clientId);
+  }
+  record.state = next;
+  record.updated = OrderRecord::Clock::now();
+  if (isTerminal(next)) {
+    open.erase(record.clientId);
+    executions.erase(record.clientId);
+  } else {
+    open.insert(record.clientId);
+  }
+  ++version;
+}
+
+}  // namespace premia
@@ -0,0 +1,174 @@
+#ifndef OrderBook_hpp
+#define OrderBook_hpp
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace premia {
+
+// Where an order is in its life at the broker. Unknown is a submit that got
+// no clear answer, which the broker may or may not have taken. Filled,
+// Canceled, Replaced, Rejected and Expired are final.
+enum class OrderState {
+  PendingSubmit,
+  Unknown,
+  Accepted,
+  Working,
+  PartiallyFilled,
+  Filled,
+  PendingCancel,
+  Canceled,
+  PendingReplace,
+  Replaced,
+  Rejected,
+  Expired
+};
+
+const char* toString(OrderState state);
+bool isTerminal(OrderState state);
+// whether an event may move an order from one state to the other
+bool canTransition(OrderState from, OrderState to);
+
+// What the user asked for, in the broker's own words
+struct OrderTicket {
+  std::string accountId;
+  std::string symbol;
+  std::string assetType = "EQUITY";
+  std::string instruction = "BUY";
+  std::string orderType = "LIMIT";
+  std::string duration = "DAY";
+  std::string session = "NORMAL";
+  double quantity = 0.0;
+  double price = 0.0;
+};
+
+struct OrderRecord {
+  using Clock = std::chrono::steady_clock;
+
+  uint64_t clientId = 0;
+  std::string brokerId;  // empty until the broker accepts it
+  OrderTicket ticket;
+  OrderState state = OrderState::PendingSubmit;
+  double filledQuantity = 0.0;
+  double averageFillPrice = 0.0;
+  Clock::time_point created;       // submit() was called
+  Clock::time_point acknowledged;  // the transport returned
+  Clock::time_point updated;
+
+  double remaining() const { return ticket.quantity - filledQuantity; }
+};
+
+// What the transport heard back from the broker
+struct SubmitReply {
+  std::string brokerId;  // empty unless the broker accepted the order
+  long status = 0;       // HTTP status, 0 when no response came back
+};
+
+// Percentiles of submit() to the transport's return over the most recent
+// submits, in microseconds
+struct SubmitLatency {
+  size_t samples = 0;
+  double p50 = 0.0;
+  double p99 = 0.0;
+};
+
+// The orders placed from this process, kept current by the account
+// activity stream instead of polling the order lists.
+//
+// Orders are found in constant time by the id handed out at submit() or by
+// the broker's id. Stream events move an order only along canTransition();
+// anything else (a late duplicate, a route after the fill) is dropped and
+// counted. A fill the stream repeats after a reconnect is known by its
+// execution id and counts once; fills never add up past the ticket. Events for a broker id not yet known, which can beat the
+// submit's own response, are held until the last submit in flight returns;
+// those no submit claims are then counted as discarded. reconcile() takes a
+// REST order response as the truth, for after a reconnect: it settles
+// Unknown orders by their ticket and adopts orders placed elsewhere. All
+// members are safe to call from several threads; the transports are called
+// outside the lock.
+class OrderBook {
+ public:
+  using Submit = std::function<SubmitReply(const OrderTicket& ticket)>;
+  using Cancel = std::function<bool(const std::string& accountId,
+                                    const std::string& brokerId)>;
+
+  OrderBook(Submit submit, Cancel cancel);
+  OrderBook(const OrderBook&) = delete;
+  OrderBook& operator=(const OrderBook&) = delete;
+
+  // blocks on the transport; the order is Accepted, Rejected when the broker
+  // answered 4xx, or Unknown when it did not answer clearly
+  uint64_t submit(const OrderTicket& ticket);
+  bool cancel(uint64_t clientId);
+
+  // one streamer frame; only its ACCT_ACTIVITY content is read
+  void applyStreamMessage(const std::string& frame);
+  // one ACCT_ACTIVITY message: its type and its XML body
+  bool applyActivity(const std::string& messageType, const std::string& xml);
+  // an order, or an array of them, as the order endpoints return them
+  void reconcile(const std::string& response);
+
+  std::optional<OrderRecord> find(uint64_t clientId) const;
+  std::optional<OrderRecord> findByBrokerId(const std::string& brokerId) const;
+  std::vector<OrderRecord> getOpenOrders() const;
+  // (account, broker id) of every open order, to check just those by REST;
+  // an empty id once per account with Unknown orders, whose order list has
+  // to be read instead
+  std::vector<std::pair<std::string, std::string>> getOpenBrokerIds() const;
+
+  // bumped on every change, for views that redraw on change
+  uint64_t getVersion() const;
+  size_t getDroppedEvents() const;
+  size_t getDiscardedEvents() const;
+  SubmitLatency getSubmitLatency() const;
+
+ private:
+  struct Event {
+    OrderState next;
+    double quantity = 0.0;
+    double price = 0.0;
+    std::string execution;  // the fill's id, or its time if it has none
+    bool resume = false;    // too late to cancel
+  };
+
+  OrderRecord* lookup(const std::string& brokerId);
+  // the oldest Unknown order placed with this ticket
+  OrderRecord* unresolved(const OrderTicket& ticket);
+  bool apply(OrderRecord& record, const Event& event);
+  void setState(OrderRecord& record, OrderState next);
+
+  Submit submitOrder;
+  Cancel cancelOrder;
+
+  mutable std::mutex mutex;
+  std::vector<OrderRecord> records;  // clientId - 1
+  std::unordered_map<std::string, uint64_t> byBrokerId;
+  std::unordered_set<uint64_t> open;
+  // the state to go back to if a cancel turns out too late
+  std::unordered_map<uint64_t, OrderState> beforeCancel;
+  // executions already counted into an open order's fills
+  std::unordered_map<uint64_t, std::unordered_set<std::string>> executions;
+  std::unordered_map<std::string, std::vector<Event>> early;
+  size_t submitting = 0;
+  uint64_t version = 0;
+  size_t dropped = 0;
+  size_t discarded = 0;
+
+  // ring of the last kLatencySamples submits
+  static constexpr size_t kLatencySamples = 1024;
+  std::vector<double> latencies;
+  size_t latencyCount = 0;
+};
+
+}  // namespace premia
+
+#endif
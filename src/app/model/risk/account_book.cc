@@ -0,0 +1,136 @@
+#include "account_book.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <unordered_map>
+
+namespace premia {
+namespace {
+
+constexpr double kSecondsPerYear = 365.0 * 24 * 3600;
+constexpr double kContractShares = 100.0;
+
+// days since 1970-01-01 of a proleptic Gregorian date
+int64_t daysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  const int64_t era = (y >= 0 ? y : y - 399) / 400;
+  const int64_t yoe = y - era * 400;
+  const int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+// 16:00 New York, taken as 20:00 UTC
+double expirySeconds(int expiry) {
+  return daysFromCivil(expiry / 10000, expiry / 100 % 100, expiry % 100) *
+             86400.0 +
+         20 * 3600.0;
+}
+
+bool allDigits(const std::string& text) {
+  if (text.empty()) return false;
+  for (char c : text) {
+    if (c < '0' || c > '9') return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool parseOptionSymbol(const std::string& symbol, OptionSymbol* out) {
+  size_t underscore = symbol.find('_');
+  // underlying, MMDDYY, C or P and at least one digit of strike
+  if (underscore == 0 || underscore == std::string::npos ||
+      symbol.size() < underscore + 9) {
+    return false;
+  }
+  std::string date = symbol.substr(underscore + 1, 6);
+  char right = symbol[underscore + 7];
+  std::string strike = symbol.substr(underscore + 8);
+  if (!allDigits(date) || (right != 'C' && right != 'P')) return false;
+
+  char* end = nullptr;
+  double value = std::strtod(strike.c_str(), &end);
+  if (end != strike.c_str() + strike.size() || !(value > 0)) return false;
+
+  int month = std::atoi(date.substr(0, 2).c_str());
+  int day = std::atoi(date.substr(2, 2).c_str());
+  int year = 2000 + std::atoi(date.substr(4, 2).c_str());
+  if (month < 1 || month > 12 || day < 1 || day > 31) return false;
+
+  out->underlying = symbol.substr(0, underscore);
+  out->expiry = year * 10000 + month * 100 + day;
+  out->call = right == 'C';
+  out->strike = value;
+  return true;
+}
+
+RiskBook makeRiskBook(const tda::Account& account, const FactorQuote& quote,
+                      double rate, std::chrono::system_clock::time_point now,
+                      std::vector<std::string>* skipped) {
+  RiskBook book;
+  book.rate = rate;
+  double nowSeconds =
+      std::chrono::duration<double>(now.time_since_epoch()).count();
+
+  // factor index by symbol, -1 once a symbol is known to have no quote
+  std::unordered_map<std::string, int> factorOf;
+  auto factorFor = [&](const std::string& symbol) {
+    auto found = factorOf.find(symbol);
+    if (found != factorOf.end()) return found->second;
+    RiskFactor factor;
+    factor.symbol = symbol;
+    int index = -1;
+    if (quote(symbol, &factor) && factor.spot > 0) {
+      index = static_cast<int>(book.factors.size());
+      book.factors.push_back(factor);
+    }
+    factorOf.emplace(symbol, index);
+    return index;
+  };
+  auto skip = [&](const std::string& symbol) {
+    if (skipped != nullptr) skipped->push_back(symbol);
+  };
+
+  for (const tda::Position& held : account.get_positions()) {
+    if (held.quantity() == 0) continue;
+
+    RiskPosition position;
+    position.quantity = held.quantity();
+    std::string underlying = held.symbol;
+    if (held.assetType == "OPTION") {
+      OptionSymbol option;
+      if (!parseOptionSymbol(held.symbol, &option)) {
+        skip(held.symbol);
+        continue;
+      }
+      underlying = held.underlyingSymbol.empty() ? option.underlying
+                                                 : held.underlyingSymbol;
+      position.option = true;
+      position.multiplier = kContractShares;
+      position.call = option.call;
+      position.strike = option.strike;
+      position.years =
+          (expirySeconds(option.expiry) - nowSeconds) / kSecondsPerYear;
+      if (!(position.years > 0)) {
+        skip(held.symbol);
+        continue;
+      }
+    } else if (held.assetType != "EQUITY") {
+      skip(held.symbol);
+      continue;
+    }
+
+    int factor = factorFor(underlying);
+    if (factor < 0) {
+      skip(held.symbol);
+      continue;
+    }
+    position.factor = static_cast<size_t>(factor);
+    if (position.option) position.vol = book.factors[factor].vol;
+    book.positions.push_back(position);
+  }
+  return book;
+}
+
+}  // namespace premia
@@ -0,0 +1,46 @@
+#ifndef AccountBook_hpp
+#define AccountBook_hpp
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "model/risk/portfolio_risk.h"
+#include "service/TDAmeritrade/data/Account.hpp"
+
+namespace premia {
+
+// The parts of a TDA option symbol, e.g. AAPL_011924C190 or SPY_032024P412.5
+struct OptionSymbol {
+  std::string underlying;
+  int expiry = 0;  // yyyymmdd
+  bool call = true;
+  double strike = 0.0;
+};
+
+// false when the symbol is not in that form
+bool parseOptionSymbol(const std::string& symbol, OptionSymbol* out);
+
+// Spot, vol and dividend of an underlying, with symbol already set; false
+// when it is not known
+using FactorQuote =
+    std::function<bool(const std::string& symbol, RiskFactor* factor)>;
+
+// The stock and option positions of an account as a RiskBook, one factor
+// per underlying in order of first use and no correlation between them.
+//
+// Options count 100 shares a contract, expire at 16:00 New York and are
+// valued at their underlying's vol, which TDA does not report per
+// position. Symbols whose underlying has no quote, options past expiry and
+// other asset types (cash sweeps, bonds, funds) are left out and, when
+// skipped is given, listed there.
+RiskBook makeRiskBook(const tda::Account& account, const FactorQuote& quote,
+                      double rate,
+                      std::chrono::system_clock::time_point now =
+                          std::chrono::system_clock::now(),
+                      std::vector<std::string>* skipped = nullptr);
+
+}  // namespace premia
+
+#endif
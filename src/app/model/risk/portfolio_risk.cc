@@ -0,0 +1,251 @@
+#include "portfolio_risk.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace premia {
+namespace {
+
+constexpr double kDaysPerYear = 365.0;
+constexpr size_t kBlockPaths = 2048;
+constexpr double kTwoPi = 6.283185307179586476925;
+
+// Philox 4x32-10 (Salmon et al., "Parallel random numbers: as easy as
+// 1, 2, 3"): ten rounds of multiply and xor turn a counter into four
+// independent 32-bit words under a key.
+void philox(const uint32_t key[2], const uint32_t counter[4],
+            uint32_t out[4]) {
+  uint32_t c[4] = {counter[0], counter[1], counter[2], counter[3]};
+  uint32_t k[2] = {key[0], key[1]};
+  for (int round = 0; round < 10; ++round) {
+    uint64_t p0 = uint64_t{0xD2511F53} * c[0];
+    uint64_t p1 = uint64_t{0xCD9E8D57} * c[2];
+    uint32_t next[4] = {static_cast<uint32_t>(p1 >> 32) ^ c[1] ^ k[0],
+                        static_cast<uint32_t>(p1),
+                        static_cast<uint32_t>(p0 >> 32) ^ c[3] ^ k[1],
+                        static_cast<uint32_t>(p0)};
+    std::copy(next, next + 4, c);
+    k[0] += 0x9E3779B9;
+    k[1] += 0xBB67AE85;
+  }
+  std::copy(c, c + 4, out);
+}
+
+// n standard normals for one path, by Box-Muller on its Philox words
+void pathNormals(uint64_t seed, uint64_t path, size_t n, double* out) {
+  const uint32_t key[2] = {static_cast<uint32_t>(seed),
+                           static_cast<uint32_t>(seed >> 32)};
+  for (size_t i = 0; i < n; i += 4) {
+    const uint32_t counter[4] = {static_cast<uint32_t>(path),
+                                 static_cast<uint32_t>(path >> 32),
+                                 static_cast<uint32_t>(i / 4), 0};
+    uint32_t bits[4];
+    philox(key, counter, bits);
+    for (size_t pair = 0; pair < 2; ++pair) {
+      double u1 = (bits[2 * pair] + 0.5) / 4294967296.0;
+      double u2 = (bits[2 * pair + 1] + 0.5) / 4294967296.0;
+      double r = std::sqrt(-2 * std::log(u1));
+      if (i + 2 * pair < n) out[i + 2 * pair] = r * std::cos(kTwoPi * u2);
+      if (i + 2 * pair + 1 < n) {
+        out[i + 2 * pair + 1] = r * std::sin(kTwoPi * u2);
+      }
+    }
+  }
+}
+
+// Lower Cholesky factor; a pivot that is not positive (a correlation matrix
+// that is only semi-definite, or slightly off from rounding) drops that
+// direction instead of failing.
+std::vector<double> choleskyOf(const std::vector<double>& correlation,
+                               size_t n) {
+  std::vector<double> l(n * n, 0.0);
+  if (correlation.size() != n * n) {
+    for (size_t i = 0; i < n; ++i) l[i * n + i] = 1.0;
+    return l;
+  }
+  for (size_t j = 0; j < n; ++j) {
+    double pivot = correlation[j * n + j];
+    for (size_t k = 0; k < j; ++k) pivot -= l[j * n + k] * l[j * n + k];
+    if (!(pivot > 0)) continue;
+    l[j * n + j] = std::sqrt(pivot);
+    for (size_t i = j + 1; i < n; ++i) {
+      double sum = correlation[i * n + j];
+      for (size_t k = 0; k < j; ++k) sum -= l[i * n + k] * l[j * n + k];
+      l[i * n + j] = sum / l[j * n + j];
+    }
+  }
+  return l;
+}
+
+}  // namespace
+
+RiskEngine::RiskEngine(WorkerPool* pool)
+    : pool(pool), workers(pool->size()) {}
+
+void RiskEngine::prepare(const RiskBook& book, double horizonDays) {
+  this->book = &book;
+  horizon = horizonDays / kDaysPerYear;
+  cholesky = choleskyOf(book.correlation, book.factors.size());
+
+  size_t n = book.positions.size();
+  todayValue.assign(n, 0.0);
+  todayDelta.assign(n, 0.0);
+  todayGamma.assign(n, 0.0);
+  todayTheta.assign(n, 0.0);
+  Worker& scratch = workers[0];
+  for (size_t p = 0; p < n; ++p) {
+    const RiskPosition& position = book.positions[p];
+    if (position.factor >= book.factors.size()) continue;
+    const RiskFactor& factor = book.factors[position.factor];
+    if (!position.option) {
+      todayValue[p] = factor.spot;
+      todayDelta[p] = 1.0;
+      continue;
+    }
+    scratch.batch.spot = factor.spot;
+    scratch.batch.rate = book.rate;
+    scratch.batch.dividend = factor.dividend;
+    scratch.batch.clear();
+    scratch.batch.add(position.strike, position.years, position.vol,
+                      position.call);
+    priceBatch(scratch.batch, &scratch.greeks);
+    todayValue[p] = scratch.greeks.price[0];
+    todayDelta[p] = scratch.greeks.delta[0];
+    todayGamma[p] = scratch.greeks.gamma[0];
+    todayTheta[p] = scratch.greeks.theta[0];
+  }
+}
+
+RiskReport RiskEngine::run(const RiskBook& book, const RiskOptions& options) {
+  prepare(book, options.horizonDays);
+  RiskReport report;
+  for (size_t p = 0; p < book.positions.size(); ++p) {
+    const RiskPosition& position = book.positions[p];
+    report.value += position.quantity * position.multiplier * todayValue[p];
+  }
+  report.pnl.assign(options.paths, 0.0);
+  size_t blocks = (options.paths + kBlockPaths - 1) / kBlockPaths;
+  pool->run(blocks, [&](size_t worker, size_t block) {
+    size_t first = block * kBlockPaths;
+    size_t count = std::min(kBlockPaths, options.paths - first);
+    simulate(workers[worker], first, count, options,
+             report.pnl.data() + first);
+  });
+  this->book = nullptr;
+  if (options.paths == 0) return report;
+
+  double sum = 0.0;
+  for (double x : report.pnl) sum += x;
+  report.mean = sum / options.paths;
+  double squares = 0.0;
+  for (double x : report.pnl) {
+    squares += (x - report.mean) * (x - report.mean);
+  }
+  report.stdev = std::sqrt(squares / options.paths);
+
+  // the worst (1 - level) of the paths make the tail; VaR is the best of
+  // them and ES their mean
+  std::vector<double> sorted = report.pnl;
+  std::sort(sorted.begin(), sorted.end());
+  for (double level : options.levels) {
+    auto tail = static_cast<size_t>(std::ceil((1 - level) * options.paths));
+    tail = std::min(std::max(tail, size_t{1}), sorted.size());
+    double shortfall = 0.0;
+    for (size_t i = 0; i < tail; ++i) shortfall += sorted[i];
+    report.levels.push_back(level);
+    report.var.push_back(-sorted[tail - 1]);
+    report.es.push_back(-shortfall / tail);
+  }
+  return report;
+}
+
+double RiskEngine::scenario(const RiskBook& book,
+                            const std::vector<double>& returns,
+                            double horizonDays) {
+  prepare(book, horizonDays);
+  Worker& worker = workers[0];
+  worker.spots.resize(book.factors.size());
+  for (size_t f = 0; f < book.factors.size(); ++f) {
+    double move = f < returns.size() ? returns[f] : 0.0;
+    worker.spots[f] = book.factors[f].spot * (1 + move);
+  }
+  double pnl = 0.0;
+  revalue(worker, 1, &pnl);
+  this->book = nullptr;
+  return pnl;
+}
+
+void RiskEngine::simulate(Worker& worker, size_t first, size_t count,
+                          const RiskOptions& options, double* pnl) {
+  const size_t factors = book->factors.size();
+  worker.spots.resize(factors * count);
+  worker.normals.resize(factors);
+  for (size_t j = 0; j < count; ++j) {
+    pathNormals(options.seed, first + j, factors, worker.normals.data());
+    for (size_t f = 0; f < factors; ++f) {
+      double x = 0.0;
+      for (size_t g = 0; g <= f; ++g) {
+        x += cholesky[f * factors + g] * worker.normals[g];
+      }
+      const RiskFactor& factor = book->factors[f];
+      double sd = factor.vol * std::sqrt(horizon);
+      worker.spots[f * count + j] =
+          factor.spot * std::exp(sd * x - sd * sd / 2);
+    }
+  }
+
+  if (options.revaluation == Revaluation::kFull) {
+    revalue(worker, count, pnl);
+    return;
+  }
+  std::fill(pnl, pnl + count, 0.0);
+  for (size_t p = 0; p < book->positions.size(); ++p) {
+    const RiskPosition& position = book->positions[p];
+    if (position.factor >= factors) continue;
+    const double units = position.quantity * position.multiplier;
+    const double spot = book->factors[position.factor].spot;
+    const double* spots = worker.spots.data() + position.factor * count;
+    const double decay = todayTheta[p] * horizon;
+    for (size_t j = 0; j < count; ++j) {
+      double move = spots[j] - spot;
+      pnl[j] += units * (todayDelta[p] * move +
+                         todayGamma[p] * move * move / 2 + decay);
+    }
+  }
+}
+
+// Full revaluation of every position at the spots in worker.spots.
+void RiskEngine::revalue(Worker& worker, size_t count, double* pnl) {
+  const size_t factors = book->factors.size();
+  std::fill(pnl, pnl + count, 0.0);
+  OptionBatch& batch = worker.batch;
+  for (size_t p = 0; p < book->positions.size(); ++p) {
+    const RiskPosition& position = book->positions[p];
+    if (position.factor >= factors) continue;
+    const double units = position.quantity * position.multiplier;
+    const double* spots = worker.spots.data() + position.factor * count;
+    if (!position.option) {
+      for (size_t j = 0; j < count; ++j) {
+        pnl[j] += units * (spots[j] - todayValue[p]);
+      }
+      continue;
+    }
+
+    batch.spot = 1.0;
+    batch.rate = book->rate;
+    batch.dividend = book->factors[position.factor].dividend;
+    batch.strike.resize(count);
+    batch.years.assign(count, position.years - horizon);
+    batch.vol.assign(count, position.vol);
+    batch.sign.assign(count, position.call ? 1.0 : -1.0);
+    for (size_t j = 0; j < count; ++j) {
+      batch.strike[j] = position.strike / spots[j];
+    }
+    priceBatch(batch, &worker.greeks);
+    for (size_t j = 0; j < count; ++j) {
+      pnl[j] += units * (worker.greeks.price[j] * spots[j] - todayValue[p]);
+    }
+  }
+}
+
+}  // namespace premia
@@ -0,0 +1,117 @@
+#ifndef PortfolioRisk_hpp
+#define PortfolioRisk_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "model/options/black_scholes.h"
+#include "model/options/worker_pool.h"
+
+namespace premia {
+
+// An underlying the book is exposed to; vol is annualized.
+struct RiskFactor {
+  std::string symbol;
+  double spot = 0.0;
+  double vol = 0.0;
+  double dividend = 0.0;
+};
+
+// Shares of a factor, or option contracts on it when option is set.
+struct RiskPosition {
+  size_t factor = 0;
+  double quantity = 0.0;
+  double multiplier = 1.0;
+  bool option = false;
+  bool call = true;
+  double strike = 0.0;
+  double years = 0.0;
+  double vol = 0.0;
+};
+
+struct RiskBook {
+  std::vector<RiskFactor> factors;
+  // factors x factors, row-major; empty for independent factors
+  std::vector<double> correlation;
+  std::vector<RiskPosition> positions;
+  double rate = 0.0;
+};
+
+enum class Revaluation {
+  kFull,        // Black-Scholes at every path
+  kDeltaGamma,  // delta, gamma and theta taken at today's spot
+};
+
+struct RiskOptions {
+  size_t paths = 100000;
+  double horizonDays = 1.0;
+  uint64_t seed = 1;
+  std::vector<double> levels = {0.95, 0.99};
+  Revaluation revaluation = Revaluation::kFull;
+};
+
+struct RiskReport {
+  double value = 0.0;  // of the book today
+  double mean = 0.0;   // of the simulated PnL
+  double stdev = 0.0;
+  std::vector<double> levels;
+  std::vector<double> var;  // losses, positive, one per level
+  std::vector<double> es;
+  std::vector<double> pnl;  // one per path, in path order
+};
+
+// Monte Carlo value at risk and expected shortfall of a book of stock and
+// option positions.
+//
+// Each path moves every factor once over the horizon as a driftless
+// lognormal, with the factor returns correlated through a Cholesky factor
+// of the correlation matrix. The normals come from a counter-based
+// generator (Philox 4x32-10) keyed by the seed and counted by path, so a
+// path's draws do not depend on which thread makes them and a seed gives
+// the same report on any pool. Paths are split into blocks on the pool.
+//
+// Options are revalued across a block of paths at once: Black-Scholes is
+// homogeneous in spot and strike, so pricing at spot 1 and strike K / S
+// and scaling by S puts one position's paths in a single priceBatch().
+class RiskEngine {
+ public:
+  explicit RiskEngine(WorkerPool* pool);
+
+  RiskReport run(const RiskBook& book, const RiskOptions& options);
+  // PnL of the book after each factor's spot moves by its return (0.05 for
+  // +5%) over the horizon, revalued in full
+  double scenario(const RiskBook& book, const std::vector<double>& returns,
+                  double horizonDays = 0.0);
+
+ private:
+  struct Worker {
+    std::vector<double> spots;  // factors x block, factor-major
+    std::vector<double> normals;
+    OptionBatch batch;
+    GreeksBatch greeks;
+  };
+
+  void prepare(const RiskBook& book, double horizonDays);
+  void simulate(Worker& worker, size_t first, size_t count,
+                const RiskOptions& options, double* pnl);
+  void revalue(Worker& worker, size_t count, double* pnl);
+
+  WorkerPool* pool;
+  std::vector<Worker> workers;
+
+  // the book being run, with what every path shares
+  const RiskBook* book = nullptr;
+  double horizon = 0.0;  // in years
+  std::vector<double> cholesky;
+  // per position and unit of quantity, at today's spots
+  std::vector<double> todayValue;
+  std::vector<double> todayDelta;
+  std::vector<double> todayGamma;
+  std::vector<double> todayTheta;
+};
+
+}  // namespace premia
+
+#endif
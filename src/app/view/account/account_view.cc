@@ -1,10 +1,12 @@
 #include "account_view.h"
 
 namespace premia {
-void AccountView::Draw_balance_string(const std::string &variable) {
-  // std::string str =
-  //     (halext::HLXT::getInstance().getPrivateBalance()) ? "***" : variable;
-  // ImGui::Text("%s", str.c_str());
+void AccountView::Draw_balance_value(double value) {
+  // if (halext::HLXT::getInstance().getPrivateBalance()) {
+  //   ImGui::Text("***");
+  //   return;
+  // }
+  ImGui::Text("%.2f", value);
 }
 
 void AccountView::Draw_symbol_string(const std::string &symbol) {
@@ -22,36 +24,11 @@ void AccountView::Draw_symbol_string(const std::string &symbol) {
  * @param account_num
  */
 void AccountView::load_account(const std::string &account_num) {
-  account_data = tda::TDA::getInstance().getAccount(account_num);
-
-  if (!positions_vector.empty()) positions_vector.clear();
-
-  for (int i = 0; i < account_data.get_position_vector_size(); i++) {
-    for (const auto &[key, value] : account_data.get_position(i)) {
-      if (key == "symbol") {
-        std::string str = value;
-        positions_vector.push_back(str);
-      }
-    }
-  }
+  // every account is in the snapshot already
+  selected_account = account_num;
 }
 
-void AccountView::load_all_accounts() {
-  account_data = tda::TDA::getInstance().getAllAccounts();
-
-  if (!positions_vector.empty()) {
-    positions_vector.clear();
-  }
-
-  for (int i = 0; i < account_data.get_position_vector_size(); i++) {
-    for (const auto &[key, value] : account_data.get_position(i)) {
-      if (key == "symbol") {
-        std::string str = value;
-        positions_vector.push_back(str);
-      }
-    }
-  }
-}
+void AccountView::load_all_accounts() { selected_account.clear(); }
 
 /**
  * @brief Load all accounts
@@ -79,6 +56,8 @@ void AccountView::initPositions() {
     i++;
   }
   default_account = account_ids_std.at(0);
+  refresher.setAccounts(account_ids_std);
+  refresher.start();
   load_account(default_account);
 }
 
@@ -153,7 +132,7 @@ void AccountView::initPositions() {
  * @author @scawful
  *
  */
-void AccountView::Draw_positions() {
+void AccountView::Draw_positions(const tda::Account &account_data) {
   if (ImGui::BeginTable("PositionsTable", 6, positionFlags)) {
     ImGui::TableSetupScrollFreeze(0, 1);  // Make top row always visible
     ImGui::TableSetupColumn("Symbol", ImGuiTableColumnFlags_WidthStretch);
@@ -169,36 +148,31 @@ void AccountView::Draw_positions() {
     ImGui::TableHeadersRow();
 
     ImGuiListClipper clipper;
-    clipper.Begin((int)positions_vector.size());
+    clipper.Begin((int)account_data.get_position_vector_size());
     while (clipper.Step()) {
       for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
         ImGui::TableNextRow();
+        const tda::Position &position = account_data.get_position(row);
         for (int column = 0; column < 6; column++) {
-          std::string symbol = positions_vector[row];
           ImGui::TableSetColumnIndex(column);
           switch (column) {
             case 0:
-              Draw_symbol_string(symbol);
+              Draw_symbol_string(position.symbol);
               break;
             case 1:
-              Draw_balance_string(account_data.get_position_balances(
-                  symbol, "currentDayProfitLoss"));
+              Draw_balance_value(position.currentDayProfitLoss);
               break;
             case 2:
-              Draw_balance_string(account_data.get_position_balances(
-                  symbol, "currentDayProfitLossPercentage"));
+              Draw_balance_value(position.currentDayProfitLossPercentage);
               break;
             case 3:
-              Draw_balance_string(
-                  account_data.get_position_balances(symbol, "averagePrice"));
+              Draw_balance_value(position.averagePrice);
               break;
             case 4:
-              Draw_balance_string(
-                  account_data.get_position_balances(symbol, "marketValue"));
+              Draw_balance_value(position.marketValue);
               break;
             case 5:
-              Draw_balance_string(
-                  account_data.get_position_balances(symbol, "longQuantity"));
+              Draw_balance_value(position.quantity());
               break;
             default:
               break;
@@ -212,25 +186,20 @@ void AccountView::Draw_positions() {
 }
 
 void AccountView::DrawAccountPane() {
+  snapshot = refresher.getSnapshot();
+  const tda::Account &account_data = snapshot->get(selected_account);
+  const tda::Balances &balances = account_data.get_balances();
   ImGui::Text("Account ID: %s",
               account_data.get_account_variable("accountId").c_str());
-  ImGui::Text("Cash: %s",
-              account_data.get_balance_variable("cashBalance").c_str());
-  ImGui::Text("Net Liq: %s",
-              account_data.get_balance_variable("liquidationValue").c_str());
-  ImGui::Text("Available Funds: %s",
-              account_data.get_balance_variable("availableFunds").c_str());
-  ImGui::Text("Long Mkt Val: %s",
-              account_data.get_balance_variable("longMarketValue").c_str());
-  ImGui::Text("Short Mtk Val: %s",
-              account_data.get_balance_variable("shortMarketValue").c_str());
-  ImGui::Text("Cumulative BP: %s",
-              account_data.get_balance_variable("buyingPower").c_str());
-  ImGui::Text("Equity: %s, %s%",
-              account_data.get_balance_variable("equity").c_str(),
-              account_data.get_balance_variable("equityPercentage").c_str());
-  ImGui::Text("Margin Balance: %s",
-              account_data.get_balance_variable("marginBalance").c_str());
+  ImGui::Text("Cash: %.2f", balances.cashBalance);
+  ImGui::Text("Net Liq: %.2f", balances.liquidationValue);
+  ImGui::Text("Available Funds: %.2f", balances.availableFunds);
+  ImGui::Text("Long Mkt Val: %.2f", balances.longMarketValue);
+  ImGui::Text("Short Mtk Val: %.2f", balances.shortMarketValue);
+  ImGui::Text("Cumulative BP: %.2f", balances.buyingPower);
+  ImGui::Text("Equity: %.2f, %.2f%%", balances.equity,
+              balances.equityPercentage);
+  ImGui::Text("Margin Balance: %.2f", balances.marginBalance);
   ImGui::Separator();
 
   //     "accruedInterest": 0,
@@ -267,7 +236,7 @@ void AccountView::DrawAccountPane() {
   ImGuiTabBarFlags tab_bar_flags = ImGuiTabBarFlags_None;
   if (ImGui::BeginTabBar("MyTabBar", tab_bar_flags)) {
     if (ImGui::BeginTabItem("Positions")) {
-      Draw_positions();
+      Draw_positions(account_data);
       ImGui::EndTabItem();
     }
     if (ImGui::BeginTabItem("Performance")) {
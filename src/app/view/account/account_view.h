@@ -2,6 +2,10 @@
 #define AccountView_hpp
 
 // #include "core/HLXT.hpp"
+#include <memory>
+#include <string>
+
+#include "model/account/account_refresher.h"
 #include "model/options/options_model.h"
 #include "view/view.h"
 
@@ -19,15 +23,24 @@ class AccountView : public View {
 
   std::unordered_map<std::string, tda::Quote> quotes;
 
-  tda::Account account_data;
-  std::vector<std::string> positions_vector;
+  // every linked account, refreshed in the background; the snapshot is
+  // taken once a frame
+  AccountRefresher refresher{
+      [](const std::string &id) {
+        return tda::TDA::getInstance().fetchAccount(id);
+      },
+      [](const std::string &response) {
+        return tda::TDA::getInstance().parseAccount(response);
+      }};
+  std::shared_ptr<const AccountSnapshot> snapshot;
+  std::string selected_account;  // empty for all of them
 
   void initPositions();
   void load_account(const std::string &account);
   void load_all_accounts();
   void Draw_symbol_string(const std::string &symbol);
-  void Draw_balance_string(const std::string &variable);
-  void Draw_positions();
+  void Draw_balance_value(double value);
+  void Draw_positions(const tda::Account &account_data);
 
   // ------------------------------
   void DrawAccountPane();
@@ -7,7 +7,10 @@
 #include <implot/implot_internal.h>
 
 
+#include <cmath>
+#include <cstdio>
 #include <string>
+#include <vector>
 
 #include "view/core/IconsMaterialDesign.h"
 #include "metatypes.h"
@@ -22,6 +25,8 @@ void OptionChainView::DrawSearch() {
   static std::string strike;
   static int current_strategy = 0;
 
+  model.pollStrategySearch(&strategies);
+
   if (ImGui::BeginTable("SearchTable", 4, ImGuiTableFlags_SizingStretchProp,
                         ImVec2(ImGui::GetContentRegionAvail().x, 0.f))) {
     ImGui::TableSetupScrollFreeze(0, 1);
@@ -40,13 +45,29 @@ void OptionChainView::DrawSearch() {
     ImGui::SetNextItemWidth(75.f);
     ImGui::Combo("##strategy", &current_strategy,
                  "SINGLE\0ANALYTICAL\0COVERED\0VERTICAL\0CALENDAR\0STRANGLE\0ST"
-                 "RADDLE\0BUTTERFLY\0CONDOR\0DIAGONAL\0COLLAR\0ROLL\0");
+                 "RADDLE\0BUTTERFLY\0IRON CONDOR\0DIAGONAL\0COLLAR\0ROLL\0");
     ImGui::TableNextColumn();
-    if (ImGui::Button(ICON_MD_QUERY_STATS,
-                      ImVec2(ImGui::GetContentRegionAvail().x, 0.f)) &&
-        !count.empty()) {
+    if (model.isSearching()) {
+      ImGui::TextDisabled(ICON_MD_HOURGLASS_EMPTY);
+    } else if (ImGui::Button(ICON_MD_QUERY_STATS,
+                             ImVec2(ImGui::GetContentRegionAvail().x, 0.f)) &&
+               !count.empty()) {
       model.fetchOptionChain(ticker, count, "SINGLE", "ALL", "ALL", "ALL");
       model.calculateGammaExposure();
+      // spreads are built locally from the single-leg chain; the others
+      // span expiries or hold stock
+      StrategyQuery query;
+      switch (current_strategy) {
+        case 3: query.kinds = {StrategyKind::kVertical}; break;
+        case 5: query.kinds = {StrategyKind::kStrangle}; break;
+        case 6: query.kinds = {StrategyKind::kStraddle}; break;
+        case 7: query.kinds = {StrategyKind::kButterfly}; break;
+        case 8: query.kinds = {StrategyKind::kIronCondor}; break;
+        default: break;
+      }
+      // the spreads show up once the search is done, see the top
+      strategies.clear();
+      if (!query.kinds.empty()) model.startStrategySearch(query);
     }
     ImGui::EndTable();
   }
@@ -280,8 +301,15 @@ void OptionChainView::DrawUnderlying() {
                     .c_str());
     ImGui::Text("Naive Gamma Exposure: $%.2f", model.getGammaExposure());
     ImGui::Text("Skew-Adjusted Gamma Exposure: N/A");
-    ImGui::Text("GEX Flip Point: N/A");
-    ImGui::Text("Distance to Flip: N/A");
+    const ExposureProfile& profile = model.getExposureProfile();
+    if (!profile.flip.empty() && std::isfinite(profile.flip[0])) {
+      ImGui::Text("GEX Flip Point: $%.2f", profile.flip[0]);
+      ImGui::Text("Distance to Flip: %.2f%%",
+                  100 * (profile.flip[0] - profile.spot) / profile.spot);
+    } else {
+      ImGui::Text("GEX Flip Point: N/A");
+      ImGui::Text("Distance to Flip: N/A");
+    }
     ImGui::TreePop();
   }
   ImGui::Separator();
@@ -366,6 +394,54 @@ void OptionChainView::DrawUnderlying() {
   ImGui::Separator();
 }
 
+void OptionChainView::DrawStrategies() {
+  static ImGuiTableFlags flags =
+      ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter |
+      ImGuiTableFlags_BordersV | ImGuiTableFlags_SizingStretchProp;
+  const OptionBatch& chain = model.getOptionBatch();
+  if (ImGui::BeginTable("StrategiesTable", 8, flags)) {
+    ImGui::TableSetupColumn("Expiration");
+    ImGui::TableSetupColumn("Legs");
+    ImGui::TableSetupColumn("Cost");
+    ImGui::TableSetupColumn("Max Gain");
+    ImGui::TableSetupColumn("Max Loss");
+    ImGui::TableSetupColumn("Breakevens");
+    ImGui::TableSetupColumn("Profit %");
+    ImGui::TableSetupColumn("Delta");
+    ImGui::TableHeadersRow();
+    for (const Strategy& strategy : strategies) {
+      ImGui::TableNextColumn();
+      ImGui::Text("%s", model.getDateTime(strategy.expiry).c_str());
+      ImGui::TableNextColumn();
+      std::string legs;
+      for (size_t i = 0; i < strategy.legCount; ++i) {
+        const StrategyLeg& leg = strategy.legs[i];
+        char text[32];
+        std::snprintf(text, sizeof text, "%+.0f %c%.0f ", leg.quantity,
+                      chain.sign[leg.contract] > 0 ? 'C' : 'P',
+                      chain.strike[leg.contract]);
+        legs += text;
+      }
+      ImGui::Text("%s", legs.c_str());
+      ImGui::TableNextColumn();
+      ImGui::Text("$%.2f", strategy.cost);
+      ImGui::TableNextColumn();
+      ImGui::Text("$%.2f", strategy.maxGain);
+      ImGui::TableNextColumn();
+      ImGui::Text("$%.2f", strategy.maxLoss);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.2f / %.2f", strategy.breakevenLow,
+                  strategy.breakevenHigh);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.1f%%", 100 * strategy.probability);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.2f", strategy.delta);
+    }
+    ImGui::EndTable();
+  }
+  ImGui::Separator();
+}
+
 std::string OptionChainView::getName() { return "Option Chain"; }
 
 void OptionChainView::addLogger(const Logger& newLogger) {
@@ -385,6 +461,7 @@ void OptionChainView::Update() {
       ImGui::TableNextColumn();
       DrawSearch();
       DrawUnderlying();
+      if (!strategies.empty()) DrawStrategies();
       DrawChain();
       ImGui::EndTable();
     }
@@ -8,6 +8,7 @@
 #include <implot/implot_internal.h>
 
 #include <string>
+#include <vector>
 
 #include "view/core/IconsMaterialDesign.h"
 #include "metatypes.h"
@@ -28,10 +29,13 @@ class OptionChainView : public View {
   EventMap events;
   Logger logger;
   OptionsModel model;
+  // ranked by the local search for the spread picked in DrawSearch()
+  std::vector<Strategy> strategies;
 
   void DrawSearch();
   void DrawChain();
   void DrawUnderlying();
+  void DrawStrategies();
 
  public:
   std::string getName() override;
@@ -0,0 +1,209 @@
+#include "BarAggregator.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace premia {
+namespace tws {
+
+namespace {
+
+// bars nobody drains are dropped oldest first past this point
+constexpr size_t kMaxFinishedBars = 4096;
+
+}  // namespace
+
+int BarAggregator::AddSeries(TickerId id, BarSpec spec) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Series series = {};
+  series.id = id;
+  series.spec = spec;
+  series.spec.size = std::max<int64_t>(spec.size, 1);
+  series.active = true;
+  series_.push_back(series);
+
+  int index = static_cast<int>(series_.size()) - 1;
+  by_ticker_[id].push_back(index);
+  return index;
+}
+
+void BarAggregator::RemoveTicker(TickerId id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = by_ticker_.find(id);
+  if (it == by_ticker_.end()) return;
+
+  for (int index : it->second) series_[index].active = false;
+  by_ticker_.erase(it);
+}
+
+void BarAggregator::SetSink(Sink sink) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sink_ = std::move(sink);
+}
+
+void BarAggregator::OnTrade(TickerId id, time_t time, double price,
+                            double size) {
+  std::vector<Closed> closed;
+  Sink sink;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = by_ticker_.find(id);
+    if (it == by_ticker_.end()) return;
+
+    for (int index : it->second) {
+      Update(index, time, price, price, price, price, size, 1, &closed);
+    }
+    if (!closed.empty()) sink = sink_;
+  }
+  Emit(sink, closed);
+}
+
+void BarAggregator::OnRealtimeBar(TickerId id, time_t time, double open,
+                                  double high, double low, double close,
+                                  double volume) {
+  std::vector<Closed> closed;
+  Sink sink;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = by_ticker_.find(id);
+    if (it == by_ticker_.end()) return;
+
+    for (int index : it->second) {
+      const BarSpec &spec = series_[index].spec;
+      if (spec.kind != kTimeBars || spec.size % 5 != 0) continue;
+      Update(index, time, open, high, low, close, volume, 0, &closed);
+    }
+    if (!closed.empty()) sink = sink_;
+  }
+  Emit(sink, closed);
+}
+
+void BarAggregator::Flush(time_t now) {
+  std::vector<Closed> closed;
+  Sink sink;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (size_t i = 0; i < series_.size(); ++i) {
+      Series &series = series_[i];
+      if (series.active && series.open && series.spec.kind == kTimeBars &&
+          now >= series.start + series.spec.size) {
+        Close(static_cast<int>(i), &closed);
+      }
+    }
+    if (!closed.empty()) sink = sink_;
+  }
+  Emit(sink, closed);
+}
+
+void BarAggregator::Update(int index, time_t time, double open, double high,
+                           double low, double close, double volume,
+                           int64_t trades, std::vector<Closed> *closed) {
+  Series &series = series_[index];
+
+  if (series.spec.kind == kTimeBars) {
+    time_t start = time - time % series.spec.size;
+    if (series.open && start > series.start) Close(index, closed);
+    if (series.open && start < series.start) return;  // late print
+    if (!series.open) series.start = start;
+  } else if (!series.open) {
+    series.start = time;
+  }
+
+  if (!series.open) {
+    series.open = true;
+    series.first = open;
+    series.high = high;
+    series.low = low;
+    series.volume = 0.0;
+    series.count = 0;
+  } else {
+    series.high = std::max(series.high, high);
+    series.low = std::min(series.low, low);
+  }
+  series.last = close;
+  series.volume += volume;
+  series.count += trades;
+
+  // the trade that crosses the threshold closes the bar, so volume bars
+  // can overshoot their size by up to one print
+  if ((series.spec.kind == kVolumeBars &&
+       series.volume >= static_cast<double>(series.spec.size)) ||
+      (series.spec.kind == kTickBars && series.count >= series.spec.size)) {
+    Close(index, closed);
+  }
+}
+
+void BarAggregator::Close(int index, std::vector<Closed> *closed) {
+  Series &series = series_[index];
+  series.open = false;
+
+  tda::Candle candle = MakeCandle(series);
+  if (sink_) closed->push_back(Closed{series.id, index, candle});
+
+  if (series.finished.size() >= kMaxFinishedBars) {
+    series.finished.erase(series.finished.begin());
+  }
+  series.finished.push_back(std::move(candle));
+}
+
+void BarAggregator::Emit(const Sink &sink, const std::vector<Closed> &closed) {
+  if (!sink) return;
+  for (const Closed &bar : closed) sink(bar.id, bar.series, bar.candle);
+}
+
+tda::Candle BarAggregator::MakeCandle(const Series &series) {
+  tda::Candle candle;
+  candle.open = series.first;
+  candle.high = series.high;
+  candle.low = series.low;
+  candle.close = series.last;
+  candle.volume = series.volume;
+  // ChartModel expects epoch milliseconds, as TDA sends them
+  candle.raw_datetime = series.start * 1000;
+
+  // the UI asks for Current() while the EReader thread closes bars, so not
+  // std::localtime and its shared buffer
+  std::tm local = {};
+  time_t start = series.start;
+#ifdef _WIN32
+  localtime_s(&local, &start);
+#else
+  localtime_r(&start, &local);
+#endif
+  std::stringstream dt_ss;
+  dt_ss << std::put_time(&local, "%a %d %b %Y - %I:%M:%S%p");
+  candle.datetime = dt_ss.str();
+  return candle;
+}
+
+size_t BarAggregator::Drain(int series, std::vector<tda::Candle> *out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (series < 0 || series >= static_cast<int>(series_.size())) return 0;
+
+  std::vector<tda::Candle> &finished = series_[series].finished;
+  size_t count = finished.size();
+  out->insert(out->end(), std::make_move_iterator(finished.begin()),
+              std::make_move_iterator(finished.end()));
+  finished.clear();
+  return count;
+}
+
+bool BarAggregator::Current(int series, tda::Candle *out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (series < 0 || series >= static_cast<int>(series_.size())) return false;
+  if (!series_[series].open) return false;
+
+  *out = MakeCandle(series_[series]);
+  return true;
+}
+
+}  // namespace tws
+}  // namespace premia
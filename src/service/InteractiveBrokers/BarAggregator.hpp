@@ -0,0 +1,96 @@
+#ifndef BarAggregator_hpp
+#define BarAggregator_hpp
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "../TDAmeritrade/Data/PricingStructures.hpp"
+#include "tws/CommonDefs.h"
+
+namespace premia {
+namespace tws {
+
+enum BarKind { kTimeBars, kVolumeBars, kTickBars };
+
+// size is seconds for time bars, shares for volume bars, trades for tick bars
+struct BarSpec {
+  BarKind kind;
+  int64_t size;
+};
+
+// Builds OHLCV bars from the tick-by-tick trade stream and from 5 second
+// realtimeBar updates. Every series registered on a tickerId is advanced in
+// constant time per trade. Finished bars come out as tda::Candle, the same
+// type ChartModel plots, both queued per series for the UI to Drain() and
+// pushed to the sink on the thread that closed them, after the lock is
+// released so the sink may call back in. Feed a tickerId from one of the
+// two sources, not both, or its volume is counted twice.
+class BarAggregator {
+ public:
+  using Sink = std::function<void(TickerId, int series, const tda::Candle &)>;
+
+  BarAggregator() = default;
+
+  // Returns a handle for Drain/Current. A tickerId may feed several series.
+  int AddSeries(TickerId id, BarSpec spec);
+  // Stops aggregating every series of a cancelled subscription.
+  void RemoveTicker(TickerId id);
+  void SetSink(Sink sink);
+
+  // tickByTickAllLast; unreported trades should not be passed in.
+  void OnTrade(TickerId id, time_t time, double price, double size);
+  // realtimeBar; only time series whose size is a multiple of 5s use these.
+  void OnRealtimeBar(TickerId id, time_t time, double open, double high,
+                     double low, double close, double volume);
+  // Closes time bars whose window ended before now, for quiet instruments.
+  void Flush(time_t now);
+
+  // Moves the bars finished since the last call into out.
+  size_t Drain(int series, std::vector<tda::Candle> *out);
+  // The bar still being built, false if none is open.
+  bool Current(int series, tda::Candle *out) const;
+
+ private:
+  struct Closed {
+    TickerId id;
+    int series;
+    tda::Candle candle;
+  };
+
+  struct Series {
+    TickerId id;
+    BarSpec spec;
+    bool active;
+    bool open;
+    time_t start;
+    double high;
+    double low;
+    double first;
+    double last;
+    double volume;
+    int64_t count;
+    std::vector<tda::Candle> finished;
+  };
+
+  // Both add the bars they close to closed, for Emit() once unlocked.
+  void Update(int index, time_t time, double open, double high, double low,
+              double close, double volume, int64_t trades,
+              std::vector<Closed> *closed);
+  void Close(int index, std::vector<Closed> *closed);
+  static void Emit(const Sink &sink, const std::vector<Closed> &closed);
+  static tda::Candle MakeCandle(const Series &series);
+
+  mutable std::mutex mutex_;
+  std::vector<Series> series_;
+  std::unordered_map<TickerId, std::vector<int>> by_ticker_;
+  Sink sink_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
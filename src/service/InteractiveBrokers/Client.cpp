@@ -12,6 +12,7 @@
 #include "Utils.hpp"
 
 #include <stdio.h>
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <thread>
@@ -31,7 +32,17 @@ Client::Client() :
 	, m_state(ST_CONNECT)
 	, m_sleepDeadline(0)
 	, m_orderId(0)
-    , m_extraAuth(false) {}
+    , m_extraAuth(false)
+    , m_runSamples(true)
+    , m_pnl(m_marketData)
+{
+	m_contracts.SetFetch([this](const Contract& contract, premia::tws::ContractCache::Done done) {
+		fetchContractDetails(contract, std::move(done));
+	});
+	m_scanners.SetMarketData(
+		[this](TickerId id, const Contract& contract) { subscribeMarketData(id, contract); },
+		[this](TickerId id) { cancelMarketData(id); });
+}
 
 //! [socket_init]
 Client::~Client()
@@ -58,6 +69,8 @@ bool Client::connect(const char *host, int port, int clientId)
         printf("Connected to TWS/IB Gateway");
 		//! [ereader]
 		m_pReader = std::unique_ptr<EReader>( new EReader(m_pClient, &m_osSignal) );
+		if (m_capture)
+			m_pReader->setCapture(m_capture.get());
 		m_pReader->start();
 		//! [ereader]
 	}
@@ -304,11 +317,216 @@ void Client::processMessages()
 			break;
 	}
 
-	m_osSignal.waitForSignal();
+	// whatever the pacer releases goes out in as few writes as possible
+	if (m_pacer.Pending() > 0) {
+		m_pClient->beginBatch();
+		m_pacer.Pump();
+		m_pClient->endBatch();
+	}
+	m_requests.Expire();
+
+	// wait for input, but not past the pacer's next release
+	auto delay = m_pacer.NextDelay();
+	if (delay < std::chrono::seconds(2)) {
+		long long ms = std::chrono::ceil<std::chrono::milliseconds>(delay).count();
+		m_osSignal.waitForSignal(static_cast<unsigned long>(std::max(ms, 1LL)));
+	} else {
+		m_osSignal.waitForSignal();
+	}
 	errno = 0;
 	m_pReader->processMsgs();
 }
 
+void Client::wake()
+{
+	m_osSignal.issueSignal();
+}
+
+void Client::setRunSamples(bool run)
+{
+	m_runSamples = run;
+}
+
+premia::tws::RequestTicket<premia::tws::HistoricalBars> Client::fetchHistoricalData(
+	const Contract& contract, const std::string& endDateTime,
+	const std::string& duration, const std::string& barSize,
+	const std::string& whatToShow, int useRTH, std::chrono::seconds timeout)
+{
+	std::string key = contract.symbol + "|" + contract.secType + "|" + contract.exchange + "|" +
+		contract.currency + "|" + std::to_string(contract.conId) + "|" + endDateTime + "|" +
+		duration + "|" + barSize + "|" + whatToShow + "|" + std::to_string(useRTH);
+
+	return m_requests.RequestHistoricalData(
+		[=](int id) {
+			bool queued = m_pacer.Submit(premia::tws::kPaceHistorical, id, key, [=]() {
+				m_pClient->reqHistoricalData(id, contract, endDateTime, duration, barSize, whatToShow, useRTH, 1, false, TagValueListSPtr());
+			});
+			if (!queued)
+				m_requests.OnError(id, 162, "identical historical data request suppressed by pacer");
+			m_osSignal.issueSignal();
+		},
+		[this](int id) {
+			if (!m_pacer.Cancel(id))
+				m_pClient->cancelHistoricalData(id);
+		},
+		timeout);
+}
+
+premia::tws::RequestTicket<premia::tws::HistoricalTicks> Client::fetchHistoricalTicks(
+	const Contract& contract, const std::string& startDateTime,
+	int numberOfTicks, const std::string& whatToShow, int useRTH,
+	std::chrono::seconds timeout)
+{
+	std::string key = contract.symbol + "|" + contract.secType + "|" + contract.exchange + "|" +
+		contract.currency + "|" + std::to_string(contract.conId) + "|ticks|" + startDateTime + "|" +
+		std::to_string(numberOfTicks) + "|" + whatToShow + "|" + std::to_string(useRTH);
+
+	return m_requests.RequestHistoricalTicks(
+		[=](int id) {
+			bool queued = m_pacer.Submit(premia::tws::kPaceHistorical, id, key, [=]() {
+				m_pClient->reqHistoricalTicks(id, contract, startDateTime, "", numberOfTicks, whatToShow, useRTH, true, TagValueListSPtr());
+			});
+			if (!queued)
+				m_requests.OnError(id, 162, "identical historical ticks request suppressed by pacer");
+			m_osSignal.issueSignal();
+		},
+		// TWS has no cancel for historical ticks, late replies are dropped
+		[this](int id) { m_pacer.Cancel(id); },
+		timeout);
+}
+
+premia::tws::RequestTicket<std::vector<ContractDetails>> Client::fetchContractDetails(
+	const Contract& contract, std::chrono::seconds timeout)
+{
+	// TWS has no cancel for contract details, late rows are dropped
+	return m_requests.RequestContractDetails(
+		[=](int id) { sendContractDetails(id, contract); },
+		[this](int id) { m_pacer.Cancel(id); },
+		timeout);
+}
+
+int Client::fetchContractDetails(const Contract& contract,
+	premia::tws::RequestRouter::ContractDetailsDone done, std::chrono::seconds timeout)
+{
+	return m_requests.RequestContractDetails(
+		[=](int id) { sendContractDetails(id, contract); },
+		[this](int id) { m_pacer.Cancel(id); },
+		timeout, std::move(done));
+}
+
+void Client::sendContractDetails(int id, const Contract& contract)
+{
+	m_pacer.Submit(premia::tws::kPaceGeneral, id, "", [=]() {
+		m_pClient->reqContractDetails(id, contract);
+	});
+	m_osSignal.issueSignal();
+}
+
+premia::tws::RequestTicket<std::vector<premia::tws::AccountSummaryRow>> Client::fetchAccountSummary(
+	const std::string& group, const std::string& tags, std::chrono::seconds timeout)
+{
+	return m_requests.RequestAccountSummary(
+		[=](int id) {
+			m_pacer.Submit(premia::tws::kPaceGeneral, id, "", [=]() {
+				m_pClient->reqAccountSummary(id, group, tags);
+			});
+			m_osSignal.issueSignal();
+		},
+		[this](int id) {
+			if (!m_pacer.Cancel(id))
+				m_pClient->cancelAccountSummary(id);
+		},
+		timeout);
+}
+
+void Client::subscribeMarketData(TickerId id, const Contract& contract, const std::string& genericTicks)
+{
+	if ((contract.secType == "OPT" || contract.secType == "FOP") && !m_options.Register(id, contract)) {
+		// the quotes still arrive, only the surface goes without this leg
+		printf( "Option surface skipped ticker %ld: full, no expiry/strike/right, or id in use\n", id);
+	}
+	if (contract.conId != 0)
+		m_pnl.WatchTicker(id, contract.conId);
+
+	m_pacer.Submit(premia::tws::kPaceGeneral, id, "", [=]() {
+		m_pClient->reqMktData(id, contract, genericTicks, false, false, TagValueListSPtr());
+	});
+	// wake processMessages() so the request does not wait out the signal timeout
+	m_osSignal.issueSignal();
+}
+
+void Client::cancelMarketData(TickerId id)
+{
+	if (!m_pacer.Cancel(id)) {
+		m_pacer.Submit(premia::tws::kPaceGeneral, -1, "", [=]() {
+			m_pClient->cancelMktData(id);
+		});
+		m_osSignal.issueSignal();
+	}
+	// clear the line for anyone watching it, then give its slot back
+	m_marketData.Reset(id);
+	m_marketData.Remove(id);
+	m_options.Unregister(id);
+}
+
+void Client::subscribePnlSingle(int reqId, const std::string& account, long conId)
+{
+	m_pnl.TrackPnlSingle(reqId, account, conId);
+	m_pacer.Submit(premia::tws::kPaceGeneral, reqId, "", [=]() {
+		m_pClient->reqPnLSingle(reqId, account, "", conId);
+	});
+	m_osSignal.issueSignal();
+}
+
+void Client::subscribeScanner(int reqId, const ScannerSubscription& subscription,
+	premia::tws::ScannerEngine::Listener listener, const TagValueListSPtr& filters)
+{
+	m_scanners.Watch(reqId, std::move(listener));
+	m_pacer.Submit(premia::tws::kPaceGeneral, reqId, "", [=]() {
+		m_pClient->reqScannerSubscription(reqId, subscription, TagValueListSPtr(), filters);
+	});
+	m_osSignal.issueSignal();
+}
+
+void Client::cancelScanner(int reqId)
+{
+	if (!m_pacer.Cancel(reqId)) {
+		m_pacer.Submit(premia::tws::kPaceGeneral, -1, "", [=]() {
+			m_pClient->cancelScannerSubscription(reqId);
+		});
+		m_osSignal.issueSignal();
+	}
+	m_scanners.Cancel(reqId);
+}
+
+bool Client::startCapture(const std::string& path)
+{
+	if (!m_pReader)
+		return false;
+
+	stopCapture();
+	std::unique_ptr<premia::tws::WireCapture> capture(new premia::tws::WireCapture());
+	if (!capture->Open(path, m_pClient->EClient::serverVersion()))
+		return false;
+
+	m_capture = std::move(capture);
+	m_pReader->setCapture(m_capture.get());
+	return true;
+}
+
+void Client::stopCapture()
+{
+	// detach first, the reader thread may be recording right now
+	if (m_pReader)
+		m_pReader->setCapture(0);
+	m_capture.reset();
+}
+
+long long Client::messageCount(int msgId) const
+{
+	return m_pReader ? m_pReader->decoder().msgCount(msgId) : 0;
+}
+
 //////////////////////////////////////////////////////////////////
 // methods
 //! [connectack]
@@ -364,6 +582,8 @@ void Client::tickDataOperation()
 {
 	/*** Requesting real time market data ***/
     std::this_thread::sleep_for(std::chrono::seconds(1));
+	// the subscriptions below go out together instead of one write each
+	m_pClient->beginBatch();
     //! [reqmktdata]
 	m_pClient->reqMktData(1001, ContractSamples::StockComboContract(), "", false, false, TagValueListSPtr());
 	m_pClient->reqMktData(1002, ContractSamples::OptionWithLocalSymbol(), "", false, false, TagValueListSPtr());
@@ -421,10 +641,12 @@ void Client::tickDataOperation()
 	//Requesting data for an ETF will return the ETF ticks
 	m_pClient->reqMktData(1017, ContractSamples::etf(), "mdoff,576,577,578,614,623", false, false, TagValueListSPtr());
 	//! [reqetfticks]
+	m_pClient->endBatch();
 
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 	/*** Canceling the market data subscription ***/
 	//! [cancelmktdata]
+	m_pClient->beginBatch();
 	m_pClient->cancelMktData(1001);
 	m_pClient->cancelMktData(1002);
 	m_pClient->cancelMktData(1003);
@@ -432,6 +654,7 @@ void Client::tickDataOperation()
 	m_pClient->cancelMktData(1015);
 	m_pClient->cancelMktData(1016);
 	m_pClient->cancelMktData(1017);
+	m_pClient->endBatch();
 	//! [cancelmktdata]
 
 	m_state = ST_TICKDATAOPERATION_ACK;
@@ -544,13 +767,22 @@ void Client::historicalDataRequests()
     timeinfo = std::localtime(&rawtime);
 	std::strftime(queryTime, 80, "%Y%m%d %H:%M:%S", timeinfo);
 
-	m_pClient->reqHistoricalData(4001, ContractSamples::EurGbpFx(), queryTime, "1 M", "1 day", "MIDPOINT", 1, 1, false, TagValueListSPtr());
-	m_pClient->reqHistoricalData(4002, ContractSamples::EuropeanStock(), queryTime, "10 D", "1 min", "TRADES", 1, 1, false, TagValueListSPtr());
+	// historical requests go through the pacer, which holds them back once the
+	// 60 per 10 minutes budget is used and drops identical repeats
+	std::string query(queryTime);
+	m_pacer.Submit(premia::tws::kPaceHistorical, 4001, "EUR.GBP|" + query + "|1 M|1 day|MIDPOINT", [this, query]() {
+		m_pClient->reqHistoricalData(4001, ContractSamples::EurGbpFx(), query, "1 M", "1 day", "MIDPOINT", 1, 1, false, TagValueListSPtr());
+	});
+	m_pacer.Submit(premia::tws::kPaceHistorical, 4002, "NOKIA|" + query + "|10 D|1 min|TRADES", [this, query]() {
+		m_pClient->reqHistoricalData(4002, ContractSamples::EuropeanStock(), query, "10 D", "1 min", "TRADES", 1, 1, false, TagValueListSPtr());
+	});
+	m_pacer.Pump();
 	//! [reqhistoricaldata]
 	std::this_thread::sleep_for(std::chrono::seconds(2));
 	/*** Canceling historical data requests ***/
-	m_pClient->cancelHistoricalData(4001);
-	m_pClient->cancelHistoricalData(4002);
+	// a request still held by the pacer never reached TWS
+	if (!m_pacer.Cancel(4001)) m_pClient->cancelHistoricalData(4001);
+	if (!m_pacer.Cancel(4002)) m_pClient->cancelHistoricalData(4002);
 
 	m_state = ST_HISTORICALDATAREQUESTS_ACK;
 }
@@ -1355,6 +1587,12 @@ void Client::nextValidId( OrderId orderId)
 	m_orderId = orderId;
 	//! [nextvalidid]
 
+	if (!m_runSamples) {
+		m_sleepDeadline = time(NULL) + SLEEP_BETWEEN_PINGS;
+		m_state = ST_IDLE;
+		return;
+	}
+
     //m_state = ST_TICKOPTIONCOMPUTATIONOPERATION; 
     //m_state = ST_TICKDATAOPERATION; 
     //m_state = ST_OPTIONSOPERATIONS;
@@ -1410,26 +1648,31 @@ void Client::currentTime( long time)
 		time_t now = ::time(NULL);
 		m_sleepDeadline = now + SLEEP_BETWEEN_PINGS;
 
-		m_state = ST_PING_ACK;
+		// wait for the next ping rather than time out on this one
+		m_state = ST_IDLE;
 	}
 }
 
 //! [error]
 void Client::error(int id, int errorCode, const std::string& errorString)
 {
+	if (m_requests.OnError(id, errorCode, errorString))
+		return;
 	printf( "Error. Id: %d, Code: %d, Msg: %s\n", id, errorCode, errorString.c_str());
 }
 //! [error]
 
 //! [tickprice]
 void Client::tickPrice( TickerId tickerId, TickType field, double price, const TickAttrib& attribs) {
-	printf( "Tick Price. Ticker Id: %ld, Field: %d, Price: %g, CanAutoExecute: %d, PastLimit: %d, PreOpen: %d\n", tickerId, (int)field, price, attribs.canAutoExecute, attribs.pastLimit, attribs.preOpen);
+	m_marketData.OnTickPrice(tickerId, field, price);
+	m_pnl.OnTickPrice(tickerId, field);
 }
 //! [tickprice]
 
 //! [ticksize]
 void Client::tickSize( TickerId tickerId, TickType field, int size) {
-	printf( "Tick Size. Ticker Id: %ld, Field: %d, Size: %d\n", tickerId, (int)field, size);
+	m_marketData.OnTickSize(tickerId, field, size);
+	m_options.OnTickSize(tickerId, field, size);
 }
 //! [ticksize]
 
@@ -1437,19 +1680,20 @@ void Client::tickSize( TickerId tickerId, TickType field, int size) {
 void Client::tickOptionComputation( TickerId tickerId, TickType tickType, int tickAttrib, double impliedVol, double delta,
                                           double optPrice, double pvDividend,
                                           double gamma, double vega, double theta, double undPrice) {
-	printf( "TickOptionComputation. Ticker Id: %ld, Type: %d, TickAttrib: %d, ImpliedVolatility: %g, Delta: %g, OptionPrice: %g, pvDividend: %g, Gamma: %g, Vega: %g, Theta: %g, Underlying Price: %g\n", tickerId, (int)tickType, tickAttrib, impliedVol, delta, optPrice, pvDividend, gamma, vega, theta, undPrice);
+	m_marketData.OnTickOptionComputation(tickerId, tickType, tickAttrib, impliedVol, delta, optPrice, pvDividend, gamma, vega, theta, undPrice);
+	m_options.OnTickOptionComputation(tickerId, tickType, impliedVol, delta, gamma, vega, theta, undPrice);
 }
 //! [tickoptioncomputation]
 
 //! [tickgeneric]
 void Client::tickGeneric(TickerId tickerId, TickType tickType, double value) {
-	printf( "Tick Generic. Ticker Id: %ld, Type: %d, Value: %g\n", tickerId, (int)tickType, value);
+	m_marketData.OnTickGeneric(tickerId, tickType, value);
 }
 //! [tickgeneric]
 
 //! [tickstring]
 void Client::tickString(TickerId tickerId, TickType tickType, const std::string& value) {
-	printf( "Tick std::string. Ticker Id: %ld, Type: %d, Value: %s\n", tickerId, (int)tickType, value.c_str());
+	m_marketData.OnTickString(tickerId, tickType, value);
 }
 //! [tickstring]
 
@@ -1484,6 +1728,8 @@ void Client::openOrderEnd() {
 void Client::winError( const std::string& str, int lastError) {}
 void Client::connectionClosed() {
 	printf( "Connection Closed\n");
+	m_pacer.Clear();
+	m_requests.FailAll(premia::tws::kRequestDisconnected, "connection closed");
 }
 
 //! [updateaccountvalue]
@@ -1497,6 +1743,7 @@ void Client::updateAccountValue(const std::string& key, const std::string& val,
 void Client::updatePortfolio(const Contract& contract, double position,
                                     double marketPrice, double marketValue, double averageCost,
                                     double unrealizedPNL, double realizedPNL, const std::string& accountName){
+	m_pnl.OnPortfolio(accountName, contract, position, marketPrice, averageCost);
 	printf("UpdatePortfolio. %s, %s @ %s: Position: %g, MarketPrice: %g, MarketValue: %g, AverageCost: %g, UnrealizedPNL: %g, RealizedPNL: %g, AccountName: %s\n", (contract.symbol).c_str(), (contract.secType).c_str(), (contract.primaryExchange).c_str(), position, marketPrice, marketValue, averageCost, unrealizedPNL, realizedPNL, accountName.c_str());
 }
 //! [updateportfolio]
@@ -1515,18 +1762,15 @@ void Client::accountDownloadEnd(const std::string& accountName) {
 
 //! [contractdetails]
 void Client::contractDetails( int reqId, const ContractDetails& contractDetails) {
-	printf( "ContractDetails begin. ReqId: %d\n", reqId);
-	printContractMsg(contractDetails.contract);
-	printContractDetailsMsg(contractDetails);
-	printf( "ContractDetails end. ReqId: %d\n", reqId);
+	m_contracts.Insert(contractDetails);
+	m_requests.OnContractDetails(reqId, contractDetails);
 }
 //! [contractdetails]
 
 //! [bondcontractdetails]
 void Client::bondContractDetails( int reqId, const ContractDetails& contractDetails) {
-	printf( "BondContractDetails begin. ReqId: %d\n", reqId);
-	printBondContractDetailsMsg(contractDetails);
-	printf( "BondContractDetails end. ReqId: %d\n", reqId);
+	m_contracts.Insert(contractDetails);
+	m_requests.OnContractDetails(reqId, contractDetails);
 }
 //! [bondcontractdetails]
 
@@ -1624,12 +1868,13 @@ void Client::printBondContractDetailsMsg(const ContractDetails& contractDetails)
 
 //! [contractdetailsend]
 void Client::contractDetailsEnd( int reqId) {
-	printf( "ContractDetailsEnd. %d\n", reqId);
+	m_requests.OnContractDetailsEnd(reqId);
 }
 //! [contractdetailsend]
 
 //! [execdetails]
 void Client::execDetails( int reqId, const Contract& contract, const Execution& execution) {
+	m_pnl.OnExecution(contract, execution);
 	printf( "ExecDetails. ReqId: %d - %s, %s, %s - %s, %ld, %g, %d\n", reqId, contract.symbol.c_str(), contract.secType.c_str(), contract.currency.c_str(), execution.execId.c_str(), execution.orderId, execution.shares, execution.lastLiquidity);
 }
 //! [execdetails]
@@ -1643,14 +1888,14 @@ void Client::execDetailsEnd( int reqId) {
 //! [updatemktdepth]
 void Client::updateMktDepth(TickerId id, int position, int operation, int side,
                                    double price, int size) {
-	printf( "UpdateMarketDepth. %ld - Position: %d, Operation: %d, Side: %d, Price: %g, Size: %d\n", id, position, operation, side, price, size);
+	m_orderBooks.OnUpdateMktDepth(id, position, operation, side, price, size);
 }
 //! [updatemktdepth]
 
 //! [updatemktdepthl2]
 void Client::updateMktDepthL2(TickerId id, int position, const std::string& marketMaker, int operation,
                                      int side, double price, int size, bool isSmartDepth) {
-	printf( "UpdateMarketDepthL2. %ld - Position: %d, Operation: %d, Side: %d, Price: %g, Size: %d, isSmartDepth: %d\n", id, position, operation, side, price, size, isSmartDepth);
+	m_orderBooks.OnUpdateMktDepthL2(id, position, marketMaker, operation, side, price, size, isSmartDepth);
 }
 //! [updatemktdepthl2]
 
@@ -1674,13 +1919,13 @@ void Client::receiveFA(faDataType pFaDataType, const std::string& cxml) {
 
 //! [historicaldata]
 void Client::historicalData(TickerId reqId, const Bar& bar) {
-	printf( "HistoricalData. ReqId: %ld - Date: %s, Open: %g, High: %g, Low: %g, Close: %g, Volume: %lld, Count: %d, WAP: %g\n", reqId, bar.time.c_str(), bar.open, bar.high, bar.low, bar.close, bar.volume, bar.count, bar.wap);
+	m_requests.OnHistoricalData(static_cast<int>(reqId), bar);
 }
 //! [historicaldata]
 
 //! [historicaldataend]
 void Client::historicalDataEnd(int reqId, const std::string& startDateStr, const std::string& endDateStr) {
-	std::cout << "HistoricalDataEnd. ReqId: " << reqId << " - Start Date: " << startDateStr << ", End Date: " << endDateStr << std::endl;	
+	m_requests.OnHistoricalDataEnd(reqId, startDateStr, endDateStr);
 }
 //! [historicaldataend]
 
@@ -1694,20 +1939,20 @@ void Client::scannerParameters(const std::string& xml) {
 void Client::scannerData(int reqId, int rank, const ContractDetails& contractDetails,
                                 const std::string& distance, const std::string& benchmark, const std::string& projection,
                                 const std::string& legsStr) {
-	printf( "ScannerData. %d - Rank: %d, Symbol: %s, SecType: %s, Currency: %s, Distance: %s, Benchmark: %s, Projection: %s, Legs std::string: %s\n", reqId, rank, contractDetails.contract.symbol.c_str(), contractDetails.contract.secType.c_str(), contractDetails.contract.currency.c_str(), distance.c_str(), benchmark.c_str(), projection.c_str(), legsStr.c_str());
+	m_scanners.OnRow(reqId, rank, contractDetails.contract, distance, benchmark, projection, legsStr);
 }
 //! [scannerdata]
 
 //! [scannerdataend]
 void Client::scannerDataEnd(int reqId) {
-	printf( "ScannerDataEnd. %d\n", reqId);
+	m_scanners.OnEnd(reqId);
 }
 //! [scannerdataend]
 
 //! [realtimebar]
 void Client::realtimeBar(TickerId reqId, long time, double open, double high, double low, double close,
                                 long volume, double wap, int count) {
-	printf( "RealTimeBars. %ld - Time: %ld, Open: %g, High: %g, Low: %g, Close: %g, Volume: %ld, Count: %d, WAP: %g\n", reqId, time, open, high, low, close, volume, count, wap);
+	m_bars.OnRealtimeBar(reqId, time, open, high, low, close, volume);
 }
 //! [realtimebar]
 
@@ -1735,12 +1980,14 @@ void Client::marketDataType(TickerId reqId, int marketDataType) {
 
 //! [commissionreport]
 void Client::commissionReport( const CommissionReport& commissionReport) {
+	m_pnl.OnCommission(commissionReport);
 	printf( "CommissionReport. %s - %g %s RPNL %g\n", commissionReport.execId.c_str(), commissionReport.commission, commissionReport.currency.c_str(), commissionReport.realizedPNL);
 }
 //! [commissionreport]
 
 //! [position]
 void Client::position( const std::string& account, const Contract& contract, double position, double avgCost) {
+	m_pnl.OnPosition(account, contract, position, avgCost);
 	printf( "Position. %s - Symbol: %s, SecType: %s, Currency: %s, Position: %g, Avg Cost: %g\n", account.c_str(), contract.symbol.c_str(), contract.secType.c_str(), contract.currency.c_str(), position, avgCost);
 }
 //! [position]
@@ -1753,13 +2000,15 @@ void Client::positionEnd() {
 
 //! [accountsummary]
 void Client::accountSummary( int reqId, const std::string& account, const std::string& tag, const std::string& value, const std::string& currency) {
-	printf( "Acct Summary. ReqId: %d, Account: %s, Tag: %s, Value: %s, Currency: %s\n", reqId, account.c_str(), tag.c_str(), value.c_str(), currency.c_str());
+	m_requests.OnAccountSummary(reqId, account, tag, value, currency);
 }
 //! [accountsummary]
 
 //! [accountsummaryend]
 void Client::accountSummaryEnd( int reqId) {
-	printf( "AccountSummaryEnd. Req Id: %d\n", reqId);
+	// a fetchAccountSummary() snapshot is done, stop the subscription
+	if (m_requests.OnAccountSummaryEnd(reqId))
+		m_pClient->cancelAccountSummary(reqId);
 }
 //! [accountsummaryend]
 
@@ -2007,12 +2256,15 @@ void Client::pnl(int reqId, double dailyPnL, double unrealizedPnL, double realiz
 
 //! [pnlsingle]
 void Client::pnlSingle(int reqId, int pos, double dailyPnL, double unrealizedPnL, double realizedPnL, double value) {
+	m_pnl.OnPnlSingle(reqId, dailyPnL);
 	printf("PnL Single. ReqId: %d, pos: %d, daily PnL: %g, unrealized PnL: %g, realized PnL: %g, value: %g\n", reqId, pos, dailyPnL, unrealizedPnL, realizedPnL, value);
 }
 //! [pnlsingle]
 
 //! [historicalticks]
 void Client::historicalTicks(int reqId, const std::vector<HistoricalTick>& ticks, bool done) {
+    if (m_requests.OnHistoricalTicks(reqId, ticks, done))
+        return;
     for (HistoricalTick tick : ticks) {
 	std::time_t t = tick.time;
         std::cout << "Historical tick. ReqId: " << reqId << ", time: " << ctime(&t) << ", price: "<< tick.price << ", size: " << tick.size << std::endl;
@@ -2022,6 +2274,8 @@ void Client::historicalTicks(int reqId, const std::vector<HistoricalTick>& ticks
 
 //! [historicalticksbidask]
 void Client::historicalTicksBidAsk(int reqId, const std::vector<HistoricalTickBidAsk>& ticks, bool done) {
+    if (m_requests.OnHistoricalTicks(reqId, ticks, done))
+        return;
     for (HistoricalTickBidAsk tick : ticks) {
 	std::time_t t = tick.time;
         std::cout << "Historical tick bid/ask. ReqId: " << reqId << ", time: " << ctime(&t) << ", price bid: "<< tick.priceBid <<
@@ -2033,6 +2287,8 @@ void Client::historicalTicksBidAsk(int reqId, const std::vector<HistoricalTickBi
 
 //! [historicaltickslast]
 void Client::historicalTicksLast(int reqId, const std::vector<HistoricalTickLast>& ticks, bool done) {
+    if (m_requests.OnHistoricalTicks(reqId, ticks, done))
+        return;
     for (HistoricalTickLast tick : ticks) {
 	std::time_t t = tick.time;
         std::cout << "Historical tick last. ReqId: " << reqId << ", time: " << ctime(&t) << ", price: "<< tick.price <<
@@ -2044,8 +2300,9 @@ void Client::historicalTicksLast(int reqId, const std::vector<HistoricalTickLast
 
 //! [tickbytickalllast]
 void Client::tickByTickAllLast(int reqId, int tickType, time_t time, double price, int size, const TickAttribLast& tickAttribLast, const std::string& exchange, const std::string& specialConditions) {
-    printf("Tick-By-Tick. ReqId: %d, TickType: %s, Time: %s, Price: %g, Size: %d, PastLimit: %d, Unreported: %d, Exchange: %s, SpecialConditions:%s\n", 
-        reqId, (tickType == 1 ? "Last" : "AllLast"), ctime(&time), price, size, tickAttribLast.pastLimit, tickAttribLast.unreported, exchange.c_str(), specialConditions.c_str());
+    // unreported prints are not part of the bar's range
+    if (!tickAttribLast.unreported)
+        m_bars.OnTrade(reqId, time, price, size);
 }
 //! [tickbytickalllast]
 
@@ -41,6 +41,17 @@
 #include "tws/EReaderOSSignal.h"
 #include "tws/EWrapper.h"
 
+#include "BarAggregator.hpp"
+#include "ContractCache.hpp"
+#include "MarketDataCache.hpp"
+#include "OptionSurface.hpp"
+#include "OrderBook.hpp"
+#include "PnlEngine.hpp"
+#include "RequestPacer.hpp"
+#include "RequestRouter.hpp"
+#include "ScannerEngine.hpp"
+#include "WireCapture.hpp"
+
 class EClientSocket;
 
 enum State {
@@ -146,8 +157,84 @@ class Client : public EWrapper {
 
   void setConnectOptions(const std::string&);
   void processMessages();
+  // makes a processMessages() waiting for input return at once
+  void wake();
+  // Whether nextValidId starts IB's sample requests, which among others
+  // replace the FA groups and profiles. On by default; off, the client
+  // only pings TWS every 30 s. Call before connect().
+  void setRunSamples(bool run);
+
+  // live top-of-book and greeks per tickerId, safe to read from any thread
+  premia::tws::MarketDataCache& marketData() { return m_marketData; }
+  // level 1 and level 2 books per reqMktDepth tickerId
+  premia::tws::OrderBookTable& orderBooks() { return m_orderBooks; }
+  // OHLCV bars built from tick-by-tick trades and realtime bars
+  premia::tws::BarAggregator& bars() { return m_bars; }
+  // rate limiter in front of m_pClient, pumped from processMessages()
+  premia::tws::RequestPacer& pacer() { return m_pacer; }
+  // reqId bookkeeping behind the fetch* calls below
+  premia::tws::RequestRouter& requests() { return m_requests; }
+  // every contract seen so far; misses are fetched with fetchContractDetails
+  premia::tws::ContractCache& contracts() { return m_contracts; }
+  // model greeks and dealer exposure of the options streamed on this client
+  premia::tws::OptionSurface& options() { return m_options; }
+  // positions and PnL per account from executions, marked from quotes
+  premia::tws::PnlEngine& pnl() { return m_pnl; }
+  // ranked scanner results; rows open market data lines while listed
+  premia::tws::ScannerEngine& scanners() { return m_scanners; }
+
+  // Paced requests whose replies arrive as futures. Call from any thread
+  // while processMessages() runs; the future throws a RequestError on a
+  // TWS error, cancellation, timeout or disconnect.
+  premia::tws::RequestTicket<premia::tws::HistoricalBars> fetchHistoricalData(
+      const Contract& contract, const std::string& endDateTime,
+      const std::string& duration, const std::string& barSize,
+      const std::string& whatToShow, int useRTH,
+      std::chrono::seconds timeout = std::chrono::seconds(120));
+  // At most numberOfTicks ticks from startDateTime on; TWS caps a request
+  // at 1000. See TickBackfill for longer ranges.
+  premia::tws::RequestTicket<premia::tws::HistoricalTicks> fetchHistoricalTicks(
+      const Contract& contract, const std::string& startDateTime,
+      int numberOfTicks, const std::string& whatToShow, int useRTH,
+      std::chrono::seconds timeout = std::chrono::seconds(180));
+  premia::tws::RequestTicket<std::vector<ContractDetails>>
+  fetchContractDetails(const Contract& contract,
+                       std::chrono::seconds timeout = std::chrono::seconds(30));
+  // done gets the rows or the error when the reply ends; returns the reqId
+  int fetchContractDetails(
+      const Contract& contract,
+      premia::tws::RequestRouter::ContractDetailsDone done,
+      std::chrono::seconds timeout = std::chrono::seconds(30));
+  premia::tws::RequestTicket<std::vector<premia::tws::AccountSummaryRow>>
+  fetchAccountSummary(const std::string& group, const std::string& tags,
+                      std::chrono::seconds timeout = std::chrono::seconds(30));
+
+  // Streaming quotes into marketData() under a caller chosen tickerId;
+  // OPT and FOP lines also feed options(), and lines with a conId mark
+  // the positions in pnl().
+  void subscribeMarketData(TickerId id, const Contract& contract,
+                           const std::string& genericTicks = "");
+  void cancelMarketData(TickerId id);
+  // IB's own daily PnL of one position, kept next to it in pnl().
+  void subscribePnlSingle(int reqId, const std::string& account, long conId);
+  // Scanner results into scanners(); listener gets the rows that entered,
+  // left or moved on each refresh.
+  void subscribeScanner(int reqId, const ScannerSubscription& subscription,
+                        premia::tws::ScannerEngine::Listener listener,
+                        const TagValueListSPtr& filters = TagValueListSPtr());
+  void cancelScanner(int reqId);
+
+  // Records every inbound message to a file WireReplay can decode again;
+  // needs a connection, since the capture header holds the server version.
+  bool startCapture(const std::string& path);
+  void stopCapture();
+  // inbound messages of one EDecoder message id decoded on this connection
+  long long messageCount(int msgId) const;
 
  private:
+  // paced reqContractDetails for a router request id
+  void sendContractDetails(int id, const Contract& contract);
+
   void pnlOperation();
   void pnlSingleOperation();
   void tickDataOperation();
@@ -212,8 +299,20 @@ class Client : public EWrapper {
 
   OrderId m_orderId;
   bool m_extraAuth;
+  bool m_runSamples;
   std::string m_bboExchange;
   std::unique_ptr<EReader> m_pReader;
+
+  premia::tws::MarketDataCache m_marketData;
+  premia::tws::OrderBookTable m_orderBooks;
+  premia::tws::BarAggregator m_bars;
+  premia::tws::RequestPacer m_pacer;
+  premia::tws::RequestRouter m_requests;
+  premia::tws::ContractCache m_contracts;
+  premia::tws::OptionSurface m_options;
+  premia::tws::PnlEngine m_pnl;
+  premia::tws::ScannerEngine m_scanners;
+  std::unique_ptr<premia::tws::WireCapture> m_capture;
 };
 
 #endif
@@ -0,0 +1,308 @@
+#include "ConnectionPool.hpp"
+
+#include <chrono>
+#include <limits>
+
+namespace premia {
+namespace tws {
+
+namespace {
+
+// above the reqIds the sample code and RequestRouter hand out
+constexpr TickerId kFirstPoolTicker = 1000000;
+
+template <typename T>
+RequestTicket<T> Unavailable() {
+  std::promise<T> promise;
+  promise.set_exception(std::make_exception_ptr(
+      RequestError(kRequestDisconnected, "no connected TWS client")));
+  return RequestTicket<T>{-1, promise.get_future()};
+}
+
+}  // namespace
+
+ConnectionPool::ConnectionPool(std::vector<Endpoint> endpoints,
+                               PoolOptions options)
+    : options_(std::move(options)),
+      running_(false),
+      next_ticker_(kFirstPoolTicker) {
+  for (Endpoint &endpoint : endpoints) {
+    auto slot = std::make_unique<Slot>();
+    slot->endpoint = std::move(endpoint);
+    slots_.push_back(std::move(slot));
+  }
+
+  contracts_.SetFetch(
+      [this](const Contract &contract, ContractCache::Done done) {
+        std::shared_ptr<Client> client = PickClient();
+        if (!client) {
+          done({}, std::make_exception_ptr(RequestError(
+                       kRequestDisconnected, "no connected TWS client")));
+          return;
+        }
+        client->fetchContractDetails(contract, std::move(done));
+      });
+}
+
+ConnectionPool::~ConnectionPool() { Stop(); }
+
+void ConnectionPool::SetTickListener(TickListener listener) {
+  listener_ = std::move(listener);
+}
+
+void ConnectionPool::Start() {
+  if (running_.exchange(true)) return;
+
+  if (!options_.contract_file.empty()) {
+    contracts_.Load(options_.contract_file);
+  }
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    slots_[i]->thread = std::thread(&ConnectionPool::Run, this,
+                                    static_cast<int>(i));
+  }
+}
+
+void ConnectionPool::Stop() {
+  if (!running_.exchange(false)) return;
+
+  std::vector<std::shared_ptr<Client>> clients;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &slot : slots_) {
+      if (slot->client) clients.push_back(slot->client);
+    }
+  }
+  stopping_.notify_all();
+  // each loop sees running_ once woken and disconnects its own client, so
+  // no socket is closed under a processMsgs() still reading it
+  for (auto &client : clients) client->wake();
+
+  for (auto &slot : slots_) {
+    if (slot->thread.joinable()) slot->thread.join();
+  }
+  if (!options_.contract_file.empty()) {
+    contracts_.Save(options_.contract_file);
+  }
+}
+
+void ConnectionPool::Run(int index) {
+  Slot &slot = *slots_[index];
+
+  while (running_) {
+    auto client = std::make_shared<Client>();
+    // the pool owns these sessions; IB's samples would rewrite FA groups
+    // and spend pacing budget on each of them
+    client->setRunSamples(false);
+    if (listener_) {
+      TickListener listener = listener_;
+      client->marketData().SetListener(
+          [listener, index](TickerId id, const TopOfBook &tob) {
+            listener(index, id, tob);
+          });
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slot.client = client;
+      ++slot.attempts;
+    }
+
+    if (client->connect(slot.endpoint.host.c_str(), slot.endpoint.port,
+                        slot.endpoint.client_id)) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot.connected = true;
+        slot.attempts = 0;
+      }
+      Resubscribe(index);
+
+      while (running_ && client->isConnected()) {
+        client->processMessages();
+      }
+      // only this thread runs the client's processMsgs()
+      if (client->isConnected()) client->disconnect();
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot.connected = false;
+      }
+      if (running_) Failover(index);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (slot.attempts >= options_.max_attempts) break;
+    stopping_.wait_for(lock, std::chrono::seconds(options_.retry_seconds),
+                       [this] { return !running_; });
+  }
+}
+
+void ConnectionPool::Resubscribe(int index) {
+  std::vector<std::pair<TickerId, Subscription>> lines;
+  std::shared_ptr<Client> client;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    client = slots_[index]->client;
+    for (const auto &entry : subscriptions_) {
+      if (entry.second.slot == index) lines.push_back(entry);
+    }
+  }
+
+  for (const auto &line : lines) {
+    client->subscribeMarketData(line.first, line.second.contract,
+                                line.second.generic_ticks);
+  }
+}
+
+void ConnectionPool::Failover(int index) {
+  std::vector<std::pair<std::shared_ptr<Client>, TickerId>> moved;
+  std::vector<Subscription> subscriptions;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : subscriptions_) {
+      if (entry.second.slot != index) continue;
+
+      int target = PickLocked(true);
+      // nowhere to go: stays put and is resent when this one reconnects
+      if (target < 0) break;
+
+      --slots_[index]->lines;
+      ++slots_[target]->lines;
+      entry.second.slot = target;
+      moved.emplace_back(slots_[target]->client, entry.first);
+      subscriptions.push_back(entry.second);
+    }
+  }
+
+  for (size_t i = 0; i < moved.size(); ++i) {
+    moved[i].first->subscribeMarketData(moved[i].second,
+                                        subscriptions[i].contract,
+                                        subscriptions[i].generic_ticks);
+  }
+}
+
+int ConnectionPool::PickLocked(bool for_lines) const {
+  int best = -1;
+  size_t best_load = std::numeric_limits<size_t>::max();
+
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    const Slot &slot = *slots_[i];
+    if (!slot.connected) continue;
+
+    size_t load;
+    if (for_lines) {
+      if (slot.lines >= options_.lines_per_connection) continue;
+      load = slot.lines;
+    } else {
+      load = slot.client->pacer().Pending();
+    }
+
+    if (load < best_load) {
+      best = static_cast<int>(i);
+      best_load = load;
+    }
+  }
+  return best;
+}
+
+std::shared_ptr<Client> ConnectionPool::PickClient() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  int index = PickLocked(false);
+  if (index < 0) return nullptr;
+  return slots_[index]->client;
+}
+
+TickerId ConnectionPool::Subscribe(const Contract &contract,
+                                   const std::string &generic_ticks) {
+  std::shared_ptr<Client> client;
+  TickerId id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    int index = PickLocked(true);
+    if (index < 0) return -1;
+
+    id = next_ticker_++;
+    subscriptions_[id] = Subscription{index, contract, generic_ticks};
+    ++slots_[index]->lines;
+    client = slots_[index]->client;
+  }
+
+  client->subscribeMarketData(id, contract, generic_ticks);
+  return id;
+}
+
+void ConnectionPool::Unsubscribe(TickerId id) {
+  std::shared_ptr<Client> client;
+  bool connected;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = subscriptions_.find(id);
+    if (it == subscriptions_.end()) return;
+
+    Slot &slot = *slots_[it->second.slot];
+    --slot.lines;
+    client = slot.client;
+    connected = slot.connected;
+    subscriptions_.erase(it);
+  }
+
+  if (connected) client->cancelMarketData(id);
+}
+
+bool ConnectionPool::Snapshot(TickerId id, TopOfBook *out) const {
+  std::shared_ptr<Client> client;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = subscriptions_.find(id);
+    if (it == subscriptions_.end()) return false;
+    client = slots_[it->second.slot]->client;
+  }
+  return client->marketData().Snapshot(id, out);
+}
+
+RequestTicket<HistoricalBars> ConnectionPool::FetchHistoricalData(
+    const Contract &contract, const std::string &end_date_time,
+    const std::string &duration, const std::string &bar_size,
+    const std::string &what_to_show, int use_rth) {
+  std::shared_ptr<Client> client = PickClient();
+  if (!client) return Unavailable<HistoricalBars>();
+
+  return client->fetchHistoricalData(contract, end_date_time, duration,
+                                     bar_size, what_to_show, use_rth);
+}
+
+RequestTicket<HistoricalTicks> ConnectionPool::FetchHistoricalTicks(
+    const Contract &contract, const std::string &start_date_time,
+    int number_of_ticks, const std::string &what_to_show, int use_rth) {
+  std::shared_ptr<Client> client = PickClient();
+  if (!client) return Unavailable<HistoricalTicks>();
+
+  return client->fetchHistoricalTicks(contract, start_date_time,
+                                      number_of_ticks, what_to_show, use_rth);
+}
+
+RequestTicket<std::vector<ContractDetails>>
+ConnectionPool::FetchContractDetails(const Contract &contract) {
+  std::shared_ptr<Client> client = PickClient();
+  if (!client) return Unavailable<std::vector<ContractDetails>>();
+
+  return client->fetchContractDetails(contract);
+}
+
+std::vector<ConnectionStatus> ConnectionPool::Status() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::vector<ConnectionStatus> status;
+  status.reserve(slots_.size());
+  for (const auto &slot : slots_) {
+    size_t pending = slot->client ? slot->client->pacer().Pending() : 0;
+    status.push_back(ConnectionStatus{slot->endpoint, slot->connected,
+                                      slot->lines, pending, slot->attempts});
+  }
+  return status;
+}
+
+}  // namespace tws
+}  // namespace premia
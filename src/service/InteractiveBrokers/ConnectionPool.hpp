@@ -0,0 +1,133 @@
+#ifndef ConnectionPool_hpp
+#define ConnectionPool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Client.hpp"
+
+namespace premia {
+namespace tws {
+
+struct Endpoint {
+  std::string host;
+  int port;
+  int client_id;
+};
+
+struct PoolOptions {
+  // TWS allows 100 concurrent market data lines per account by default;
+  // lower this if several connections share one account's allowance
+  size_t lines_per_connection = 100;
+  unsigned max_attempts = 10;
+  int retry_seconds = 5;
+  // contracts resolved through the pool persist here, empty to disable
+  std::string contract_file;
+};
+
+struct ConnectionStatus {
+  Endpoint endpoint;
+  bool connected;
+  size_t market_data_lines;
+  size_t pending_requests;
+  unsigned attempts;
+};
+
+// Keeps one Client per (host, port, clientId) connected and spreads work
+// across them.
+//
+// Each connection runs its own message loop thread and reconnects on its
+// own. Market data lines go to the connected client with the fewest lines
+// and move to another connection if theirs drops; historical and contract
+// requests go to the client with the shortest pacing queue, so the per
+// connection message and historical budgets add up. Pool tickerIds are
+// unique across connections, and every client's quotes are forwarded to one
+// tick listener tagged with the connection they came from. Only quotes are
+// merged: depth, bars and errors stay on the Client that received them.
+class ConnectionPool {
+ public:
+  using TickListener =
+      std::function<void(int connection, TickerId id, const TopOfBook &tob)>;
+
+  explicit ConnectionPool(std::vector<Endpoint> endpoints,
+                          PoolOptions options = PoolOptions());
+  ~ConnectionPool();
+
+  ConnectionPool(const ConnectionPool &) = delete;
+  ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+  // Set before Start(); it is called on the connections' threads.
+  void SetTickListener(TickListener listener);
+  void Start();
+  void Stop();
+
+  // Returns -1 if every connection is down or out of lines.
+  TickerId Subscribe(const Contract &contract,
+                     const std::string &generic_ticks = "");
+  void Unsubscribe(TickerId id);
+  bool Snapshot(TickerId id, TopOfBook *out) const;
+
+  RequestTicket<HistoricalBars> FetchHistoricalData(
+      const Contract &contract, const std::string &end_date_time,
+      const std::string &duration, const std::string &bar_size,
+      const std::string &what_to_show, int use_rth);
+  RequestTicket<HistoricalTicks> FetchHistoricalTicks(
+      const Contract &contract, const std::string &start_date_time,
+      int number_of_ticks, const std::string &what_to_show, int use_rth);
+  RequestTicket<std::vector<ContractDetails>> FetchContractDetails(
+      const Contract &contract);
+  // Shared by all connections, fetching misses through FetchContractDetails.
+  ContractCache &contracts() { return contracts_; }
+
+  size_t size() const { return slots_.size(); }
+  std::vector<ConnectionStatus> Status() const;
+
+ private:
+  struct Slot {
+    Endpoint endpoint;
+    std::shared_ptr<Client> client;
+    bool connected = false;
+    size_t lines = 0;
+    unsigned attempts = 0;
+    std::thread thread;
+  };
+
+  struct Subscription {
+    int slot;
+    Contract contract;
+    std::string generic_ticks;
+  };
+
+  void Run(int index);
+  // Sends the lines assigned to a connection that just came up.
+  void Resubscribe(int index);
+  // Moves the lines of a dropped connection to the others that have room.
+  void Failover(int index);
+  // Connected slot with the least load, -1 if none. Caller holds mutex_.
+  int PickLocked(bool for_lines) const;
+  std::shared_ptr<Client> PickClient();
+
+  PoolOptions options_;
+  TickListener listener_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable stopping_;
+  std::atomic<bool> running_;
+  std::vector<std::unique_ptr<Slot>> slots_;
+  std::unordered_map<TickerId, Subscription> subscriptions_;
+  TickerId next_ticker_;
+
+  ContractCache contracts_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
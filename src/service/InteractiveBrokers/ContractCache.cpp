@@ -0,0 +1,321 @@
+#include "ContractCache.hpp"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace premia {
+namespace tws {
+
+namespace {
+
+constexpr char kFileHeader[] = "# premia ib contracts v1";
+constexpr int kFileColumns = 15;
+
+std::string NormalizeRight(const std::string &right) {
+  if (right.empty() || right == "?") return "";
+  return std::string(1, static_cast<char>(std::toupper(right[0])));
+}
+
+// "20240119 16:00 US/Eastern" and "20240119" name the same expiry
+std::string NormalizeExpiry(const std::string &expiry) {
+  return expiry.substr(0, expiry.find(' '));
+}
+
+std::string Clean(const std::string &field) {
+  std::string out = field;
+  for (char &c : out) {
+    if (c == '\t' || c == '\n' || c == '\r') c = ' ';
+  }
+  return out;
+}
+
+}  // namespace
+
+CachedContract CachedContract::FromDetails(const ContractDetails &details) {
+  const Contract &contract = details.contract;
+
+  CachedContract cached;
+  cached.con_id = contract.conId;
+  cached.symbol = contract.symbol;
+  cached.sec_type = contract.secType;
+  cached.expiry = NormalizeExpiry(contract.lastTradeDateOrContractMonth);
+  cached.strike = contract.strike;
+  cached.right = NormalizeRight(contract.right);
+  cached.multiplier = contract.multiplier;
+  cached.exchange = contract.exchange;
+  cached.primary_exchange = contract.primaryExchange;
+  cached.currency = contract.currency;
+  cached.local_symbol = contract.localSymbol;
+  cached.trading_class = contract.tradingClass;
+  cached.min_tick = details.minTick;
+  cached.under_con_id = details.underConId;
+  cached.long_name = details.longName;
+  return cached;
+}
+
+Contract CachedContract::ToContract() const {
+  Contract contract;
+  contract.conId = con_id;
+  contract.symbol = symbol;
+  contract.secType = sec_type;
+  contract.lastTradeDateOrContractMonth = expiry;
+  contract.strike = strike;
+  contract.right = right;
+  contract.multiplier = multiplier;
+  contract.exchange = exchange;
+  contract.primaryExchange = primary_exchange;
+  contract.currency = currency;
+  contract.localSymbol = local_symbol;
+  contract.tradingClass = trading_class;
+  return contract;
+}
+
+std::string ContractCache::KeyOf(const Contract &contract) {
+  char strike[32];
+  std::snprintf(strike, sizeof(strike), "%.8g", contract.strike);
+
+  std::string key;
+  key.reserve(64);
+  key += contract.symbol;
+  key += '|';
+  key += contract.secType;
+  key += '|';
+  key += NormalizeExpiry(contract.lastTradeDateOrContractMonth);
+  key += '|';
+  key += strike;
+  key += '|';
+  key += NormalizeRight(contract.right);
+  key += '|';
+  key += contract.exchange;
+  key += '|';
+  key += contract.currency;
+  return key;
+}
+
+void ContractCache::SetFetch(Fetch fetch) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  fetch_ = std::move(fetch);
+}
+
+std::shared_future<ContractMatches> ContractCache::Resolve(
+    const Contract &contract) {
+  std::string key = KeyOf(contract);
+  Fetch fetch;
+  auto flight = std::make_shared<Flight>();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    ContractMatches hits;
+    auto con_id = by_con_id_.find(contract.conId);
+    if (contract.conId > 0 && con_id != by_con_id_.end()) {
+      hits.push_back(con_id->second);
+    } else {
+      FindLocked(key, &hits);
+    }
+
+    if (!hits.empty()) {
+      std::promise<ContractMatches> ready;
+      ready.set_value(std::move(hits));
+      return ready.get_future().share();
+    }
+
+    auto pending = in_flight_.find(key);
+    if (pending != in_flight_.end()) return pending->second->result;
+
+    if (!fetch_) {
+      std::promise<ContractMatches> none;
+      none.set_value(ContractMatches());
+      return none.get_future().share();
+    }
+
+    // registered before the request goes out, so a racing Resolve() for
+    // the same key joins this one
+    fetch = fetch_;
+    flight->result = flight->promise.get_future().share();
+    in_flight_.emplace(key, flight);
+  }
+
+  try {
+    fetch(contract, [this, key, flight](std::vector<ContractDetails> rows,
+                                        std::exception_ptr error) {
+      Complete(key, flight, std::move(rows), error);
+    });
+  } catch (...) {
+    Complete(key, flight, {}, std::current_exception());
+  }
+  return flight->result;
+}
+
+std::vector<std::shared_future<ContractMatches>> ContractCache::ResolveAll(
+    const std::vector<Contract> &contracts) {
+  std::vector<std::shared_future<ContractMatches>> results;
+  results.reserve(contracts.size());
+  for (const Contract &contract : contracts) {
+    results.push_back(Resolve(contract));
+  }
+  return results;
+}
+
+void ContractCache::Complete(const std::string &key,
+                             const std::shared_ptr<Flight> &flight,
+                             std::vector<ContractDetails> rows,
+                             std::exception_ptr error) {
+  ContractMatches matches;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto pending = in_flight_.find(key);
+    // Clear() may have dropped it, and a new fetch taken the key since
+    if (pending != in_flight_.end() && pending->second == flight) {
+      in_flight_.erase(pending);
+    }
+
+    if (!error) {
+      matches.reserve(rows.size());
+      std::vector<long> &alias = by_key_[key];
+      alias.clear();
+      for (const ContractDetails &details : rows) {
+        matches.push_back(CachedContract::FromDetails(details));
+        Store(matches.back());
+        // the requested key may be looser than the contract's own, e.g. an
+        // expiry month or a blank right
+        alias.push_back(matches.back().con_id);
+      }
+      if (alias.empty()) by_key_.erase(key);
+    }
+  }
+
+  // settled outside the lock, waiters may resolve more contracts
+  if (error) {
+    flight->promise.set_exception(error);
+  } else {
+    flight->promise.set_value(std::move(matches));
+  }
+}
+
+void ContractCache::Insert(const ContractDetails &details) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Store(CachedContract::FromDetails(details));
+}
+
+void ContractCache::Store(const CachedContract &contract) {
+  if (contract.con_id <= 0) return;
+
+  bool known = by_con_id_.count(contract.con_id) > 0;
+  by_con_id_[contract.con_id] = contract;
+  if (known) return;
+
+  std::vector<long> &ids = by_key_[KeyOf(contract.ToContract())];
+  ids.push_back(contract.con_id);
+}
+
+bool ContractCache::FindByConId(long con_id, CachedContract *out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = by_con_id_.find(con_id);
+  if (it == by_con_id_.end()) return false;
+
+  *out = it->second;
+  return true;
+}
+
+bool ContractCache::Find(const Contract &contract, ContractMatches *out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (contract.conId > 0) {
+    auto it = by_con_id_.find(contract.conId);
+    if (it == by_con_id_.end()) return false;
+    out->push_back(it->second);
+    return true;
+  }
+  return FindLocked(KeyOf(contract), out);
+}
+
+bool ContractCache::FindLocked(const std::string &key,
+                               ContractMatches *out) const {
+  auto it = by_key_.find(key);
+  if (it == by_key_.end()) return false;
+
+  size_t before = out->size();
+  for (long con_id : it->second) {
+    auto contract = by_con_id_.find(con_id);
+    if (contract != by_con_id_.end()) out->push_back(contract->second);
+  }
+  return out->size() > before;
+}
+
+size_t ContractCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return by_con_id_.size();
+}
+
+void ContractCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  by_con_id_.clear();
+  by_key_.clear();
+  in_flight_.clear();
+}
+
+bool ContractCache::Save(const std::string &path) const {
+  std::ofstream file(path, std::ios::out | std::ios::trunc);
+  if (!file) return false;
+
+  // strikes like 4012.125 need more than the default 6 digits
+  file.precision(12);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  file << kFileHeader << '\n';
+  for (const auto &entry : by_con_id_) {
+    const CachedContract &c = entry.second;
+    file << c.con_id << '\t' << Clean(c.symbol) << '\t' << Clean(c.sec_type)
+         << '\t' << Clean(c.expiry) << '\t' << c.strike << '\t'
+         << Clean(c.right) << '\t' << Clean(c.multiplier) << '\t'
+         << Clean(c.exchange) << '\t' << Clean(c.primary_exchange) << '\t'
+         << Clean(c.currency) << '\t' << Clean(c.local_symbol) << '\t'
+         << Clean(c.trading_class) << '\t' << c.min_tick << '\t'
+         << c.under_con_id << '\t' << Clean(c.long_name) << '\n';
+  }
+  return static_cast<bool>(file);
+}
+
+bool ContractCache::Load(const std::string &path) {
+  std::ifstream file(path);
+  if (!file) return false;
+
+  std::string line;
+  if (!std::getline(file, line) || line != kFileHeader) return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (std::getline(file, line)) {
+    std::vector<std::string> fields;
+    std::stringstream line_ss(line);
+    std::string field;
+    while (std::getline(line_ss, field, '\t')) fields.push_back(field);
+    if (fields.size() == kFileColumns - 1) fields.emplace_back();
+    if (fields.size() != kFileColumns) continue;
+
+    CachedContract c;
+    c.con_id = std::strtol(fields[0].c_str(), nullptr, 10);
+    c.symbol = fields[1];
+    c.sec_type = fields[2];
+    c.expiry = fields[3];
+    c.strike = std::strtod(fields[4].c_str(), nullptr);
+    c.right = fields[5];
+    c.multiplier = fields[6];
+    c.exchange = fields[7];
+    c.primary_exchange = fields[8];
+    c.currency = fields[9];
+    c.local_symbol = fields[10];
+    c.trading_class = fields[11];
+    c.min_tick = std::strtod(fields[12].c_str(), nullptr);
+    c.under_con_id = std::atoi(fields[13].c_str());
+    c.long_name = fields[14];
+    Store(c);
+  }
+  return true;
+}
+
+}  // namespace tws
+}  // namespace premia
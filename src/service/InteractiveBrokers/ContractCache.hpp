@@ -0,0 +1,112 @@
+#ifndef ContractCache_hpp
+#define ContractCache_hpp
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tws/Contract.h"
+
+namespace premia {
+namespace tws {
+
+// The part of ContractDetails needed to trade and chart a contract; small
+// enough to keep thousands of option legs resident and on disk.
+struct CachedContract {
+  long con_id = 0;
+  std::string symbol;
+  std::string sec_type;
+  std::string expiry;
+  double strike = 0.0;
+  std::string right;
+  std::string multiplier;
+  std::string exchange;
+  std::string primary_exchange;
+  std::string currency;
+  std::string local_symbol;
+  std::string trading_class;
+  double min_tick = 0.0;
+  int under_con_id = 0;
+  std::string long_name;
+
+  static CachedContract FromDetails(const ContractDetails &details);
+  // A contract that identifies this one exactly, by conId.
+  Contract ToContract() const;
+};
+
+using ContractMatches = std::vector<CachedContract>;
+
+// Resolves contracts by conId or by (symbol, secType, expiry, strike, right,
+// exchange, currency) without a TWS round trip once they have been seen.
+//
+// Every contractDetails row that reaches the client is stored, whoever asked
+// for it. Misses go to the Fetch function, one reqContractDetails each;
+// Resolve() calls for a contract already being fetched share the same
+// future instead of sending another request. The fetch settles that future
+// itself when its reply ends, whether or not anyone is waiting. The cache
+// can be saved to and loaded from a file between sessions.
+class ContractCache {
+ public:
+  // Called once, from any thread, with the reply's rows or its error.
+  using Done = std::function<void(std::vector<ContractDetails> rows,
+                                  std::exception_ptr error)>;
+  // Sends the request; must call done when it ends. The cache has to
+  // outlive the fetches it started.
+  using Fetch = std::function<void(const Contract &, Done)>;
+
+  ContractCache() = default;
+
+  void SetFetch(Fetch fetch);
+
+  // Ready immediately on a hit. A fetch failure comes out of get() as the
+  // fetch future's exception.
+  std::shared_future<ContractMatches> Resolve(const Contract &contract);
+  // Resolves a whole option ladder; misses are all requested before any of
+  // the futures is waited on.
+  std::vector<std::shared_future<ContractMatches>> ResolveAll(
+      const std::vector<Contract> &contracts);
+
+  // contractDetails / bondContractDetails
+  void Insert(const ContractDetails &details);
+  bool FindByConId(long con_id, CachedContract *out) const;
+  // Only exact key hits, never fetches.
+  bool Find(const Contract &contract, ContractMatches *out) const;
+
+  size_t size() const;
+  void Clear();
+
+  // Tab separated, one contract per line. Load merges into what is cached
+  // and returns false if the file could not be read.
+  bool Save(const std::string &path) const;
+  bool Load(const std::string &path);
+
+  static std::string KeyOf(const Contract &contract);
+
+ private:
+  void Store(const CachedContract &contract);
+  bool FindLocked(const std::string &key, ContractMatches *out) const;
+  struct Flight {
+    std::promise<ContractMatches> promise;
+    std::shared_future<ContractMatches> result;
+  };
+
+  // Runs once per fetch, on the thread that ended its reply.
+  void Complete(const std::string &key, const std::shared_ptr<Flight> &flight,
+                std::vector<ContractDetails> rows, std::exception_ptr error);
+
+  mutable std::mutex mutex_;
+  std::unordered_map<long, CachedContract> by_con_id_;
+  std::unordered_map<std::string, std::vector<long>> by_key_;
+  std::unordered_map<std::string, std::shared_ptr<Flight>> in_flight_;
+  Fetch fetch_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
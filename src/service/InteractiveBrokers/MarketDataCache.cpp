@@ -0,0 +1,266 @@
+#include "MarketDataCache.hpp"
+
+#include <cstdlib>
+
+namespace premia {
+namespace tws {
+
+MarketDataCache::MarketDataCache(size_t capacity)
+    : index_(capacity),
+      slots_(new SeqlockSlot<TopOfBook>[index_.capacity()]),
+      update_count_(0),
+      dropped_(0) {}
+
+MarketDataCache::~MarketDataCache() = default;
+
+void MarketDataCache::SetListener(Listener listener) {
+  listener_ = std::move(listener);
+}
+
+template <typename Fn>
+void MarketDataCache::Publish(TickerId id, Fn &&update) {
+  bool inserted = false;
+  int slot = index_.FindOrInsert(id, &inserted);
+  if (slot < 0) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  SeqlockSlot<TopOfBook> &entry = slots_[slot];
+  entry.Write([&](TopOfBook &tob) {
+    // a reused slot still holds the values of the id removed from it
+    if (inserted) tob = TopOfBook();
+    update(tob);
+  });
+  update_count_.fetch_add(1, std::memory_order_relaxed);
+
+  if (listener_) listener_(id, entry.data);
+}
+
+void MarketDataCache::OnTickPrice(TickerId id, TickType field, double price) {
+  double TopOfBook::*member = nullptr;
+  uint32_t bit = 0;
+  bool delayed = false;
+  switch (field) {
+    case DELAYED_BID:
+      delayed = true;
+      [[fallthrough]];
+    case BID:
+      member = &TopOfBook::bid;
+      bit = kTickBid;
+      break;
+    case DELAYED_ASK:
+      delayed = true;
+      [[fallthrough]];
+    case ASK:
+      member = &TopOfBook::ask;
+      bit = kTickAsk;
+      break;
+    case DELAYED_LAST:
+      delayed = true;
+      [[fallthrough]];
+    case LAST:
+      member = &TopOfBook::last;
+      bit = kTickLast;
+      break;
+    case DELAYED_OPEN:
+      delayed = true;
+      [[fallthrough]];
+    case OPEN:
+      member = &TopOfBook::open;
+      bit = kTickOpen;
+      break;
+    case DELAYED_HIGH:
+      delayed = true;
+      [[fallthrough]];
+    case HIGH:
+      member = &TopOfBook::high;
+      bit = kTickHigh;
+      break;
+    case DELAYED_LOW:
+      delayed = true;
+      [[fallthrough]];
+    case LOW:
+      member = &TopOfBook::low;
+      bit = kTickLow;
+      break;
+    case DELAYED_CLOSE:
+      delayed = true;
+      [[fallthrough]];
+    case CLOSE:
+      member = &TopOfBook::close;
+      bit = kTickClose;
+      break;
+    case MARK_PRICE:
+      member = &TopOfBook::mark;
+      bit = kTickMark;
+      break;
+    default:
+      return;
+  }
+
+  Publish(id, [&](TopOfBook &tob) {
+    tob.*member = price;
+    tob.delayed = delayed;
+    tob.changed = bit;
+  });
+}
+
+void MarketDataCache::OnTickSize(TickerId id, TickType field, double size) {
+  double TopOfBook::*member = nullptr;
+  uint32_t bit = 0;
+  bool delayed = false;
+  switch (field) {
+    case DELAYED_BID_SIZE:
+      delayed = true;
+      [[fallthrough]];
+    case BID_SIZE:
+      member = &TopOfBook::bid_size;
+      bit = kTickBidSize;
+      break;
+    case DELAYED_ASK_SIZE:
+      delayed = true;
+      [[fallthrough]];
+    case ASK_SIZE:
+      member = &TopOfBook::ask_size;
+      bit = kTickAskSize;
+      break;
+    case DELAYED_LAST_SIZE:
+      delayed = true;
+      [[fallthrough]];
+    case LAST_SIZE:
+      member = &TopOfBook::last_size;
+      bit = kTickLastSize;
+      break;
+    case DELAYED_VOLUME:
+      delayed = true;
+      [[fallthrough]];
+    case VOLUME:
+      member = &TopOfBook::volume;
+      bit = kTickVolume;
+      break;
+    case OPTION_CALL_OPEN_INTEREST:
+      member = &TopOfBook::call_open_interest;
+      bit = kTickOpenInterest;
+      break;
+    case OPTION_PUT_OPEN_INTEREST:
+      member = &TopOfBook::put_open_interest;
+      bit = kTickOpenInterest;
+      break;
+    case FUTURES_OPEN_INTEREST:
+      member = &TopOfBook::futures_open_interest;
+      bit = kTickOpenInterest;
+      break;
+    default:
+      return;
+  }
+
+  Publish(id, [&](TopOfBook &tob) {
+    tob.*member = size;
+    tob.delayed = delayed;
+    tob.changed = bit;
+  });
+}
+
+void MarketDataCache::OnTickGeneric(TickerId id, TickType field,
+                                    double value) {
+  if (field != HALTED && field != DELAYED_HALTED) return;
+
+  Publish(id, [&](TopOfBook &tob) {
+    tob.halted = value > 0;
+    tob.changed = kTickHalted;
+  });
+}
+
+void MarketDataCache::OnTickString(TickerId id, TickType field,
+                                   const std::string &value) {
+  if (field != LAST_TIMESTAMP && field != DELAYED_LAST_TIMESTAMP) return;
+
+  int64_t last_time = std::strtoll(value.c_str(), nullptr, 10);
+  Publish(id, [&](TopOfBook &tob) {
+    tob.last_time = last_time;
+    tob.changed = kTickLastTime;
+  });
+}
+
+void MarketDataCache::OnTickOptionComputation(
+    TickerId id, TickType field, int tick_attrib, double implied_vol,
+    double delta, double opt_price, double pv_dividend, double gamma,
+    double vega, double theta, double und_price) {
+  GreeksSource source;
+  switch (field) {
+    case BID_OPTION_COMPUTATION:
+    case DELAYED_BID_OPTION_COMPUTATION:
+      source = kGreeksBid;
+      break;
+    case ASK_OPTION_COMPUTATION:
+    case DELAYED_ASK_OPTION_COMPUTATION:
+      source = kGreeksAsk;
+      break;
+    case LAST_OPTION_COMPUTATION:
+    case DELAYED_LAST_OPTION_COMPUTATION:
+      source = kGreeksLast;
+      break;
+    case MODEL_OPTION:
+    case DELAYED_MODEL_OPTION_COMPUTATION:
+      source = kGreeksModel;
+      break;
+    default:
+      return;
+  }
+
+  Publish(id, [&](TopOfBook &tob) {
+    OptionGreeks &greeks = tob.greeks[source];
+    greeks.implied_vol = implied_vol;
+    greeks.delta = delta;
+    greeks.opt_price = opt_price;
+    greeks.pv_dividend = pv_dividend;
+    greeks.gamma = gamma;
+    greeks.vega = vega;
+    greeks.theta = theta;
+    greeks.und_price = und_price;
+    greeks.tick_attrib = tick_attrib;
+    tob.changed = kTickGreeks;
+  });
+}
+
+void MarketDataCache::Reset(TickerId id) {
+  if (index_.Find(id) < 0) return;
+
+  Publish(id, [](TopOfBook &tob) {
+    tob = TopOfBook();
+    tob.changed = ~0u;
+  });
+}
+
+void MarketDataCache::Remove(TickerId id) { index_.Remove(id); }
+
+bool MarketDataCache::Snapshot(TickerId id, TopOfBook *out,
+                               uint64_t *version) const {
+  int slot = index_.Find(id);
+  if (slot < 0) return false;
+
+  return slots_[slot].Read([out](const TopOfBook &tob) { *out = tob; },
+                           version);
+}
+
+bool MarketDataCache::SnapshotIfChanged(TickerId id, uint64_t *last_version,
+                                        TopOfBook *out) const {
+  int slot = index_.Find(id);
+  if (slot < 0) return false;
+  if (slots_[slot].version() == *last_version) return false;
+
+  return slots_[slot].Read([out](const TopOfBook &tob) { *out = tob; },
+                           last_version);
+}
+
+uint64_t MarketDataCache::UpdateCount() const {
+  return update_count_.load(std::memory_order_relaxed);
+}
+
+uint64_t MarketDataCache::DroppedTicks() const {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+}  // namespace tws
+}  // namespace premia
@@ -0,0 +1,149 @@
+#ifndef MarketDataCache_hpp
+#define MarketDataCache_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "TickerTable.hpp"
+#include "tws/EWrapper.h"
+
+namespace premia {
+namespace tws {
+
+// Bits set in TopOfBook::changed for the fields touched by the last update.
+enum TickField : uint32_t {
+  kTickBid = 1u << 0,
+  kTickAsk = 1u << 1,
+  kTickLast = 1u << 2,
+  kTickBidSize = 1u << 3,
+  kTickAskSize = 1u << 4,
+  kTickLastSize = 1u << 5,
+  kTickVolume = 1u << 6,
+  kTickOpen = 1u << 7,
+  kTickHigh = 1u << 8,
+  kTickLow = 1u << 9,
+  kTickClose = 1u << 10,
+  kTickMark = 1u << 11,
+  kTickOpenInterest = 1u << 12,
+  kTickLastTime = 1u << 13,
+  kTickHalted = 1u << 14,
+  kTickGreeks = 1u << 15,
+};
+
+// Index into TopOfBook::greeks, one set per option computation tick type.
+enum GreeksSource { kGreeksBid, kGreeksAsk, kGreeksLast, kGreeksModel, kGreeksCount };
+
+struct OptionGreeks {
+  double implied_vol = 0.0;
+  double delta = 0.0;
+  double opt_price = 0.0;
+  double pv_dividend = 0.0;
+  double gamma = 0.0;
+  double vega = 0.0;
+  double theta = 0.0;
+  double und_price = 0.0;
+  int tick_attrib = 0;
+};
+
+struct TopOfBook {
+  double bid = 0.0;
+  double ask = 0.0;
+  double last = 0.0;
+  double bid_size = 0.0;
+  double ask_size = 0.0;
+  double last_size = 0.0;
+  double volume = 0.0;
+  double open = 0.0;
+  double high = 0.0;
+  double low = 0.0;
+  double close = 0.0;
+  double mark = 0.0;
+  // an option contract line gets both call and put ticks for its
+  // underlying, so each kind keeps its own field
+  double call_open_interest = 0.0;
+  double put_open_interest = 0.0;
+  double futures_open_interest = 0.0;
+  int64_t last_time = 0;
+  bool halted = false;
+  bool delayed = false;
+  uint32_t changed = 0;
+  OptionGreeks greeks[kGreeksCount];
+};
+
+// Per-tickerId quote and greeks table fed from the EWrapper tick callbacks.
+//
+// Slots live in a fixed open-addressed array so that lookups never allocate
+// or lock. Each slot is published through a seqlock: the EReader thread is
+// the only writer for a given tickerId, and any number of UI or analytics
+// threads can copy a consistent TopOfBook out of it without blocking it.
+class MarketDataCache {
+ public:
+  using Listener = std::function<void(TickerId, const TopOfBook &)>;
+
+  // capacity is rounded up to a power of two and is the maximum number of
+  // tickerIds the cache holds at once; Remove() gives a slot back.
+  explicit MarketDataCache(size_t capacity = 4096);
+  ~MarketDataCache();
+
+  MarketDataCache(const MarketDataCache &) = delete;
+  MarketDataCache &operator=(const MarketDataCache &) = delete;
+
+  // Called on the writer thread after every published update. Set it before
+  // market data starts flowing.
+  void SetListener(Listener listener);
+
+  // Writer side, mirrors the EWrapper callbacks.
+  void OnTickPrice(TickerId id, TickType field, double price);
+  void OnTickSize(TickerId id, TickType field, double size);
+  void OnTickGeneric(TickerId id, TickType field, double value);
+  void OnTickString(TickerId id, TickType field, const std::string &value);
+  void OnTickOptionComputation(TickerId id, TickType field, int tick_attrib,
+                               double implied_vol, double delta,
+                               double opt_price, double pv_dividend,
+                               double gamma, double vega, double theta,
+                               double und_price);
+
+  // Drops the cached values of a cancelled subscription, keeping its slot.
+  void Reset(TickerId id);
+
+  // Frees the slot of a cancelled subscription for another tickerId. A tick
+  // still in flight for the id afterwards claims a slot again, starting
+  // from an empty TopOfBook. Call it on the writer thread.
+  void Remove(TickerId id);
+
+  // Reader side. Returns false if nothing was ever received for the id.
+  // version, when given, receives the slot sequence of the copy; it only
+  // grows, so comparing it against a previous value detects changes.
+  bool Snapshot(TickerId id, TopOfBook *out, uint64_t *version = nullptr) const;
+
+  // Copies the slot only if it moved past last_version, updating it.
+  bool SnapshotIfChanged(TickerId id, uint64_t *last_version,
+                         TopOfBook *out) const;
+
+  // Total number of updates published, a cheap "anything new?" check.
+  uint64_t UpdateCount() const;
+
+  // Ticks thrown away because every slot was taken.
+  uint64_t DroppedTicks() const;
+
+  size_t capacity() const { return index_.capacity(); }
+
+ private:
+  template <typename Fn>
+  void Publish(TickerId id, Fn &&update);
+
+  TickerIndex index_;
+  std::unique_ptr<SeqlockSlot<TopOfBook>[]> slots_;
+  std::atomic<uint64_t> update_count_;
+  std::atomic<uint64_t> dropped_;
+  Listener listener_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
@@ -0,0 +1,421 @@
+#include "MockServer.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "tws/EClient.h"
+#include "tws/EDecoder.h"
+
+namespace premia {
+namespace tws {
+
+namespace {
+
+using ibapi::client_constants::REQ_CURRENT_TIME;
+using ibapi::client_constants::REQ_IDS;
+using ibapi::client_constants::START_API;
+
+constexpr int kVersionNextValidId = 1;
+constexpr int kVersionManagedAccounts = 1;
+constexpr int kVersionCurrentTime = 1;
+constexpr int kVersionTickPrice = 6;
+constexpr int kVersionTickSize = 6;
+constexpr int kVersionTickString = 6;
+constexpr int kVersionMarketDepth = 1;
+constexpr int kVersionContractDataEnd = 1;
+constexpr int kVersionError = 2;
+constexpr int kVersionHistoricalData = 3;
+
+bool ReadAll(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = ::recv(fd, data, size, 0);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) continue;
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// One length-prefixed message, as EClient frames them after the handshake.
+bool ReadFrame(int fd, std::string *payload) {
+  unsigned char header[HEADER_LEN];
+  if (!ReadAll(fd, reinterpret_cast<char *>(header), sizeof(header))) {
+    return false;
+  }
+
+  uint32_t size = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) |
+                  (uint32_t(header[2]) << 8) | uint32_t(header[3]);
+  if (size > static_cast<uint32_t>(MAX_MSG_LEN)) return false;
+
+  payload->resize(size);
+  return size == 0 || ReadAll(fd, &(*payload)[0], size);
+}
+
+MockTwsServer::Fields Split(const std::string &payload) {
+  MockTwsServer::Fields fields;
+  size_t start = 0;
+  while (start < payload.size()) {
+    size_t end = payload.find('\0', start);
+    if (end == std::string::npos) end = payload.size();
+    fields.push_back(payload.substr(start, end - start));
+    start = end + 1;
+  }
+  return fields;
+}
+
+std::string Field(int value) { return std::to_string(value); }
+std::string Field(long value) { return std::to_string(value); }
+
+std::string Field(double value) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.10g", value);
+  return buffer;
+}
+
+}  // namespace
+
+MockTwsServer::MockTwsServer() : MockTwsServer(Options()) {}
+
+MockTwsServer::MockTwsServer(Options options)
+    : options_(std::move(options)),
+      listen_fd_(-1),
+      port_(0),
+      client_fd_(-1),
+      version_(0),
+      running_(false),
+      api_started_(false) {
+  OnRequest(START_API, [](MockTwsServer &server, const Fields &) {
+    server.Send({Field(NEXT_VALID_ID), Field(kVersionNextValidId),
+                 Field(static_cast<long>(server.options_.next_order_id))});
+    server.Send({Field(MANAGED_ACCTS), Field(kVersionManagedAccounts),
+                 server.options_.accounts});
+  });
+  OnRequest(REQ_IDS, [](MockTwsServer &server, const Fields &) {
+    server.Send({Field(NEXT_VALID_ID), Field(kVersionNextValidId),
+                 Field(static_cast<long>(server.options_.next_order_id))});
+  });
+  OnRequest(REQ_CURRENT_TIME, [](MockTwsServer &server, const Fields &) {
+    server.Send({Field(CURRENT_TIME), Field(kVersionCurrentTime),
+                 Field(static_cast<long>(std::time(nullptr)))});
+  });
+}
+
+MockTwsServer::~MockTwsServer() { Stop(); }
+
+bool MockTwsServer::Start() {
+  if (running_) return true;
+
+  listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) return false;
+
+  int reuse = 1;
+  ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(static_cast<uint16_t>(options_.port));
+
+  socklen_t length = sizeof(addr);
+  if (::bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), length) < 0 ||
+      ::listen(listen_fd_, 4) < 0 ||
+      ::getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&addr),
+                    &length) < 0) {
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+
+  port_ = ntohs(addr.sin_port);
+  running_ = true;
+  thread_ = std::thread(&MockTwsServer::Serve, this);
+  return true;
+}
+
+void MockTwsServer::Stop() {
+  if (!running_.exchange(false)) return;
+
+  // shutdown() wakes the server thread out of accept() and recv()
+  ::shutdown(listen_fd_, SHUT_RDWR);
+  DropClient();
+  if (thread_.joinable()) thread_.join();
+
+  ::close(listen_fd_);
+  listen_fd_ = -1;
+}
+
+void MockTwsServer::Serve() {
+  while (running_) {
+    int fd = ::accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    int no_delay = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    if (!Handshake(fd)) {
+      ::close(fd);
+      continue;
+    }
+    client_fd_ = fd;
+
+    std::string payload;
+    while (running_ && ReadFrame(fd, &payload)) {
+      Dispatch(Split(payload));
+    }
+
+    // DropClient() may have closed it already
+    int expected = fd;
+    if (client_fd_.compare_exchange_strong(expected, -1)) ::close(fd);
+    std::lock_guard<std::mutex> lock(mutex_);
+    api_started_ = false;
+  }
+}
+
+bool MockTwsServer::Handshake(int fd) {
+  char sign[sizeof(API_SIGN)];
+  if (!ReadAll(fd, sign, sizeof(sign)) ||
+      std::memcmp(sign, API_SIGN, sizeof(sign)) != 0) {
+    return false;
+  }
+
+  // "v100..157" followed by optional connect options
+  std::string offer;
+  if (!ReadFrame(fd, &offer) || offer.empty() || offer[0] != 'v') {
+    return false;
+  }
+
+  int low = std::atoi(offer.c_str() + 1);
+  size_t dots = offer.find("..");
+  int high = dots == std::string::npos ? low
+                                       : std::atoi(offer.c_str() + dots + 2);
+
+  int version = options_.server_version > 0 ? options_.server_version : high;
+  if (version < low || version > high) return false;
+  version_ = version;
+
+  char now[32];
+  std::time_t t = std::time(nullptr);
+  std::strftime(now, sizeof(now), "%Y%m%d %H:%M:%S", std::localtime(&t));
+
+  std::string ack = Frame({Field(version), now});
+  return ::send(fd, ack.data(), ack.size(), MSG_NOSIGNAL) ==
+         static_cast<ssize_t>(ack.size());
+}
+
+void MockTwsServer::Dispatch(const Fields &request) {
+  if (request.empty()) return;
+
+  int msg_id = std::atoi(request[0].c_str());
+  Handler handler;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++counts_[msg_id];
+    last_[msg_id] = request;
+
+    auto it = handlers_.find(msg_id);
+    if (it != handlers_.end()) handler = it->second;
+  }
+
+  if (handler) handler(*this, request);
+
+  if (msg_id == START_API) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    api_started_ = true;
+    ready_.notify_all();
+  }
+}
+
+bool MockTwsServer::WaitForClient(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return ready_.wait_for(lock, timeout, [this] { return api_started_; });
+}
+
+void MockTwsServer::OnRequest(int msg_id, Handler handler) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  handlers_[msg_id] = std::move(handler);
+}
+
+size_t MockTwsServer::RequestCount(int msg_id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = counts_.find(msg_id);
+  return it == counts_.end() ? 0 : it->second;
+}
+
+MockTwsServer::Fields MockTwsServer::LastRequest(int msg_id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = last_.find(msg_id);
+  return it == last_.end() ? Fields() : it->second;
+}
+
+bool MockTwsServer::Send(const Fields &fields) {
+  std::string frame = Frame(fields);
+  return WriteAll(frame.data(), frame.size());
+}
+
+size_t MockTwsServer::Stream(const std::vector<Fields> &messages,
+                             double messages_per_second, size_t repeat) {
+  using Clock = std::chrono::steady_clock;
+
+  std::vector<std::string> frames;
+  frames.reserve(messages.size());
+  for (const Fields &fields : messages) frames.push_back(Frame(fields));
+
+  auto interval = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(
+          messages_per_second > 0.0 ? 1.0 / messages_per_second : 0.0));
+  Clock::time_point next = Clock::now();
+
+  size_t sent = 0;
+  for (size_t round = 0; round < repeat; ++round) {
+    for (const std::string &frame : frames) {
+      if (interval.count() > 0) {
+        std::this_thread::sleep_until(next);
+        next += interval;
+      }
+      if (!WriteAll(frame.data(), frame.size())) return sent;
+      ++sent;
+    }
+  }
+  return sent;
+}
+
+bool MockTwsServer::SendRaw(const std::string &bytes) {
+  return WriteAll(bytes.data(), bytes.size());
+}
+
+void MockTwsServer::DropClient() {
+  int fd = client_fd_.exchange(-1);
+  if (fd < 0) return;
+
+  ::shutdown(fd, SHUT_RDWR);
+  ::close(fd);
+}
+
+bool MockTwsServer::WriteAll(const char *data, size_t size) {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+
+  int fd = client_fd_;
+  if (fd < 0) return false;
+
+  while (size > 0) {
+    ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+MockTwsServer::Fields MockTwsServer::TickPrice(TickerId id, int tick_type,
+                                               double price, int size) const {
+  return {Field(TICK_PRICE), Field(kVersionTickPrice), Field(id),
+          Field(tick_type), Field(price), Field(size), "0"};
+}
+
+MockTwsServer::Fields MockTwsServer::TickSize(TickerId id, int tick_type,
+                                              int size) const {
+  return {Field(TICK_SIZE), Field(kVersionTickSize), Field(id),
+          Field(tick_type), Field(size)};
+}
+
+MockTwsServer::Fields MockTwsServer::TickString(
+    TickerId id, int tick_type, const std::string &value) const {
+  return {Field(TICK_STRING), Field(kVersionTickString), Field(id),
+          Field(tick_type), value};
+}
+
+MockTwsServer::Fields MockTwsServer::MarketDepth(TickerId id, int position,
+                                                 int operation, int side,
+                                                 double price,
+                                                 int size) const {
+  return {Field(MARKET_DEPTH), Field(kVersionMarketDepth), Field(id),
+          Field(position), Field(operation), Field(side), Field(price),
+          Field(size)};
+}
+
+MockTwsServer::Fields MockTwsServer::MarketDepthL2(
+    TickerId id, int position, const std::string &market_maker,
+    int operation, int side, double price, int size) const {
+  Fields fields = {Field(MARKET_DEPTH_L2), Field(kVersionMarketDepth),
+                   Field(id),           Field(position),
+                   market_maker,        Field(operation),
+                   Field(side),         Field(price),
+                   Field(size)};
+  if (version_ >= MIN_SERVER_VER_SMART_DEPTH) fields.push_back("0");
+  return fields;
+}
+
+MockTwsServer::Fields MockTwsServer::HistoricalData(
+    int req_id, const std::string &start, const std::string &end,
+    const std::vector<Bar> &bars) const {
+  bool synthetic = version_ >= MIN_SERVER_VER_SYNT_REALTIME_BARS;
+
+  Fields fields = {Field(HISTORICAL_DATA)};
+  if (!synthetic) fields.push_back(Field(kVersionHistoricalData));
+  fields.push_back(Field(req_id));
+  fields.push_back(start);
+  fields.push_back(end);
+  fields.push_back(Field(static_cast<int>(bars.size())));
+
+  for (const Bar &bar : bars) {
+    fields.push_back(bar.time);
+    fields.push_back(Field(bar.open));
+    fields.push_back(Field(bar.high));
+    fields.push_back(Field(bar.low));
+    fields.push_back(Field(bar.close));
+    fields.push_back(std::to_string(bar.volume));
+    fields.push_back(Field(bar.wap));
+    if (!synthetic) fields.push_back("false");
+    fields.push_back(Field(bar.count));
+  }
+  return fields;
+}
+
+MockTwsServer::Fields MockTwsServer::ContractDataEnd(int req_id) const {
+  return {Field(CONTRACT_DATA_END), Field(kVersionContractDataEnd),
+          Field(req_id)};
+}
+
+MockTwsServer::Fields MockTwsServer::Error(int id, int code,
+                                           const std::string &message) const {
+  return {Field(ERR_MSG), Field(kVersionError), Field(id), Field(code),
+          message};
+}
+
+std::string MockTwsServer::Frame(const Fields &fields) {
+  std::string frame(HEADER_LEN, '\0');
+  for (const std::string &field : fields) {
+    frame += field;
+    frame += '\0';
+  }
+
+  uint32_t size = static_cast<uint32_t>(frame.size() - HEADER_LEN);
+  frame[0] = static_cast<char>((size >> 24) & 0xFF);
+  frame[1] = static_cast<char>((size >> 16) & 0xFF);
+  frame[2] = static_cast<char>((size >> 8) & 0xFF);
+  frame[3] = static_cast<char>(size & 0xFF);
+  return frame;
+}
+
+}  // namespace tws
+}  // namespace premia
@@ -0,0 +1,121 @@
+#ifndef MockServer_hpp
+#define MockServer_hpp
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tws/CommonDefs.h"
+#include "tws/bar.h"
+
+namespace premia {
+namespace tws {
+
+// A stand-in for TWS on the loopback interface, for tests and benchmarks.
+//
+// It accepts one client at a time, answers the V100+ handshake with its
+// configured server version and replies to startApi, reqIds and
+// reqCurrentTime the way TWS does. Anything else the client sends is
+// recorded and handed to the handler registered for its message id, which
+// can script a reply. Tick, depth and historical messages can also be
+// pushed unprompted, paced to a target rate, or replayed byte for byte
+// from a capture. POSIX sockets only.
+class MockTwsServer {
+ public:
+  using Fields = std::vector<std::string>;
+  // Runs on the server thread for each decoded client request.
+  using Handler = std::function<void(MockTwsServer &, const Fields &)>;
+
+  struct Options {
+    // 0 picks a free port, see port()
+    int port = 0;
+    // 0 answers with the newest version the client offers
+    int server_version = 0;
+    std::string accounts = "DU0000001";
+    OrderId next_order_id = 1;
+  };
+
+  MockTwsServer();
+  explicit MockTwsServer(Options options);
+  ~MockTwsServer();
+
+  MockTwsServer(const MockTwsServer &) = delete;
+  MockTwsServer &operator=(const MockTwsServer &) = delete;
+
+  // Binds 127.0.0.1 and starts accepting; false if the port is taken.
+  bool Start();
+  void Stop();
+  int port() const { return port_; }
+
+  // Blocks until a client finished the handshake and sent startApi.
+  bool WaitForClient(std::chrono::milliseconds timeout);
+  // Server version agreed with the connected client.
+  int version() const { return version_; }
+
+  void OnRequest(int msg_id, Handler handler);
+  // How many requests with this message id the client has sent.
+  size_t RequestCount(int msg_id) const;
+  // Fields of the last request with this message id, empty if none.
+  Fields LastRequest(int msg_id) const;
+
+  // Frames and writes one message; false once the client is gone.
+  bool Send(const Fields &fields);
+  // Sends messages in order, messages_per_second apart (0 for no pacing),
+  // repeated `repeat` times. Returns how many were written.
+  size_t Stream(const std::vector<Fields> &messages,
+                double messages_per_second = 0.0, size_t repeat = 1);
+  // Writes already framed bytes, e.g. a wire capture.
+  bool SendRaw(const std::string &bytes);
+  // Closes the client connection, as TWS does on a fatal error.
+  void DropClient();
+
+  // Messages at the layout this server's version implies.
+  Fields TickPrice(TickerId id, int tick_type, double price, int size) const;
+  Fields TickSize(TickerId id, int tick_type, int size) const;
+  Fields TickString(TickerId id, int tick_type, const std::string &value) const;
+  Fields MarketDepth(TickerId id, int position, int operation, int side,
+                     double price, int size) const;
+  Fields MarketDepthL2(TickerId id, int position,
+                       const std::string &market_maker, int operation,
+                       int side, double price, int size) const;
+  Fields HistoricalData(int req_id, const std::string &start,
+                        const std::string &end,
+                        const std::vector<Bar> &bars) const;
+  Fields ContractDataEnd(int req_id) const;
+  Fields Error(int id, int code, const std::string &message) const;
+
+  static std::string Frame(const Fields &fields);
+
+ private:
+  void Serve();
+  bool Handshake(int fd);
+  void Dispatch(const Fields &request);
+  bool WriteAll(const char *data, size_t size);
+
+  Options options_;
+  int listen_fd_;
+  int port_;
+  std::atomic<int> client_fd_;
+  std::atomic<int> version_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+
+  std::mutex write_mutex_;
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+  bool api_started_;
+  std::map<int, Handler> handlers_;
+  std::map<int, size_t> counts_;
+  std::map<int, Fields> last_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
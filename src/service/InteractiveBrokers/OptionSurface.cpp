@@ -0,0 +1,551 @@
+#include "OptionSurface.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+namespace premia {
+namespace tws {
+
+namespace {
+
+constexpr double kSecondsPerYear = 365.0 * 24 * 3600;
+// vanna blows up at expiry; treat the last hour as one hour out
+constexpr double kMinYears = 3600.0 / kSecondsPerYear;
+constexpr double kInvSqrt2Pi = 0.3989422804014327;
+
+// days since 1970-01-01 of a proleptic Gregorian date
+int64_t DaysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  const int64_t era = (y >= 0 ? y : y - 399) / 400;
+  const int64_t yoe = y - era * 400;
+  const int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+// US equity options stop trading at 16:00 New York, about 20:00 UTC
+double ExpiryTime(int expiry) {
+  int64_t days = DaysFromCivil(expiry / 10000, expiry / 100 % 100,
+                               expiry % 100);
+  return days * 86400.0 + 20 * 3600.0;
+}
+
+double NowSeconds() {
+  return std::chrono::duration<double>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+bool Valid(double value) { return value != DBL_MAX && std::isfinite(value); }
+
+std::unique_ptr<double[]> Column(size_t size) {
+  return std::unique_ptr<double[]>(new double[size]());
+}
+
+}  // namespace
+
+OptionSurface::OptionSurface(size_t capacity)
+    : index_(capacity), rows_(0), live_(0), buckets_(0), seq_(0) {
+  capacity_ = index_.capacity();
+
+  row_of_slot_.reset(new std::atomic<int>[capacity_]);
+  for (size_t i = 0; i < capacity_; ++i) {
+    row_of_slot_[i].store(-1, std::memory_order_relaxed);
+  }
+
+  row_id_.reset(new TickerId[capacity_]());
+  row_bucket_.reset(new int[capacity_]());
+  row_call_.reset(new bool[capacity_]());
+  row_live_.reset(new bool[capacity_]());
+  row_multiplier_ = Column(capacity_);
+  row_expiry_time_ = Column(capacity_);
+  iv_ = Column(capacity_);
+  delta_ = Column(capacity_);
+  gamma_ = Column(capacity_);
+  vega_ = Column(capacity_);
+  theta_ = Column(capacity_);
+  und_ = Column(capacity_);
+  oi_ = Column(capacity_);
+  gex_ = Column(capacity_);
+  vanna_ = Column(capacity_);
+
+  bucket_underlying_.reset(new int[capacity_]());
+  bucket_expiry_.reset(new int[capacity_]());
+  bucket_strike_ = Column(capacity_);
+  call_gamma_ = Column(capacity_);
+  put_gamma_ = Column(capacity_);
+  net_vanna_ = Column(capacity_);
+  call_iv_ = Column(capacity_);
+  put_iv_ = Column(capacity_);
+  call_oi_ = Column(capacity_);
+  put_oi_ = Column(capacity_);
+  spot_ = Column(capacity_);
+}
+
+OptionSurface::~OptionSurface() = default;
+
+int OptionSurface::ParseExpiry(const std::string &expiry) {
+  if (expiry.size() < 8) return 0;
+  for (size_t i = 0; i < 8; ++i) {
+    if (expiry[i] < '0' || expiry[i] > '9') return 0;
+  }
+  int value = std::atoi(expiry.substr(0, 8).c_str());
+  int month = value / 100 % 100;
+  int day = value % 100;
+  if (month < 1 || month > 12 || day < 1 || day > 31) return 0;
+  return value;
+}
+
+bool OptionSurface::Register(TickerId id, const Contract &contract) {
+  int expiry = ParseExpiry(contract.lastTradeDateOrContractMonth);
+  if (expiry == 0 || contract.strike <= 0.0 || contract.right.empty()) {
+    return false;
+  }
+  char right = contract.right[0];
+  if (right != 'C' && right != 'c' && right != 'P' && right != 'p') {
+    return false;
+  }
+
+  double multiplier = std::atof(contract.multiplier.c_str());
+  return Register(id, contract.symbol, expiry, contract.strike,
+                  right == 'C' || right == 'c',
+                  multiplier > 0.0 ? multiplier : 100.0);
+}
+
+bool OptionSurface::Register(TickerId id, const std::string &underlying,
+                             int expiry, double strike, bool call,
+                             double multiplier) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto found = underlyings_.find(underlying);
+  int u;
+  if (found != underlyings_.end()) {
+    u = found->second;
+  } else {
+    if (underlying_names_.size() >= capacity_) return false;
+    u = static_cast<int>(underlying_names_.size());
+    underlyings_.emplace(underlying, u);
+    underlying_names_.push_back(underlying);
+  }
+
+  BucketKey key(u, expiry, strike);
+  int existing = RowOf(id);
+  if (existing >= 0) {
+    auto same = bucket_of_.find(key);
+    return same != bucket_of_.end() &&
+           same->second == row_bucket_[existing] &&
+           row_call_[existing] == call;
+  }
+
+  size_t fresh = rows_.load(std::memory_order_relaxed);
+  if (free_rows_.empty() && fresh >= capacity_) return false;
+
+  auto bucket = bucket_of_.find(key);
+  int b;
+  if (bucket != bucket_of_.end()) {
+    b = bucket->second;
+  } else {
+    b = static_cast<int>(buckets_.load(std::memory_order_relaxed));
+    if (static_cast<size_t>(b) >= capacity_) return false;
+    bucket_underlying_[b] = u;
+    bucket_expiry_[b] = expiry;
+    bucket_strike_[b] = strike;
+    bucket_of_.emplace(key, b);
+    buckets_.store(b + 1, std::memory_order_release);
+  }
+
+  int slot = index_.FindOrInsert(id);
+  if (slot < 0) return false;
+
+  int row;
+  if (!free_rows_.empty()) {
+    row = free_rows_.back();
+    free_rows_.pop_back();
+  } else {
+    row = static_cast<int>(fresh);
+    rows_.store(fresh + 1, std::memory_order_relaxed);
+  }
+
+  // the row is filled in before the id can resolve to it; a reused row
+  // still has the greeks of the option that held it
+  BeginWrite();
+  row_id_[row] = id;
+  row_bucket_[row] = b;
+  row_call_[row] = call;
+  row_multiplier_[row] = multiplier;
+  row_expiry_time_[row] = ExpiryTime(expiry);
+  iv_[row] = 0.0;
+  delta_[row] = 0.0;
+  gamma_[row] = 0.0;
+  vega_[row] = 0.0;
+  theta_[row] = 0.0;
+  und_[row] = 0.0;
+  row_live_[row] = true;
+  EndWrite();
+  row_of_slot_[slot].store(row, std::memory_order_release);
+  live_.fetch_add(1, std::memory_order_release);
+  return true;
+}
+
+bool OptionSurface::Unregister(TickerId id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int slot = index_.Find(id);
+  if (slot < 0) return false;
+  int row = row_of_slot_[slot].exchange(-1, std::memory_order_acq_rel);
+  index_.Remove(id);
+  if (row < 0) return false;
+
+  int b = row_bucket_[row];
+
+  BeginWrite();
+  row_live_[row] = false;
+  if (row_call_[row]) {
+    call_gamma_[b] -= gex_[row];
+    call_oi_[b] -= oi_[row];
+    call_iv_[b] = 0.0;
+  } else {
+    put_gamma_[b] -= gex_[row];
+    put_oi_[b] -= oi_[row];
+    put_iv_[b] = 0.0;
+  }
+  net_vanna_[b] -= vanna_[row];
+  gex_[row] = 0.0;
+  vanna_[row] = 0.0;
+  oi_[row] = 0.0;
+  EndWrite();
+
+  free_rows_.push_back(row);
+  live_.fetch_sub(1, std::memory_order_release);
+  return true;
+}
+
+int OptionSurface::RowOf(TickerId id) const {
+  int slot = index_.Find(id);
+  if (slot < 0) return -1;
+  return row_of_slot_[slot].load(std::memory_order_acquire);
+}
+
+int OptionSurface::UnderlyingOf(const std::string &underlying) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = underlyings_.find(underlying);
+  return found == underlyings_.end() ? -1 : found->second;
+}
+
+void OptionSurface::BeginWrite() {
+  while (writing_.test_and_set(std::memory_order_acquire)) {
+  }
+  seq_.store(seq_.load(std::memory_order_relaxed) + 1,
+             std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void OptionSurface::EndWrite() {
+  seq_.store(seq_.load(std::memory_order_relaxed) + 1,
+             std::memory_order_release);
+  writing_.clear(std::memory_order_release);
+}
+
+template <typename Fn>
+void OptionSurface::ReadConsistent(Fn &&copy) const {
+  for (;;) {
+    uint64_t before = seq_.load(std::memory_order_acquire);
+    if (before & 1) continue;
+
+    copy();
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (seq_.load(std::memory_order_relaxed) == before) return;
+  }
+}
+
+void OptionSurface::Reprice(int row, double now) {
+  double sign = row_call_[row] ? 1.0 : -1.0;
+  double size = oi_[row] * row_multiplier_[row];
+  double spot = und_[row];
+  double vol = iv_[row];
+  int b = row_bucket_[row];
+
+  double gex = sign * gamma_[row] * size * spot * spot * 0.01;
+
+  double vanna = 0.0;
+  double strike = bucket_strike_[b];
+  if (vol > 0.0 && spot > 0.0 && strike > 0.0 && size > 0.0) {
+    double years = std::max((row_expiry_time_[row] - now) / kSecondsPerYear,
+                            kMinYears);
+    double vol_sqrt_t = vol * std::sqrt(years);
+    double d1 = (std::log(spot / strike) + 0.5 * vol * vol * years) /
+                vol_sqrt_t;
+    double d2 = d1 - vol_sqrt_t;
+    double pdf = kInvSqrt2Pi * std::exp(-0.5 * d1 * d1);
+    // dDelta/dVol is the same for calls and puts
+    vanna = sign * (-pdf * d2 / vol) * size * spot * 0.01;
+  }
+
+  if (row_call_[row]) {
+    call_gamma_[b] += gex - gex_[row];
+  } else {
+    put_gamma_[b] += gex - gex_[row];
+  }
+  net_vanna_[b] += vanna - vanna_[row];
+  gex_[row] = gex;
+  vanna_[row] = vanna;
+}
+
+void OptionSurface::OnTickOptionComputation(TickerId id, TickType field,
+                                            double implied_vol, double delta,
+                                            double gamma, double vega,
+                                            double theta, double und_price) {
+  if (field != MODEL_OPTION && field != DELAYED_MODEL_OPTION_COMPUTATION) {
+    return;
+  }
+  int row = RowOf(id);
+  if (row < 0) return;
+
+  double now = NowSeconds();
+
+  BeginWrite();
+  // unregistered, or even taken over, after RowOf found it
+  if (!row_live_[row] || row_id_[row] != id) {
+    EndWrite();
+    return;
+  }
+  int b = row_bucket_[row];
+  // fields IB has not computed yet arrive as DBL_MAX and keep the old value
+  if (Valid(implied_vol) && implied_vol >= 0.0) {
+    iv_[row] = implied_vol;
+    (row_call_[row] ? call_iv_ : put_iv_)[b] = implied_vol;
+  }
+  if (Valid(delta)) delta_[row] = delta;
+  if (Valid(gamma)) gamma_[row] = gamma;
+  if (Valid(vega)) vega_[row] = vega;
+  if (Valid(theta)) theta_[row] = theta;
+  if (Valid(und_price) && und_price > 0.0) {
+    und_[row] = und_price;
+    spot_[bucket_underlying_[b]] = und_price;
+  }
+  Reprice(row, now);
+  EndWrite();
+}
+
+void OptionSurface::OnTickSize(TickerId id, TickType field, double size) {
+  if (field != OPTION_CALL_OPEN_INTEREST && field != OPTION_PUT_OPEN_INTEREST) {
+    return;
+  }
+  int row = RowOf(id);
+  if (row < 0) return;
+
+  // an option line reports the open interest of its own right
+  if (row_call_[row] == (field == OPTION_CALL_OPEN_INTEREST)) {
+    OnOpenInterest(id, size);
+  }
+}
+
+void OptionSurface::OnOpenInterest(TickerId id, double open_interest) {
+  int row = RowOf(id);
+  if (row < 0 || !Valid(open_interest) || open_interest < 0.0) return;
+
+  BeginWrite();
+  if (!row_live_[row] || row_id_[row] != id) {
+    EndWrite();
+    return;
+  }
+  int b = row_bucket_[row];
+  (row_call_[row] ? call_oi_ : put_oi_)[b] += open_interest - oi_[row];
+  oi_[row] = open_interest;
+  Reprice(row, NowSeconds());
+  EndWrite();
+}
+
+bool OptionSurface::Leg(TickerId id, OptionLeg *out) const {
+  int row = RowOf(id);
+  if (row < 0) return false;
+
+  int b = 0;
+  bool same = false;
+  ReadConsistent([&]() {
+    same = row_live_[row] && row_id_[row] == id;
+    b = row_bucket_[row];
+    out->call = row_call_[row];
+    out->implied_vol = iv_[row];
+    out->delta = delta_[row];
+    out->gamma = gamma_[row];
+    out->vega = vega_[row];
+    out->theta = theta_[row];
+    out->und_price = und_[row];
+    out->open_interest = oi_[row];
+    out->gamma_exposure = gex_[row];
+    out->vanna_exposure = vanna_[row];
+  });
+  if (!same) return false;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out->underlying = underlying_names_[bucket_underlying_[b]];
+  }
+  out->expiry = bucket_expiry_[b];
+  out->strike = bucket_strike_[b];
+  return true;
+}
+
+double OptionSurface::Spot(const std::string &underlying) const {
+  int u = UnderlyingOf(underlying);
+  if (u < 0) return 0.0;
+
+  double spot = 0.0;
+  ReadConsistent([&]() { spot = spot_[u]; });
+  return spot;
+}
+
+std::vector<int> OptionSurface::BucketsOf(int underlying, int expiry) const {
+  std::vector<int> out;
+  if (underlying < 0) return out;
+
+  // bucket keys never change once published, no seqlock needed
+  size_t count = buckets_.load(std::memory_order_acquire);
+  for (size_t b = 0; b < count; ++b) {
+    if (bucket_underlying_[b] == underlying &&
+        (expiry == 0 || bucket_expiry_[b] == expiry)) {
+      out.push_back(static_cast<int>(b));
+    }
+  }
+  return out;
+}
+
+std::vector<StrikeExposure> OptionSurface::ExposureByStrike(
+    const std::string &underlying, int expiry) const {
+  std::vector<int> buckets = BucketsOf(UnderlyingOf(underlying), expiry);
+  std::sort(buckets.begin(), buckets.end(), [this](int a, int b) {
+    return bucket_strike_[a] < bucket_strike_[b];
+  });
+
+  std::vector<StrikeExposure> rows(buckets.size());
+  ReadConsistent([&]() {
+    for (size_t i = 0; i < buckets.size(); ++i) {
+      int b = buckets[i];
+      StrikeExposure &row = rows[i];
+      row.strike = bucket_strike_[b];
+      row.call_gamma = call_gamma_[b];
+      row.put_gamma = put_gamma_[b];
+      row.net_vanna = net_vanna_[b];
+      row.call_open_interest = call_oi_[b];
+      row.put_open_interest = put_oi_[b];
+    }
+  });
+
+  // the same strike of different expiries collapses into one row
+  std::vector<StrikeExposure> out;
+  for (StrikeExposure &row : rows) {
+    row.net_gamma = row.call_gamma + row.put_gamma;
+    if (!out.empty() && out.back().strike == row.strike) {
+      StrikeExposure &merged = out.back();
+      merged.call_gamma += row.call_gamma;
+      merged.put_gamma += row.put_gamma;
+      merged.net_gamma += row.net_gamma;
+      merged.net_vanna += row.net_vanna;
+      merged.call_open_interest += row.call_open_interest;
+      merged.put_open_interest += row.put_open_interest;
+    } else {
+      out.push_back(row);
+    }
+  }
+  return out;
+}
+
+std::vector<ExpiryExposure> OptionSurface::ExposureByExpiry(
+    const std::string &underlying) const {
+  std::vector<int> buckets = BucketsOf(UnderlyingOf(underlying), 0);
+
+  std::map<int, ExpiryExposure> by_expiry;
+  ReadConsistent([&]() {
+    by_expiry.clear();
+    for (int b : buckets) {
+      ExpiryExposure &row = by_expiry[bucket_expiry_[b]];
+      row.expiry = bucket_expiry_[b];
+      row.net_gamma += call_gamma_[b] + put_gamma_[b];
+      row.net_vanna += net_vanna_[b];
+      row.call_open_interest += call_oi_[b];
+      row.put_open_interest += put_oi_[b];
+    }
+  });
+
+  std::vector<ExpiryExposure> out;
+  out.reserve(by_expiry.size());
+  for (const auto &entry : by_expiry) out.push_back(entry.second);
+  return out;
+}
+
+std::vector<SkewPoint> OptionSurface::Skew(const std::string &underlying,
+                                           int expiry) const {
+  int u = UnderlyingOf(underlying);
+  std::vector<int> buckets = BucketsOf(u, expiry);
+  std::sort(buckets.begin(), buckets.end(), [this](int a, int b) {
+    return bucket_strike_[a] < bucket_strike_[b];
+  });
+
+  std::vector<SkewPoint> out(buckets.size());
+  double spot = 0.0;
+  ReadConsistent([&]() {
+    spot = u >= 0 ? spot_[u] : 0.0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+      out[i].strike = bucket_strike_[buckets[i]];
+      out[i].call_vol = call_iv_[buckets[i]];
+      out[i].put_vol = put_iv_[buckets[i]];
+    }
+  });
+
+  for (SkewPoint &point : out) {
+    point.log_moneyness = spot > 0.0 ? std::log(point.strike / spot) : 0.0;
+  }
+  return out;
+}
+
+std::vector<TermPoint> OptionSurface::TermStructure(
+    const std::string &underlying) const {
+  std::vector<TermPoint> out;
+  std::vector<ExpiryExposure> expiries = ExposureByExpiry(underlying);
+  double spot = Spot(underlying);
+  double now = NowSeconds();
+
+  for (const ExpiryExposure &expiry : expiries) {
+    std::vector<SkewPoint> skew = Skew(underlying, expiry.expiry);
+
+    // out-of-the-money side where both are quoted, the one that is otherwise
+    auto vol_at = [spot](const SkewPoint &point) {
+      double call = point.call_vol, put = point.put_vol;
+      if (call > 0.0 && put > 0.0) return point.strike >= spot ? call : put;
+      return call > 0.0 ? call : put;
+    };
+
+    const SkewPoint *below = nullptr;
+    const SkewPoint *above = nullptr;
+    for (const SkewPoint &point : skew) {
+      if (vol_at(point) <= 0.0) continue;
+      if (point.strike <= spot) below = &point;
+      if (point.strike >= spot && above == nullptr) above = &point;
+    }
+
+    double atm = 0.0;
+    if (below != nullptr && above != nullptr &&
+        above->strike > below->strike) {
+      double w = (spot - below->strike) / (above->strike - below->strike);
+      atm = (1.0 - w) * vol_at(*below) + w * vol_at(*above);
+    } else if (below != nullptr || above != nullptr) {
+      atm = vol_at(below != nullptr ? *below : *above);
+    }
+    if (atm <= 0.0) continue;
+
+    TermPoint point;
+    point.expiry = expiry.expiry;
+    point.years = std::max((ExpiryTime(expiry.expiry) - now) / kSecondsPerYear,
+                           0.0);
+    point.atm_vol = atm;
+    out.push_back(point);
+  }
+  return out;
+}
+
+}  // namespace tws
+}  // namespace premia
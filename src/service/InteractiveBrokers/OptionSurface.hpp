@@ -0,0 +1,214 @@
+#ifndef OptionSurface_hpp
+#define OptionSurface_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "TickerTable.hpp"
+#include "tws/Contract.h"
+#include "tws/EWrapper.h"
+
+namespace premia {
+namespace tws {
+
+// Latest model greeks of one registered option.
+struct OptionLeg {
+  std::string underlying;
+  int expiry = 0;  // yyyymmdd
+  double strike = 0.0;
+  bool call = true;
+  double implied_vol = 0.0;
+  double delta = 0.0;
+  double gamma = 0.0;
+  double vega = 0.0;
+  double theta = 0.0;
+  double und_price = 0.0;
+  double open_interest = 0.0;
+  // dealer exposure of this leg, see OptionSurface
+  double gamma_exposure = 0.0;
+  double vanna_exposure = 0.0;
+};
+
+// Exposures are dealer-signed: calls add, puts subtract.
+struct StrikeExposure {
+  double strike = 0.0;
+  double call_gamma = 0.0;
+  double put_gamma = 0.0;
+  double net_gamma = 0.0;
+  double net_vanna = 0.0;
+  double call_open_interest = 0.0;
+  double put_open_interest = 0.0;
+};
+
+struct ExpiryExposure {
+  int expiry = 0;
+  double net_gamma = 0.0;
+  double net_vanna = 0.0;
+  double call_open_interest = 0.0;
+  double put_open_interest = 0.0;
+};
+
+struct TermPoint {
+  int expiry = 0;
+  double years = 0.0;
+  // implied vol interpolated at the underlying price
+  double atm_vol = 0.0;
+};
+
+struct SkewPoint {
+  double strike = 0.0;
+  // ln(strike / underlying price)
+  double log_moneyness = 0.0;
+  double call_vol = 0.0;
+  double put_vol = 0.0;
+};
+
+// Model greeks of every registered option, indexed by (underlying, expiry,
+// strike, right), with the dealer exposure views kept current tick by tick.
+//
+// tickOptionComputation only carries a tickerId, so options are registered
+// with their contract first (Client::subscribeMarketData does this for OPT
+// and FOP) and unregistered when the line is cancelled. The EReader thread
+// does nearly all the writing: it resolves the tickerId without locking,
+// stores the greeks in column arrays and moves the leg's old gamma and vanna
+// exposure out of its (expiry, strike) bucket and the new one in. Register
+// and Unregister take the same write side to set up or clear a row, so a
+// late tick cannot put a removed leg back or land on the option that took
+// over its row. Queries copy bucket columns under a
+// seqlock, retrying if a tick lands mid-copy, so they cost O(buckets) and
+// never block the writer.
+//
+// Gamma exposure is gamma * open interest * multiplier * S^2 * 1%, the
+// dollar delta dealers trade for a 1% move. Vanna exposure is the dollar
+// delta change for a one vol point move, from the Black-Scholes vanna at
+// the leg's implied vol.
+class OptionSurface {
+ public:
+  // capacity is the maximum number of options registered at once, and of
+  // distinct (underlying, expiry, strike) buckets over the surface's life.
+  explicit OptionSurface(size_t capacity = 8192);
+  ~OptionSurface();
+
+  OptionSurface(const OptionSurface &) = delete;
+  OptionSurface &operator=(const OptionSurface &) = delete;
+
+  // Any thread. False if the surface is full, the contract has no expiry,
+  // strike and right, or id is already registered for another option.
+  bool Register(TickerId id, const Contract &contract);
+  bool Register(TickerId id, const std::string &underlying, int expiry,
+                double strike, bool call, double multiplier = 100.0);
+  // Any thread. Takes the leg out of its bucket's exposure and open
+  // interest and ignores later ticks for id; false if it was not
+  // registered. Its row and tickerId slot go to the next registration.
+  bool Unregister(TickerId id);
+
+  // Writer side, from the EWrapper callbacks. Only model computations are
+  // kept; bid, ask and last computations are ignored.
+  void OnTickOptionComputation(TickerId id, TickType field,
+                               double implied_vol, double delta,
+                               double gamma, double vega, double theta,
+                               double und_price);
+  // Keeps OPTION_CALL_OPEN_INTEREST on calls and OPTION_PUT_OPEN_INTEREST
+  // on puts, ignores every other size tick.
+  void OnTickSize(TickerId id, TickType field, double size);
+  // Open interest from any source, e.g. a chain snapshot over REST.
+  void OnOpenInterest(TickerId id, double open_interest);
+
+  // Reader side, any thread.
+  bool Leg(TickerId id, OptionLeg *out) const;
+  // Latest underlying price seen on any of its options, 0 if none.
+  double Spot(const std::string &underlying) const;
+  // Sorted by strike; expiry 0 sums all expiries.
+  std::vector<StrikeExposure> ExposureByStrike(const std::string &underlying,
+                                               int expiry = 0) const;
+  std::vector<ExpiryExposure> ExposureByExpiry(
+      const std::string &underlying) const;
+  std::vector<TermPoint> TermStructure(const std::string &underlying) const;
+  std::vector<SkewPoint> Skew(const std::string &underlying, int expiry) const;
+
+  // Options registered now.
+  size_t size() const { return live_.load(std::memory_order_acquire); }
+  // Grows with every update, for cheap change detection.
+  uint64_t version() const { return seq_.load(std::memory_order_acquire); }
+
+  // "20240119" or "20240119 16:00 US/Eastern" to 20240119, 0 if invalid.
+  static int ParseExpiry(const std::string &expiry);
+
+ private:
+  using BucketKey = std::tuple<int, int, double>;
+
+  int RowOf(TickerId id) const;
+  int UnderlyingOf(const std::string &underlying) const;
+  // Writer only, between seqlock Begin/End.
+  void Reprice(int row, double now);
+  // BeginWrite also keeps out any other writer until EndWrite.
+  void BeginWrite();
+  void EndWrite();
+  template <typename Fn>
+  void ReadConsistent(Fn &&copy) const;
+  // Published buckets of one underlying (and expiry, unless 0).
+  std::vector<int> BucketsOf(int underlying, int expiry) const;
+
+  size_t capacity_;
+  TickerIndex index_;
+  std::unique_ptr<std::atomic<int>[]> row_of_slot_;
+  std::atomic<size_t> rows_;
+  std::atomic<size_t> live_;
+  std::atomic<size_t> buckets_;
+  std::atomic<uint64_t> seq_;
+  std::atomic_flag writing_ = ATOMIC_FLAG_INIT;
+
+  // per row, set at registration between Begin/EndWrite; row_id_ tells a
+  // tick that resolved its id just before the row was reused
+  std::unique_ptr<TickerId[]> row_id_;
+  std::unique_ptr<int[]> row_bucket_;
+  std::unique_ptr<bool[]> row_call_;
+  std::unique_ptr<double[]> row_multiplier_;
+  std::unique_ptr<double[]> row_expiry_time_;
+  // cleared by Unregister, only touched between Begin/EndWrite afterwards
+  std::unique_ptr<bool[]> row_live_;
+  // per row, written by the EReader thread
+  std::unique_ptr<double[]> iv_;
+  std::unique_ptr<double[]> delta_;
+  std::unique_ptr<double[]> gamma_;
+  std::unique_ptr<double[]> vega_;
+  std::unique_ptr<double[]> theta_;
+  std::unique_ptr<double[]> und_;
+  std::unique_ptr<double[]> oi_;
+  std::unique_ptr<double[]> gex_;
+  std::unique_ptr<double[]> vanna_;
+
+  // per (underlying, expiry, strike) bucket, fixed at registration
+  std::unique_ptr<int[]> bucket_underlying_;
+  std::unique_ptr<int[]> bucket_expiry_;
+  std::unique_ptr<double[]> bucket_strike_;
+  // per bucket, running sums kept by the writer
+  std::unique_ptr<double[]> call_gamma_;
+  std::unique_ptr<double[]> put_gamma_;
+  std::unique_ptr<double[]> net_vanna_;
+  std::unique_ptr<double[]> call_iv_;
+  std::unique_ptr<double[]> put_iv_;
+  std::unique_ptr<double[]> call_oi_;
+  std::unique_ptr<double[]> put_oi_;
+  // per underlying
+  std::unique_ptr<double[]> spot_;
+
+  // registration only
+  mutable std::mutex mutex_;
+  std::map<std::string, int> underlyings_;
+  std::vector<std::string> underlying_names_;
+  std::map<BucketKey, int> bucket_of_;
+  std::vector<int> free_rows_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
@@ -0,0 +1,187 @@
+#include "OrderBook.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace premia {
+namespace tws {
+
+void OrderBook::Clear() {
+  bid_rows = 0;
+  ask_rows = 0;
+  bid_total = 0.0;
+  ask_total = 0.0;
+  smart_depth = false;
+}
+
+void OrderBook::Apply(int position, int operation, int side, double price,
+                      double size, const char *market_maker,
+                      size_t market_maker_len) {
+  if (position < 0 || position >= kMaxDepthRows) return;
+
+  bool is_bid = side == kDepthBid;
+  DepthLevel *rows = is_bid ? bids : asks;
+  int &count = is_bid ? bid_rows : ask_rows;
+  double &total = is_bid ? bid_total : ask_total;
+
+  switch (operation) {
+    case kDepthInsert: {
+      if (count == kMaxDepthRows) {
+        total -= rows[count - 1].size;
+        --count;
+      }
+      position = std::min(position, count);
+      std::memmove(rows + position + 1, rows + position,
+                   (count - position) * sizeof(DepthLevel));
+      ++count;
+      rows[position].size = 0.0;
+      break;
+    }
+    case kDepthUpdate:
+      // TWS occasionally updates a row it has not inserted yet
+      if (position >= count) {
+        position = count;
+        ++count;
+        rows[position].size = 0.0;
+      }
+      break;
+    case kDepthDelete:
+      if (position >= count) return;
+      total -= rows[position].size;
+      std::memmove(rows + position, rows + position + 1,
+                   (count - position - 1) * sizeof(DepthLevel));
+      --count;
+      ++updates;
+      return;
+    default:
+      return;
+  }
+
+  DepthLevel &level = rows[position];
+  total += size - level.size;
+  level.price = price;
+  level.size = size;
+  size_t len = std::min(market_maker_len, kMarketMakerLen - 1);
+  if (len > 0) std::memcpy(level.market_maker, market_maker, len);
+  level.market_maker[len] = '\0';
+  ++updates;
+}
+
+BestBidOffer OrderBook::Bbo() const {
+  BestBidOffer bbo = {};
+  if (bid_rows > 0) {
+    bbo.bid_price = bids[0].price;
+    bbo.bid_size = bids[0].size;
+    bbo.has_bid = true;
+  }
+  if (ask_rows > 0) {
+    bbo.ask_price = asks[0].price;
+    bbo.ask_size = asks[0].size;
+    bbo.has_ask = true;
+  }
+  return bbo;
+}
+
+double OrderBook::Mid() const {
+  if (bid_rows == 0 || ask_rows == 0) return 0.0;
+  return (bids[0].price + asks[0].price) / 2.0;
+}
+
+double OrderBook::Spread() const {
+  if (bid_rows == 0 || ask_rows == 0) return 0.0;
+  return asks[0].price - bids[0].price;
+}
+
+int OrderBook::CumulativeDepth(int side, double *out, int max_rows) const {
+  const DepthLevel *rows = side == kDepthBid ? bids : asks;
+  int count = std::min(side == kDepthBid ? bid_rows : ask_rows, max_rows);
+  double running = 0.0;
+  for (int i = 0; i < count; ++i) {
+    running += rows[i].size;
+    out[i] = running;
+  }
+  return count;
+}
+
+double OrderBook::Imbalance(int levels) const {
+  double bid = 0.0;
+  double ask = 0.0;
+  for (int i = 0; i < std::min(levels, bid_rows); ++i) bid += bids[i].size;
+  for (int i = 0; i < std::min(levels, ask_rows); ++i) ask += asks[i].size;
+  return bid + ask > 0.0 ? (bid - ask) / (bid + ask) : 0.0;
+}
+
+double OrderBook::TotalImbalance() const {
+  double sum = bid_total + ask_total;
+  return sum > 0.0 ? (bid_total - ask_total) / sum : 0.0;
+}
+
+OrderBookTable::OrderBookTable(size_t capacity)
+    : index_(capacity),
+      books_(new SeqlockSlot<OrderBook>[index_.capacity()]) {}
+
+OrderBookTable::~OrderBookTable() = default;
+
+void OrderBookTable::SetListener(Listener listener) {
+  listener_ = std::move(listener);
+}
+
+template <typename Fn>
+void OrderBookTable::Publish(TickerId id, Fn &&update) {
+  int slot = index_.FindOrInsert(id);
+  if (slot < 0) return;
+
+  SeqlockSlot<OrderBook> &entry = books_[slot];
+  entry.Write(update);
+
+  if (listener_) listener_(id, entry.data);
+}
+
+void OrderBookTable::OnUpdateMktDepth(TickerId id, int position, int operation,
+                                      int side, double price, double size) {
+  Publish(id, [&](OrderBook &book) {
+    book.Apply(position, operation, side, price, size, nullptr, 0);
+  });
+}
+
+void OrderBookTable::OnUpdateMktDepthL2(TickerId id, int position,
+                                        const std::string &market_maker,
+                                        int operation, int side, double price,
+                                        double size, bool is_smart_depth) {
+  Publish(id, [&](OrderBook &book) {
+    book.smart_depth = is_smart_depth;
+    book.Apply(position, operation, side, price, size, market_maker.data(),
+               market_maker.size());
+  });
+}
+
+void OrderBookTable::Reset(TickerId id) {
+  if (index_.Find(id) < 0) return;
+
+  Publish(id, [](OrderBook &book) { book.Clear(); });
+}
+
+bool OrderBookTable::Bbo(TickerId id, BestBidOffer *out) const {
+  int slot = index_.Find(id);
+  if (slot < 0) return false;
+
+  return books_[slot].Read(
+      [out](const OrderBook &book) { *out = book.Bbo(); });
+}
+
+bool OrderBookTable::Snapshot(TickerId id, OrderBook *out,
+                              uint64_t *version) const {
+  int slot = index_.Find(id);
+  if (slot < 0) return false;
+
+  return books_[slot].Read([out](const OrderBook &book) { *out = book; },
+                           version);
+}
+
+uint64_t OrderBookTable::Version(TickerId id) const {
+  int slot = index_.Find(id);
+  return slot < 0 ? 0 : books_[slot].version();
+}
+
+}  // namespace tws
+}  // namespace premia
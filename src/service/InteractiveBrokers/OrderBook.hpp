@@ -0,0 +1,113 @@
+#ifndef OrderBook_hpp
+#define OrderBook_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "TickerTable.hpp"
+#include "tws/CommonDefs.h"
+
+namespace premia {
+namespace tws {
+
+// Deepest row TWS will send for a single book, SMART depth included.
+constexpr int kMaxDepthRows = 64;
+constexpr size_t kMarketMakerLen = 16;
+
+// updateMktDepth side and operation codes.
+enum DepthSide { kDepthAsk = 0, kDepthBid = 1 };
+enum DepthOperation { kDepthInsert = 0, kDepthUpdate = 1, kDepthDelete = 2 };
+
+struct DepthLevel {
+  double price;
+  double size;
+  char market_maker[kMarketMakerLen];
+};
+
+struct BestBidOffer {
+  double bid_price;
+  double bid_size;
+  double ask_price;
+  double ask_size;
+  bool has_bid;
+  bool has_ask;
+};
+
+// One instrument's book as TWS describes it: row 0 is the top of each side
+// and rows shift on insert and delete. Both sides are fixed arrays, so
+// applying an update never allocates.
+struct OrderBook {
+  DepthLevel bids[kMaxDepthRows];
+  DepthLevel asks[kMaxDepthRows];
+  int bid_rows;
+  int ask_rows;
+  double bid_total;
+  double ask_total;
+  bool smart_depth;
+  uint64_t updates;
+
+  void Clear();
+  void Apply(int position, int operation, int side, double price, double size,
+             const char *market_maker, size_t market_maker_len);
+
+  BestBidOffer Bbo() const;
+  double Mid() const;
+  double Spread() const;
+
+  // Running size of the first rows of a side; returns the rows written.
+  int CumulativeDepth(int side, double *out, int max_rows) const;
+
+  // (bid - ask) / (bid + ask) over the top levels rows, in [-1, 1].
+  double Imbalance(int levels) const;
+
+  // Same measure over the whole book, kept up to date on every update.
+  double TotalImbalance() const;
+};
+
+// Books for every instrument subscribed with reqMktDepth, keyed by tickerId.
+// The EReader thread applies updates; readers copy BBOs or full books out
+// through the same seqlock scheme as MarketDataCache.
+class OrderBookTable {
+ public:
+  using Listener = std::function<void(TickerId, const OrderBook &)>;
+
+  explicit OrderBookTable(size_t capacity = 128);
+  ~OrderBookTable();
+
+  OrderBookTable(const OrderBookTable &) = delete;
+  OrderBookTable &operator=(const OrderBookTable &) = delete;
+
+  void SetListener(Listener listener);
+
+  // Writer side, mirrors updateMktDepth and updateMktDepthL2.
+  void OnUpdateMktDepth(TickerId id, int position, int operation, int side,
+                        double price, double size);
+  void OnUpdateMktDepthL2(TickerId id, int position,
+                          const std::string &market_maker, int operation,
+                          int side, double price, double size,
+                          bool is_smart_depth);
+
+  // Empties the book after cancelMktDepth or a reconnect.
+  void Reset(TickerId id);
+
+  // Reader side, false when no depth was ever received for the id.
+  bool Bbo(TickerId id, BestBidOffer *out) const;
+  bool Snapshot(TickerId id, OrderBook *out, uint64_t *version = nullptr) const;
+  uint64_t Version(TickerId id) const;
+
+ private:
+  template <typename Fn>
+  void Publish(TickerId id, Fn &&update);
+
+  TickerIndex index_;
+  std::unique_ptr<SeqlockSlot<OrderBook>[]> books_;
+  Listener listener_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
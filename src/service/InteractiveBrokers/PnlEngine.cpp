@@ -0,0 +1,287 @@
+#include "PnlEngine.hpp"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+
+namespace premia {
+namespace tws {
+
+namespace {
+
+std::string LineKey(const std::string &account, long con_id) {
+  return account + '|' + std::to_string(con_id);
+}
+
+double Multiplier(const Contract &contract) {
+  double multiplier = std::atof(contract.multiplier.c_str());
+  return multiplier > 0.0 ? multiplier : 1.0;
+}
+
+bool Valid(double value) { return value != DBL_MAX && std::isfinite(value); }
+
+}  // namespace
+
+PnlEngine::PnlEngine(const MarketDataCache &quotes) : quotes_(quotes) {}
+
+void PnlEngine::SetListener(Listener listener) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  listener_ = std::move(listener);
+}
+
+size_t PnlEngine::LineFor(const std::string &account,
+                          const Contract &contract) {
+  std::string key = LineKey(account, contract.conId);
+  auto found = line_of_.find(key);
+  if (found != line_of_.end()) {
+    // a line TrackPnlSingle made from a bare conId takes the first full
+    // contract that comes along
+    PositionLine &line = lines_[found->second];
+    if (line.sec_type.empty() && !contract.secType.empty()) {
+      line.symbol = contract.symbol;
+      line.sec_type = contract.secType;
+      line.multiplier = Multiplier(contract);
+    }
+    return found->second;
+  }
+
+  PositionLine line;
+  line.account = account;
+  line.con_id = contract.conId;
+  line.symbol = contract.symbol;
+  line.sec_type = contract.secType;
+  line.multiplier = Multiplier(contract);
+  auto mark = marks_.find(contract.conId);
+  if (mark != marks_.end()) line.mark = mark->second;
+
+  size_t index = lines_.size();
+  lines_.push_back(line);
+  line_of_.emplace(key, index);
+  lines_of_contract_[contract.conId].push_back(index);
+  AccountFor(account);
+  return index;
+}
+
+AccountPnl &PnlEngine::AccountFor(const std::string &account) {
+  AccountPnl &total = accounts_[account];
+  total.account = account;
+  return total;
+}
+
+void PnlEngine::Update(size_t index, double realized, double fees,
+                       size_t fills) {
+  PositionLine &line = lines_[index];
+  double unrealized = 0.0;
+  double market_value = 0.0;
+  if (line.mark > 0.0) {
+    market_value = line.mark * line.quantity * line.multiplier;
+    unrealized = (line.mark - line.average_price) * line.quantity *
+                 line.multiplier;
+  }
+
+  AccountPnl &total = AccountFor(line.account);
+  total.realized += realized;
+  total.fees += fees;
+  total.fills += fills;
+  total.unrealized += unrealized - line.unrealized;
+  total.market_value += market_value - line.market_value;
+
+  line.realized += realized;
+  line.fees += fees;
+  line.fills += fills;
+  line.unrealized = unrealized;
+  line.market_value = market_value;
+
+  if (listener_) listener_(line, total);
+}
+
+void PnlEngine::OnExecution(const Contract &contract,
+                            const Execution &execution) {
+  double shares = execution.shares;
+  if (shares <= 0.0 || !Valid(execution.price)) return;
+  double signed_qty = execution.side == "SLD" ? -shares : shares;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!executions_.insert(execution.execId).second) return;
+
+  size_t index = LineFor(execution.acctNumber, contract);
+  line_of_execution_[execution.execId] = index;
+  PositionLine &line = lines_[index];
+
+  double realized = 0.0;
+  double held = line.quantity;
+  if (held != 0.0 && (held > 0.0) != (signed_qty > 0.0)) {
+    // reducing, possibly through zero
+    double closed = std::fmin(std::fabs(held), shares);
+    double direction = held > 0.0 ? 1.0 : -1.0;
+    realized = (execution.price - line.average_price) * closed * direction *
+               line.multiplier;
+    line.quantity += direction * -closed;
+    double opened = shares - closed;
+    if (opened > 0.0) {
+      line.quantity = signed_qty > 0.0 ? opened : -opened;
+      line.average_price = execution.price;
+    } else if (line.quantity == 0.0) {
+      line.average_price = 0.0;
+    }
+  } else {
+    double quantity = held + signed_qty;
+    line.average_price = (line.average_price * std::fabs(held) +
+                          execution.price * shares) /
+                         std::fabs(quantity);
+    line.quantity = quantity;
+  }
+  if (line.mark <= 0.0) line.mark = execution.price;
+
+  double fees = 0.0;
+  auto pending = pending_fees_.find(execution.execId);
+  if (pending != pending_fees_.end()) {
+    fees = pending->second;
+    pending_fees_.erase(pending);
+  }
+  Update(index, realized, fees, 1);
+}
+
+void PnlEngine::OnCommission(const CommissionReport &report) {
+  if (!Valid(report.commission)) return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = line_of_execution_.find(report.execId);
+  if (found == line_of_execution_.end()) {
+    pending_fees_[report.execId] = report.commission;
+    return;
+  }
+  Update(found->second, 0.0, report.commission, 0);
+}
+
+void PnlEngine::OnPosition(const std::string &account,
+                           const Contract &contract, double position,
+                           double avg_cost) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t index = LineFor(account, contract);
+  PositionLine &line = lines_[index];
+  line.quantity = position;
+  line.average_price = position != 0.0 ? avg_cost / line.multiplier : 0.0;
+  Update(index, 0.0, 0.0, 0);
+}
+
+void PnlEngine::OnPortfolio(const std::string &account,
+                            const Contract &contract, double position,
+                            double market_price, double avg_cost) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t index = LineFor(account, contract);
+  PositionLine &line = lines_[index];
+  line.quantity = position;
+  line.average_price = position != 0.0 ? avg_cost / line.multiplier : 0.0;
+  Update(index, 0.0, 0.0, 0);
+  if (Valid(market_price) && market_price > 0.0) {
+    MarkLocked(contract.conId, market_price);
+  }
+}
+
+void PnlEngine::TrackPnlSingle(int req_id, const std::string &account,
+                               long con_id) {
+  Contract contract;
+  contract.conId = con_id;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  pnl_single_[req_id] = LineFor(account, contract);
+}
+
+void PnlEngine::OnPnlSingle(int req_id, double daily_pnl) {
+  if (!Valid(daily_pnl)) return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = pnl_single_.find(req_id);
+  if (found == pnl_single_.end()) return;
+  lines_[found->second].ib_daily_pnl = daily_pnl;
+}
+
+void PnlEngine::WatchTicker(TickerId id, long con_id) {
+  if (con_id == 0) return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  watched_[id] = con_id;
+}
+
+void PnlEngine::OnTickPrice(TickerId id, TickType field) {
+  // sizes, highs, lows and the like never move the mark
+  switch (field) {
+    case BID:
+    case ASK:
+    case LAST:
+    case DELAYED_BID:
+    case DELAYED_ASK:
+    case DELAYED_LAST:
+      break;
+    default:
+      return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = watched_.find(id);
+  if (found == watched_.end()) return;
+
+  TopOfBook quote;
+  if (!quotes_.Snapshot(id, &quote)) return;
+  double mark = quote.bid > 0.0 && quote.ask > 0.0
+                    ? 0.5 * (quote.bid + quote.ask)
+                    : quote.last;
+  if (Valid(mark) && mark > 0.0) MarkLocked(found->second, mark);
+}
+
+void PnlEngine::Mark(long con_id, double price) {
+  if (!Valid(price) || price <= 0.0) return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  MarkLocked(con_id, price);
+}
+
+void PnlEngine::MarkLocked(long con_id, double price) {
+  marks_[con_id] = price;
+
+  auto found = lines_of_contract_.find(con_id);
+  if (found == lines_of_contract_.end()) return;
+  for (size_t index : found->second) {
+    lines_[index].mark = price;
+    Update(index, 0.0, 0.0, 0);
+  }
+}
+
+bool PnlEngine::Position(const std::string &account, long con_id,
+                         PositionLine *out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = line_of_.find(LineKey(account, con_id));
+  if (found == line_of_.end()) return false;
+  *out = lines_[found->second];
+  return true;
+}
+
+std::vector<PositionLine> PnlEngine::Positions(
+    const std::string &account) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<PositionLine> out;
+  for (const PositionLine &line : lines_) {
+    if (account.empty() || line.account == account) out.push_back(line);
+  }
+  return out;
+}
+
+bool PnlEngine::Account(const std::string &account, AccountPnl *out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = accounts_.find(account);
+  if (found == accounts_.end()) return false;
+  *out = found->second;
+  return true;
+}
+
+std::vector<AccountPnl> PnlEngine::Accounts() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<AccountPnl> out;
+  out.reserve(accounts_.size());
+  for (const auto &entry : accounts_) out.push_back(entry.second);
+  return out;
+}
+
+}  // namespace tws
+}  // namespace premia
@@ -0,0 +1,142 @@
+#ifndef PnlEngine_hpp
+#define PnlEngine_hpp
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "MarketDataCache.hpp"
+#include "tws/CommissionReport.h"
+#include "tws/Contract.h"
+#include "tws/EWrapper.h"
+#include "tws/Execution.h"
+
+namespace premia {
+namespace tws {
+
+// One contract held in one account. Prices are per unit, PnL and values in
+// account currency (price * quantity * multiplier).
+struct PositionLine {
+  std::string account;
+  long con_id = 0;
+  std::string symbol;
+  std::string sec_type;
+  double multiplier = 1.0;
+  double quantity = 0.0;
+  double average_price = 0.0;
+  double mark = 0.0;
+  double realized = 0.0;
+  double unrealized = 0.0;
+  double fees = 0.0;
+  double market_value = 0.0;
+  // as reported by reqPnLSingle, for reconciliation
+  double ib_daily_pnl = 0.0;
+  size_t fills = 0;
+};
+
+struct AccountPnl {
+  std::string account;
+  double realized = 0.0;
+  double unrealized = 0.0;
+  double fees = 0.0;
+  double market_value = 0.0;
+  size_t fills = 0;
+
+  double net() const { return realized + unrealized - fees; }
+};
+
+// Positions, average cost and PnL per (account, conId), built from the
+// execution stream and marked to market from the quotes a MarketDataCache
+// already holds.
+//
+// Fills are applied with average cost accounting: adding to a position
+// moves the average price, reducing it realizes (price - average) on the
+// closed quantity, and a fill through zero closes and reopens at the fill
+// price. Commissions land on the line of the execution they belong to,
+// whichever of the two arrives first. position() and updatePortfolio()
+// snapshots reset quantity and average price to what IB reports, so a
+// missed fill cannot leave a line wrong for long.
+//
+// Every event touches only its own line and moves the account totals by
+// the line's change, so the cost per event does not grow with the number
+// of fills or positions.
+class PnlEngine {
+ public:
+  using Listener =
+      std::function<void(const PositionLine &line, const AccountPnl &total)>;
+
+  // quotes must outlive the engine; only its Snapshot() is used.
+  explicit PnlEngine(const MarketDataCache &quotes);
+
+  PnlEngine(const PnlEngine &) = delete;
+  PnlEngine &operator=(const PnlEngine &) = delete;
+
+  // Called with the lock held after each change; keep it short.
+  void SetListener(Listener listener);
+
+  // execDetails / commissionReport. Repeated execIds are ignored.
+  void OnExecution(const Contract &contract, const Execution &execution);
+  void OnCommission(const CommissionReport &report);
+  // position / updatePortfolio; avg_cost includes the multiplier, as IB
+  // sends it.
+  void OnPosition(const std::string &account, const Contract &contract,
+                  double position, double avg_cost);
+  void OnPortfolio(const std::string &account, const Contract &contract,
+                   double position, double market_price, double avg_cost);
+  // reqPnLSingle replies, once the reqId has been tracked. Tracking may
+  // come before the position; the line then has no symbol or multiplier
+  // until an execution or position brings the contract.
+  void TrackPnlSingle(int req_id, const std::string &account, long con_id);
+  void OnPnlSingle(int req_id, double daily_pnl);
+
+  // Marks every line of con_id with the quotes of a market data line:
+  // the bid/ask midpoint when both are known, else the last price.
+  void WatchTicker(TickerId id, long con_id);
+  // After the cache has taken the tick; only bid, ask and last re-mark.
+  void OnTickPrice(TickerId id, TickType field);
+  void Mark(long con_id, double price);
+
+  bool Position(const std::string &account, long con_id,
+                PositionLine *out) const;
+  // Every line of an account, or of all accounts when empty.
+  std::vector<PositionLine> Positions(const std::string &account = "") const;
+  bool Account(const std::string &account, AccountPnl *out) const;
+  std::vector<AccountPnl> Accounts() const;
+
+ private:
+  // All private members expect mutex_ held.
+  size_t LineFor(const std::string &account, const Contract &contract);
+  AccountPnl &AccountFor(const std::string &account);
+  // Recomputes the derived values of a line after any change to it and
+  // moves the account totals by the difference.
+  void Update(size_t index, double realized, double fees, size_t fills);
+  void MarkLocked(long con_id, double price);
+
+  mutable std::mutex mutex_;
+  Listener listener_;
+
+  std::vector<PositionLine> lines_;
+  std::unordered_map<std::string, size_t> line_of_;
+  std::unordered_map<long, std::vector<size_t>> lines_of_contract_;
+  std::unordered_map<std::string, AccountPnl> accounts_;
+  std::unordered_map<long, double> marks_;
+
+  std::unordered_set<std::string> executions_;
+  std::unordered_map<std::string, size_t> line_of_execution_;
+  // commissions that arrived before their execution
+  std::unordered_map<std::string, double> pending_fees_;
+
+  std::unordered_map<int, size_t> pnl_single_;
+
+  const MarketDataCache &quotes_;
+  std::unordered_map<TickerId, long> watched_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
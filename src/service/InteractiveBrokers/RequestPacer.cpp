@@ -0,0 +1,241 @@
+#include "RequestPacer.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace premia {
+namespace tws {
+
+namespace {
+
+using Seconds = std::chrono::duration<double>;
+using Millis = std::chrono::duration<double, std::milli>;
+
+}  // namespace
+
+void RequestPacer::Bucket::Reset(const BucketLimits &limits) {
+  per_second = limits.per_second;
+  burst = limits.burst;
+  tokens = limits.burst;
+}
+
+void RequestPacer::Bucket::Refill(double seconds) {
+  tokens = std::min(burst, tokens + seconds * per_second);
+}
+
+double RequestPacer::Bucket::SecondsToToken(double seconds) const {
+  double ahead = std::min(burst, tokens + seconds * per_second);
+  return ahead >= 1.0 ? 0.0 : (1.0 - ahead) / per_second;
+}
+
+RequestPacer::RequestPacer(PacingLimits limits)
+    : limits_(limits), refilled_at_(Clock::now()) {
+  shared_.Reset({limits.messages_per_second, limits.message_burst});
+  for (int category = 0; category < kPaceCategoryCount; ++category) {
+    queues_[category].bucket.Reset(limits.category[category]);
+  }
+}
+
+bool RequestPacer::Submit(PacingCategory category, long id,
+                          const std::string &key, Send send,
+                          Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Queue &queue = queues_[category];
+
+  if (!key.empty()) {
+    Expire(now);
+    bool queued = queued_count_.count(key) > 0;
+    bool recent = category == kPaceHistorical && recent_count_.count(key) > 0;
+    if (queued || recent) {
+      ++queue.stats.suppressed;
+      return false;
+    }
+    ++queued_count_[key];
+  }
+
+  queue.requests.push_back(Request{id, key, std::move(send), now});
+  queue.stats.queued = queue.requests.size();
+  return true;
+}
+
+bool RequestPacer::Cancel(long id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (Queue &queue : queues_) {
+    auto it = std::find_if(queue.requests.begin(), queue.requests.end(),
+                           [id](const Request &r) { return r.id == id; });
+    if (it == queue.requests.end()) continue;
+
+    if (!it->key.empty() && --queued_count_[it->key] == 0) {
+      queued_count_.erase(it->key);
+    }
+    queue.requests.erase(it);
+    queue.stats.queued = queue.requests.size();
+    return true;
+  }
+  return false;
+}
+
+size_t RequestPacer::Pump(Clock::time_point now) {
+  std::vector<Send> ready;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Refill(now);
+    Expire(now);
+
+    for (int category = 0; category < kPaceCategoryCount; ++category) {
+      Queue &queue = queues_[category];
+      while (!queue.requests.empty() && shared_.tokens >= 1.0) {
+        if (category == kPaceHistorical && !HistoricalAllowed()) break;
+        bool own = queue.bucket.tokens >= 1.0;
+        if (!own && !Borrows(static_cast<PacingCategory>(category), 0.0)) {
+          break;
+        }
+
+        Request &request = queue.requests.front();
+        shared_.tokens -= 1.0;
+        if (own) queue.bucket.tokens -= 1.0;
+
+        if (category == kPaceHistorical) {
+          historical_sent_.push_back(now);
+        }
+        if (!request.key.empty()) {
+          if (--queued_count_[request.key] == 0) {
+            queued_count_.erase(request.key);
+          }
+          if (category == kPaceHistorical) {
+            recent_keys_.emplace_back(now, request.key);
+            ++recent_count_[request.key];
+          }
+        }
+
+        double wait_ms = Millis(now - request.queued_at).count();
+        queue.total_wait_ms += wait_ms;
+        queue.stats.max_wait_ms = std::max(queue.stats.max_wait_ms, wait_ms);
+        if (wait_ms >= 1.0) ++queue.stats.deferred;
+        ++queue.stats.sent;
+
+        ready.push_back(std::move(request.send));
+        queue.requests.pop_front();
+      }
+      queue.stats.queued = queue.requests.size();
+    }
+  }
+
+  // EClient calls run outside the lock so they may Submit() follow-ups
+  for (Send &send : ready) send();
+  return ready.size();
+}
+
+RequestPacer::Clock::duration RequestPacer::NextDelay(
+    Clock::time_point now) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Clock::time_point next = Clock::time_point::max();
+  for (int category = 0; category < kPaceCategoryCount; ++category) {
+    if (queues_[category].requests.empty()) continue;
+    next = std::min(next, ReadyAt(static_cast<PacingCategory>(category), now));
+  }
+
+  if (next == Clock::time_point::max()) return Clock::duration::max();
+  return next > now ? next - now : Clock::duration::zero();
+}
+
+size_t RequestPacer::Pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  size_t pending = 0;
+  for (const Queue &queue : queues_) pending += queue.requests.size();
+  return pending;
+}
+
+PacingStats RequestPacer::Stats(PacingCategory category) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const Queue &queue = queues_[category];
+  PacingStats stats = queue.stats;
+  stats.queued = queue.requests.size();
+  if (stats.sent > 0) stats.mean_wait_ms = queue.total_wait_ms / stats.sent;
+  return stats;
+}
+
+void RequestPacer::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (int category = 0; category < kPaceCategoryCount; ++category) {
+    queues_[category].requests.clear();
+    queues_[category].stats.queued = 0;
+    queues_[category].bucket.Reset(limits_.category[category]);
+  }
+  queued_count_.clear();
+  recent_keys_.clear();
+  recent_count_.clear();
+  historical_sent_.clear();
+  shared_.Reset({limits_.messages_per_second, limits_.message_burst});
+  refilled_at_ = Clock::now();
+}
+
+void RequestPacer::Refill(Clock::time_point now) {
+  if (now <= refilled_at_) return;
+
+  double elapsed = Seconds(now - refilled_at_).count();
+  shared_.Refill(elapsed);
+  for (Queue &queue : queues_) queue.bucket.Refill(elapsed);
+  refilled_at_ = now;
+}
+
+void RequestPacer::Expire(Clock::time_point now) {
+  auto window = std::chrono::duration_cast<Clock::duration>(
+      Seconds(limits_.historical_window_seconds));
+  while (!historical_sent_.empty() && historical_sent_.front() + window <= now) {
+    historical_sent_.pop_front();
+  }
+
+  auto identical = std::chrono::duration_cast<Clock::duration>(
+      Seconds(limits_.identical_window_seconds));
+  while (!recent_keys_.empty() && recent_keys_.front().first + identical <= now) {
+    const std::string &key = recent_keys_.front().second;
+    if (--recent_count_[key] == 0) recent_count_.erase(key);
+    recent_keys_.pop_front();
+  }
+}
+
+bool RequestPacer::HistoricalAllowed() const {
+  return historical_sent_.size() < limits_.historical_per_window;
+}
+
+bool RequestPacer::Borrows(PacingCategory category, double seconds) const {
+  if (category == kPaceHistorical) return false;
+
+  for (int other = 0; other < kPaceCategoryCount; ++other) {
+    const Queue &queue = queues_[other];
+    if (other == category || queue.requests.empty()) continue;
+    if (other == kPaceHistorical && !HistoricalAllowed()) continue;
+    if (queue.bucket.SecondsToToken(seconds) == 0.0) return false;
+  }
+  return true;
+}
+
+RequestPacer::Clock::time_point RequestPacer::ReadyAt(
+    PacingCategory category, Clock::time_point now) const {
+  double elapsed =
+      now > refilled_at_ ? Seconds(now - refilled_at_).count() : 0.0;
+  double wait = shared_.SecondsToToken(elapsed);
+  if (!Borrows(category, elapsed)) {
+    wait = std::max(wait, queues_[category].bucket.SecondsToToken(elapsed));
+  }
+  Clock::time_point ready =
+      now + std::chrono::duration_cast<Clock::duration>(Seconds(wait));
+
+  if (category == kPaceHistorical && !HistoricalAllowed()) {
+    Clock::time_point slot =
+        historical_sent_.front() +
+        std::chrono::duration_cast<Clock::duration>(
+            Seconds(limits_.historical_window_seconds));
+    ready = std::max(ready, slot);
+  }
+  return ready;
+}
+
+}  // namespace tws
+}  // namespace premia
@@ -0,0 +1,149 @@
+#ifndef RequestPacer_hpp
+#define RequestPacer_hpp
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace premia {
+namespace tws {
+
+// Orders are served first, historical requests last. Each category has its
+// own token bucket, and every request also takes a token from the shared
+// connection budget. Orders and general requests may go past their own
+// bucket while no other category has a request ready, so an idle category's
+// share is not lost; historical requests never do, TWS paces them apart.
+enum PacingCategory {
+  kPaceOrders,
+  kPaceGeneral,
+  kPaceHistorical,
+  kPaceCategoryCount
+};
+
+struct BucketLimits {
+  double per_second;
+  double burst;
+};
+
+struct PacingLimits {
+  // TWS disconnects above 50 messages/s; stay under it for direct calls
+  double messages_per_second = 45.0;
+  double message_burst = 45.0;
+  // each category's share while the others have work, so a flood of one
+  // cannot starve the others out of the shared budget; by PacingCategory
+  BucketLimits category[kPaceCategoryCount] = {
+      {25.0, 10.0}, {15.0, 15.0}, {5.0, 5.0}};
+  // historical data: 60 requests per 10 minutes, no identical request
+  // within 15 seconds
+  size_t historical_per_window = 60;
+  double historical_window_seconds = 600.0;
+  double identical_window_seconds = 15.0;
+};
+
+struct PacingStats {
+  uint64_t sent = 0;
+  uint64_t deferred = 0;
+  uint64_t suppressed = 0;
+  size_t queued = 0;
+  double mean_wait_ms = 0.0;
+  double max_wait_ms = 0.0;
+};
+
+// Sits in front of EClient and releases requests at a rate TWS accepts.
+//
+// Callers Submit() a closure that makes the EClient call. Pump(), run from
+// the client's message loop, sends as many queued requests as their
+// category's bucket, the shared bucket and the historical sliding window
+// allow. Requests with a key
+// are dropped if the same key is still queued, or for historical requests,
+// if it went out within the identical-request window.
+class RequestPacer {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Send = std::function<void()>;
+
+  explicit RequestPacer(PacingLimits limits = PacingLimits());
+
+  // id identifies the request for Cancel() (use -1 if never cancelled); key
+  // describes its content for duplicate suppression (empty disables it).
+  // Returns false if the request was suppressed.
+  bool Submit(PacingCategory category, long id, const std::string &key,
+              Send send, Clock::time_point now = Clock::now());
+
+  // Removes a request that has not gone out yet. Returns false if it was
+  // already sent, in which case the caller must cancel it with TWS.
+  bool Cancel(long id);
+
+  // Sends what the budgets allow right now; returns how many went out.
+  size_t Pump(Clock::time_point now = Clock::now());
+
+  // How long until the next queued request may be sent, zero if one is
+  // ready now, Clock::duration::max() if nothing is queued.
+  Clock::duration NextDelay(Clock::time_point now = Clock::now()) const;
+
+  size_t Pending() const;
+  PacingStats Stats(PacingCategory category) const;
+
+  // Drops everything queued and the pacing history, e.g. on disconnect.
+  void Clear();
+
+ private:
+  struct Request {
+    long id;
+    std::string key;
+    Send send;
+    Clock::time_point queued_at;
+  };
+
+  struct Bucket {
+    double tokens = 0.0;
+    double per_second = 0.0;
+    double burst = 0.0;
+
+    void Reset(const BucketLimits &limits);
+    void Refill(double seconds);
+    // when the bucket, refilled for seconds more, has a whole token
+    double SecondsToToken(double seconds) const;
+  };
+
+  struct Queue {
+    Bucket bucket;
+    std::deque<Request> requests;
+    PacingStats stats;
+    double total_wait_ms = 0.0;
+  };
+
+  void Refill(Clock::time_point now);
+  void Expire(Clock::time_point now);
+  bool HistoricalAllowed() const;
+  // whether a category may spend shared tokens past its own bucket, with
+  // the buckets refilled for seconds more
+  bool Borrows(PacingCategory category, double seconds) const;
+  Clock::time_point ReadyAt(PacingCategory category,
+                            Clock::time_point now) const;
+
+  PacingLimits limits_;
+  mutable std::mutex mutex_;
+  Queue queues_[kPaceCategoryCount];
+
+  Bucket shared_;
+  Clock::time_point refilled_at_;
+
+  // send times inside the historical window, oldest first
+  std::deque<Clock::time_point> historical_sent_;
+  // keys recently sent, oldest first, and how many of each are queued
+  std::deque<std::pair<Clock::time_point, std::string>> recent_keys_;
+  std::unordered_map<std::string, int> recent_count_;
+  std::unordered_map<std::string, int> queued_count_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
@@ -0,0 +1,214 @@
+#include "RequestRouter.hpp"
+
+namespace premia {
+namespace tws {
+
+namespace {
+
+// 2100-2199 are farm status and other notices sent against a reqId that
+// do not end the request
+bool IsWarning(int code) { return code >= 2100 && code < 2200; }
+
+std::exception_ptr MakeError(int code, const std::string &message) {
+  return std::make_exception_ptr(RequestError(code, message));
+}
+
+}  // namespace
+
+RequestRouter::RequestRouter(int first_id) : next_id_(first_id) {}
+
+RequestTicket<HistoricalBars> RequestRouter::RequestHistoricalData(
+    Send send, CancelFn cancel, Clock::duration timeout) {
+  return Start<HistoricalBars>(std::move(send), std::move(cancel), timeout);
+}
+
+RequestTicket<HistoricalTicks> RequestRouter::RequestHistoricalTicks(
+    Send send, CancelFn cancel, Clock::duration timeout) {
+  return Start<HistoricalTicks>(std::move(send), std::move(cancel), timeout);
+}
+
+RequestTicket<std::vector<ContractDetails>>
+RequestRouter::RequestContractDetails(Send send, CancelFn cancel,
+                                      Clock::duration timeout) {
+  return Start<std::vector<ContractDetails>>(std::move(send),
+                                             std::move(cancel), timeout);
+}
+
+int RequestRouter::RequestContractDetails(Send send, CancelFn cancel,
+                                          Clock::duration timeout,
+                                          ContractDetailsDone done) {
+  return Start<std::vector<ContractDetails>>(std::move(send),
+                                             std::move(cancel), timeout,
+                                             std::move(done))
+      .id;
+}
+
+RequestTicket<std::vector<AccountSummaryRow>>
+RequestRouter::RequestAccountSummary(Send send, CancelFn cancel,
+                                     Clock::duration timeout) {
+  return Start<std::vector<AccountSummaryRow>>(std::move(send),
+                                               std::move(cancel), timeout);
+}
+
+void RequestRouter::OnHistoricalData(int id, const Bar &bar) {
+  Update<HistoricalBars>(
+      id, [&bar](HistoricalBars *value) { value->bars.push_back(bar); });
+}
+
+void RequestRouter::OnHistoricalDataEnd(int id, const std::string &start,
+                                        const std::string &end) {
+  Update<HistoricalBars>(id, [&](HistoricalBars *value) {
+    value->start = start;
+    value->end = end;
+  });
+  Complete<HistoricalBars>(id);
+}
+
+bool RequestRouter::OnHistoricalTicks(
+    int id, const std::vector<HistoricalTick> &ticks, bool done) {
+  bool routed = Update<HistoricalTicks>(id, [&ticks](HistoricalTicks *value) {
+    for (const HistoricalTick &tick : ticks) {
+      HistoricalTickRow row;
+      row.time = tick.time;
+      row.price = tick.price;
+      row.size = tick.size;
+      value->ticks.push_back(row);
+    }
+  });
+  if (routed && done) Complete<HistoricalTicks>(id);
+  return routed;
+}
+
+bool RequestRouter::OnHistoricalTicks(
+    int id, const std::vector<HistoricalTickBidAsk> &ticks, bool done) {
+  bool routed = Update<HistoricalTicks>(id, [&ticks](HistoricalTicks *value) {
+    for (const HistoricalTickBidAsk &tick : ticks) {
+      HistoricalTickRow row;
+      row.time = tick.time;
+      row.bid = tick.priceBid;
+      row.ask = tick.priceAsk;
+      row.bid_size = tick.sizeBid;
+      row.ask_size = tick.sizeAsk;
+      row.attrib = (tick.tickAttribBidAsk.bidPastLow ? 1 : 0) |
+                   (tick.tickAttribBidAsk.askPastHigh ? 2 : 0);
+      value->ticks.push_back(row);
+    }
+  });
+  if (routed && done) Complete<HistoricalTicks>(id);
+  return routed;
+}
+
+bool RequestRouter::OnHistoricalTicks(
+    int id, const std::vector<HistoricalTickLast> &ticks, bool done) {
+  bool routed = Update<HistoricalTicks>(id, [&ticks](HistoricalTicks *value) {
+    for (const HistoricalTickLast &tick : ticks) {
+      HistoricalTickRow row;
+      row.time = tick.time;
+      row.price = tick.price;
+      row.size = tick.size;
+      row.attrib = (tick.tickAttribLast.pastLimit ? 1 : 0) |
+                   (tick.tickAttribLast.unreported ? 2 : 0);
+      row.exchange = tick.exchange;
+      row.conditions = tick.specialConditions;
+      value->ticks.push_back(row);
+    }
+  });
+  if (routed && done) Complete<HistoricalTicks>(id);
+  return routed;
+}
+
+void RequestRouter::OnContractDetails(int id,
+                                      const ContractDetails &details) {
+  Update<std::vector<ContractDetails>>(
+      id, [&details](std::vector<ContractDetails> *value) {
+        value->push_back(details);
+      });
+}
+
+void RequestRouter::OnContractDetailsEnd(int id) {
+  Complete<std::vector<ContractDetails>>(id);
+}
+
+void RequestRouter::OnAccountSummary(int id, const std::string &account,
+                                     const std::string &tag,
+                                     const std::string &value,
+                                     const std::string &currency) {
+  Update<std::vector<AccountSummaryRow>>(
+      id, [&](std::vector<AccountSummaryRow> *rows) {
+        rows->push_back(AccountSummaryRow{account, tag, value, currency});
+      });
+}
+
+bool RequestRouter::OnAccountSummaryEnd(int id) {
+  return Complete<std::vector<AccountSummaryRow>>(id);
+}
+
+bool RequestRouter::OnError(int id, int code, const std::string &message) {
+  if (IsWarning(code)) return false;
+
+  std::unique_ptr<PendingBase> pending = Take(id);
+  if (!pending) return false;
+
+  pending->Fail(MakeError(code, message));
+  return true;
+}
+
+bool RequestRouter::Cancel(int id) {
+  std::unique_ptr<PendingBase> pending = Take(id);
+  if (!pending) return false;
+
+  if (pending->cancel) pending->cancel(id);
+  pending->Fail(MakeError(kRequestCancelled, "request cancelled"));
+  return true;
+}
+
+size_t RequestRouter::Expire(Clock::time_point now) {
+  std::vector<std::pair<int, std::unique_ptr<PendingBase>>> expired;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = pending_.begin(); it != pending_.end();) {
+      if (it->second->deadline <= now) {
+        expired.emplace_back(it->first, std::move(it->second));
+        it = pending_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  for (auto &entry : expired) {
+    if (entry.second->cancel) entry.second->cancel(entry.first);
+    entry.second->Fail(MakeError(kRequestTimedOut, "request timed out"));
+  }
+  return expired.size();
+}
+
+void RequestRouter::FailAll(int code, const std::string &message) {
+  std::unordered_map<int, std::unique_ptr<PendingBase>> failed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed.swap(pending_);
+  }
+
+  // nothing to cancel, TWS forgets requests with the connection
+  for (auto &entry : failed) entry.second->Fail(MakeError(code, message));
+}
+
+size_t RequestRouter::Outstanding() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_.size();
+}
+
+std::unique_ptr<RequestRouter::PendingBase> RequestRouter::Take(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = pending_.find(id);
+  if (it == pending_.end()) return nullptr;
+
+  std::unique_ptr<PendingBase> pending = std::move(it->second);
+  pending_.erase(it);
+  return pending;
+}
+
+}  // namespace tws
+}  // namespace premia
@@ -0,0 +1,253 @@
+#ifndef RequestRouter_hpp
+#define RequestRouter_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tws/Contract.h"
+#include "tws/HistoricalTick.h"
+#include "tws/HistoricalTickBidAsk.h"
+#include "tws/HistoricalTickLast.h"
+#include "tws/bar.h"
+
+namespace premia {
+namespace tws {
+
+// Codes a RequestError carries when the failure did not come from TWS.
+enum RequestErrorCode {
+  kRequestTimedOut = -1,
+  kRequestCancelled = -2,
+  kRequestDisconnected = -3
+};
+
+// What a request future throws: a TWS error() code or a RequestErrorCode.
+class RequestError : public std::runtime_error {
+ public:
+  RequestError(int code, const std::string &message)
+      : std::runtime_error(message), code_(code) {}
+  int code() const { return code_; }
+
+ private:
+  int code_;
+};
+
+struct AccountSummaryRow {
+  std::string account;
+  std::string tag;
+  std::string value;
+  std::string currency;
+};
+
+struct HistoricalBars {
+  std::vector<Bar> bars;
+  std::string start;
+  std::string end;
+};
+
+// One reqHistoricalTicks row, whatever was asked for: TRADES fill price,
+// size, exchange and conditions, BID_ASK the quote columns, MIDPOINT the
+// price alone. attrib holds pastLimit/bidPastLow in bit 0 and
+// unreported/askPastHigh in bit 1.
+struct HistoricalTickRow {
+  int64_t time = 0;  // seconds since the epoch
+  double price = 0.0;
+  long long size = 0;
+  double bid = 0.0;
+  double ask = 0.0;
+  long long bid_size = 0;
+  long long ask_size = 0;
+  int attrib = 0;
+  std::string exchange;
+  std::string conditions;
+};
+
+struct HistoricalTicks {
+  std::vector<HistoricalTickRow> ticks;
+};
+
+template <typename T>
+struct RequestTicket {
+  int id;
+  std::future<T> result;
+};
+
+// Turns the reqId keyed EWrapper callbacks into futures.
+//
+// Each Request*() allocates a reqId, registers it and hands the id to send,
+// which makes the EClient call (directly or through the RequestPacer). Rows
+// accumulate until the matching *End callback fulfils the future; an error()
+// for the reqId, Cancel(), Expire() past the deadline or FailAll() on
+// disconnect complete it with a RequestError instead. Callbacks may come
+// from the EReader thread while application threads start requests.
+class RequestRouter {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Send = std::function<void(int id)>;
+  // Tells TWS to stop a request that timed out or was cancelled.
+  using CancelFn = std::function<void(int id)>;
+
+  // Ids start well above the ones the sample code hard-codes.
+  explicit RequestRouter(int first_id = 100000);
+
+  RequestTicket<HistoricalBars> RequestHistoricalData(
+      Send send, CancelFn cancel, Clock::duration timeout);
+  RequestTicket<HistoricalTicks> RequestHistoricalTicks(
+      Send send, CancelFn cancel, Clock::duration timeout);
+  RequestTicket<std::vector<ContractDetails>> RequestContractDetails(
+      Send send, CancelFn cancel, Clock::duration timeout);
+  // Same request, but done is called with the rows or the error instead of
+  // a future being fulfilled, on whichever thread completes it. Returns
+  // the reqId.
+  using ContractDetailsDone = std::function<void(
+      std::vector<ContractDetails> rows, std::exception_ptr error)>;
+  int RequestContractDetails(Send send, CancelFn cancel,
+                             Clock::duration timeout,
+                             ContractDetailsDone done);
+  RequestTicket<std::vector<AccountSummaryRow>> RequestAccountSummary(
+      Send send, CancelFn cancel, Clock::duration timeout);
+
+  void OnHistoricalData(int id, const Bar &bar);
+  void OnHistoricalDataEnd(int id, const std::string &start,
+                           const std::string &end);
+  // historicalTicks*; done completes the request. Returns true if the
+  // ticks belonged to a routed request.
+  bool OnHistoricalTicks(int id, const std::vector<HistoricalTick> &ticks,
+                         bool done);
+  bool OnHistoricalTicks(int id,
+                         const std::vector<HistoricalTickBidAsk> &ticks,
+                         bool done);
+  bool OnHistoricalTicks(int id, const std::vector<HistoricalTickLast> &ticks,
+                         bool done);
+  void OnContractDetails(int id, const ContractDetails &details);
+  void OnContractDetailsEnd(int id);
+  void OnAccountSummary(int id, const std::string &account,
+                        const std::string &tag, const std::string &value,
+                        const std::string &currency);
+  // Returns true if it completed a routed request; the subscription behind
+  // it is still open and should be cancelled.
+  bool OnAccountSummaryEnd(int id);
+  // Returns true if the error belonged to a routed request.
+  bool OnError(int id, int code, const std::string &message);
+
+  // Returns false if the request already completed.
+  bool Cancel(int id);
+  // Fails every request whose deadline has passed; returns how many.
+  size_t Expire(Clock::time_point now = Clock::now());
+  void FailAll(int code, const std::string &message);
+
+  size_t Outstanding() const;
+
+ private:
+  struct PendingBase {
+    virtual ~PendingBase() = default;
+    virtual void Fail(std::exception_ptr error) = 0;
+    Clock::time_point deadline;
+    CancelFn cancel;
+  };
+
+  template <typename T>
+  struct Pending : PendingBase {
+    void Fail(std::exception_ptr error) override {
+      if (done) {
+        done(T(), error);
+      } else {
+        promise.set_exception(error);
+      }
+    }
+    std::promise<T> promise;
+    // when set, takes the place of the promise
+    std::function<void(T, std::exception_ptr)> done;
+    T value;
+  };
+
+  template <typename T>
+  RequestTicket<T> Start(Send send, CancelFn cancel, Clock::duration timeout,
+                         std::function<void(T, std::exception_ptr)> done =
+                             nullptr);
+  // Runs fn on the pending value if id is a live request of type T;
+  // returns whether it was.
+  template <typename T, typename Fn>
+  bool Update(int id, Fn fn);
+  template <typename T>
+  bool Complete(int id);
+  std::unique_ptr<PendingBase> Take(int id);
+
+  std::atomic<int> next_id_;
+  mutable std::mutex mutex_;
+  std::unordered_map<int, std::unique_ptr<PendingBase>> pending_;
+};
+
+template <typename T>
+RequestTicket<T> RequestRouter::Start(
+    Send send, CancelFn cancel, Clock::duration timeout,
+    std::function<void(T, std::exception_ptr)> done) {
+  auto pending = std::make_unique<Pending<T>>();
+  pending->deadline = Clock::now() + timeout;
+  pending->cancel = std::move(cancel);
+  pending->done = std::move(done);
+
+  RequestTicket<T> ticket;
+  ticket.id = next_id_++;
+  if (!pending->done) ticket.result = pending->promise.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_[ticket.id] = std::move(pending);
+  }
+
+  // registered first, so a reply racing the send still finds its request
+  send(ticket.id);
+  return ticket;
+}
+
+template <typename T, typename Fn>
+bool RequestRouter::Update(int id, Fn fn) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = pending_.find(id);
+  if (it == pending_.end()) return false;
+
+  auto *pending = dynamic_cast<Pending<T> *>(it->second.get());
+  if (pending == nullptr) return false;
+  fn(&pending->value);
+  return true;
+}
+
+template <typename T>
+bool RequestRouter::Complete(int id) {
+  std::unique_ptr<PendingBase> taken;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = pending_.find(id);
+    if (it == pending_.end()) return false;
+    if (dynamic_cast<Pending<T> *>(it->second.get()) == nullptr) return false;
+
+    taken = std::move(it->second);
+    pending_.erase(it);
+  }
+
+  // fulfilled outside the lock, continuations may start new requests
+  auto *pending = static_cast<Pending<T> *>(taken.get());
+  if (pending->done) {
+    pending->done(std::move(pending->value), nullptr);
+  } else {
+    pending->promise.set_value(std::move(pending->value));
+  }
+  return true;
+}
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
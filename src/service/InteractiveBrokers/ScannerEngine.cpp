@@ -0,0 +1,201 @@
+#include "ScannerEngine.hpp"
+
+#include <algorithm>
+
+namespace premia {
+namespace tws {
+
+ScannerEngine::ScannerEngine(TickerId first_ticker)
+    : next_ticker_(first_ticker) {}
+
+void ScannerEngine::SetMarketData(Subscribe subscribe,
+                                  Unsubscribe unsubscribe) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  subscribe_ = std::move(subscribe);
+  unsubscribe_ = std::move(unsubscribe);
+}
+
+std::string ScannerEngine::KeyOf(const ScanRow &row) {
+  const Contract &contract = row.contract;
+  if (contract.conId != 0) return std::to_string(contract.conId);
+  return contract.symbol + '|' + contract.secType + '|' + contract.currency +
+         '|' + row.legs;
+}
+
+TickerId ScannerEngine::Acquire(
+    const std::string &key, const Contract &contract,
+    std::vector<std::pair<TickerId, Contract>> *open) {
+  if (!subscribe_) return -1;
+  Line &line = lines_[key];
+  if (line.scans++ == 0) {
+    line.ticker = next_ticker_++;
+    open->emplace_back(line.ticker, contract);
+  }
+  return line.ticker;
+}
+
+void ScannerEngine::Release(const std::string &key,
+                            std::vector<TickerId> *close) {
+  auto found = lines_.find(key);
+  if (found == lines_.end()) return;
+  if (--found->second.scans == 0) {
+    close->push_back(found->second.ticker);
+    lines_.erase(found);
+  }
+}
+
+void ScannerEngine::Watch(int req_id, Listener listener) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  scans_[req_id].listener = std::move(listener);
+}
+
+void ScannerEngine::Cancel(int req_id) {
+  Listener listener;
+  std::vector<ScanEvent> events;
+  std::vector<TickerId> close;
+  Unsubscribe unsubscribe;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = scans_.find(req_id);
+    if (found == scans_.end()) return;
+
+    Scan &scan = found->second;
+    events.reserve(scan.rows.size());
+    for (ScanRow &row : scan.rows) {
+      if (row.ticker >= 0) Release(KeyOf(row), &close);
+      ScanEvent event;
+      event.kind = ScanEvent::kExited;
+      event.old_rank = row.rank;
+      event.row = std::move(row);
+      events.push_back(std::move(event));
+    }
+    listener = std::move(scan.listener);
+    unsubscribe = unsubscribe_;
+    scans_.erase(found);
+  }
+
+  if (unsubscribe) {
+    for (TickerId id : close) unsubscribe(id);
+  }
+  if (listener && !events.empty()) listener(req_id, events);
+}
+
+void ScannerEngine::OnRow(int req_id, int rank, const Contract &contract,
+                          const std::string &distance,
+                          const std::string &benchmark,
+                          const std::string &projection,
+                          const std::string &legs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = scans_.find(req_id);
+  if (found == scans_.end()) return;
+
+  ScanRow row;
+  row.rank = rank;
+  row.contract = contract;
+  row.distance = distance;
+  row.benchmark = benchmark;
+  row.projection = projection;
+  row.legs = legs;
+  found->second.staged.push_back(std::move(row));
+}
+
+void ScannerEngine::OnEnd(int req_id) {
+  Listener listener;
+  std::vector<ScanEvent> events;
+  std::vector<std::pair<TickerId, Contract>> open;
+  std::vector<TickerId> close;
+  Subscribe subscribe;
+  Unsubscribe unsubscribe;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = scans_.find(req_id);
+    if (found == scans_.end()) return;
+    Scan &scan = found->second;
+
+    std::vector<ScanRow> &next = scan.staged;
+    std::sort(next.begin(), next.end(),
+              [](const ScanRow &a, const ScanRow &b) {
+                return a.rank < b.rank;
+              });
+
+    // keys still listed are erased from index_of, what remains has exited
+    std::unordered_map<std::string, int> next_index_of;
+    next_index_of.reserve(next.size());
+    for (size_t i = 0; i < next.size(); ++i) {
+      ScanRow &row = next[i];
+      std::string key = KeyOf(row);
+      if (!next_index_of.emplace(key, static_cast<int>(i)).second) continue;
+
+      auto previous = scan.index_of.find(key);
+      if (previous == scan.index_of.end()) {
+        row.ticker = Acquire(key, row.contract, &open);
+        ScanEvent event;
+        event.kind = ScanEvent::kEntered;
+        event.new_rank = row.rank;
+        event.row = row;
+        events.push_back(std::move(event));
+        continue;
+      }
+
+      const ScanRow &old = scan.rows[previous->second];
+      row.ticker = old.ticker;
+      if (old.rank != row.rank) {
+        ScanEvent event;
+        event.kind = ScanEvent::kMoved;
+        event.old_rank = old.rank;
+        event.new_rank = row.rank;
+        event.row = row;
+        events.push_back(std::move(event));
+      }
+      scan.index_of.erase(previous);
+    }
+    for (const auto &gone : scan.index_of) {
+      ScanRow &row = scan.rows[gone.second];
+      if (row.ticker >= 0) Release(gone.first, &close);
+      ScanEvent event;
+      event.kind = ScanEvent::kExited;
+      event.old_rank = row.rank;
+      event.row = std::move(row);
+      events.push_back(std::move(event));
+    }
+
+    // the staging buffer keeps its capacity for the next refresh
+    scan.rows.swap(next);
+    next.clear();
+    scan.index_of.swap(next_index_of);
+    ++scan.refreshes;
+
+    listener = scan.listener;
+    subscribe = subscribe_;
+    unsubscribe = unsubscribe_;
+  }
+
+  if (unsubscribe) {
+    for (TickerId id : close) unsubscribe(id);
+  }
+  if (subscribe) {
+    for (const auto &line : open) subscribe(line.first, line.second);
+  }
+  if (listener && !events.empty()) listener(req_id, events);
+}
+
+std::vector<ScanRow> ScannerEngine::Rows(int req_id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = scans_.find(req_id);
+  if (found == scans_.end()) return {};
+  return found->second.rows;
+}
+
+size_t ScannerEngine::refreshes(int req_id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = scans_.find(req_id);
+  return found == scans_.end() ? 0 : found->second.refreshes;
+}
+
+size_t ScannerEngine::subscriptions() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lines_.size();
+}
+
+}  // namespace tws
+}  // namespace premia
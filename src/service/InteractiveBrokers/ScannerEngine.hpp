@@ -0,0 +1,117 @@
+#ifndef ScannerEngine_hpp
+#define ScannerEngine_hpp
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tws/CommonDefs.h"
+#include "tws/Contract.h"
+
+namespace premia {
+namespace tws {
+
+struct ScanRow {
+  int rank = 0;
+  Contract contract;
+  std::string distance;
+  std::string benchmark;
+  std::string projection;
+  std::string legs;
+  // market data line opened for this contract, -1 if none
+  TickerId ticker = -1;
+};
+
+struct ScanEvent {
+  enum Kind { kEntered, kExited, kMoved };
+
+  Kind kind = kEntered;
+  // rank before and after the refresh; -1 where the row is not listed
+  int old_rank = -1;
+  int new_rank = -1;
+  ScanRow row;
+};
+
+// Keeps the ranked result list of every scanner subscription and turns each
+// refresh into the rows that entered, left or changed rank.
+//
+// TWS resends a whole scan on every refresh: one scannerData() per row, then
+// scannerDataEnd(). Rows are staged per reqId and compared with the current
+// list at the end through a key -> rank map, so a refresh costs O(rows) of
+// its own scanner and scanners that did not refresh cost nothing.
+//
+// With SetMarketData() set, the first scanner listing a contract opens a
+// market data line for it and the last one to drop it closes the line;
+// tickerIds are allocated from first_ticker upwards. Listener and market
+// data calls are made after the engine's lock is released.
+class ScannerEngine {
+ public:
+  using Listener =
+      std::function<void(int req_id, const std::vector<ScanEvent> &events)>;
+  using Subscribe = std::function<void(TickerId id, const Contract &contract)>;
+  using Unsubscribe = std::function<void(TickerId id)>;
+
+  explicit ScannerEngine(TickerId first_ticker = 1 << 24);
+
+  ScannerEngine(const ScannerEngine &) = delete;
+  ScannerEngine &operator=(const ScannerEngine &) = delete;
+
+  void SetMarketData(Subscribe subscribe, Unsubscribe unsubscribe);
+
+  // Starts keeping req_id; listener may be empty.
+  void Watch(int req_id, Listener listener);
+  // Drops req_id, reporting every listed row as exited.
+  void Cancel(int req_id);
+
+  // scannerData / scannerDataEnd. Rows of unwatched reqIds are ignored.
+  void OnRow(int req_id, int rank, const Contract &contract,
+             const std::string &distance, const std::string &benchmark,
+             const std::string &projection, const std::string &legs);
+  void OnEnd(int req_id);
+
+  // Current rows by rank.
+  std::vector<ScanRow> Rows(int req_id) const;
+  // Refreshes applied to req_id so far.
+  size_t refreshes(int req_id) const;
+  // Market data lines open for scanner rows.
+  size_t subscriptions() const;
+
+ private:
+  struct Scan {
+    Listener listener;
+    std::vector<ScanRow> rows;
+    std::vector<ScanRow> staged;
+    // key -> position in rows
+    std::unordered_map<std::string, int> index_of;
+    size_t refreshes = 0;
+  };
+
+  struct Line {
+    TickerId ticker = -1;
+    int scans = 0;
+  };
+
+  // conId, or the contract description for combos without one
+  static std::string KeyOf(const ScanRow &row);
+
+  // Both expect mutex_ held and queue the market data calls to make.
+  TickerId Acquire(const std::string &key, const Contract &contract,
+                   std::vector<std::pair<TickerId, Contract>> *open);
+  void Release(const std::string &key, std::vector<TickerId> *close);
+
+  mutable std::mutex mutex_;
+  Subscribe subscribe_;
+  Unsubscribe unsubscribe_;
+  TickerId next_ticker_;
+  std::unordered_map<int, Scan> scans_;
+  std::unordered_map<std::string, Line> lines_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
@@ -0,0 +1,245 @@
+#include "TickBackfill.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <future>
+#include <thread>
+
+namespace premia {
+namespace tws {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Civil date <-> days since 1970-01-01, proleptic Gregorian, so no time
+// zone or platform timegm is involved.
+int64_t DaysFromCivil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = static_cast<unsigned>(y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+void CivilFromDays(int64_t z, int64_t *y, unsigned *m, unsigned *d) {
+  z += 719468;
+  int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned doe = static_cast<unsigned>(z - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp < 10 ? mp + 3 : mp - 9;
+  *y = static_cast<int64_t>(yoe) + era * 400 + (*m <= 2);
+}
+
+// One window being paged through.
+struct Lane {
+  size_t window = 0;
+  int64_t cursor = 0;
+  int64_t end = 0;
+  std::vector<HistoricalTickRow> rows;
+  // rows kept so far whose time equals cursor
+  size_t kept_at_cursor = 0;
+  int failures = 0;
+  bool done = false;
+  std::future<HistoricalTicks> reply;
+  Clock::time_point retry_at;
+};
+
+}  // namespace
+
+TickBackfill::TickBackfill(Fetch fetch, BackfillOptions options)
+    : fetch_(std::move(fetch)), options_(std::move(options)) {}
+
+std::vector<std::pair<int64_t, int64_t>> TickBackfill::Windows(
+    int64_t start, int64_t end, int64_t length) {
+  std::vector<std::pair<int64_t, int64_t>> windows;
+  if (length <= 0) length = end - start;
+  for (int64_t from = start; from < end; from += length) {
+    windows.emplace_back(from, std::min(end, from + length));
+  }
+  return windows;
+}
+
+std::string TickBackfill::FormatTime(int64_t time) {
+  int64_t days = time >= 0 ? time / 86400 : (time - 86399) / 86400;
+  int64_t seconds = time - days * 86400;
+  int64_t year;
+  unsigned month, day;
+  CivilFromDays(days, &year, &month, &day);
+
+  char text[64];
+  std::snprintf(text, sizeof(text), "%04lld%02u%02u-%02d:%02d:%02d",
+                static_cast<long long>(year), month, day,
+                static_cast<int>(seconds / 3600),
+                static_cast<int>(seconds / 60 % 60),
+                static_cast<int>(seconds % 60));
+  return text;
+}
+
+int64_t TickBackfill::ParseTime(const std::string &text) {
+  int year = 0, hour = 0, minute = 0, second = 0;
+  unsigned month = 0, day = 0;
+  char separator = 0;
+  int fields = std::sscanf(text.c_str(), "%4d%2u%2u%c%d:%d:%d", &year,
+                           &month, &day, &separator, &hour, &minute,
+                           &second);
+  if (fields != 3 && fields != 7) return -1;
+  if (fields == 7 && separator != ' ' && separator != '-') return -1;
+  if (month < 1 || month > 12 || day < 1 || day > 31 || hour < 0 ||
+      hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 60) {
+    return -1;
+  }
+  return DaysFromCivil(year, month, day) * 86400 + hour * 3600 +
+         minute * 60 + second;
+}
+
+BackfillStats TickBackfill::Run(const Contract &contract, int64_t start,
+                                int64_t end, const Sink &sink) {
+  BackfillStats stats;
+  Clock::time_point started = Clock::now();
+
+  auto windows = Windows(start, end, options_.window_seconds);
+  stats.windows = windows.size();
+  std::vector<std::vector<HistoricalTickRow>> results(windows.size());
+  std::vector<bool> finished(windows.size(), false);
+  size_t next_window = 0;
+  size_t flushed = 0;
+  std::vector<Lane> lanes;
+
+  auto issue = [&](Lane &lane) {
+    ++stats.requests;
+    lane.reply = fetch_(contract, FormatTime(lane.cursor),
+                        options_.ticks_per_request, options_.what_to_show,
+                        options_.use_rth)
+                     .result;
+  };
+
+  // Keeps the new ticks of a page; returns true if the window needs
+  // another one.
+  auto absorb = [&](Lane &lane, const HistoricalTicks &page) {
+    size_t skip = lane.kept_at_cursor;
+    size_t fresh = 0;
+    bool past_end = false;
+    for (const HistoricalTickRow &row : page.ticks) {
+      if (row.time < lane.cursor || (row.time == lane.cursor && skip > 0)) {
+        if (row.time == lane.cursor) --skip;
+        ++stats.duplicates;
+        continue;
+      }
+      if (row.time >= lane.end) {
+        past_end = true;
+        break;
+      }
+      lane.rows.push_back(row);
+      ++fresh;
+    }
+
+    if (past_end ||
+        page.ticks.size() < static_cast<size_t>(options_.ticks_per_request)) {
+      return false;
+    }
+    if (fresh == 0) {
+      // a single second holds more than a page; move on rather than loop
+      ++stats.truncated_seconds;
+      ++lane.cursor;
+      lane.kept_at_cursor = 0;
+      return lane.cursor < lane.end;
+    }
+    lane.cursor = lane.rows.back().time;
+    lane.kept_at_cursor = 0;
+    for (auto row = lane.rows.rbegin();
+         row != lane.rows.rend() && row->time == lane.cursor; ++row) {
+      ++lane.kept_at_cursor;
+    }
+    return true;
+  };
+
+  while (flushed < windows.size()) {
+    while (lanes.size() < options_.max_in_flight &&
+           next_window < windows.size()) {
+      Lane lane;
+      lane.window = next_window;
+      lane.cursor = windows[next_window].first;
+      lane.end = windows[next_window].second;
+      ++next_window;
+      issue(lane);
+      lanes.push_back(std::move(lane));
+    }
+
+    bool progressed = false;
+    Clock::time_point now = Clock::now();
+    for (Lane &lane : lanes) {
+      if (!lane.reply.valid()) {
+        if (now >= lane.retry_at) issue(lane);
+        continue;
+      }
+      if (lane.reply.wait_for(std::chrono::seconds(0)) !=
+          std::future_status::ready) {
+        continue;
+      }
+      progressed = true;
+
+      HistoricalTicks page;
+      try {
+        page = lane.reply.get();
+      } catch (const std::exception &) {
+        if (++lane.failures > options_.max_retries) {
+          ++stats.failed_windows;
+          lane.rows.clear();
+          lane.done = true;
+        } else {
+          ++stats.retries;
+          lane.retry_at = now + options_.retry_delay;
+        }
+        continue;
+      }
+      lane.failures = 0;
+      if (absorb(lane, page)) {
+        issue(lane);
+      } else {
+        lane.done = true;
+      }
+    }
+
+    for (Lane &lane : lanes) {
+      if (!lane.done) continue;
+      results[lane.window] = std::move(lane.rows);
+      finished[lane.window] = true;
+    }
+    lanes.erase(std::remove_if(lanes.begin(), lanes.end(),
+                               [](const Lane &lane) { return lane.done; }),
+                lanes.end());
+
+    while (flushed < windows.size() && finished[flushed]) {
+      std::vector<HistoricalTickRow> rows = std::move(results[flushed]);
+      stats.ticks += rows.size();
+      if (!rows.empty() && sink) sink(rows);
+      ++flushed;
+    }
+
+    if (!progressed && flushed < windows.size()) {
+      // replies arrive on the client's thread; wait on the oldest one
+      auto waiting = std::find_if(lanes.begin(), lanes.end(),
+                                  [](const Lane &lane) {
+                                    return lane.reply.valid();
+                                  });
+      if (waiting != lanes.end()) {
+        waiting->reply.wait_for(std::chrono::milliseconds(20));
+      } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      }
+    }
+  }
+
+  stats.seconds =
+      std::chrono::duration<double>(Clock::now() - started).count();
+  return stats;
+}
+
+}  // namespace tws
+}  // namespace premia
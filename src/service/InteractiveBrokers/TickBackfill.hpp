@@ -0,0 +1,90 @@
+#ifndef TickBackfill_hpp
+#define TickBackfill_hpp
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RequestRouter.hpp"
+#include "tws/Contract.h"
+
+namespace premia {
+namespace tws {
+
+struct BackfillOptions {
+  std::string what_to_show = "TRADES";
+  int use_rth = 0;
+  // each window is paged through on its own, windows run side by side
+  int64_t window_seconds = 3600;
+  size_t max_in_flight = 6;
+  int ticks_per_request = 1000;
+  // a failed page is retried after retry_delay, which must outlast the
+  // pacer's identical-request window
+  int max_retries = 3;
+  std::chrono::milliseconds retry_delay = std::chrono::seconds(16);
+};
+
+struct BackfillStats {
+  size_t windows = 0;
+  size_t failed_windows = 0;
+  size_t requests = 0;
+  size_t retries = 0;
+  size_t ticks = 0;
+  // ticks dropped because an earlier page already had them
+  size_t duplicates = 0;
+  // seconds holding more ticks than TWS would page through; the ticks
+  // past the first page of each are missing from the output
+  size_t truncated_seconds = 0;
+  double seconds = 0.0;
+};
+
+// Pulls every historical tick of a time range, 1000 ticks per request.
+//
+// The range is cut into windows, and up to max_in_flight of them are
+// fetched at once through Fetch, normally Client::fetchHistoricalTicks or
+// ConnectionPool::FetchHistoricalTicks, whose pacer decides how fast the
+// requests really go out. Within a window each page starts at the time of
+// the last tick of the one before, so the ticks of that second are
+// repeated; the count already kept for it is skipped. Pages end when TWS
+// returns a short page or passes the window's end, and ticks at or past
+// the end are left to the next window, so windows join without overlap.
+// Finished windows go to the sink strictly in time order, as soon as every
+// window before them is done.
+class TickBackfill {
+ public:
+  using Fetch = std::function<RequestTicket<HistoricalTicks>(
+      const Contract &contract, const std::string &start_date_time,
+      int number_of_ticks, const std::string &what_to_show, int use_rth)>;
+  using Sink = std::function<void(const std::vector<HistoricalTickRow> &)>;
+
+  explicit TickBackfill(Fetch fetch,
+                        BackfillOptions options = BackfillOptions());
+
+  // Blocks until [start, end) has been fetched; times in seconds since the
+  // epoch. A window whose page fails max_retries times is skipped and
+  // counted in failed_windows.
+  BackfillStats Run(const Contract &contract, int64_t start, int64_t end,
+                    const Sink &sink);
+
+  static std::vector<std::pair<int64_t, int64_t>> Windows(int64_t start,
+                                                          int64_t end,
+                                                          int64_t length);
+  // "yyyymmdd-hh:mm:ss", the UTC form TWS accepts for startDateTime.
+  static std::string FormatTime(int64_t time);
+  // "yyyymmdd", "yyyymmdd hh:mm:ss" or "yyyymmdd-hh:mm:ss" read as UTC;
+  // -1 if malformed.
+  static int64_t ParseTime(const std::string &text);
+
+ private:
+  Fetch fetch_;
+  BackfillOptions options_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
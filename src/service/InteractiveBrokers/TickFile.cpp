@@ -0,0 +1,315 @@
+#include "TickFile.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+
+namespace premia {
+namespace tws {
+
+namespace {
+
+const char kMagic[8] = {'P', 'R', 'E', 'M', 'T', 'I', 'C', 'K'};
+const uint32_t kVersion = 1;
+
+enum Column {
+  kTime,
+  kPrice,
+  kSize,
+  kBid,
+  kAsk,
+  kBidSize,
+  kAskSize,
+  kAttrib,
+  kExchange,
+  kConditions,
+  kColumnCount
+};
+
+uint64_t Zigzag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+int64_t Unzigzag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+void PutVarint(std::string *out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void PutString(std::string *out, const std::string &value) {
+  PutVarint(out, value.size());
+  out->append(value);
+}
+
+// Bounds checked reads over a block or the header.
+struct Cursor {
+  const char *at;
+  const char *end;
+  bool ok = true;
+
+  uint64_t Varint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (at == end) break;
+      uint8_t byte = static_cast<uint8_t>(*at++);
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) return value;
+    }
+    ok = false;
+    return 0;
+  }
+
+  std::string String() {
+    uint64_t size = Varint();
+    if (!ok || size > static_cast<uint64_t>(end - at)) {
+      ok = false;
+      return std::string();
+    }
+    std::string value(at, static_cast<size_t>(size));
+    at += size;
+    return value;
+  }
+};
+
+int64_t Scaled(double price, double scale) {
+  return static_cast<int64_t>(std::llround(price * scale));
+}
+
+// Interns strings into a block's table, in order of first use.
+class StringTable {
+ public:
+  uint64_t Index(const std::string &value) {
+    auto found = index_.find(value);
+    if (found != index_.end()) return found->second;
+    uint64_t index = strings_.size();
+    index_.emplace(value, index);
+    strings_.push_back(value);
+    return index;
+  }
+
+  void Write(std::string *out) const {
+    PutVarint(out, strings_.size());
+    for (const std::string &value : strings_) PutString(out, value);
+  }
+
+ private:
+  std::unordered_map<std::string, uint64_t> index_;
+  std::vector<std::string> strings_;
+};
+
+}  // namespace
+
+TickFileWriter::~TickFileWriter() { Close(); }
+
+bool TickFileWriter::Open(const std::string &path, const TickFileInfo &info) {
+  Close();
+  file_.open(path, std::ios::binary | std::ios::trunc);
+  if (!file_) return false;
+
+  price_scale_ = info.price_scale > 0.0 ? info.price_scale : 1e6;
+  std::string header(kMagic, sizeof(kMagic));
+  PutVarint(&header, kVersion);
+  PutString(&header, info.symbol);
+  PutVarint(&header, Zigzag(info.con_id));
+  PutString(&header, info.what_to_show);
+  char scale[sizeof(double)];
+  std::memcpy(scale, &price_scale_, sizeof(scale));
+  header.append(scale, sizeof(scale));
+
+  file_.write(header.data(), header.size());
+  rows_ = 0;
+  bytes_ = header.size();
+  return static_cast<bool>(file_);
+}
+
+bool TickFileWriter::Append(const std::vector<HistoricalTickRow> &rows) {
+  if (!file_.is_open()) return false;
+  if (rows.empty()) return true;
+
+  uint32_t present = 1u << kTime;
+  for (const HistoricalTickRow &row : rows) {
+    if (row.price != 0.0) present |= 1u << kPrice;
+    if (row.size != 0) present |= 1u << kSize;
+    if (row.bid != 0.0) present |= 1u << kBid;
+    if (row.ask != 0.0) present |= 1u << kAsk;
+    if (row.bid_size != 0) present |= 1u << kBidSize;
+    if (row.ask_size != 0) present |= 1u << kAskSize;
+    if (row.attrib != 0) present |= 1u << kAttrib;
+    if (!row.exchange.empty()) present |= 1u << kExchange;
+    if (!row.conditions.empty()) present |= 1u << kConditions;
+  }
+
+  std::string &body = block_;
+  body.clear();
+  PutVarint(&body, present);
+  for (int column = 0; column < kColumnCount; ++column) {
+    if ((present & (1u << column)) == 0) continue;
+
+    int64_t previous = 0;
+    auto delta = [&](int64_t value) {
+      PutVarint(&body, Zigzag(value - previous));
+      previous = value;
+    };
+    switch (column) {
+      case kTime:
+        for (const auto &row : rows) delta(row.time);
+        break;
+      case kPrice:
+        for (const auto &row : rows) delta(Scaled(row.price, price_scale_));
+        break;
+      case kBid:
+        for (const auto &row : rows) delta(Scaled(row.bid, price_scale_));
+        break;
+      case kAsk:
+        for (const auto &row : rows) delta(Scaled(row.ask, price_scale_));
+        break;
+      case kSize:
+        for (const auto &row : rows) PutVarint(&body, Zigzag(row.size));
+        break;
+      case kBidSize:
+        for (const auto &row : rows) PutVarint(&body, Zigzag(row.bid_size));
+        break;
+      case kAskSize:
+        for (const auto &row : rows) PutVarint(&body, Zigzag(row.ask_size));
+        break;
+      case kAttrib:
+        for (const auto &row : rows) PutVarint(&body, row.attrib);
+        break;
+      case kExchange:
+      case kConditions: {
+        StringTable table;
+        std::vector<uint64_t> indexes;
+        indexes.reserve(rows.size());
+        for (const auto &row : rows) {
+          indexes.push_back(table.Index(column == kExchange ? row.exchange
+                                                            : row.conditions));
+        }
+        table.Write(&body);
+        for (uint64_t index : indexes) PutVarint(&body, index);
+        break;
+      }
+    }
+  }
+
+  std::string head;
+  PutVarint(&head, rows.size());
+  PutVarint(&head, body.size());
+  file_.write(head.data(), head.size());
+  file_.write(body.data(), body.size());
+  rows_ += rows.size();
+  bytes_ += head.size() + body.size();
+  return static_cast<bool>(file_);
+}
+
+void TickFileWriter::Close() {
+  if (file_.is_open()) file_.close();
+}
+
+bool ReadTickFile(const std::string &path, TickFileInfo *info,
+                  std::vector<HistoricalTickRow> *rows) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  std::string data((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  if (data.size() < sizeof(kMagic) ||
+      std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+    return false;
+  }
+
+  Cursor in{data.data() + sizeof(kMagic), data.data() + data.size()};
+  if (in.Varint() != kVersion) return false;
+  info->symbol = in.String();
+  info->con_id = static_cast<long>(Unzigzag(in.Varint()));
+  info->what_to_show = in.String();
+  if (!in.ok || in.end - in.at < static_cast<long>(sizeof(double))) {
+    return false;
+  }
+  std::memcpy(&info->price_scale, in.at, sizeof(double));
+  in.at += sizeof(double);
+  double scale = info->price_scale;
+
+  rows->clear();
+  while (in.at < in.end) {
+    uint64_t count = in.Varint();
+    uint64_t size = in.Varint();
+    if (!in.ok || size > static_cast<uint64_t>(in.end - in.at) ||
+        count > size) {
+      return false;
+    }
+    Cursor block{in.at, in.at + size};
+    in.at += size;
+
+    size_t first = rows->size();
+    rows->resize(first + count);
+    HistoricalTickRow *out = rows->data() + first;
+    uint32_t present = static_cast<uint32_t>(block.Varint());
+    for (int column = 0; column < kColumnCount; ++column) {
+      if ((present & (1u << column)) == 0) continue;
+
+      int64_t previous = 0;
+      auto delta = [&]() {
+        previous += Unzigzag(block.Varint());
+        return previous;
+      };
+      if (column == kExchange || column == kConditions) {
+        // every entry takes at least its length byte; check before sizing
+        uint64_t entries = block.Varint();
+        if (!block.ok ||
+            entries > static_cast<uint64_t>(block.end - block.at)) {
+          return false;
+        }
+        std::vector<std::string> table(static_cast<size_t>(entries));
+        for (std::string &value : table) value = block.String();
+        for (uint64_t i = 0; i < count && block.ok; ++i) {
+          uint64_t index = block.Varint();
+          if (index >= table.size()) return false;
+          (column == kExchange ? out[i].exchange : out[i].conditions) =
+              table[index];
+        }
+        continue;
+      }
+      for (uint64_t i = 0; i < count && block.ok; ++i) {
+        HistoricalTickRow &row = out[i];
+        switch (column) {
+          case kTime:
+            row.time = delta();
+            break;
+          case kPrice:
+            row.price = delta() / scale;
+            break;
+          case kBid:
+            row.bid = delta() / scale;
+            break;
+          case kAsk:
+            row.ask = delta() / scale;
+            break;
+          case kSize:
+            row.size = Unzigzag(block.Varint());
+            break;
+          case kBidSize:
+            row.bid_size = Unzigzag(block.Varint());
+            break;
+          case kAskSize:
+            row.ask_size = Unzigzag(block.Varint());
+            break;
+          case kAttrib:
+            row.attrib = static_cast<int>(block.Varint());
+            break;
+        }
+      }
+    }
+    if (!block.ok) return false;
+  }
+  return true;
+}
+
+}  // namespace tws
+}  // namespace premia
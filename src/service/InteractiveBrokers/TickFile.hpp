@@ -0,0 +1,65 @@
+#ifndef TickFile_hpp
+#define TickFile_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "RequestRouter.hpp"
+
+namespace premia {
+namespace tws {
+
+struct TickFileInfo {
+  std::string symbol;
+  long con_id = 0;
+  std::string what_to_show;
+  // prices are stored as integers of 1 / price_scale
+  double price_scale = 1e6;
+};
+
+// Historical ticks stored column by column in blocks.
+//
+// The file starts with the magic "PREMTICK", a format version and the
+// TickFileInfo. Each Append() writes one block: its row count, byte size,
+// a bitmask of the columns present, then each present column in turn.
+// Times and prices are zigzag varint deltas from the previous row, sizes
+// and attributes plain varints, exchange and conditions indexes into a
+// per-block string table. Columns that are zero on every row of a block
+// (the quote columns of TRADES, the trade columns of BID_ASK) are left
+// out, so a TRADES tick costs a few bytes instead of the 80 odd of a row.
+class TickFileWriter {
+ public:
+  TickFileWriter() = default;
+  ~TickFileWriter();
+
+  TickFileWriter(const TickFileWriter &) = delete;
+  TickFileWriter &operator=(const TickFileWriter &) = delete;
+
+  bool Open(const std::string &path, const TickFileInfo &info);
+  // Rows are expected in time order; an empty call writes nothing.
+  bool Append(const std::vector<HistoricalTickRow> &rows);
+  void Close();
+
+  size_t rows() const { return rows_; }
+  size_t bytes() const { return bytes_; }
+
+ private:
+  std::ofstream file_;
+  double price_scale_ = 1e6;
+  std::string block_;
+  size_t rows_ = 0;
+  size_t bytes_ = 0;
+};
+
+// Reads a whole tick file back; false if it is missing, not a tick file or
+// a block is truncated.
+bool ReadTickFile(const std::string &path, TickFileInfo *info,
+                  std::vector<HistoricalTickRow> *rows);
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
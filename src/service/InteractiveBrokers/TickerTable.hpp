@@ -0,0 +1,157 @@
+#ifndef TickerTable_hpp
+#define TickerTable_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+#include "tws/CommonDefs.h"
+
+namespace premia {
+namespace tws {
+
+// Open-addressed map from TickerId to a dense slot number. Lookups, inserts
+// and removals never lock or allocate, so the EReader thread and any reader
+// can resolve ids concurrently. Remove() leaves a tombstone that lookups
+// probe past and inserts take over, so a long session that keeps opening
+// and cancelling lines does not run out of slots. Inserts of one id should
+// come from one thread at a time; each user of the table has one writer.
+class TickerIndex {
+ public:
+  static constexpr TickerId kEmpty = std::numeric_limits<TickerId>::min();
+  static constexpr TickerId kRemoved = kEmpty + 1;
+
+  explicit TickerIndex(size_t capacity) {
+    capacity_ = 16;
+    while (capacity_ < capacity) capacity_ <<= 1;
+    mask_ = capacity_ - 1;
+    keys_.reset(new std::atomic<TickerId>[capacity_]);
+    for (size_t i = 0; i < capacity_; ++i) {
+      keys_[i].store(kEmpty, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns the slot for id, or -1 if it was never inserted.
+  int Find(TickerId id) const {
+    size_t index = Hash(id) & mask_;
+    for (size_t probe = 0; probe < capacity_; ++probe) {
+      size_t slot = (index + probe) & mask_;
+      TickerId current = keys_[slot].load(std::memory_order_acquire);
+      if (current == id) return static_cast<int>(slot);
+      if (current == kEmpty) return -1;
+    }
+    return -1;
+  }
+
+  // Returns the slot for id, claiming a free one if needed; -1 when full.
+  // inserted, when given, says whether the slot was just claimed, in which
+  // case whatever a removed id left there is stale.
+  int FindOrInsert(TickerId id, bool *inserted = nullptr) {
+    if (inserted != nullptr) *inserted = false;
+    size_t index = Hash(id) & mask_;
+    int reuse = -1;
+    for (size_t probe = 0; probe < capacity_; ++probe) {
+      int slot = static_cast<int>((index + probe) & mask_);
+      TickerId current = keys_[slot].load(std::memory_order_acquire);
+      if (current == id) return slot;
+      if (current == kRemoved) {
+        if (reuse < 0) reuse = slot;
+        continue;
+      }
+      if (current != kEmpty) continue;
+
+      // id is not further along the chain; prefer the first tombstone
+      if (reuse >= 0 && Claim(reuse, kRemoved, id)) slot = reuse;
+      else if (!Claim(slot, kEmpty, id)) {
+        if (keys_[slot].load(std::memory_order_acquire) == id) return slot;
+        reuse = -1;
+        continue;
+      }
+      if (inserted != nullptr) *inserted = true;
+      return slot;
+    }
+    if (reuse < 0 || !Claim(reuse, kRemoved, id)) return -1;
+    if (inserted != nullptr) *inserted = true;
+    return reuse;
+  }
+
+  // Frees the slot of id; false if it was not there.
+  bool Remove(TickerId id) {
+    int slot = Find(id);
+    if (slot < 0) return false;
+    TickerId current = id;
+    return keys_[slot].compare_exchange_strong(current, kRemoved,
+                                               std::memory_order_acq_rel);
+  }
+
+  TickerId IdAt(size_t slot) const {
+    return keys_[slot].load(std::memory_order_acquire);
+  }
+
+  size_t capacity() const { return capacity_; }
+
+ private:
+  bool Claim(int slot, TickerId expected, TickerId id) {
+    return keys_[slot].compare_exchange_strong(expected, id,
+                                               std::memory_order_acq_rel);
+  }
+
+  static size_t Hash(TickerId id) {
+    uint64_t x = static_cast<uint64_t>(id) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(x ^ (x >> 29));
+  }
+
+  size_t capacity_;
+  size_t mask_;
+  std::unique_ptr<std::atomic<TickerId>[]> keys_;
+};
+
+// A value guarded by a sequence lock. One thread writes, any number of
+// threads read; readers retry instead of blocking the writer. seq is odd
+// while a write is in progress and only ever grows, so it doubles as a
+// version number for change detection (0 means never written).
+template <typename T>
+struct alignas(64) SeqlockSlot {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "seqlock values are copied while the writer may be active");
+
+  std::atomic<uint64_t> seq{0};
+  T data{};
+
+  template <typename Fn>
+  void Write(Fn &&update) {
+    uint64_t current = seq.load(std::memory_order_relaxed);
+    seq.store(current + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    update(data);
+    seq.store(current + 2, std::memory_order_release);
+  }
+
+  // copy(const T&) pulls out whatever part of the value the caller needs.
+  template <typename Fn>
+  bool Read(Fn &&copy, uint64_t *version = nullptr) const {
+    for (;;) {
+      uint64_t before = seq.load(std::memory_order_acquire);
+      if (before == 0) return false;
+      if (before & 1) continue;
+
+      copy(data);
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      if (seq.load(std::memory_order_relaxed) == before) {
+        if (version != nullptr) *version = before;
+        return true;
+      }
+    }
+  }
+
+  uint64_t version() const { return seq.load(std::memory_order_acquire); }
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
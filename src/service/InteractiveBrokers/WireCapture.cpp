@@ -0,0 +1,203 @@
+#include "WireCapture.hpp"
+
+#include <cstring>
+#include <iterator>
+
+#include "tws/EDecoder.h"
+
+namespace premia {
+namespace tws {
+
+namespace {
+
+constexpr char kMagic[8] = {'P', 'R', 'E', 'M', 'W', 'I', 'R', 'E'};
+// records are appended here and written out in blocks of this size
+constexpr size_t kFlushBytes = 1 << 20;
+
+template <typename T>
+void Append(std::vector<char> *buffer, const T &value) {
+  const char *bytes = reinterpret_cast<const char *>(&value);
+  buffer->insert(buffer->end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+bool Extract(const std::vector<char> &data, size_t *offset, T *value) {
+  if (data.size() - *offset < sizeof(T)) return false;
+  std::memcpy(value, data.data() + *offset, sizeof(T));
+  *offset += sizeof(T);
+  return true;
+}
+
+}  // namespace
+
+WireCapture::~WireCapture() { Close(); }
+
+bool WireCapture::Open(const std::string &path, int server_version) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (file_.is_open()) {
+    file_.write(buffer_.data(), buffer_.size());
+    file_.close();
+  }
+  file_.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file_) return false;
+
+  int32_t version = server_version;
+  int64_t started_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+  buffer_.clear();
+  buffer_.reserve(kFlushBytes + 4096);
+  buffer_.insert(buffer_.end(), kMagic, kMagic + sizeof(kMagic));
+  Append(&buffer_, version);
+  Append(&buffer_, started_ns);
+
+  start_ = std::chrono::steady_clock::now();
+  messages_ = 0;
+  bytes_ = 0;
+  return true;
+}
+
+void WireCapture::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (!file_.is_open()) return;
+  file_.write(buffer_.data(), buffer_.size());
+  buffer_.clear();
+  file_.close();
+}
+
+bool WireCapture::is_open() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return file_.is_open();
+}
+
+void WireCapture::onMessage(const char *data, unsigned int size) {
+  auto now = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!file_.is_open()) return;
+
+  int64_t elapsed =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now - start_)
+          .count();
+
+  uint32_t length = size;
+  Append(&buffer_, elapsed);
+  Append(&buffer_, length);
+  buffer_.insert(buffer_.end(), data, data + size);
+  ++messages_;
+  bytes_ += size;
+
+  if (buffer_.size() >= kFlushBytes) {
+    file_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+}
+
+size_t WireCapture::messages() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return messages_;
+}
+
+size_t WireCapture::bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+double ReplayStats::MessagesPerSecond() const {
+  return seconds > 0.0 ? messages / seconds : 0.0;
+}
+
+bool WireReplay::Load(const std::string &path) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file) return false;
+
+  std::vector<char> raw((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+  if (raw.size() < sizeof(kMagic) ||
+      std::memcmp(raw.data(), kMagic, sizeof(kMagic)) != 0) {
+    return false;
+  }
+
+  size_t offset = sizeof(kMagic);
+  int32_t version;
+  int64_t started_ns;
+  if (!Extract(raw, &offset, &version) || !Extract(raw, &offset, &started_ns)) {
+    return false;
+  }
+
+  // payloads are copied together so a replay walks one contiguous block
+  std::vector<char> data;
+  std::vector<Message> messages;
+  data.reserve(raw.size());
+  for (;;) {
+    Message message;
+    if (!Extract(raw, &offset, &message.timestamp_ns) ||
+        !Extract(raw, &offset, &message.size) ||
+        raw.size() - offset < message.size) {
+      break;
+    }
+    message.offset = data.size();
+    data.insert(data.end(), raw.begin() + offset,
+                raw.begin() + offset + message.size);
+    offset += message.size;
+    messages.push_back(message);
+  }
+
+  server_version_ = version;
+  started_ns_ = started_ns;
+  data_ = std::move(data);
+  messages_ = std::move(messages);
+  return true;
+}
+
+const char *WireReplay::payload(const Message &message) const {
+  return data_.data() + message.offset;
+}
+
+ReplayStats WireReplay::Run(EWrapper *wrapper, size_t repeat) const {
+  ReplayStats stats;
+  EDecoder decoder(server_version_, wrapper);
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t pass = 0; pass < repeat; ++pass) {
+    for (const Message &message : messages_) {
+      if (message.size == 0) continue;
+
+      const char *begin = payload(message);
+      if (decoder.parseAndProcessMsg(begin, begin + message.size) <= 0) {
+        ++stats.failed;
+      }
+      ++stats.messages;
+      stats.bytes += message.size;
+    }
+  }
+  stats.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+
+  stats.by_msg_id.resize(MAX_MSG_ID + 1);
+  for (int id = 0; id <= MAX_MSG_ID; ++id) {
+    stats.by_msg_id[id] = decoder.msgCount(id);
+  }
+  return stats;
+}
+
+std::string WireReplay::Framed() const {
+  std::string out;
+  out.reserve(data_.size() + messages_.size() * 4);
+  for (const Message &message : messages_) {
+    uint32_t length = message.size;
+    char prefix[4] = {static_cast<char>(length >> 24),
+                      static_cast<char>(length >> 16),
+                      static_cast<char>(length >> 8),
+                      static_cast<char>(length)};
+    out.append(prefix, sizeof(prefix));
+    out.append(payload(message), message.size);
+  }
+  return out;
+}
+
+}  // namespace tws
+}  // namespace premia
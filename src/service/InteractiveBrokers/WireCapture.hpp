@@ -0,0 +1,99 @@
+#ifndef WireCapture_hpp
+#define WireCapture_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tws/EReader.h"
+
+class EWrapper;
+
+namespace premia {
+namespace tws {
+
+// Records what the EReader thread receives, one record per framed message.
+//
+// The file starts with an 8 byte magic, the negotiated server version and
+// the wall clock time of Open() in ns since the epoch. Each record is the ns
+// elapsed since Open() (int64), the payload size (uint32) and the payload
+// exactly as EDecoder sees it, without the V100 length prefix. Integers are
+// in host byte order.
+class WireCapture : public EReaderCapture {
+ public:
+  WireCapture() = default;
+  ~WireCapture() override;
+
+  WireCapture(const WireCapture &) = delete;
+  WireCapture &operator=(const WireCapture &) = delete;
+
+  bool Open(const std::string &path, int server_version);
+  void Close();
+  bool is_open() const;
+
+  // EReaderCapture
+  void onMessage(const char *data, unsigned int size) override;
+
+  size_t messages() const;
+  size_t bytes() const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::ofstream file_;
+  std::vector<char> buffer_;
+  std::chrono::steady_clock::time_point start_;
+  size_t messages_ = 0;
+  size_t bytes_ = 0;
+};
+
+struct ReplayStats {
+  size_t messages = 0;
+  size_t bytes = 0;
+  // messages EDecoder could not consume
+  size_t failed = 0;
+  double seconds = 0.0;
+  // decoded messages indexed by EDecoder message id
+  std::vector<long long> by_msg_id;
+
+  double MessagesPerSecond() const;
+};
+
+// A capture loaded into memory, to be decoded again without a socket.
+class WireReplay {
+ public:
+  struct Message {
+    int64_t timestamp_ns;
+    size_t offset;
+    uint32_t size;
+  };
+
+  // False if the file is missing or not a capture; a truncated last record
+  // is dropped.
+  bool Load(const std::string &path);
+
+  int server_version() const { return server_version_; }
+  int64_t started_ns() const { return started_ns_; }
+  size_t size() const { return messages_.size(); }
+  const std::vector<Message> &messages() const { return messages_; }
+  const char *payload(const Message &message) const;
+
+  // Feeds every message to one EDecoder::parseAndProcessMsg back to back,
+  // `repeat` times, ignoring the recorded timing.
+  ReplayStats Run(EWrapper *wrapper, size_t repeat = 1) const;
+  // The messages with V100 length prefixes, for MockTwsServer::SendRaw.
+  std::string Framed() const;
+
+ private:
+  int server_version_ = 0;
+  int64_t started_ns_ = 0;
+  std::vector<char> data_;
+  std::vector<Message> messages_;
+};
+
+}  // namespace tws
+}  // namespace premia
+
+#endif
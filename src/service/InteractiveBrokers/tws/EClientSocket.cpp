@@ -94,6 +94,21 @@ ESocket *EClientSocket::getTransport() {
     return static_cast<ESocket*>(m_transport.get());
 }
 
+void EClientSocket::beginBatch() {
+    getTransport()->beginBatch();
+}
+
+bool EClientSocket::endBatch() {
+    if (getTransport()->endBatch() < 0)
+        return handleSocketError();
+
+    return true;
+}
+
+void EClientSocket::setNoDelay(bool enable) {
+    getTransport()->noDelay(enable);
+}
+
 bool EClientSocket::eConnectImpl(int clientId, bool extraAuth, ConnState* stateOutPt)
 {
 	// resolve host
@@ -36,6 +36,11 @@ public:
     void asyncEConnect(bool val);
     ESocket *getTransport();
 
+    // coalesce the requests issued between these calls into few writes
+    void beginBatch();
+    bool endBatch();
+    void setNoDelay(bool enable);
+
     void allowRedirect(bool v);
     bool allowRedirect() const; 
 
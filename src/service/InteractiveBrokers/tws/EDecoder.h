@@ -5,6 +5,8 @@
 #ifndef TWS_API_CLIENT_EDECODER_H
 #define TWS_API_CLIENT_EDECODER_H
 
+#include <atomic>
+
 #include "platformspecific.h"
 #include "Contract.h"
 #include "HistoricalTick.h"
@@ -200,6 +202,7 @@ const int ORDER_BOUND                               = 100;
 const int COMPLETED_ORDER                           = 101;
 const int COMPLETED_ORDERS_END                      = 102;
 const int REPLACE_FA_END                            = 103;
+const int MAX_MSG_ID                                = REPLACE_FA_END;
 
 const int HEADER_LEN = 4; // 4 bytes for msg length
 const int MAX_MSG_LEN = 0xFFFFFF; // 16Mb - 1byte
@@ -237,13 +240,20 @@ struct EClientMsgSink;
 
 class TWSAPIDLLEXP EDecoder
 {
+    typedef const char* (EDecoder::*MsgHandler)(const char* ptr, const char* endPtr);
+
     EWrapper *m_pEWrapper;
     int m_serverVersion;
     EClientMsgSink *m_pClientMsgSink;
+    // indexed by message id, rebuilt whenever the server version changes
+    MsgHandler m_handlers[MAX_MSG_ID + 1];
+    std::atomic<long long> m_msgCounts[MAX_MSG_ID + 1];
 
-    const char* processTickPriceMsg(const char* ptr, const char* endPtr);
+    void buildDispatchTable();
+
+    template<bool pastLimit, bool preOpen> const char* processTickPriceMsg(const char* ptr, const char* endPtr);
     const char* processTickSizeMsg(const char* ptr, const char* endPtr);
-    const char* processTickOptionComputationMsg(const char* ptr, const char* endPtr);
+    template<bool priceBasedVolatility> const char* processTickOptionComputationMsg(const char* ptr, const char* endPtr);
     const char* processTickGenericMsg(const char* ptr, const char* endPtr);
     const char* processTickStringMsg(const char* ptr, const char* endPtr);
     const char* processTickEfpMsg(const char* ptr, const char* endPtr);
@@ -258,7 +268,7 @@ class TWSAPIDLLEXP EDecoder
     const char* processBondContractDataMsg(const char* ptr, const char* endPtr);
     const char* processExecutionDetailsMsg(const char* ptr, const char* endPtr);
     const char* processMarketDepthMsg(const char* ptr, const char* endPtr);
-    const char* processMarketDepthL2Msg(const char* ptr, const char* endPtr);
+    template<bool smartDepth> const char* processMarketDepthL2Msg(const char* ptr, const char* endPtr);
     const char* processNewsBulletinsMsg(const char* ptr, const char* endPtr);
     const char* processManagedAcctsMsg(const char* ptr, const char* endPtr);
     const char* processReceiveFaMsg(const char* ptr, const char* endPtr);
@@ -354,6 +364,11 @@ public:
     EDecoder(int serverVersion, EWrapper *callback, EClientMsgSink *clientMsgSink = 0);
 
     int parseAndProcessMsg(const char*& beginPtr, const char* endPtr);
+
+    // messages decoded per message id since construction or the last reset;
+    // safe to read from any thread
+    long long msgCount(int msgId) const;
+    void resetMsgCounts();
 };
 
 #define DECODE_FIELD(x) if (!EDecoder::DecodeField(x, ptr, endPtr)) return 0;
@@ -29,6 +29,7 @@ EReader::EReader(EClientSocket *clientSocket, EReaderSignal *signal)
 		m_pEReaderSignal = signal;
 		m_nMaxBufSize = IN_BUF_SIZE_DEFAULT;
 		m_buf.reserve(IN_BUF_SIZE_DEFAULT);
+		m_pCapture = 0;
 }
 
 EReader::~EReader(void) {
@@ -47,6 +48,24 @@ EReader::~EReader(void) {
 #endif
 }
 
+void EReader::setCapture(EReaderCapture *capture) {
+	EMutexGuard lock(m_csCapture);
+
+	m_pCapture = capture;
+}
+
+void EReader::captureMsg(const std::vector<char> &msg) {
+	// the unlocked check keeps the cost at one load when nothing records
+	if (!m_pCapture)
+		return;
+
+	EMutexGuard lock(m_csCapture);
+
+	EReaderCapture *capture = m_pCapture;
+	if (capture)
+		capture->onMessage(msg.data(), msg.size());
+}
+
 void EReader::start() {
 #if defined(IB_POSIX)
     pthread_create( &m_hReadThread, NULL, readToQueueThread, this );
@@ -218,6 +237,8 @@ EMessage * EReader::readSingleMsg() {
 		if (!bufferedRead(buf.data(), buf.size()))
 			return 0;
 
+		captureMsg(buf);
+
 		return new EMessage(buf);
 	}
 	else {
@@ -243,6 +264,8 @@ EMessage * EReader::readSingleMsg() {
 		if (!bufferedRead(msgData.data(), msgSize))
 			return 0;
 
+		captureMsg(msgData);
+
 		if (m_buf.size() < IN_BUF_SIZE_DEFAULT && m_buf.capacity() > IN_BUF_SIZE_DEFAULT)
 		{
 			m_buf.resize(m_nMaxBufSize = IN_BUF_SIZE_DEFAULT);
@@ -16,6 +16,13 @@ class EClientSocket;
 struct EReaderSignal;
 class EMessage;
 
+struct EReaderCapture
+{
+	virtual ~EReaderCapture() {}
+	// called on the reader thread with the payload of every inbound message
+	virtual void onMessage(const char *data, unsigned int size) = 0;
+};
+
 class TWSAPIDLLEXP EReader
 {  
     EClientSocket *m_pClientSocket;
@@ -31,8 +38,11 @@ class TWSAPIDLLEXP EReader
     HANDLE m_hReadThread;
 #endif
 	unsigned int m_nMaxBufSize;
+	std::atomic<EReaderCapture *> m_pCapture;
+	EMutex m_csCapture;
 
 	void onReceive();
+	void captureMsg(const std::vector<char> &msg);
 	void onSend();
 	bool bufferedRead(char *buf, unsigned int size);
 
@@ -58,6 +68,10 @@ public:
     void processMsgs(void);
 	bool putMessageToQueue();
 	void start();
+	// Records inbound messages until called again with 0. The capture must
+	// outlive the reader or be detached first.
+	void setCapture(EReaderCapture *capture);
+	const EDecoder &decoder() const { return processMsgsDecoder_; }
 };
 
 #endif
\ No newline at end of file
@@ -64,10 +64,14 @@ void EReaderOSSignal::issueSignal() {
 }
 
 void EReaderOSSignal::waitForSignal() {
+    waitForSignal(m_waitTimeout);
+}
+
+void EReaderOSSignal::waitForSignal(unsigned long waitTimeout) {
 #if defined(IB_POSIX)
     pthread_mutex_lock(&m_mutex); 
     if (!open) {
-        if ( m_waitTimeout == INFINITE ) {
+        if ( waitTimeout == INFINITE ) {
             pthread_cond_wait(&m_evMsgs, &m_mutex);
         }
         else {
@@ -82,8 +86,8 @@ void EReaderOSSignal::waitForSignal() {
             ts.tv_sec = tv.tv_sec;
             ts.tv_nsec = tv.tv_usec * 1000;
 #endif
-            ts.tv_sec += m_waitTimeout / 1000;
-            ts.tv_nsec += 1000 * 1000 * (m_waitTimeout % 1000);
+            ts.tv_sec += waitTimeout / 1000;
+            ts.tv_nsec += 1000 * 1000 * (waitTimeout % 1000);
             ts.tv_sec += ts.tv_nsec / (1000 * 1000 * 1000);
             ts.tv_nsec %= (1000 * 1000 * 1000);
             pthread_cond_timedwait(&m_evMsgs, &m_mutex, &ts);
@@ -92,7 +96,7 @@ void EReaderOSSignal::waitForSignal() {
     open = false;
     pthread_mutex_unlock(&m_mutex);
 #elif defined(IB_WIN32)
-	WaitForSingleObject(m_evMsgs, m_waitTimeout);
+	WaitForSingleObject(m_evMsgs, waitTimeout);
 #else
 #   error "Not implemented on this platform"
 #endif
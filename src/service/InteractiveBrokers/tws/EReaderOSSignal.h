@@ -34,6 +34,8 @@ public:
 
 	virtual void issueSignal();
 	virtual void waitForSignal();
+	// as waitForSignal(), but for at most waitTimeout milliseconds
+	void waitForSignal(unsigned long waitTimeout);
 };
 
 #endif
\ No newline at end of file
@@ -9,14 +9,39 @@
 
 #if defined(IB_POSIX)
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #endif
 
+static const size_t BufferSizeHighMark = 1 * 1024 * 1024; // 1Mb
+static const size_t DefaultBatchFlushBytes = 64 * 1024;
+static const size_t MaxSpareBuffers = 256;
+static const size_t MaxIoVecs = 256;
 
-ESocket::ESocket() {
+ESocket::ESocket()
+    : m_fd(-1)
+    , m_noDelay(false)
+    , m_outOffset(0)
+    , m_outBytes(0)
+    , m_batchDepth(0)
+    , m_batchFlushBytes(DefaultBatchFlushBytes)
+{
 }
 
 void ESocket::fd(int fd) {
+    EMutexGuard lock(m_outMutex);
+
+    // whatever was queued for a previous connection must not leak into this one
+    while( !m_outQueue.empty()) {
+        CleanupBuffer( (int)(m_outQueue.front().size() - m_outOffset));
+    }
+
     m_fd = fd;
+
+    if( m_fd >= 0 && m_noDelay) {
+        applyNoDelay();
+    }
 }
 
 ESocket::~ESocket(void) {
@@ -31,16 +56,22 @@ int ESocket::bufferedSend(const char* buf, size_t sz)
 	if( sz <= 0)
 		return 0;
 
-	if( !m_outBuffer.empty()) {
-		m_outBuffer.insert( m_outBuffer.end(), buf, buf + sz);
-		return sendBufferedData();
+	EMutexGuard lock(m_outMutex);
+
+	if( m_batchDepth > 0 || !m_outQueue.empty()) {
+		enqueue( buf, sz);
+
+		if( m_batchDepth > 0 && m_outBytes < m_batchFlushBytes)
+			return (int)sz;
+
+		return sendQueued();
 	}
 
 	int nResult = send(buf, sz);
 
 	if( nResult < (int)sz) {
 		int sent = (std::max)( nResult, 0);
-		m_outBuffer.insert( m_outBuffer.end(), buf + sent, buf + sz);
+		enqueue( buf + sent, sz - sent);
 	}
 
 	return nResult;
@@ -48,15 +79,123 @@ int ESocket::bufferedSend(const char* buf, size_t sz)
 
 int ESocket::sendBufferedData()
 {
-	if( m_outBuffer.empty())
+	EMutexGuard lock(m_outMutex);
+
+	if( m_batchDepth > 0)
 		return 0;
 
-	int nResult = send( &m_outBuffer[0], m_outBuffer.size());
-	if( nResult <= 0) {
-		return nResult;
+	return sendQueued();
+}
+
+void ESocket::beginBatch()
+{
+	EMutexGuard lock(m_outMutex);
+
+	++m_batchDepth;
+}
+
+int ESocket::endBatch()
+{
+	EMutexGuard lock(m_outMutex);
+
+	if( m_batchDepth > 0 && --m_batchDepth > 0)
+		return 0;
+
+	return sendQueued();
+}
+
+void ESocket::batchFlushBytes(size_t bytes)
+{
+	EMutexGuard lock(m_outMutex);
+
+	m_batchFlushBytes = bytes;
+}
+
+void ESocket::noDelay(bool enable)
+{
+	EMutexGuard lock(m_outMutex);
+
+	m_noDelay = enable;
+
+	if( m_fd >= 0)
+		applyNoDelay();
+}
+
+void ESocket::applyNoDelay()
+{
+	int flag = m_noDelay ? 1 : 0;
+	setsockopt( m_fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&flag, sizeof(flag));
+}
+
+void ESocket::enqueue(const char* buf, size_t sz)
+{
+	if( m_spareBuffers.empty()) {
+		m_outQueue.push_back( std::vector<char>( buf, buf + sz));
 	}
-	CleanupBuffer( m_outBuffer, nResult);
-	return nResult;
+	else {
+		m_outQueue.push_back( std::vector<char>());
+		m_outQueue.back().swap( m_spareBuffers.back());
+		m_spareBuffers.pop_back();
+		m_outQueue.back().assign( buf, buf + sz);
+	}
+
+	m_outBytes += sz;
+}
+
+int ESocket::sendQueued()
+{
+	if( m_outQueue.empty())
+		return 0;
+
+	int total = 0;
+
+	while( !m_outQueue.empty()) {
+#if defined(IB_POSIX)
+		struct iovec iov[MaxIoVecs];
+#else
+		WSABUF iov[MaxIoVecs];
+#endif
+		size_t count = 0;
+		size_t requested = 0;
+		size_t offset = m_outOffset;
+
+		for( std::deque<std::vector<char> >::iterator it = m_outQueue.begin();
+			it != m_outQueue.end() && count < MaxIoVecs; ++it, ++count) {
+			size_t len = it->size() - offset;
+#if defined(IB_POSIX)
+			iov[count].iov_base = &(*it)[offset];
+			iov[count].iov_len = len;
+#else
+			iov[count].buf = &(*it)[offset];
+			iov[count].len = (ULONG)len;
+#endif
+			requested += len;
+			offset = 0;
+		}
+
+#if defined(IB_POSIX)
+		int nResult = (int)::writev( m_fd, iov, (int)count);
+#else
+		DWORD sent = 0;
+		int nResult = WSASend( m_fd, iov, (DWORD)count, &sent, 0, NULL, NULL) == SOCKET_ERROR ? -1 : (int)sent;
+#endif
+
+		if( nResult <= 0) {
+			// report the error only if nothing at all went out on this call
+			if( total > 0)
+				break;
+			return nResult == -1 ? -1 : 0;
+		}
+
+		CleanupBuffer( nResult);
+		total += nResult;
+
+		// kernel buffer is full, the reader thread will retry once writable
+		if( (size_t)nResult < requested)
+			break;
+	}
+
+	return total;
 }
 
 int ESocket::send(const char* buf, size_t sz)
@@ -75,32 +214,45 @@ int ESocket::send(const char* buf, size_t sz)
 	return nResult;
 }
 
-static const size_t BufferSizeHighMark = 1 * 1024 * 1024; // 1Mb
-
-void ESocket::CleanupBuffer(std::vector<char>& buffer, int processed)
+void ESocket::CleanupBuffer(int processed)
 {
-	assert( buffer.empty() || processed <= (int)buffer.size());
+	assert( m_outQueue.empty() || (size_t)processed <= m_outBytes);
 
-	if( buffer.empty())
+	if( m_outQueue.empty())
 		return;
 
 	if( processed <= 0)
 		return;
 
-	if( (size_t)processed == buffer.size()) {
-		if( buffer.capacity() >= BufferSizeHighMark) {
-			std::vector<char>().swap(buffer);
+	m_outBytes -= processed;
+
+	size_t remaining = processed;
+	while( remaining > 0 && !m_outQueue.empty()) {
+		std::vector<char>& front = m_outQueue.front();
+		size_t left = front.size() - m_outOffset;
+
+		if( remaining < left) {
+			m_outOffset += remaining;
+			break;
 		}
-		else {
-			buffer.clear();
+
+		remaining -= left;
+		m_outOffset = 0;
+
+		// keep the allocation around for the next message unless it grew large
+		if( front.capacity() < BufferSizeHighMark && m_spareBuffers.size() < MaxSpareBuffers) {
+			front.clear();
+			m_spareBuffers.push_back( std::vector<char>());
+			m_spareBuffers.back().swap( front);
 		}
-	}
-	else {
-		buffer.erase( buffer.begin(), buffer.begin() + processed);
+		m_outQueue.pop_front();
 	}
 }
 
 bool ESocket::isOutBufferEmpty() const
 {
-	return m_outBuffer.empty();
+	EMutexGuard lock(m_outMutex);
+
+	// an open batch is flushed by endBatch(), not by the reader's select loop
+	return m_outQueue.empty() || m_batchDepth > 0;
 }
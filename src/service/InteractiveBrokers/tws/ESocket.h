@@ -6,17 +6,32 @@
 #define TWS_API_CLIENT_ESOCKET_H
 
 #include "ETransport.h"
+#include "EMutex.h"
+#include <deque>
 #include <vector>
 
 class ESocket :
     public ETransport
 {
     int m_fd;
-	std::vector<char> m_outBuffer;
+    bool m_noDelay;
+
+    // pending outbound messages, flushed front to back with a single
+    // vectored write; m_outOffset is how much of the front one already went out
+    std::deque<std::vector<char> > m_outQueue;
+    std::vector<std::vector<char> > m_spareBuffers;
+    size_t m_outOffset;
+    size_t m_outBytes;
+    int m_batchDepth;
+    size_t m_batchFlushBytes;
+    mutable EMutex m_outMutex;
 
     int bufferedSend(const char* buf, size_t sz);
     int send(const char* buf, size_t sz);
-    void CleanupBuffer(std::vector<char>& buffer, int processed);
+    int sendQueued();
+    void enqueue(const char* buf, size_t sz);
+    void CleanupBuffer(int processed);
+    void applyNoDelay();
 
 public:
     ESocket();
@@ -26,6 +41,15 @@ public:
     bool isOutBufferEmpty() const;
     int sendBufferedData();
     void fd(int fd);
+
+    // while a batch is open, messages are queued and go out together when
+    // the outermost endBatch() is reached or the queue passes flushBytes
+    void beginBatch();
+    int endBatch();
+    void batchFlushBytes(size_t bytes);
+
+    // TCP_NODELAY, applied now if connected and again on every new fd
+    void noDelay(bool enable);
 };
 
 #endif
\ No newline at end of file
@@ -1,65 +1,121 @@
 /* =============== Account Class =============== */
 #include "Account.hpp"
+
+#include <cmath>
+#include <cstdlib>
+
 namespace premia {
 namespace tda {
+namespace {
+
+const std::unordered_map<std::string, double Balances::*> &balanceFields() {
+  static const std::unordered_map<std::string, double Balances::*> fields = {
+      {"cashBalance", &Balances::cashBalance},
+      {"liquidationValue", &Balances::liquidationValue},
+      {"availableFunds", &Balances::availableFunds},
+      {"longMarketValue", &Balances::longMarketValue},
+      {"shortMarketValue", &Balances::shortMarketValue},
+      {"longOptionMarketValue", &Balances::longOptionMarketValue},
+      {"shortOptionMarketValue", &Balances::shortOptionMarketValue},
+      {"buyingPower", &Balances::buyingPower},
+      {"equity", &Balances::equity},
+      {"equityPercentage", &Balances::equityPercentage},
+      {"marginBalance", &Balances::marginBalance},
+      {"maintenanceRequirement", &Balances::maintenanceRequirement}};
+  return fields;
+}
 
-size_t tda::Account::get_position_vector_size() {
-  return positions_vector.size();
+}  // namespace
+
+size_t tda::Account::get_position_vector_size() const {
+  return positions.size();
 }
 
-void Account::add_position(std::unordered_map<std::string, std::string> position) {
-  positions_vector.push_back(position);
+void Account::add_position(const Position &position) {
+  auto [it, inserted] =
+      position_index.emplace(position.symbol, positions.size());
+  if (inserted) {
+    positions.push_back(position);
+    return;
+  }
+
+  Position &held = positions[it->second];
+  double heldQuantity = held.quantity();
+  double addedQuantity = position.quantity();
+  double heldSize = std::fabs(heldQuantity);
+  double addedSize = std::fabs(addedQuantity);
+  if (heldQuantity * addedQuantity >= 0) {
+    if (heldSize + addedSize > 0) {
+      held.averagePrice = (held.averagePrice * heldSize +
+                           position.averagePrice * addedSize) /
+                          (heldSize + addedSize);
+    }
+  } else if (addedSize > heldSize) {
+    // a short's price says nothing about what a long cost
+    held.averagePrice = position.averagePrice;
+  } else if (addedSize == heldSize) {
+    held.averagePrice = 0.0;
+  }
+  held.longQuantity += position.longQuantity;
+  held.shortQuantity += position.shortQuantity;
+  held.marketValue += position.marketValue;
+  held.currentDayProfitLoss += position.currentDayProfitLoss;
+  held.currentDayCost += position.currentDayCost;
+  held.maintenanceRequirement += position.maintenanceRequirement;
+  double opening = held.marketValue - held.currentDayProfitLoss;
+  held.currentDayProfitLossPercentage =
+      opening != 0 ? 100 * held.currentDayProfitLoss / std::fabs(opening)
+                   : 0.0;
 }
 
-void Account::add_balance(PositionBalances balance) {
-  position_balances.push_back(balance);
+void Account::merge(const Account &other) {
+  for (const Position &position : other.positions) add_position(position);
+  for (const auto &[key, field] : balanceFields()) {
+    current_balances.*field += other.current_balances.*field;
+  }
+  // percentages do not add up
+  Balances &sum = current_balances;
+  sum.equityPercentage =
+      sum.liquidationValue != 0 ? 100 * sum.equity / sum.liquidationValue
+                                : 0.0;
 }
 
 void Account::set_account_variable(std::string key, std::string value) {
   account_info[key] = value;
 }
 
-void Account::set_balance_variable(std::string key, std::string value) {
-  if (!current_balances.count(key)) {
-    current_balances[key] = value;
-  } else {
-    try {
-      double num;
-      num = boost::lexical_cast<double>(value);
-      double balance = boost::lexical_cast<double>(current_balances[key]);
-      num += balance;
-      std::string newEntry = std::to_string(num);
-      current_balances[key] = newEntry.substr(0, newEntry.find('.') + 3);
-    } catch (const boost::wrapexcept<boost::bad_lexical_cast>& e) {
-      // it's fine
-      current_balances[key] = value;
-    }
-  }
+void Account::set_balance_variable(const std::string &key,
+                                   const std::string &value) {
+  const auto &fields = balanceFields();
+  auto field = fields.find(key);
+  if (field == fields.end()) return;
+  char *end = nullptr;
+  double number = std::strtod(value.c_str(), &end);
+  if (end == value.c_str()) return;
+  current_balances.*field->second += number;
 }
 
 void Account::set_primary_account_id(const std::string &key) { account_id = key; }
 
-std::string tda::Account::get_account_variable(std::string variable) {
-  return account_info[variable];
+std::string tda::Account::get_account_variable(
+    const std::string &variable) const {
+  auto it = account_info.find(variable);
+  return it == account_info.end() ? std::string() : it->second;
 }
 
-std::string tda::Account::get_balance_variable(std::string variable) {
-  return current_balances[variable];
-}
+const Balances &tda::Account::get_balances() const { return current_balances; }
 
-std::unordered_map<std::string, std::string> tda::Account::get_position(int index) {
-  return positions_vector[index];
+const Position &tda::Account::get_position(size_t index) const {
+  return positions[index];
 }
 
-std::string tda::Account::get_position_balances(std::string symbol, std::string variable) {
-  std::string found_item;
-  for (int i = 0; i < position_balances.size(); i++) {
-    if (position_balances[i].symbol == symbol) {
-      found_item = position_balances[i].balances[variable];
-    }
-  }
+const std::vector<Position> &tda::Account::get_positions() const {
+  return positions;
+}
 
-  return found_item;
+const Position *tda::Account::find_position(const std::string &symbol) const {
+  auto it = position_index.find(symbol);
+  return it == position_index.end() ? nullptr : &positions[it->second];
 }
 }  // namespace tda
-}  // namespace premia
\ No newline at end of file
+}  // namespace premia
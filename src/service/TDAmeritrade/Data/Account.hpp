@@ -7,12 +7,41 @@
 
 namespace premia {
 namespace tda {
-struct PositionBalances {
+
+// One row of the positions table, numbers parsed once at load.
+struct Position {
   std::string symbol;
-  std::unordered_map<std::string, std::string> balances;
-  int longQuantity;
-  int averagePrice;
-  double dayProfitLoss;
+  std::string cusip;
+  std::string assetType;  // EQUITY, OPTION, ...
+  std::string putCall;
+  std::string underlyingSymbol;
+  std::string description;
+  double longQuantity = 0.0;
+  double shortQuantity = 0.0;
+  double averagePrice = 0.0;
+  double marketValue = 0.0;
+  double currentDayProfitLoss = 0.0;
+  double currentDayProfitLossPercentage = 0.0;
+  double currentDayCost = 0.0;
+  double maintenanceRequirement = 0.0;
+
+  double quantity() const { return longQuantity - shortQuantity; }
+};
+
+// currentBalances, summed over the accounts loaded into one Account
+struct Balances {
+  double cashBalance = 0.0;
+  double liquidationValue = 0.0;
+  double availableFunds = 0.0;
+  double longMarketValue = 0.0;
+  double shortMarketValue = 0.0;
+  double longOptionMarketValue = 0.0;
+  double shortOptionMarketValue = 0.0;
+  double buyingPower = 0.0;
+  double equity = 0.0;
+  double equityPercentage = 0.0;
+  double marginBalance = 0.0;
+  double maintenanceRequirement = 0.0;
 };
 
 class Account {
@@ -20,27 +49,35 @@ class Account {
   int num_positions;
   std::string account_id;
   std::unordered_map<std::string, std::string> account_info;
-  std::unordered_map<std::string, std::string> current_balances;
-  std::vector<std::unordered_map<std::string, std::string>> positions_vector;
-
-  std::vector<PositionBalances> position_balances;
+  Balances current_balances;
+  std::vector<Position> positions;
+  std::unordered_map<std::string, size_t> position_index;  // by symbol
 
  public:
   Account() = default;
 
-  void add_position(std::unordered_map<std::string, std::string> position);
-  void add_balance(PositionBalances balance);
+  // a symbol already held, from another account, is merged into its row;
+  // a long in one account and a short in another net out, and the row
+  // keeps the average price of the larger side
+  void add_position(const Position &position);
+  // adds the other account's positions and balances to this one; the
+  // equity percentage is taken again from the summed equity and
+  // liquidation value
+  void merge(const Account &other);
   void set_account_variable(std::string key, std::string value);
-  void set_balance_variable(std::string key, std::string value);
+  // unknown keys and values that are not numbers are ignored
+  void set_balance_variable(const std::string &key, const std::string &value);
   void set_primary_account_id(const std::string &key);
 
-  size_t get_position_vector_size();
-  std::string get_account_variable(std::string variable);
-  std::string get_balance_variable(std::string variable);
-  std::unordered_map<std::string, std::string> get_position(int index);
-  std::string get_position_balances(std::string symbol, std::string variable);
+  size_t get_position_vector_size() const;
+  std::string get_account_variable(const std::string &variable) const;
+  const Balances &get_balances() const;
+  const Position &get_position(size_t index) const;
+  const std::vector<Position> &get_positions() const;
+  // nullptr when the symbol is not held
+  const Position *find_position(const std::string &symbol) const;
 };
 
 }  // namespace tda
 }  // namespace premia
-#endif
\ No newline at end of file
+#endif
@@ -2,6 +2,7 @@
 
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <sstream>
 #include <string>
 
 #include "PricingStructures.hpp"
@@ -9,27 +10,82 @@
 namespace premia {
 namespace tda {
 
-void Order::prepareOrderString() const {
+Order::Order() = default;
+
+Order::Order(const std::string &orderType, const std::string &session,
+             const std::string &duration, const std::string &price)
+    : orderType(orderType),
+      price(price),
+      session(session),
+      duration(duration),
+      orderStrategyType("SINGLE") {}
+
+Order::~Order() = default;
+
+void Order::setOrderType(const std::string &type) { orderType = type; }
+
+void Order::setSession(const std::string &value) { session = value; }
+
+void Order::setDuration(const std::string &value) { duration = value; }
+
+void Order::setPrice(const std::string &value) { price = value; }
+
+void Order::setOrderStrategyType(const std::string &type) {
+  orderStrategyType = type;
+}
+
+void Order::setComplexOrderStrategyType(const std::string &type) {
+  complexOrderStrategyType = type;
+}
+
+void Order::addLeg(const std::string &instruction, double quantity,
+                   const std::string &symbol, const std::string &assetType) {
+  orderLegCollection.push_back({quantity, symbol, assetType, instruction});
+}
+
+std::string Order::getString() const {
   boost::property_tree::ptree orderPropertyTree;
 
   orderPropertyTree.put("orderType", getOrderType());
   orderPropertyTree.put("session", getSession());
   orderPropertyTree.put("duration", getDuration());
-  orderPropertyTree.put("price", getPrice());
+  // market orders are rejected with a price attached
+  if (!price.empty()) orderPropertyTree.put("price", getPrice());
   orderPropertyTree.put("orderStrategyType", getOrderStrategyType());
+  if (!complexOrderStrategyType.empty()) {
+    orderPropertyTree.put("complexOrderStrategyType",
+                          complexOrderStrategyType);
+  }
+
+  boost::property_tree::ptree legs;
+  for (const auto &each_leg : orderLegCollection) {
+    boost::property_tree::ptree leg;
+    leg.put("instruction", each_leg.instruction);
+    leg.put("quantity", each_leg.quantity);
+    leg.put("instrument.symbol", each_leg.symbol);
+    leg.put("instrument.assetType", each_leg.assetType);
+    legs.push_back(std::make_pair("", leg));
+  }
+  orderPropertyTree.add_child("orderLegCollection", legs);
 
+  std::ostringstream orderJSON;
   try {
-    write_json(orderJSON, orderPropertyTree);
-  } catch (const boost::property_tree::ptree_error& e) {
-    e.what();
+    write_json(orderJSON, orderPropertyTree, false);
+  } catch (const boost::property_tree::ptree_error &) {
+    return "";
   }
+  // ptree quotes every value, but quantities have to go out as numbers
+  std::string body = orderJSON.str();
+  const std::string key = "\"quantity\":\"";
+  for (size_t at = body.find(key); at != std::string::npos;
+       at = body.find(key, at)) {
+    at += key.size() - 1;
+    body.erase(at, 1);
+    body.erase(body.find('"', at), 1);
+  }
+  return body;
 }
 
-Order::Order() = default;
-Order::~Order() = default;
-
-std::string Order::getString() const { return orderJSON; }
-
 std::string Order::getOrderType() const { return orderType; }
 
 std::string Order::getSession() const { return session; }
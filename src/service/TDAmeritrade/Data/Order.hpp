@@ -4,6 +4,7 @@
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <string>
+#include <vector>
 
 #include "PricingStructures.hpp"
 
@@ -12,7 +13,7 @@ namespace tda {
 class Order {
  private:
   struct OrderLegCollection {
-    int quantity;
+    double quantity;
     std::string symbol;
     std::string assetType;
     std::string instruction;
@@ -26,14 +27,22 @@ class Order {
   std::string complexOrderStrategyType;
   std::vector<OrderLegCollection> orderLegCollection;
 
-  std::string orderJSON;
-
-  void prepareOrderString() const;
-
  public:
   Order();
+  Order(const std::string &orderType, const std::string &session,
+        const std::string &duration, const std::string &price = "");
   ~Order();
 
+  void setOrderType(const std::string &type);
+  void setSession(const std::string &session);
+  void setDuration(const std::string &duration);
+  void setPrice(const std::string &price);
+  void setOrderStrategyType(const std::string &type);
+  void setComplexOrderStrategyType(const std::string &type);
+  void addLeg(const std::string &instruction, double quantity,
+              const std::string &symbol, const std::string &assetType);
+
+  // the request body for the order endpoints
   std::string getString() const;
   std::string getOrderType() const;
   std::string getSession() const;
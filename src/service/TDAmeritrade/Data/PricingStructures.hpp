@@ -64,7 +64,22 @@ enum OrderType {
   NET_ZERO
 };
 
-enum OrderStatus { ACCEPTED, WORKING, REJECTED, CANCELED };
+enum OrderStatus {
+  ACCEPTED,
+  WORKING,
+  REJECTED,
+  CANCELED,
+  AWAITING_PARENT_ORDER,
+  AWAITING_CONDITION,
+  AWAITING_MANUAL_REVIEW,
+  PENDING_ACTIVATION,
+  QUEUED,
+  PENDING_CANCEL,
+  PENDING_REPLACE,
+  REPLACED,
+  FILLED,
+  EXPIRED
+};
 
 enum ServiceType {
   NONE,
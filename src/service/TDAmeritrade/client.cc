@@ -19,6 +19,8 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <algorithm>
+#include <cctype>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -56,6 +58,24 @@ static size_t json_write(const char *contents, size_t size, size_t nmemb,
   return new_length;
 }
 
+// Keep the id at the end of a Location header, which is how the order
+// endpoints name the order they created
+static size_t location_write(const char *contents, size_t size, size_t nmemb,
+                             std::string *s) {
+  size_t length = size * nmemb;
+  std::string line(contents, length);
+  std::string name = line.substr(0, 9);
+  std::transform(name.begin(), name.end(), name.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (name == "location:") {
+    while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) {
+      line.pop_back();
+    }
+    *s = line.substr(line.find_last_of('/') + 1);
+  }
+  return length;
+}
+
 namespace tda {
 
 void Client::OpenBrowser() {
@@ -238,25 +258,45 @@ std::string Client::send_request(const std::string &endpoint) const {
 }
 
 // Send an authorized request for data from the API using the json callback
-std::string Client::send_authorized_request(const std::string &endpoint) const {
+std::string Client::send_authorized_request(const std::string &endpoint,
+                                            const std::string &method,
+                                            const std::string &body,
+                                            std::string *location,
+                                            long *status) const {
   CURL *curl;
-  CURLcode res;
   CURLHeader headers = nullptr;
   std::string response;
   std::string auth_bearer = "Authorization: Bearer " + access_token;
 
   curl = curl_easy_init();
+  if (!body.empty()) {
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, body.length());
+  }
   headers = curl_slist_append(headers, auth_bearer.c_str());
 
   curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
   curl_easy_setopt(curl, CURLOPT_URL, endpoint.c_str());
+  if (method != "GET") {
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
+  }
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, json_write);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+  if (location != nullptr) {
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, location_write);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, location);
+  }
   curl_easy_setopt(curl, CURLOPT_USERAGENT, "premia-agent/1.0");
   curl_easy_setopt(curl, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
 
-  res = curl_easy_perform(curl);
+  long code = 0;
+  if (curl_easy_perform(curl) == CURLE_OK) {
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+  }
+  if (status != nullptr) *status = code;
 
+  curl_slist_free_all(headers);
   curl_easy_cleanup(curl);
   return response;
 }
@@ -532,27 +572,8 @@ std::string Client::get_all_accounts() {
 
 // Create a vector of all the account ids present on the API key
 std::vector<std::string> Client::get_all_account_ids() {
-  std::vector<std::string> accounts;
-
-  for (const auto &[key, value] : _user_principals) {
-    if (key == "accounts") {
-      for (const auto &[key2, val2] : value) {
-        for (const auto &[elementKey, elementValue] : val2) {
-          if (elementKey == "accountId") {
-            accounts.push_back(elementValue.get_value<std::string>());
-          }
-        }
-      }
-    }
-
-    if (key == "primaryAccountId") {
-      std::cout << "Here" << value.get_value<std::string>() << std::endl
-                << std::flush;
-      accounts.push_back(value.get_value<std::string>());
-    }
-  }
-
-  return accounts;
+  check_user_principals();
+  return parser.parse_account_ids(_user_principals);
 }
 
 // Request quote data by the instrument symbol
@@ -655,17 +676,37 @@ std::string Client::get_orders_by_query(const std::string &account_id,
   string_replace(endpoint, "{maxResults}", std::to_string(maxResults));
   string_replace(endpoint, "{from}", std::to_string(fromEnteredTime));
   string_replace(endpoint, "{to}", std::to_string(toEnteredTime));
-  string_replace(endpoint, "{status}", "status");
+  string_replace(endpoint, "{status}", EnumAPIOrderStatus[status]);
   return send_authorized_request(endpoint);
 }
 
 // Place an Order for the account by id
-void Client::place_order(const std::string &account_id,
-                         const Order &order) const {
+std::string Client::place_order(const std::string &account_id,
+                                const Order &order, long *status) const {
   std::string endpoint =
       "https://api.tdameritrade.com/v1/accounts/{accountId}/orders";
   string_replace(endpoint, "{accountId}", account_id);
-  post_authorized_request(endpoint, order.getString());
+
+  std::string order_id;
+  long code = 0;
+  send_authorized_request(endpoint, "POST", order.getString(), &order_id,
+                          &code);
+  if (status != nullptr) *status = code;
+  if (code != 200 && code != 201) order_id.clear();
+  return order_id;
+}
+
+// Cancel an Order for the account by id
+bool Client::cancel_order(const std::string &account_id,
+                          const std::string &order_id) const {
+  std::string endpoint =
+      "https://api.tdameritrade.com/v1/accounts/{accountId}/orders/{orderId}";
+  string_replace(endpoint, "{accountId}", account_id);
+  string_replace(endpoint, "{orderId}", order_id);
+
+  long status = 0;
+  send_authorized_request(endpoint, "DELETE", "", nullptr, &status);
+  return status == 200;
 }
 
 // temp function for passing key to client
@@ -60,6 +60,21 @@ static const std::string EnumAPIFreq[]{"minute", "daily", "weekly", "monthly"};
 static const std::string EnumAPIPeriod[]{"1", "2",  "3",  "4", "5",
                                          "6", "10", "15", "20"};
 static const std::string EnumAPIFreqAmt[]{"1", "5", "10", "15", "30"};
+static const std::string EnumAPIOrderStatus[]{
+    "ACCEPTED",
+    "WORKING",
+    "REJECTED",
+    "CANCELED",
+    "AWAITING_PARENT_ORDER",
+    "AWAITING_CONDITION",
+    "AWAITING_MANUAL_REVIEW",
+    "PENDING_ACTIVATION",
+    "QUEUED",
+    "PENDING_CANCEL",
+    "PENDING_REPLACE",
+    "REPLACED",
+    "FILLED",
+    "EXPIRED"};
 static const std::string EnumAPIServiceName[]{
     "NONE",
     "ADMIN",
@@ -153,7 +168,12 @@ class Client {
   std::string get_orders_by_query(const std::string &account_id, int maxResults,
                                   double fromEnteredTime, double toEnteredTime,
                                   OrderStatus status) const;
-  void place_order(const std::string &account_id, const Order &order) const;
+  // the broker's id for the new order, empty if it was not accepted; status
+  // is the HTTP status, 0 when no response came back
+  std::string place_order(const std::string &account_id, const Order &order,
+                          long *status = nullptr) const;
+  bool cancel_order(const std::string &account_id,
+                    const std::string &order_id) const;
 
   void addAuth(const std::string &key, const std::string &token);
 
@@ -192,7 +212,13 @@ class Client {
 
   // API Functions
   std::string send_request(const std::string &endpoint) const;
-  std::string send_authorized_request(const std::string &endpoint) const;
+  // method other than GET, a JSON body, the id of the Location header and
+  // the HTTP status (0 when no response came back) are optional
+  std::string send_authorized_request(const std::string &endpoint,
+                                      const std::string &method = "GET",
+                                      const std::string &body = "",
+                                      std::string *location = nullptr,
+                                      long *status = nullptr) const;
   void post_authorized_request(const std::string &endpoint,
                                const std::string &data) const;
   std::string post_access_token() const;
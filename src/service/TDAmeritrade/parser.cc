@@ -6,6 +6,8 @@
 #include <boost/property_tree/ptree.hpp>
 #include <iostream>
 #include <string>
+#include <unordered_set>
+#include <vector>
 
 #include "data/Account.hpp"
 #include "data/OptionChain.hpp"
@@ -202,6 +204,29 @@ PriceHistory Parser::parse_price_history(const json::ptree &data,
  * @param data
  * @return UserPrincipals
  */
+std::vector<std::string> Parser::parse_account_ids(
+    const json::ptree &data) const {
+  std::vector<std::string> ids;
+  auto primary = data.get_optional<std::string>("primaryAccountId");
+  if (primary && !primary->empty()) ids.push_back(*primary);
+  auto accounts = data.get_child_optional("accounts");
+  if (accounts) {
+    for (const auto &account : *accounts) {
+      auto id = account.second.get_optional<std::string>("accountId");
+      if (id && !id->empty()) ids.push_back(*id);
+    }
+  }
+
+  // the primary account is listed under accounts as well, after it or
+  // before it depending on the key order of the response
+  std::unordered_set<std::string> seen;
+  std::vector<std::string> unique;
+  for (auto &id : ids) {
+    if (seen.insert(id).second) unique.push_back(std::move(id));
+  }
+  return unique;
+}
+
 UserPrincipals Parser::parse_user_principals(json::ptree &data) const {
   UserPrincipals user_principals;
 
@@ -260,6 +285,74 @@ OptionChain Parser::parse_option_chain(const json::ptree &data) const {
   return optionChain;
 }
 
+/**
+ * @brief Parse one position into a typed row
+ *
+ * @param data
+ * @return Position
+ */
+Position Parser::parse_position(const json::ptree &data) const {
+  static const std::unordered_map<std::string, double Position::*> numbers = {
+      {"longQuantity", &Position::longQuantity},
+      {"shortQuantity", &Position::shortQuantity},
+      {"averagePrice", &Position::averagePrice},
+      {"marketValue", &Position::marketValue},
+      {"currentDayProfitLoss", &Position::currentDayProfitLoss},
+      {"currentDayProfitLossPercentage",
+       &Position::currentDayProfitLossPercentage},
+      {"currentDayCost", &Position::currentDayCost},
+      {"maintenanceRequirement", &Position::maintenanceRequirement}};
+  static const std::unordered_map<std::string, std::string Position::*>
+      instrumentFields = {{"symbol", &Position::symbol},
+                          {"cusip", &Position::cusip},
+                          {"assetType", &Position::assetType},
+                          {"putCall", &Position::putCall},
+                          {"underlyingSymbol", &Position::underlyingSymbol},
+                          {"description", &Position::description}};
+
+  Position position;
+  for (const auto &[key, value] : data) {
+    if (key == "instrument") {
+      for (const auto &[fieldKey, fieldValue] : value) {
+        auto field = instrumentFields.find(fieldKey);
+        if (field != instrumentFields.end()) {
+          position.*field->second = fieldValue.get_value<std::string>();
+        }
+      }
+      continue;
+    }
+    auto field = numbers.find(key);
+    if (field == numbers.end()) continue;
+    position.*field->second = value.get_value<double>(0.0);
+  }
+  return position;
+}
+
+/**
+ * @brief Add one securitiesAccount object to the account
+ *
+ * @param data
+ * @param account
+ */
+void Parser::parse_account_fields(const json::ptree &data,
+                                  Account &account) const {
+  for (const auto &[accountKey, accountValue] : data) {
+    if (accountKey == "positions") {
+      for (const auto &[positionKey, positionValue] : accountValue) {
+        account.add_position(parse_position(positionValue));
+      }
+    } else if (accountKey == "currentBalances") {
+      for (const auto &[balanceKey, balanceValue] : accountValue) {
+        account.set_balance_variable(balanceKey,
+                                     balanceValue.get_value<std::string>());
+      }
+    } else {
+      account.set_account_variable(accountKey,
+                                   accountValue.get_value<std::string>());
+    }
+  }
+}
+
 /**
  * @brief Parse the users account data from the API
  * @author @scawful
@@ -270,36 +363,7 @@ OptionChain Parser::parse_option_chain(const json::ptree &data) const {
 Account Parser::parse_account(const json::ptree &data) const {
   Account account;
   for (const auto &[classKey, classValue] : data) {
-    for (const auto &[accountKey, accountValue] : classValue) {
-      if (accountKey == "positions") {
-        for (const auto &[positionListKey, positionListValue] : accountValue) {
-          tda::PositionBalances new_position_balance;  // positions and balances
-          for (const auto &[positionsKey, positionsValue] : positionListValue) {
-            new_position_balance.balances[positionsKey] =
-                positionsValue.get_value<std::string>();
-            std::unordered_map<std::string, std::string> pos_field;
-            std::unordered_map<std::string, std::string> instrument;
-            for (const auto &[fieldKey, fieldValue] : positionsValue) {
-              if (fieldKey == "symbol") {
-                new_position_balance.symbol =
-                    fieldValue.get_value<std::string>();
-              }
-              pos_field[fieldKey] = fieldValue.get_value<std::string>();
-            }
-            account.add_position(pos_field);
-          }
-          account.add_balance(new_position_balance);
-        }
-      } else if (accountKey == "currentBalances") {
-        for (const auto &[balanceKey, balanceValue] : accountValue) {
-          account.set_balance_variable(balanceKey,
-                                       balanceValue.get_value<std::string>());
-        }
-      } else {
-        account.set_account_variable(accountKey,
-                                     accountValue.get_value<std::string>());
-      }
-    }
+    parse_account_fields(classValue, account);
   }
   return account;
 }
@@ -315,42 +379,7 @@ Account Parser::parse_all_accounts(const json::ptree &data) const {
   Account account;
   for (const auto &[key, val] : data) {
     for (const auto &[classKey, classValue] : val) {
-      for (const auto &[accountKey, accountValue] : classValue) {
-        if (accountKey == "positions") {
-          for (const auto &[positionListKey, positionListValue] :
-               accountValue) {
-            tda::PositionBalances
-                new_position_balance;  // positions and balances
-            for (const auto &[positionsKey, positionsValue] :
-                 positionListValue) {
-              std::cout << "Positions List: " << positionListKey << " : "
-                        << positionListValue.get_value<std::string>()
-                        << std::endl;
-              new_position_balance.balances[positionsKey] =
-                  positionsValue.get_value<std::string>();
-              std::unordered_map<std::string, std::string> pos_field;
-              std::unordered_map<std::string, std::string> instrument;
-              for (const auto &[fieldKey, fieldValue] : positionsValue) {
-                if (fieldKey == "symbol") {
-                  new_position_balance.symbol =
-                      fieldValue.get_value<std::string>();
-                }
-                pos_field[fieldKey] = fieldValue.get_value<std::string>();
-              }
-              account.add_position(pos_field);
-            }
-            account.add_balance(new_position_balance);
-          }
-        } else if (accountKey == "currentBalances") {
-          for (const auto &[balanceKey, balanceValue] : accountValue) {
-            account.set_balance_variable(balanceKey,
-                                         balanceValue.get_value<std::string>());
-          }
-        } else {
-          account.set_account_variable(accountKey,
-                                       accountValue.get_value<std::string>());
-        }
-      }
+      parse_account_fields(classValue, account);
     }
   }
   return account;
@@ -24,6 +24,8 @@ class Parser {
  private:
   void parseStrikeMap(const json::ptree& data, OptionChain& chain,
                       int idx) const;
+  void parse_account_fields(const json::ptree& data, Account& account) const;
+  Position parse_position(const json::ptree& data) const;
   const std::vector<std::string> months = {"N/A", "Jan", "Feb",  "Mar", "Apr",
                                            "May", "Jun", "July", "Aug", "Sept",
                                            "Oct", "Nov", "Dec"};
@@ -36,6 +38,9 @@ class Parser {
   PriceHistory parse_price_history(const json::ptree& data,
                                    const std::string& ticker, int freq) const;
   UserPrincipals parse_user_principals(json::ptree& data) const;
+  // every linked account id of a user principals response once, the
+  // primary account first
+  std::vector<std::string> parse_account_ids(const json::ptree& data) const;
   OptionChain parse_option_chain(const json::ptree& data) const;
   Account parse_account(const json::ptree& data) const;
   Account parse_all_accounts(const json::ptree& data) const;
@@ -0,0 +1,134 @@
+// Downloads every historical tick of a contract over a date range into a
+// columnar tick file, spreading the requests over one or more TWS
+// connections so each connection's historical pacing budget is used.
+//
+//   premia_ib_backfill SYMBOL[:SECTYPE:EXCHANGE:CURRENCY] START END out.ticks
+//                      [TRADES|BID_ASK|MIDPOINT] [host:port:clientId ...]
+//
+// START and END are UTC, "yyyymmdd" or "yyyymmdd-hh:mm:ss"; END is
+// exclusive.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "service/InteractiveBrokers/ConnectionPool.hpp"
+#include "service/InteractiveBrokers/TickBackfill.hpp"
+#include "service/InteractiveBrokers/TickFile.hpp"
+
+namespace {
+
+std::vector<std::string> Split(const std::string &text, char separator) {
+  std::vector<std::string> parts;
+  size_t from = 0;
+  for (;;) {
+    size_t at = text.find(separator, from);
+    parts.push_back(text.substr(from, at - from));
+    if (at == std::string::npos) return parts;
+    from = at + 1;
+  }
+}
+
+Contract ParseContract(const std::string &text) {
+  std::vector<std::string> parts = Split(text, ':');
+  Contract contract;
+  contract.symbol = parts[0];
+  contract.secType = parts.size() > 1 ? parts[1] : "STK";
+  contract.exchange = parts.size() > 2 ? parts[2] : "SMART";
+  contract.currency = parts.size() > 3 ? parts[3] : "USD";
+  return contract;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  using premia::tws::TickBackfill;
+
+  if (argc < 5) {
+    std::fprintf(stderr,
+                 "usage: %s SYMBOL[:SECTYPE:EXCHANGE:CURRENCY] START END "
+                 "out.ticks [TRADES|BID_ASK|MIDPOINT] "
+                 "[host:port:clientId ...]\n",
+                 argv[0]);
+    return 2;
+  }
+  Contract contract = ParseContract(argv[1]);
+  int64_t start = TickBackfill::ParseTime(argv[2]);
+  int64_t end = TickBackfill::ParseTime(argv[3]);
+  if (start < 0 || end <= start) {
+    std::fprintf(stderr, "bad range %s .. %s\n", argv[2], argv[3]);
+    return 2;
+  }
+
+  premia::tws::BackfillOptions options;
+  if (argc > 5) options.what_to_show = argv[5];
+
+  std::vector<premia::tws::Endpoint> endpoints;
+  for (int i = 6; i < argc; ++i) {
+    std::vector<std::string> parts = Split(argv[i], ':');
+    if (parts.size() != 3) {
+      std::fprintf(stderr, "bad endpoint %s\n", argv[i]);
+      return 2;
+    }
+    endpoints.push_back(
+        {parts[0], std::atoi(parts[1].c_str()), std::atoi(parts[2].c_str())});
+  }
+  if (endpoints.empty()) endpoints.push_back({"127.0.0.1", 7497, 50});
+
+  premia::tws::ConnectionPool pool(endpoints);
+  pool.Start();
+  for (int waited = 0;; ++waited) {
+    size_t connected = 0;
+    for (const auto &status : pool.Status()) connected += status.connected;
+    if (connected > 0) break;
+    if (waited == 300) {
+      std::fprintf(stderr, "no TWS connection came up\n");
+      pool.Stop();
+      return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+
+  premia::tws::TickFileInfo info;
+  info.symbol = contract.symbol;
+  info.what_to_show = options.what_to_show;
+  premia::tws::TickFileWriter writer;
+  if (!writer.Open(argv[4], info)) {
+    std::fprintf(stderr, "cannot write %s\n", argv[4]);
+    pool.Stop();
+    return 1;
+  }
+
+  TickBackfill backfill(
+      [&pool](const Contract &c, const std::string &start_date_time,
+              int number_of_ticks, const std::string &what_to_show,
+              int use_rth) {
+        return pool.FetchHistoricalTicks(c, start_date_time, number_of_ticks,
+                                         what_to_show, use_rth);
+      },
+      options);
+  premia::tws::BackfillStats stats = backfill.Run(
+      contract, start, end,
+      [&writer](const std::vector<premia::tws::HistoricalTickRow> &rows) {
+        writer.Append(rows);
+        std::printf("%s  %zu ticks\n",
+                    TickBackfill::FormatTime(rows.back().time).c_str(),
+                    writer.rows());
+        std::fflush(stdout);
+      });
+  writer.Close();
+  pool.Stop();
+
+  std::printf("%zu ticks in %zu windows, %zu requests (%zu retried, %zu "
+              "windows failed), %zu duplicates dropped, %zu seconds "
+              "truncated, %.1f s\n",
+              stats.ticks, stats.windows, stats.requests, stats.retries,
+              stats.failed_windows, stats.duplicates, stats.truncated_seconds,
+              stats.seconds);
+  std::printf("%s: %zu bytes, %.2f bytes/tick\n", argv[4], writer.bytes(),
+              stats.ticks ? double(writer.bytes()) / stats.ticks : 0.0);
+  return stats.failed_windows == 0 ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "app/model/account/account_refresher.h"
+#include "service/TDAmeritrade/parser.h"
+
+namespace premiatests {
+namespace AppTestSuite {
+namespace AccountTests {
+
+using premia::AccountRefresher;
+using premia::AccountSnapshot;
+
+std::string makeResponse(const std::string& id, double shares, double cash) {
+  return R"({"securitiesAccount": {"accountId": ")" + id +
+         R"(", "positions": [{"longQuantity": )" + std::to_string(shares) +
+         R"(, "averagePrice": 100, "marketValue": )" +
+         std::to_string(shares * 110) +
+         R"(, "instrument": {"assetType": "EQUITY", "symbol": "AAPL"}}],
+         "currentBalances": {"cashBalance": )" +
+         std::to_string(cash) + "}}}";
+}
+
+// A broker whose responses the test edits, counting fetches and parses.
+struct FakeBroker {
+  std::mutex mutex;
+  std::map<std::string, std::string> responses;
+  std::atomic<int> parses{0};
+  std::atomic<int> inFlight{0};
+  std::atomic<int> mostInFlight{0};
+  premia::tda::Parser parser;
+
+  AccountRefresher::Fetch fetch() {
+    return [this](const std::string& id) {
+      int now = ++inFlight;
+      int most = mostInFlight;
+      while (now > most && !mostInFlight.compare_exchange_weak(most, now)) {
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      --inFlight;
+      std::lock_guard<std::mutex> lock(mutex);
+      return responses[id];
+    };
+  }
+
+  AccountRefresher::Parse parse() {
+    return [this](const std::string& response) {
+      ++parses;
+      return parser.parse_account(parser.read_response(response));
+    };
+  }
+};
+
+TEST(AccountRefresherTest, OnlyChangedAccountsAreParsed) {
+  FakeBroker broker;
+  broker.responses = {{"1", makeResponse("1", 10, 100)},
+                      {"2", makeResponse("2", 20, 200)},
+                      {"3", makeResponse("3", 30, 300)}};
+  AccountRefresher refresher(broker.fetch(), broker.parse(), 3);
+  EXPECT_EQ(0u, refresher.getSnapshot()->version);
+
+  refresher.setAccounts({"1", "2", "3"});
+  refresher.refresh();
+  auto first = refresher.getSnapshot();
+  EXPECT_EQ(1u, first->version);
+  EXPECT_EQ(3, broker.parses);
+  EXPECT_GT(broker.mostInFlight, 1);
+  EXPECT_DOUBLE_EQ(600.0, first->household.get_balances().cashBalance);
+  EXPECT_DOUBLE_EQ(60.0, first->household.find_position("AAPL")->quantity());
+  EXPECT_DOUBLE_EQ(
+      20.0, first->get("2").find_position("AAPL")->quantity());
+
+  // nothing moved, so nothing is parsed or published
+  refresher.refresh();
+  EXPECT_EQ(3, broker.parses);
+  EXPECT_EQ(first, refresher.getSnapshot());
+
+  broker.responses["2"] = makeResponse("2", 25, 200);
+  refresher.refresh();
+  auto second = refresher.getSnapshot();
+  EXPECT_EQ(4, broker.parses);
+  EXPECT_EQ(2u, second->version);
+  EXPECT_EQ(first->accounts[0], second->accounts[0]);
+  EXPECT_DOUBLE_EQ(65.0, second->household.find_position("AAPL")->quantity());
+  // the first snapshot is untouched
+  EXPECT_DOUBLE_EQ(60.0, first->household.find_position("AAPL")->quantity());
+
+  // a failed fetch keeps the account and marks it stale
+  broker.responses["3"].clear();
+  refresher.refresh();
+  auto third = refresher.getSnapshot();
+  EXPECT_EQ(3u, third->version);
+  EXPECT_TRUE(third->stale[2]);
+  EXPECT_EQ(second->accounts[2], third->accounts[2]);
+  EXPECT_EQ(&third->household, &third->get("unknown"));
+}
+
+TEST(AccountRefresherTest, HouseholdIsLabelledAndWeighsEquity) {
+  FakeBroker broker;
+  auto response = [](const std::string& id, double equity, double liquidation,
+                     double percentage) {
+    return R"({"securitiesAccount": {"accountId": ")" + id +
+           R"(", "currentBalances": {"equity": )" + std::to_string(equity) +
+           R"(, "liquidationValue": )" + std::to_string(liquidation) +
+           R"(, "equityPercentage": )" + std::to_string(percentage) + "}}}";
+  };
+  broker.responses = {{"1", response("1", 50, 100, 50)},
+                      {"2", response("2", 900, 1000, 90)}};
+  AccountRefresher refresher(broker.fetch(), broker.parse(), 2);
+  refresher.setAccounts({"1", "2"});
+  refresher.refresh();
+
+  auto snapshot = refresher.getSnapshot();
+  const premia::tda::Account& household = snapshot->get("");
+  EXPECT_EQ(AccountSnapshot::kHouseholdId,
+            household.get_account_variable("accountId"));
+  EXPECT_EQ("2", snapshot->get("2").get_account_variable("accountId"));
+  EXPECT_DOUBLE_EQ(950.0, household.get_balances().equity);
+  EXPECT_NEAR(100 * 950.0 / 1100.0,
+              household.get_balances().equityPercentage, 1e-9);
+}
+
+TEST(AccountMergeTest, LongsAndShortsKeepTheirOwnPrices) {
+  auto held = [](double longQuantity, double shortQuantity, double price) {
+    premia::tda::Position position;
+    position.symbol = "AAPL";
+    position.longQuantity = longQuantity;
+    position.shortQuantity = shortQuantity;
+    position.averagePrice = price;
+    return position;
+  };
+  premia::tda::Account household;
+  household.add_position(held(100, 0, 150));
+  household.add_position(held(50, 0, 180));
+  EXPECT_DOUBLE_EQ(160.0, household.find_position("AAPL")->averagePrice);
+
+  // a short elsewhere nets the long down but does not reprice it
+  household.add_position(held(0, 60, 190));
+  EXPECT_DOUBLE_EQ(90.0, household.find_position("AAPL")->quantity());
+  EXPECT_DOUBLE_EQ(160.0, household.find_position("AAPL")->averagePrice);
+
+  // once the short side is larger, the row is a short at the short's price
+  household.add_position(held(0, 200, 195));
+  EXPECT_DOUBLE_EQ(-110.0, household.find_position("AAPL")->quantity());
+  EXPECT_DOUBLE_EQ(195.0, household.find_position("AAPL")->averagePrice);
+}
+
+TEST(AccountRefresherTest, BackgroundRefreshPublishesOnItsInterval) {
+  FakeBroker broker;
+  broker.responses = {{"1", makeResponse("1", 10, 100)}};
+  AccountRefresher refresher(broker.fetch(), broker.parse(), 2);
+  refresher.setAccounts({"1"});
+  refresher.setInterval(std::chrono::milliseconds(10));
+  refresher.start();
+
+  auto waitFor = [&](uint64_t version) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (refresher.getSnapshot()->version < version &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return refresher.getSnapshot()->version;
+  };
+  EXPECT_EQ(1u, waitFor(1));
+  {
+    std::lock_guard<std::mutex> lock(broker.mutex);
+    broker.responses["1"] = makeResponse("1", 12, 100);
+  }
+  EXPECT_EQ(2u, waitFor(2));
+  refresher.stop();
+  EXPECT_EQ(2, broker.parses);
+
+  // a long interval still answers a refresh request at once
+  refresher.setInterval(std::chrono::hours(1));
+  refresher.start();
+  {
+    std::lock_guard<std::mutex> lock(broker.mutex);
+    broker.responses["1"] = makeResponse("1", 14, 100);
+  }
+  refresher.requestRefresh();
+  EXPECT_EQ(3u, waitFor(3));
+  refresher.stop();
+}
+
+}  // namespace AccountTests
+}  // namespace AppTestSuite
+}  // namespace premiatests
@@ -0,0 +1,703 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "app/model/options/black_scholes.h"
+#include "app/model/options/gamma_exposure.h"
+#include "app/model/options/strategy_search.h"
+#include "app/model/options/vol_surface.h"
+
+namespace premiatests {
+namespace AppTestSuite {
+namespace OptionsTests {
+
+using premia::ExposureBook;
+using premia::ExposureEngine;
+using premia::ExposureGrid;
+using premia::ExposureProfile;
+using premia::GreeksBatch;
+using premia::ImpliedVolBatch;
+using premia::IvStatus;
+using premia::OptionBatch;
+using premia::SimdLevel;
+using premia::SmileQuotes;
+using premia::Strategy;
+using premia::StrategyKind;
+using premia::StrategyObjective;
+using premia::StrategyQuery;
+using premia::StrategySearch;
+using premia::SviParams;
+using premia::VolSurface;
+using premia::WorkerPool;
+
+// A chain whose length is not a multiple of any lane width, with expired,
+// vol-less and far out-of-the-money strikes mixed in.
+OptionBatch makeChain() {
+  OptionBatch batch;
+  batch.spot = 4500.0;
+  batch.rate = 0.045;
+  batch.dividend = 0.013;
+  const double years[] = {1.0 / 365, 7.0 / 365, 0.25, 1.0, 2.5};
+  for (double t : years) {
+    for (double k = 2000.0; k <= 7000.0; k += 125.0) {
+      double vol = 0.12 + std::fabs(k - 4500.0) / 10000.0;
+      batch.add(k, t, vol, true);
+      batch.add(k, t, vol, false);
+    }
+  }
+  batch.add(4400.0, 0.0, 0.2, true);
+  batch.add(4600.0, 0.0, 0.2, false);
+  batch.add(4600.0, 0.0, 0.2, true);
+  batch.add(4400.0, 0.5, 0.0, false);
+  batch.add(4600.0, -0.1, 0.2, false);
+  return batch;
+}
+
+void expectNear(const std::vector<double>& expected,
+                const std::vector<double>& actual, const char* greek,
+                SimdLevel level) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected[i], actual[i], 1e-10 * (1 + std::fabs(expected[i])))
+        << greek << " of option " << i << " at "
+        << premia::simdLevelName(level);
+  }
+}
+
+TEST(BlackScholesTest, EveryKernelMatchesTheReference) {
+  OptionBatch batch = makeChain();
+  ASSERT_NE(0u, batch.size() % 8);
+  GreeksBatch reference;
+  premia::priceReference(batch, &reference);
+
+  for (auto level : {SimdLevel::kScalar, SimdLevel::kAvx2,
+                     SimdLevel::kAvx512}) {
+    GreeksBatch greeks;
+    premia::priceBatch(batch, &greeks, level);
+    expectNear(reference.price, greeks.price, "price", level);
+    expectNear(reference.delta, greeks.delta, "delta", level);
+    expectNear(reference.gamma, greeks.gamma, "gamma", level);
+    expectNear(reference.vega, greeks.vega, "vega", level);
+    expectNear(reference.theta, greeks.theta, "theta", level);
+    expectNear(reference.vanna, greeks.vanna, "vanna", level);
+    expectNear(reference.volga, greeks.volga, "volga", level);
+    expectNear(reference.charm, greeks.charm, "charm", level);
+  }
+
+  // the dead options at the end are worth intrinsic and carry no greeks
+  size_t n = batch.size();
+  GreeksBatch greeks;
+  premia::priceBatch(batch, &greeks);
+  EXPECT_DOUBLE_EQ(100.0, greeks.price[n - 5]);
+  EXPECT_DOUBLE_EQ(1.0, greeks.delta[n - 5]);
+  EXPECT_DOUBLE_EQ(100.0, greeks.price[n - 4]);
+  EXPECT_DOUBLE_EQ(-1.0, greeks.delta[n - 4]);
+  EXPECT_DOUBLE_EQ(0.0, greeks.price[n - 3]);
+  EXPECT_DOUBLE_EQ(0.0, greeks.delta[n - 3]);
+  EXPECT_DOUBLE_EQ(0.0, greeks.price[n - 2]);
+  EXPECT_DOUBLE_EQ(0.0, greeks.gamma[n - 2]);
+  EXPECT_DOUBLE_EQ(0.0, greeks.vega[n - 1]);
+}
+
+TEST(BlackScholesTest, GreeksAgreeWithFiniteDifferences) {
+  OptionBatch batch;
+  batch.spot = 100.0;
+  batch.rate = 0.03;
+  batch.dividend = 0.01;
+  batch.add(105.0, 0.5, 0.25, true);
+  batch.add(95.0, 0.5, 0.25, false);
+
+  GreeksBatch base;
+  GreeksBatch up;
+  GreeksBatch down;
+  premia::priceBatch(batch, &base);
+
+  const double h = 1e-3;
+  OptionBatch bumped = batch;
+  bumped.spot = batch.spot + h;
+  premia::priceBatch(bumped, &up);
+  bumped.spot = batch.spot - h;
+  premia::priceBatch(bumped, &down);
+  for (size_t i = 0; i < batch.size(); ++i) {
+    EXPECT_NEAR((up.price[i] - down.price[i]) / (2 * h), base.delta[i], 1e-6);
+    EXPECT_NEAR((up.delta[i] - down.delta[i]) / (2 * h), base.gamma[i], 1e-6);
+    EXPECT_NEAR((up.vega[i] - down.vega[i]) / (2 * h), base.vanna[i], 1e-5);
+  }
+
+  bumped = batch;
+  for (double& v : bumped.vol) v += h;
+  premia::priceBatch(bumped, &up);
+  bumped = batch;
+  for (double& v : bumped.vol) v -= h;
+  premia::priceBatch(bumped, &down);
+  for (size_t i = 0; i < batch.size(); ++i) {
+    EXPECT_NEAR((up.price[i] - down.price[i]) / (2 * h), base.vega[i], 1e-4);
+    EXPECT_NEAR((up.vega[i] - down.vega[i]) / (2 * h), base.volga[i], 1e-3);
+  }
+
+  bumped = batch;
+  for (double& t : bumped.years) t -= h;
+  premia::priceBatch(bumped, &down);
+  for (size_t i = 0; i < batch.size(); ++i) {
+    EXPECT_NEAR((down.price[i] - base.price[i]) / h, base.theta[i], 1e-2);
+    EXPECT_NEAR((down.delta[i] - base.delta[i]) / h, base.charm[i], 1e-3);
+  }
+}
+
+TEST(ImpliedVolTest, EveryKernelRecoversTheVolThatPricedTheChain) {
+  OptionBatch batch;
+  batch.spot = 4500.0;
+  batch.rate = 0.045;
+  batch.dividend = 0.013;
+  const double years[] = {3.0 / 365, 30.0 / 365, 0.5, 2.0};
+  for (double t : years) {
+    for (double k = 3000.0; k <= 6500.0; k += 50.0) {
+      double vol = 0.1 + std::fabs(k - 4500.0) / 5000.0;
+      batch.add(k, t, vol, true);
+      batch.add(k, t, vol, false);
+    }
+  }
+  GreeksBatch greeks;
+  premia::priceReference(batch, &greeks);
+  OptionBatch guessless = batch;
+  for (double& v : guessless.vol) v = 0.0;
+
+  for (auto level : {SimdLevel::kScalar, SimdLevel::kAvx2,
+                     SimdLevel::kAvx512}) {
+    ImpliedVolBatch solved;
+    premia::solveImpliedVol(guessless, greeks.price, &solved, level);
+    ASSERT_EQ(batch.size(), solved.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+      // with almost no vega the price no longer pins the vol down
+      if (greeks.vega[i] < 1e-3) continue;
+      EXPECT_EQ(IvStatus::kConverged, solved.status[i])
+          << "option " << i << " at " << premia::simdLevelName(level);
+      EXPECT_NEAR(batch.vol[i], solved.vol[i], 1e-7)
+          << "option " << i << " at " << premia::simdLevelName(level);
+      EXPECT_LE(solved.iterations[i], 12);
+    }
+  }
+}
+
+TEST(ImpliedVolTest, PricesOutsideTheBoundsAreFlagged) {
+  OptionBatch batch;
+  batch.spot = 100.0;
+  batch.rate = 0.03;
+  batch.dividend = 0.0;
+  batch.add(80.0, 0.5, 0.0, true);
+  batch.add(100.0, 0.5, 0.0, true);
+  batch.add(100.0, 0.0, 0.0, true);
+  batch.add(100.0, 0.5, 0.0, false);
+  const std::vector<double> prices = {15.0, 120.0, 5.0, -1.0};
+
+  ImpliedVolBatch solved;
+  premia::solveImpliedVol(batch, prices, &solved);
+  EXPECT_EQ(IvStatus::kBelowIntrinsic, solved.status[0]);
+  EXPECT_EQ(IvStatus::kAboveMaximum, solved.status[1]);
+  EXPECT_EQ(IvStatus::kInvalid, solved.status[2]);
+  EXPECT_EQ(IvStatus::kInvalid, solved.status[3]);
+  for (size_t i = 0; i < solved.size(); ++i) {
+    EXPECT_TRUE(std::isnan(solved.vol[i]));
+    EXPECT_EQ(0, solved.iterations[i]);
+  }
+}
+
+TEST(ImpliedVolTest, YesterdaysVolIsAWarmStart) {
+  OptionBatch batch;
+  batch.spot = 100.0;
+  batch.rate = 0.03;
+  batch.dividend = 0.01;
+  for (double k = 60.0; k <= 140.0; k += 5.0) batch.add(k, 0.25, 0.3, true);
+  GreeksBatch greeks;
+  premia::priceReference(batch, &greeks);
+
+  OptionBatch cold = batch;
+  for (double& v : cold.vol) v = 0.0;
+  OptionBatch warm = batch;
+  for (double& v : warm.vol) v = 0.3001;
+  ImpliedVolBatch fromCold;
+  ImpliedVolBatch fromWarm;
+  premia::solveImpliedVol(cold, greeks.price, &fromCold);
+  premia::solveImpliedVol(warm, greeks.price, &fromWarm);
+
+  int coldPasses = 0;
+  int warmPasses = 0;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    EXPECT_NEAR(0.3, fromWarm.vol[i], 1e-8);
+    coldPasses += fromCold.iterations[i];
+    warmPasses += fromWarm.iterations[i];
+  }
+  EXPECT_LT(warmPasses, coldPasses);
+}
+
+// Puts below spot and calls above it, so dealer gamma is short on the way
+// down and long on the way up.
+OptionBatch makeSkewedChain(std::vector<double>* openInterest) {
+  OptionBatch batch;
+  batch.spot = 100.0;
+  batch.rate = 0.03;
+  batch.dividend = 0.01;
+  for (double t : {2.0 / 365, 30.0 / 365, 0.5}) {
+    for (double k = 70.0; k <= 130.0; k += 2.5) {
+      batch.add(k, t, 0.2, true);
+      openInterest->push_back(k > 100 ? 800.0 : 100.0);
+      batch.add(k, t, 0.25, false);
+      openInterest->push_back(k < 100 ? 1000.0 : 100.0);
+    }
+  }
+  return batch;
+}
+
+double dealerGamma(OptionBatch batch, const std::vector<double>& openInterest,
+                   double spot, double days) {
+  batch.spot = spot;
+  for (double& t : batch.years) t -= days / 365;
+  GreeksBatch greeks;
+  premia::priceReference(batch, &greeks);
+  double total = 0.0;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    total += 100 * openInterest[i] * batch.sign[i] * greeks.gamma[i];
+  }
+  return total * spot * spot / 100;
+}
+
+TEST(GammaExposureTest, ThreadsAgreeWithTheReference) {
+  std::vector<double> openInterest;
+  OptionBatch batch = makeSkewedChain(&openInterest);
+  ExposureGrid grid = ExposureGrid::around(batch.spot, 0.2, 41, {0.0, 3.0});
+
+  ExposureProfile inline_;
+  ExposureProfile pooled;
+  WorkerPool one(1);
+  WorkerPool three(3);
+  ExposureEngine(&one).compute(batch, openInterest, grid, &inline_);
+  ExposureEngine(&three).compute(batch, openInterest, grid, &pooled);
+
+  ASSERT_EQ(25u, pooled.strikes.size());
+  ASSERT_EQ(82u, pooled.gamma.size());
+  EXPECT_EQ(inline_.gamma, pooled.gamma);
+  EXPECT_EQ(inline_.strikeCharm, pooled.strikeCharm);
+  for (size_t d = 0; d < grid.days.size(); ++d) {
+    for (size_t s = 0; s < grid.spots.size(); s += 8) {
+      size_t index = pooled.scenario(d, s);
+      double expected =
+          dealerGamma(batch, openInterest, grid.spots[s], grid.days[d]);
+      EXPECT_NEAR(expected, pooled.gamma[index], 1e-8 * std::fabs(expected));
+
+      double strikes = 0.0;
+      for (size_t k = 0; k < pooled.strikes.size(); ++k) {
+        strikes += pooled.strikeGamma[index * pooled.strikes.size() + k];
+      }
+      EXPECT_NEAR(pooled.gamma[index], strikes,
+                  1e-9 * std::fabs(pooled.gamma[index]));
+    }
+  }
+}
+
+TEST(GammaExposureTest, FlipIsWhereDealerGammaChangesSign) {
+  std::vector<double> openInterest;
+  OptionBatch batch = makeSkewedChain(&openInterest);
+  ExposureProfile profile;
+  WorkerPool pool(2);
+  ExposureEngine engine(&pool);
+  engine.compute(batch, openInterest,
+                 ExposureGrid::around(batch.spot, 0.2, 21, {0.0, 1.0}),
+                 &profile);
+
+  for (size_t d = 0; d < profile.days.size(); ++d) {
+    double flip = profile.flip[d];
+    ASSERT_TRUE(std::isfinite(flip));
+    EXPECT_GT(flip, 80.0);
+    EXPECT_LT(flip, 120.0);
+    EXPECT_LT(dealerGamma(batch, openInterest, flip * 0.999, profile.days[d]),
+              0.0);
+    EXPECT_GT(dealerGamma(batch, openInterest, flip * 1.001, profile.days[d]),
+              0.0);
+  }
+
+  // a chain that is long gamma everywhere has no flip
+  for (double& interest : openInterest) interest = 0.0;
+  openInterest[0] = 1000.0;
+  engine.compute(batch, openInterest,
+                 ExposureGrid::around(batch.spot, 0.2, 21, {0.0}), &profile);
+  EXPECT_TRUE(std::isnan(profile.flip[0]));
+}
+
+TEST(GammaExposureTest, BookUpdatesMatchARebuild) {
+  std::vector<double> openInterest;
+  OptionBatch batch = makeSkewedChain(&openInterest);
+  std::vector<size_t> expiryIndex;
+  for (size_t i = 0; i < batch.size(); ++i) expiryIndex.push_back(i / 50);
+
+  ExposureBook book;
+  book.reset(batch, openInterest, expiryIndex, 3);
+  ASSERT_EQ(25u, book.getStrikes().size());
+  book.update(7, 0.35, std::nan(""));
+  book.update(60, std::nan(""), 2500.0);
+  book.update(61, 0.1, 0.0);
+  book.update(batch.size(), 0.2, 1.0);
+
+  batch.vol[7] = 0.35;
+  batch.vol[61] = 0.1;
+  openInterest[60] = 2500.0;
+  openInterest[61] = 0.0;
+  ExposureBook rebuilt;
+  rebuilt.reset(batch, openInterest, expiryIndex, 3);
+
+  const auto& a = book.getByExpiry();
+  const auto& b = rebuilt.getByExpiry();
+  for (size_t e = 0; e < 3; ++e) {
+    EXPECT_NEAR(b.gamma[e], a.gamma[e], 1e-6 * std::fabs(b.gamma[e]));
+    EXPECT_NEAR(b.putGamma[e], a.putGamma[e], 1e-6 * std::fabs(b.putGamma[e]));
+    EXPECT_NEAR(b.vanna[e], a.vanna[e], 1e-6 * std::fabs(b.vanna[e]));
+    EXPECT_NEAR(b.charm[e], a.charm[e], 1e-6 * std::fabs(b.charm[e]));
+  }
+  for (size_t k = 0; k < book.getStrikes().size(); ++k) {
+    EXPECT_NEAR(rebuilt.getByStrike().gamma[k], book.getByStrike().gamma[k],
+                1e-3);
+  }
+  EXPECT_NEAR(rebuilt.getTotal().gamma[0], book.getTotal().gamma[0],
+              1e-6 * std::fabs(rebuilt.getTotal().gamma[0]));
+
+  // the total agrees with the grid at spot
+  ExposureProfile profile;
+  WorkerPool pool(1);
+  ExposureEngine(&pool).compute(book.getChain(), book.getOpenInterest(),
+                                ExposureGrid::around(batch.spot, 0.1, 1),
+                                &profile);
+  EXPECT_NEAR(profile.gamma[0], book.getTotal().gamma[0],
+              1e-9 * std::fabs(profile.gamma[0]));
+
+  book.setSpot(105.0);
+  rebuilt.setSpot(105.0);
+  EXPECT_DOUBLE_EQ(rebuilt.getTotal().vega[0], book.getTotal().vega[0]);
+}
+
+// What OptionsModel does with streamed quotes: contracts move the book one
+// at a time and the profile is only rebuilt once spot leaves its grid step.
+TEST(GammaExposureTest, StreamedUpdatesMatchAFullRecompute) {
+  std::vector<double> openInterest;
+  OptionBatch batch = makeSkewedChain(&openInterest);
+  std::vector<size_t> expiryIndex;
+  for (size_t i = 0; i < batch.size(); ++i) expiryIndex.push_back(i / 50);
+  auto grid = [](double spot) {
+    return ExposureGrid::around(spot, 0.15, 61, {0.0, 1.0, 7.0});
+  };
+
+  WorkerPool pool(2);
+  ExposureEngine engine(&pool);
+  ExposureBook book;
+  book.reset(batch, openInterest, expiryIndex, 3);
+  ExposureProfile profile;
+  EXPECT_TRUE(profile.stale(batch.spot));
+  engine.compute(book.getChain(), book.getOpenInterest(), grid(batch.spot),
+                 &profile);
+  const double step = profile.spots[1] - profile.spots[0];
+  EXPECT_FALSE(profile.stale(batch.spot + 0.4 * step));
+  EXPECT_FALSE(profile.stale(batch.spot - 0.9 * step));
+  EXPECT_TRUE(profile.stale(batch.spot - step));
+
+  book.update(3, 0.3, std::nan(""));
+  book.update(40, std::nan(""), 5000.0);
+  book.setSpot(batch.spot + 0.5 * step);
+  EXPECT_FALSE(profile.stale(book.getChain().spot));
+  book.update(97, 0.15, 20.0);
+  const double moved = batch.spot + 1.5 * step;
+  book.setSpot(moved);
+  ASSERT_TRUE(profile.stale(moved));
+  engine.compute(book.getChain(), book.getOpenInterest(), grid(moved),
+                 &profile);
+
+  batch.vol[3] = 0.3;
+  openInterest[40] = 5000.0;
+  batch.vol[97] = 0.15;
+  openInterest[97] = 20.0;
+  batch.spot = moved;
+  ExposureBook rebuilt;
+  rebuilt.reset(batch, openInterest, expiryIndex, 3);
+  ExposureProfile full;
+  engine.compute(batch, openInterest, grid(moved), &full);
+
+  EXPECT_NEAR(rebuilt.getTotal().gamma[0], book.getTotal().gamma[0],
+              1e-6 * std::fabs(rebuilt.getTotal().gamma[0]));
+  EXPECT_NEAR(rebuilt.getTotal().vanna[0], book.getTotal().vanna[0],
+              1e-6 * std::fabs(rebuilt.getTotal().vanna[0]));
+  ASSERT_EQ(full.gamma.size(), profile.gamma.size());
+  for (size_t i = 0; i < full.gamma.size(); ++i) {
+    EXPECT_NEAR(full.gamma[i], profile.gamma[i],
+                1e-9 * std::fabs(full.gamma[i]));
+    EXPECT_NEAR(full.vanna[i], profile.vanna[i],
+                1e-9 * std::fabs(full.vanna[i]));
+    EXPECT_NEAR(full.charm[i], profile.charm[i],
+                1e-9 * std::fabs(full.charm[i]));
+  }
+  ASSERT_EQ(full.flip.size(), profile.flip.size());
+  for (size_t d = 0; d < full.flip.size(); ++d) {
+    if (std::isnan(full.flip[d])) {
+      EXPECT_TRUE(std::isnan(profile.flip[d]));
+    } else {
+      EXPECT_NEAR(full.flip[d], profile.flip[d], 1e-9);
+    }
+  }
+}
+
+// Smiles drawn from known SVI parameters, a week to a year out.
+std::vector<SmileQuotes> makeSmiles(std::vector<SviParams>* truth) {
+  std::vector<SmileQuotes> smiles;
+  for (double days : {7.0, 30.0, 91.0, 182.0, 365.0}) {
+    double t = days / 365;
+    SviParams params;
+    params.a = 0.02 * t + 0.0005;
+    params.b = 0.1 * std::sqrt(t) + 0.02;
+    params.rho = -0.6;
+    params.m = 0.02;
+    params.sigma = 0.05 + 0.1 * t;
+    truth->push_back(params);
+
+    SmileQuotes smile;
+    smile.years = t;
+    double forward = 4500.0 * std::exp((0.045 - 0.013) * t);
+    for (double k = 3200.0; k <= 5800.0; k += 50.0) {
+      smile.strike.push_back(k);
+      smile.vol.push_back(
+          std::sqrt(params.variance(std::log(k / forward)) / t));
+    }
+    smiles.push_back(smile);
+  }
+  return smiles;
+}
+
+TEST(VolSurfaceTest, SviFitRecoversTheSmiles) {
+  std::vector<SviParams> truth;
+  std::vector<SmileQuotes> smiles = makeSmiles(&truth);
+  WorkerPool pool(3);
+  VolSurface surface;
+  surface.fit(4500.0, 0.045, 0.013, smiles, &pool);
+
+  ASSERT_EQ(smiles.size(), surface.getFits().size());
+  for (size_t e = 0; e < smiles.size(); ++e) {
+    const auto& fit = surface.getFits()[e];
+    EXPECT_TRUE(fit.fitted);
+    EXPECT_LT(fit.rmse, 1e-4);
+    EXPECT_LE(fit.params.b * (1 + std::fabs(fit.params.rho)), 4.0);
+    for (size_t i = 0; i < smiles[e].strike.size(); i += 5) {
+      EXPECT_NEAR(smiles[e].vol[i],
+                  surface.vol(smiles[e].strike[i], smiles[e].years), 1e-3);
+    }
+  }
+
+  // total variance never falls with time at a fixed moneyness
+  for (double k : {3500.0, 4500.0, 5500.0}) {
+    double last = 0.0;
+    for (double t = 1.0 / 365; t < 1.5; t += 5.0 / 365) {
+      double w = surface.totalVariance(k * std::exp(0.032 * t), t);
+      EXPECT_GE(w, last);
+      last = w;
+    }
+  }
+  EXPECT_TRUE(std::isnan(surface.vol(-1.0, 0.5)));
+}
+
+TEST(VolSurfaceTest, RefitsStartFromTheLastSmiles) {
+  std::vector<SviParams> truth;
+  std::vector<SmileQuotes> smiles = makeSmiles(&truth);
+  WorkerPool pool(1);
+  VolSurface surface;
+  surface.fit(4500.0, 0.045, 0.013, smiles, &pool);
+  int cold = 0;
+  for (const auto& fit : surface.getFits()) cold += fit.iterations;
+
+  // an hour later and a little richer
+  for (auto& smile : smiles) {
+    smile.years -= 1.0 / (365 * 24);
+    for (double& v : smile.vol) v *= 1.001;
+  }
+  surface.fit(4500.0, 0.045, 0.013, smiles, &pool);
+  int warm = 0;
+  for (const auto& fit : surface.getFits()) {
+    EXPECT_LT(fit.rmse, 1e-4);
+    warm += fit.iterations;
+  }
+  EXPECT_LT(warm, cold);
+
+  // a thin expiry keeps a flat smile
+  SmileQuotes thin;
+  thin.years = 0.5;
+  thin.strike = {4400.0, 4500.0};
+  thin.vol = {0.2, 0.2};
+  surface.fit(4500.0, 0.045, 0.013, {thin}, &pool);
+  EXPECT_FALSE(surface.getFits()[0].fitted);
+  EXPECT_NEAR(0.2, surface.vol(5000.0, 0.5), 1e-12);
+}
+
+// Two expiries of a skewed chain, priced at their own vols, with a few
+// strikes missing a side.
+OptionBatch makeSpreadChain(std::vector<double>* price,
+                            std::vector<size_t>* expiryIndex) {
+  OptionBatch batch;
+  batch.spot = 4500.0;
+  batch.rate = 0.045;
+  batch.dividend = 0.013;
+  const double years[] = {14.0 / 365, 45.0 / 365};
+  for (size_t e = 0; e < 2; ++e) {
+    for (double k = 4000.0; k <= 5000.0; k += 25.0) {
+      double vol = 0.16 - (k - 4500.0) / 10000.0;
+      if (k != 4225.0) {
+        batch.add(k, years[e], vol, true);
+        expiryIndex->push_back(e);
+      }
+      if (k != 4775.0) {
+        batch.add(k, years[e], vol, false);
+        expiryIndex->push_back(e);
+      }
+    }
+  }
+  GreeksBatch greeks;
+  premia::priceReference(batch, &greeks);
+  *price = greeks.price;
+  return batch;
+}
+
+// the search's terminal spread: the vol of the strike nearest the forward
+double atTheMoneySd(double forward, double years) {
+  double strike = std::round(forward / 25.0) * 25.0;
+  return (0.16 - (strike - 4500.0) / 10000.0) * std::sqrt(years);
+}
+
+double lognormalBelow(double x, double forward, double sd) {
+  return 0.5 * std::erfc(-(std::log(x / forward) + sd * sd / 2) /
+                         (sd * std::sqrt(2.0)));
+}
+
+TEST(StrategySearchTest, VerticalMetricsAreExact) {
+  std::vector<double> price;
+  std::vector<size_t> expiryIndex;
+  OptionBatch chain = makeSpreadChain(&price, &expiryIndex);
+  WorkerPool pool(2);
+  StrategySearch search(&pool);
+  search.load(chain, price, expiryIndex);
+
+  StrategyQuery query;
+  query.kinds = {StrategyKind::kVertical};
+  query.topK = 100000;
+  query.maxWidth = 4;
+  auto found = search.search(query);
+  ASSERT_FALSE(found.empty());
+
+  // the 4500 / 4600 bull call spread of the first expiry
+  size_t low = 0;
+  size_t high = 0;
+  for (size_t i = 0; i < chain.size(); ++i) {
+    if (expiryIndex[i] != 0 || chain.sign[i] < 0) continue;
+    if (chain.strike[i] == 4500.0) low = i;
+    if (chain.strike[i] == 4600.0) high = i;
+  }
+  const Strategy* spread = nullptr;
+  for (const Strategy& strategy : found) {
+    if (strategy.legCount == 2 && strategy.legs[0].contract == low &&
+        strategy.legs[0].quantity == 1.0 &&
+        strategy.legs[1].contract == high) {
+      spread = &strategy;
+    }
+  }
+  ASSERT_NE(nullptr, spread);
+
+  double cost = 100 * (price[low] - price[high]);
+  EXPECT_NEAR(cost, spread->cost, 1e-9);
+  EXPECT_NEAR(cost, spread->maxLoss, 1e-9);
+  EXPECT_NEAR(10000.0 - cost, spread->maxGain, 1e-9);
+  double breakeven = 4500.0 + cost / 100;
+  EXPECT_NEAR(breakeven, spread->breakevenLow, 1e-9);
+  EXPECT_TRUE(std::isnan(spread->breakevenHigh));
+
+  const double t = 14.0 / 365;
+  double forward = 4500.0 * std::exp((0.045 - 0.013) * t);
+  double sd = atTheMoneySd(forward, t);
+  EXPECT_NEAR(1 - lognormalBelow(breakeven, forward, sd), spread->probability,
+              1e-4);
+
+  GreeksBatch greeks;
+  premia::priceReference(chain, &greeks);
+  EXPECT_NEAR(100 * (greeks.delta[low] - greeks.delta[high]), spread->delta,
+              1e-6);
+  EXPECT_NEAR(100 * (greeks.vega[low] - greeks.vega[high]), spread->vega,
+              1e-6);
+
+  for (size_t i = 1; i < found.size(); ++i) {
+    EXPECT_GE(found[i - 1].score, found[i].score);
+  }
+}
+
+TEST(StrategySearchTest, CondorsRankTheSameOnAnyPoolAndTopK) {
+  std::vector<double> price;
+  std::vector<size_t> expiryIndex;
+  OptionBatch chain = makeSpreadChain(&price, &expiryIndex);
+
+  StrategyQuery query;
+  query.kinds = {StrategyKind::kIronCondor, StrategyKind::kButterfly};
+  query.maxWidth = 3;
+  query.maxLoss = 4000.0;
+  query.topK = 500;
+
+  for (StrategyObjective objective :
+       {StrategyObjective::kProbabilityOfProfit,
+        StrategyObjective::kReturnOnRisk}) {
+    query.objective = objective;
+    WorkerPool one(1);
+    StrategySearch inline_(&one);
+    inline_.load(chain, price, expiryIndex);
+    auto all = inline_.search(query);
+    ASSERT_EQ(500u, all.size());
+
+    // the pruned search finds the head of the full ranking
+    WorkerPool three(3);
+    StrategySearch pooled(&three);
+    pooled.load(chain, price, expiryIndex);
+    query.topK = 25;
+    auto head = pooled.search(query);
+    query.topK = 500;
+    ASSERT_EQ(25u, head.size());
+    for (size_t i = 0; i < head.size(); ++i) {
+      EXPECT_EQ(all[i].score, head[i].score);
+      EXPECT_EQ(all[i].legs[0].contract, head[i].legs[0].contract);
+      EXPECT_EQ(all[i].legs[3].contract, head[i].legs[3].contract);
+    }
+
+    for (const Strategy& strategy : all) {
+      EXPECT_LE(strategy.maxLoss, 4000.0);
+      if (strategy.kind != StrategyKind::kIronCondor ||
+          strategy.legs[1].quantity > 0) {
+        continue;
+      }
+      // against the payoff integrated cell by cell over the lognormal
+      const double t = chain.years[strategy.legs[0].contract];
+      double forward = 4500.0 * std::exp((0.045 - 0.013) * t);
+      double sd = atTheMoneySd(forward, t);
+      auto profits = [&](double spot) {
+        double value = -strategy.cost / 100;
+        for (size_t i = 0; i < strategy.legCount; ++i) {
+          size_t leg = strategy.legs[i].contract;
+          double intrinsic = chain.sign[leg] * (spot - chain.strike[leg]);
+          value += strategy.legs[i].quantity * std::max(intrinsic, 0.0);
+        }
+        return value > 0;
+      };
+      double probability = 0.0;
+      double last = 0.0;
+      for (double x = 3000.0; x <= 6000.0; x += 0.1) {
+        double below = lognormalBelow(x, forward, sd);
+        if (profits(x - 0.05)) probability += below - last;
+        last = below;
+      }
+      if (profits(6000.0)) probability += 1 - last;
+      EXPECT_NEAR(probability, strategy.probability, 1e-4);
+      EXPECT_LT(strategy.cost, 0.0);
+    }
+  }
+}
+
+}  // namespace OptionsTests
+}  // namespace AppTestSuite
+}  // namespace premiatests
@@ -0,0 +1,240 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "app/model/order/order_book.h"
+
+namespace premiatests {
+namespace AppTestSuite {
+namespace OrderTests {
+
+using premia::OrderBook;
+using premia::OrderState;
+using premia::OrderTicket;
+using premia::SubmitReply;
+
+OrderTicket makeTicket(double quantity) {
+  OrderTicket ticket;
+  ticket.accountId = "123";
+  ticket.symbol = "AAPL";
+  ticket.quantity = quantity;
+  ticket.price = 150.0;
+  return ticket;
+}
+
+std::string makeFill(const std::string& orderKey, double quantity,
+                     double price, const std::string& executionId = "") {
+  std::string id;
+  if (!executionId.empty()) id = "<ID>" + executionId + "</ID>";
+  return "<OrderFillMessage><Order><OrderKey>" + orderKey +
+         "</OrderKey><OriginalQuantity>999</OriginalQuantity></Order>"
+         "<ExecutionInformation><Type>Bought</Type><Quantity>" +
+         std::to_string(quantity) + "</Quantity><ExecutionPrice>" +
+         std::to_string(price) + "</ExecutionPrice>" + id +
+         "</ExecutionInformation></OrderFillMessage>";
+}
+
+std::string makeMessage(const std::string& orderKey) {
+  return "<Message><Order><OrderKey>" + orderKey + "</OrderKey></Order>"
+         "</Message>";
+}
+
+// a streamer frame carrying one ACCT_ACTIVITY message
+std::string makeFrame(const std::string& type, const std::string& xml) {
+  return R"({"data": [{"service": "ACCT_ACTIVITY", "command": "SUBS",
+            "content": [{"seq": 1, "key": "sub", "1": "123", "2": ")" +
+         type + R"(", "3": ")" + xml + R"("}]}]})";
+}
+
+TEST(TdaOrderBookTest, OrdersFollowTheActivityStream) {
+  std::vector<SubmitReply> replies = {{"1001", 201}, {"", 400}};
+  size_t submits = 0;
+  OrderBook book([&](const OrderTicket&) { return replies[submits++]; },
+                 [](const std::string&, const std::string&) { return true; });
+
+  uint64_t id = book.submit(makeTicket(100));
+  EXPECT_EQ(1u, id);
+  EXPECT_EQ(OrderState::Accepted, book.find(id)->state);
+  EXPECT_EQ(id, book.findByBrokerId("1001")->clientId);
+
+  book.applyStreamMessage(makeFrame("OrderRoute", makeMessage("1001")));
+  EXPECT_EQ(OrderState::Working, book.find(id)->state);
+  book.applyStreamMessage(makeFrame("OrderPartialFill",
+                                    makeFill("1001", 40, 150)));
+  EXPECT_EQ(OrderState::PartiallyFilled, book.find(id)->state);
+  EXPECT_DOUBLE_EQ(40.0, book.find(id)->filledQuantity);
+  EXPECT_TRUE(book.applyActivity("OrderFill", makeFill("1001", 60, 151)));
+
+  auto filled = book.find(id);
+  EXPECT_EQ(OrderState::Filled, filled->state);
+  EXPECT_DOUBLE_EQ(100.0, filled->filledQuantity);
+  EXPECT_DOUBLE_EQ(150.6, filled->averageFillPrice);
+  EXPECT_TRUE(book.getOpenOrders().empty());
+
+  // a late route cannot reopen a filled order
+  uint64_t version = book.getVersion();
+  EXPECT_FALSE(book.applyActivity("OrderRoute", makeMessage("1001")));
+  EXPECT_EQ(1u, book.getDroppedEvents());
+  EXPECT_EQ(version, book.getVersion());
+  EXPECT_FALSE(book.cancel(id));
+
+  // an order the broker refuses with a 4xx never gets a broker id
+  uint64_t refused = book.submit(makeTicket(10));
+  EXPECT_EQ(OrderState::Rejected, book.find(refused)->state);
+  EXPECT_TRUE(book.find(refused)->brokerId.empty());
+  EXPECT_FALSE(book.find(99).has_value());
+  EXPECT_EQ(2u, book.getSubmitLatency().samples);
+}
+
+TEST(TdaOrderBookTest, EventsAheadOfTheAckAreHeld) {
+  OrderBook* self = nullptr;
+  OrderBook book(
+      [&](const OrderTicket&) {
+        // the stream beats the response to the order endpoint
+        self->applyActivity("OrderEntryRequest", makeMessage("2002"));
+        self->applyActivity("OrderFill", makeFill("2002", 5, 10));
+        // and brings one for an order placed elsewhere
+        self->applyActivity("OrderRoute", makeMessage("9009"));
+        return SubmitReply{"2002", 201};
+      },
+      [](const std::string&, const std::string&) { return true; });
+  self = &book;
+
+  uint64_t id = book.submit(makeTicket(5));
+  auto record = book.find(id);
+  EXPECT_EQ(OrderState::Filled, record->state);
+  EXPECT_DOUBLE_EQ(5.0, record->filledQuantity);
+  EXPECT_EQ(0u, book.getDroppedEvents());
+  EXPECT_EQ(1u, book.getDiscardedEvents());
+  EXPECT_FALSE(book.findByBrokerId("9009").has_value());
+
+  // with nothing in flight, an unknown order's events are left to reconcile
+  EXPECT_FALSE(book.applyActivity("OrderRoute", makeMessage("3003")));
+  EXPECT_FALSE(book.findByBrokerId("3003").has_value());
+}
+
+TEST(TdaOrderBookTest, ReplayedFillsCountOnce) {
+  OrderBook book([](const OrderTicket&) { return SubmitReply{"6006", 201}; },
+                 [](const std::string&, const std::string&) { return true; });
+  uint64_t id = book.submit(makeTicket(100));
+  book.applyActivity("OrderRoute", makeMessage("6006"));
+
+  // the streamer sends recent messages again after a reconnect
+  const std::string partial =
+      makeFrame("OrderPartialFill", makeFill("6006", 40, 150, "E1"));
+  book.applyStreamMessage(partial);
+  book.applyStreamMessage(partial);
+  EXPECT_EQ(OrderState::PartiallyFilled, book.find(id)->state);
+  EXPECT_DOUBLE_EQ(40.0, book.find(id)->filledQuantity);
+  EXPECT_DOUBLE_EQ(150.0, book.find(id)->averageFillPrice);
+
+  book.applyStreamMessage(
+      makeFrame("OrderPartialFill", makeFill("6006", 20, 153, "E2")));
+  EXPECT_DOUBLE_EQ(60.0, book.find(id)->filledQuantity);
+  EXPECT_DOUBLE_EQ(151.0, book.find(id)->averageFillPrice);
+
+  // without an execution id, the ticket still bounds what a repeat adds
+  book.applyActivity("OrderPartialFill", makeFill("6006", 40, 160));
+  book.applyActivity("OrderPartialFill", makeFill("6006", 40, 160));
+  auto record = book.find(id);
+  EXPECT_EQ(OrderState::Filled, record->state);
+  EXPECT_DOUBLE_EQ(100.0, record->filledQuantity);
+  EXPECT_DOUBLE_EQ(154.6, record->averageFillPrice);
+  // the second one came after the order was full
+  EXPECT_EQ(1u, book.getDroppedEvents());
+}
+
+TEST(TdaOrderBookTest, CancelsAndReconcilesAgainstTheBroker) {
+  std::vector<std::string> canceled;
+  OrderBook book([](const OrderTicket&) { return SubmitReply{"4004", 201}; },
+                 [&](const std::string& account, const std::string& id) {
+                   canceled.push_back(account + "/" + id);
+                   return true;
+                 });
+
+  uint64_t id = book.submit(makeTicket(50));
+  book.applyActivity("OrderRoute", makeMessage("4004"));
+  book.applyActivity("OrderPartialFill", makeFill("4004", 10, 20));
+  EXPECT_TRUE(book.cancel(id));
+  EXPECT_EQ(std::vector<std::string>{"123/4004"}, canceled);
+  EXPECT_EQ(OrderState::PendingCancel, book.find(id)->state);
+
+  // too late: the order goes back to where it was
+  book.applyActivity("TooLateToCancel", makeMessage("4004"));
+  EXPECT_EQ(OrderState::PartiallyFilled, book.find(id)->state);
+
+  // the broker's list fills ours and brings in one placed elsewhere
+  book.reconcile(R"([
+    {"orderId": 4004, "accountId": 123, "status": "FILLED",
+     "quantity": 50, "filledQuantity": 50},
+    {"orderId": 5005, "accountId": 123, "status": "WORKING",
+     "orderType": "LIMIT", "quantity": 3, "filledQuantity": 0,
+     "price": 4.5, "orderLegCollection": [{"instruction": "SELL",
+     "instrument": {"symbol": "MSFT", "assetType": "EQUITY"}}]}])");
+  EXPECT_EQ(OrderState::Filled, book.find(id)->state);
+  EXPECT_DOUBLE_EQ(50.0, book.find(id)->filledQuantity);
+
+  auto adopted = book.findByBrokerId("5005");
+  ASSERT_TRUE(adopted.has_value());
+  EXPECT_EQ(OrderState::Working, adopted->state);
+  EXPECT_EQ("MSFT", adopted->ticket.symbol);
+  EXPECT_DOUBLE_EQ(3.0, adopted->remaining());
+  using Ids = std::vector<std::pair<std::string, std::string>>;
+  EXPECT_EQ((Ids{{"123", "5005"}}), book.getOpenBrokerIds());
+
+  // a single order, as the order endpoint returns it
+  book.reconcile(R"({"orderId": 5005, "status": "CANCELED"})");
+  EXPECT_EQ(OrderState::Canceled, book.findByBrokerId("5005")->state);
+  EXPECT_TRUE(book.getOpenBrokerIds().empty());
+}
+
+TEST(TdaOrderBookTest, UnansweredSubmitsAreSettledByReconcile) {
+  size_t submits = 0;
+  OrderBook book(
+      [&](const OrderTicket&) -> SubmitReply {
+        // a timeout, then a 201 without its Location header
+        if (submits++ == 0) throw std::runtime_error("timed out");
+        return SubmitReply{"", 201};
+      },
+      [](const std::string&, const std::string&) { return true; });
+
+  uint64_t first = book.submit(makeTicket(10));
+  OrderTicket other = makeTicket(20);
+  other.price = 151.0;
+  uint64_t second = book.submit(other);
+  EXPECT_EQ(OrderState::Unknown, book.find(first)->state);
+  EXPECT_EQ(OrderState::Unknown, book.find(second)->state);
+  EXPECT_EQ(2u, book.getOpenOrders().size());
+  EXPECT_FALSE(book.cancel(first));
+
+  // both want the account's order list, asked for once
+  using Ids = std::vector<std::pair<std::string, std::string>>;
+  EXPECT_EQ((Ids{{"123", ""}}), book.getOpenBrokerIds());
+
+  // the broker has the first, which takes its id instead of a copy
+  book.reconcile(R"([
+    {"orderId": 6006, "accountId": 123, "status": "WORKING",
+     "orderType": "LIMIT", "quantity": 10, "filledQuantity": 0,
+     "price": 150.0, "orderLegCollection": [{"instruction": "BUY",
+     "instrument": {"symbol": "AAPL", "assetType": "EQUITY"}}]}])");
+  auto settled = book.find(first);
+  EXPECT_EQ(OrderState::Working, settled->state);
+  EXPECT_EQ("6006", settled->brokerId);
+  EXPECT_EQ(first, book.findByBrokerId("6006")->clientId);
+  EXPECT_EQ(OrderState::Unknown, book.find(second)->state);
+  EXPECT_EQ(2u, book.getOpenOrders().size());
+  Ids ids = book.getOpenBrokerIds();
+  std::sort(ids.begin(), ids.end());
+  EXPECT_EQ((Ids{{"123", ""}, {"123", "6006"}}), ids);
+
+  book.applyActivity("OrderFill", makeFill("6006", 10, 150));
+  EXPECT_EQ(OrderState::Filled, book.find(first)->state);
+}
+
+}  // namespace OrderTests
+}  // namespace AppTestSuite
+}  // namespace premiatests
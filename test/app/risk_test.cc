@@ -0,0 +1,239 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "app/model/options/black_scholes.h"
+#include "app/model/options/worker_pool.h"
+#include "app/model/risk/account_book.h"
+#include "app/model/risk/portfolio_risk.h"
+
+namespace premiatests {
+namespace AppTestSuite {
+namespace RiskTests {
+
+using premia::OptionSymbol;
+using premia::Revaluation;
+using premia::RiskBook;
+using premia::RiskEngine;
+using premia::RiskFactor;
+using premia::RiskOptions;
+using premia::RiskPosition;
+using premia::WorkerPool;
+
+RiskFactor makeFactor(double spot, double vol) {
+  RiskFactor factor;
+  factor.spot = spot;
+  factor.vol = vol;
+  return factor;
+}
+
+RiskPosition makeShares(size_t factor, double quantity) {
+  RiskPosition position;
+  position.factor = factor;
+  position.quantity = quantity;
+  return position;
+}
+
+RiskPosition makeOption(size_t factor, double quantity, double strike,
+                        double years, bool call) {
+  RiskPosition position;
+  position.factor = factor;
+  position.quantity = quantity;
+  position.multiplier = 100.0;
+  position.option = true;
+  position.call = call;
+  position.strike = strike;
+  position.years = years;
+  position.vol = 0.3;
+  return position;
+}
+
+// Three correlated underlyings with stock and option positions on each.
+RiskBook makeBook() {
+  RiskBook book;
+  book.rate = 0.04;
+  book.factors = {makeFactor(100.0, 0.25), makeFactor(50.0, 0.4),
+                  makeFactor(400.0, 0.15)};
+  book.correlation = {1.0, 0.6, 0.3, 0.6, 1.0, 0.2, 0.3, 0.2, 1.0};
+  book.positions = {makeShares(0, 200.0),
+                    makeOption(0, -3.0, 105.0, 0.1, true),
+                    makeOption(1, 5.0, 45.0, 0.25, false),
+                    makeShares(2, -20.0),
+                    makeOption(2, 2.0, 400.0, 0.05, true)};
+  return book;
+}
+
+TEST(RiskEngineTest, SeedGivesTheSameReportOnAnyPool) {
+  RiskBook book = makeBook();
+  RiskOptions options;
+  options.paths = 5000;
+  options.seed = 42;
+
+  WorkerPool one(1);
+  WorkerPool three(3);
+  auto inline_ = RiskEngine(&one).run(book, options);
+  auto pooled = RiskEngine(&three).run(book, options);
+  EXPECT_EQ(inline_.pnl, pooled.pnl);
+  EXPECT_EQ(inline_.var, pooled.var);
+  EXPECT_EQ(inline_.es, pooled.es);
+
+  options.seed = 43;
+  auto reseeded = RiskEngine(&one).run(book, options);
+  EXPECT_NE(inline_.pnl, reseeded.pnl);
+  for (size_t i = 0; i < inline_.levels.size(); ++i) {
+    EXPECT_GT(inline_.var[i], 0.0);
+    EXPECT_GE(inline_.es[i], inline_.var[i]);
+  }
+}
+
+TEST(RiskEngineTest, StockVarMatchesTheLognormalQuantile) {
+  RiskBook book;
+  book.factors = {makeFactor(100.0, 0.3)};
+  book.positions = {makeShares(0, 1000.0)};
+  RiskOptions options;
+  options.paths = 50000;
+  options.horizonDays = 10.0;
+  options.levels = {0.99};
+
+  WorkerPool pool(2);
+  auto report = RiskEngine(&pool).run(book, options);
+  EXPECT_DOUBLE_EQ(100000.0, report.value);
+
+  const double sd = 0.3 * std::sqrt(10.0 / 365);
+  const double z99 = 2.3263478740408408;
+  double var = 100000.0 * (1 - std::exp(-z99 * sd - sd * sd / 2));
+  EXPECT_NEAR(var, report.var[0], 0.03 * var);
+  EXPECT_NEAR(100000.0 * sd, report.stdev, 0.02 * 100000.0 * sd);
+  EXPECT_NEAR(0.0, report.mean, 0.02 * report.stdev);
+}
+
+TEST(RiskEngineTest, PerfectlyCorrelatedHedgeHasNoRisk) {
+  RiskBook book;
+  book.factors = {makeFactor(100.0, 0.2), makeFactor(100.0, 0.2)};
+  book.correlation = {1.0, 1.0, 1.0, 1.0};
+  book.positions = {makeShares(0, 10.0), makeShares(1, -10.0)};
+  RiskOptions options;
+  options.paths = 1000;
+
+  WorkerPool pool(1);
+  auto report = RiskEngine(&pool).run(book, options);
+  EXPECT_NEAR(0.0, report.var[1], 1e-9);
+  EXPECT_NEAR(0.0, report.stdev, 1e-9);
+}
+
+TEST(RiskEngineTest, ScenariosRevalueInFull) {
+  RiskBook book = makeBook();
+  WorkerPool pool(1);
+  RiskEngine engine(&pool);
+
+  // one option alone, against the reference pricer
+  RiskBook single = book;
+  single.positions = {book.positions[1]};
+  premia::OptionBatch batch;
+  batch.spot = 100.0;
+  batch.rate = book.rate;
+  batch.add(105.0, 0.1, 0.3, true);
+  batch.spot = 90.0;
+  premia::GreeksBatch down;
+  premia::priceReference(batch, &down);
+  batch.spot = 100.0;
+  premia::GreeksBatch today;
+  premia::priceReference(batch, &today);
+  EXPECT_NEAR(-300.0 * (down.price[0] - today.price[0]),
+              engine.scenario(single, {-0.1}), 1e-8);
+
+  EXPECT_NEAR(0.0, engine.scenario(book, {0.0, 0.0, 0.0}), 1e-8);
+  double crash = engine.scenario(book, {-0.2, -0.2, -0.2});
+  EXPECT_LT(crash, 0.0);
+
+  // over a short horizon the Taylor expansion tracks full revaluation
+  RiskOptions options;
+  options.paths = 4000;
+  auto full = engine.run(book, options);
+  options.revaluation = Revaluation::kDeltaGamma;
+  auto approx = engine.run(book, options);
+  EXPECT_NEAR(full.var[0], approx.var[0], 0.05 * full.var[0]);
+}
+
+TEST(AccountBookTest, PositionsBecomeFactorsAndContracts) {
+  OptionSymbol option;
+  ASSERT_TRUE(premia::parseOptionSymbol("SPY_032024P412.5", &option));
+  EXPECT_EQ(option.underlying, "SPY");
+  EXPECT_EQ(option.expiry, 20240320);
+  EXPECT_FALSE(option.call);
+  EXPECT_DOUBLE_EQ(option.strike, 412.5);
+  EXPECT_FALSE(premia::parseOptionSymbol("SPY", &option));
+  EXPECT_FALSE(premia::parseOptionSymbol("SPY_1320C400", &option));
+  EXPECT_FALSE(premia::parseOptionSymbol("SPY_032024X400", &option));
+
+  auto held = [](const std::string& symbol, const std::string& type,
+                 double longQuantity, double shortQuantity) {
+    premia::tda::Position position;
+    position.symbol = symbol;
+    position.assetType = type;
+    position.longQuantity = longQuantity;
+    position.shortQuantity = shortQuantity;
+    return position;
+  };
+  premia::tda::Account account;
+  account.add_position(held("AAPL", "EQUITY", 200, 0));
+  account.add_position(held("AAPL_011924C190", "OPTION", 0, 3));
+  account.add_position(held("SPY_011924P470", "OPTION", 5, 0));
+  account.add_position(held("AAPL_010124C150", "OPTION", 1, 0));  // expired
+  account.add_position(held("MMDA1", "CASH_EQUIVALENT", 1000, 0));
+  account.add_position(held("XYZ", "EQUITY", 10, 0));  // no quote
+
+  int quotes = 0;
+  auto quote = [&](const std::string& symbol, RiskFactor* factor) {
+    ++quotes;
+    if (symbol == "AAPL") *factor = makeFactor(185.0, 0.22);
+    if (symbol == "SPY") *factor = makeFactor(475.0, 0.13);
+    factor->symbol = symbol;
+    return symbol != "XYZ";
+  };
+  // 2024-01-12 20:00 UTC, a week before the January expiry
+  auto now = std::chrono::system_clock::time_point(
+      std::chrono::seconds(1705089600));
+  std::vector<std::string> skipped;
+  RiskBook book = premia::makeRiskBook(account, quote, 0.05, now, &skipped);
+
+  EXPECT_EQ(quotes, 3);  // once per underlying
+  ASSERT_EQ(book.factors.size(), 2u);
+  EXPECT_EQ(book.factors[0].symbol, "AAPL");
+  EXPECT_EQ(book.factors[1].symbol, "SPY");
+  EXPECT_TRUE(book.correlation.empty());
+  EXPECT_DOUBLE_EQ(book.rate, 0.05);
+  EXPECT_EQ(skipped, (std::vector<std::string>{"AAPL_010124C150", "MMDA1",
+                                               "XYZ"}));
+
+  ASSERT_EQ(book.positions.size(), 3u);
+  const RiskPosition& shares = book.positions[0];
+  EXPECT_FALSE(shares.option);
+  EXPECT_EQ(shares.factor, 0u);
+  EXPECT_DOUBLE_EQ(shares.quantity, 200);
+  const RiskPosition& call = book.positions[1];
+  EXPECT_TRUE(call.option);
+  EXPECT_TRUE(call.call);
+  EXPECT_EQ(call.factor, 0u);
+  EXPECT_DOUBLE_EQ(call.quantity, -3);
+  EXPECT_DOUBLE_EQ(call.multiplier, 100);
+  EXPECT_DOUBLE_EQ(call.strike, 190);
+  EXPECT_NEAR(call.years, 7.0 / 365, 1e-12);
+  EXPECT_DOUBLE_EQ(call.vol, 0.22);
+  EXPECT_EQ(book.positions[2].factor, 1u);
+  EXPECT_FALSE(book.positions[2].call);
+
+  // the book runs as is
+  WorkerPool pool(1);
+  RiskEngine engine(&pool);
+  EXPECT_NEAR(engine.scenario(book, {0.0, 0.0}), 0.0, 1e-9);
+  EXPECT_GT(engine.scenario(book, {0.05, 0.0}), 0.0);
+}
+
+}  // namespace RiskTests
+}  // namespace AppTestSuite
+}  // namespace premiatests
@@ -0,0 +1,206 @@
+// Decode throughput and callback latency of the IB client stack against the
+// local MockTwsServer. Runs on loopback, no TWS or network needed.
+//
+//   premia_ib_benchmark [messages] [latency_samples] [latency_rate]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "service/InteractiveBrokers/MockServer.hpp"
+#include "service/InteractiveBrokers/WireCapture.hpp"
+#include "service/InteractiveBrokers/tws/DefaultEWrapper.h"
+#include "service/InteractiveBrokers/tws/EClientSocket.h"
+#include "service/InteractiveBrokers/tws/EReader.h"
+#include "service/InteractiveBrokers/tws/EReaderOSSignal.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using premia::tws::MockTwsServer;
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+// Counts callbacks; everything runs on the one thread calling processMsgs.
+class CountingWrapper : public DefaultEWrapper {
+ public:
+  void tickPrice(TickerId, TickType, double, const TickAttrib &) override {
+    ++ticks;
+  }
+  void tickString(TickerId, TickType, const std::string &value) override {
+    latencies_ns.push_back(NowNs() - std::atoll(value.c_str()));
+    ++strings;
+  }
+  void updateMktDepthL2(TickerId, int, const std::string &, int, int, double,
+                        int, bool) override {
+    ++depth;
+  }
+  void historicalData(TickerId, const Bar &) override { ++bars; }
+
+  std::atomic<size_t> ticks{0};
+  std::atomic<size_t> strings{0};
+  std::atomic<size_t> depth{0};
+  std::atomic<size_t> bars{0};
+  std::vector<int64_t> latencies_ns;
+};
+
+bool WaitFor(const std::function<bool()> &done, std::chrono::seconds limit) {
+  Clock::time_point deadline = Clock::now() + limit;
+  while (!done()) {
+    if (Clock::now() > deadline) return false;
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+void Throughput(const char *name, MockTwsServer &server,
+                const std::vector<MockTwsServer::Fields> &messages,
+                size_t repeat, size_t callbacks_each,
+                const std::atomic<size_t> &counter) {
+  size_t start_count = counter;
+  size_t expected = start_count + messages.size() * repeat * callbacks_each;
+  size_t bytes = 0;
+  for (const auto &fields : messages) {
+    bytes += MockTwsServer::Frame(fields).size();
+  }
+  bytes *= repeat;
+
+  Clock::time_point start = Clock::now();
+  std::thread writer([&]() { server.Stream(messages, 0.0, repeat); });
+  bool finished = WaitFor([&]() { return counter >= expected; },
+                          std::chrono::seconds(120));
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  writer.join();
+
+  size_t count = messages.size() * repeat;
+  std::printf("%-16s %10zu msgs %8.3f s %12.0f msgs/s %8.1f MB/s%s\n", name,
+              count, seconds, count / seconds, bytes / seconds / 1e6,
+              finished ? "" : "  (timed out)");
+}
+
+void Latency(MockTwsServer &server, CountingWrapper &wrapper, size_t samples,
+             double rate) {
+  wrapper.latencies_ns.clear();
+  wrapper.latencies_ns.reserve(samples);
+  size_t expected = wrapper.strings + samples;
+
+  auto interval = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(1.0 / rate));
+  Clock::time_point next = Clock::now();
+  for (size_t i = 0; i < samples; ++i) {
+    std::this_thread::sleep_until(next);
+    next += interval;
+    server.Send(server.TickString(1, LAST_TIMESTAMP, std::to_string(NowNs())));
+  }
+  WaitFor([&]() { return wrapper.strings >= expected; },
+          std::chrono::seconds(30));
+
+  // the consumer thread is idle once every sample arrived
+  std::vector<int64_t> sorted = wrapper.latencies_ns;
+  if (sorted.empty()) return;
+  std::sort(sorted.begin(), sorted.end());
+  auto at = [&](double q) {
+    return sorted[std::min(sorted.size() - 1,
+                           static_cast<size_t>(q * sorted.size()))] / 1e3;
+  };
+  std::printf("%-16s %10zu msgs at %.0f/s  p50 %.1f us  p99 %.1f us  "
+              "p99.9 %.1f us  max %.1f us\n",
+              "latency", sorted.size(), rate, at(0.5), at(0.99), at(0.999),
+              sorted.back() / 1e3);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t messages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+  size_t samples = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20000;
+  double rate = argc > 3 ? std::atof(argv[3]) : 10000.0;
+
+  MockTwsServer server;
+  if (!server.Start()) {
+    std::fprintf(stderr, "cannot listen on loopback\n");
+    return 1;
+  }
+
+  CountingWrapper wrapper;
+  EReaderOSSignal signal(2000);
+  EClientSocket client(&wrapper, &signal);
+  if (!client.eConnect("127.0.0.1", server.port(), 0) ||
+      !server.WaitForClient(std::chrono::seconds(5))) {
+    std::fprintf(stderr, "handshake with the mock server failed\n");
+    return 1;
+  }
+
+  EReader reader(&client, &signal);
+  reader.start();
+  std::atomic<bool> running(true);
+  std::thread consumer([&]() {
+    while (running && client.isConnected()) {
+      signal.waitForSignal();
+      reader.processMsgs();
+    }
+  });
+
+  std::printf("server version %d\n", server.version());
+
+  std::vector<MockTwsServer::Fields> ticks;
+  for (int i = 0; i < 1000; ++i) {
+    ticks.push_back(server.TickPrice(1, i % 2 ? ASK : BID, 100.0 + i * 0.01,
+                                     100 + i));
+  }
+  // the tick run is captured so it can be decoded again without the socket
+  std::string capture_path = "/tmp/premia_ib_benchmark.bin";
+  premia::tws::WireCapture capture;
+  if (capture.Open(capture_path, server.version())) {
+    reader.setCapture(&capture);
+  }
+  Throughput("tickPrice", server, ticks, std::max<size_t>(messages / 1000, 1),
+             1, wrapper.ticks);
+  reader.setCapture(nullptr);
+  capture.Close();
+
+  premia::tws::WireReplay replay;
+  if (replay.Load(capture_path)) {
+    DefaultEWrapper sink;
+    premia::tws::ReplayStats stats = replay.Run(&sink);
+    std::printf("%-16s %10zu msgs %8.3f s %12.0f msgs/s %8.1f MB/s\n",
+                "replay", stats.messages, stats.seconds,
+                stats.MessagesPerSecond(), stats.bytes / stats.seconds / 1e6);
+  }
+  std::remove(capture_path.c_str());
+
+  std::vector<MockTwsServer::Fields> depth;
+  for (int i = 0; i < 1000; ++i) {
+    depth.push_back(server.MarketDepthL2(2, i % 10, "NSDQ", 1, i % 2,
+                                         100.0 + i * 0.01, 100 + i));
+  }
+  Throughput("updateMktDepthL2", server, depth,
+             std::max<size_t>(messages / 1000, 1), 1, wrapper.depth);
+
+  std::vector<Bar> bars(500, Bar{"20240102 09:30:00", 101, 99, 100, 100.5,
+                                 100.2, 12000, 40});
+  std::vector<MockTwsServer::Fields> history = {
+      server.HistoricalData(3, "20240101", "20240102", bars)};
+  Throughput("historicalData", server, history,
+             std::max<size_t>(messages / 50000, 1), bars.size(),
+             wrapper.bars);
+
+  Latency(server, wrapper, samples, rate);
+
+  running = false;
+  client.eDisconnect();
+  signal.issueSignal();
+  consumer.join();
+  server.Stop();
+  return 0;
+}
@@ -0,0 +1,53 @@
+// Decodes a wire capture recorded with Client::startCapture() at full speed,
+// for profiling EDecoder without TWS or a socket in the way.
+//
+//   premia_ib_replay capture.bin [repeat]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+#include "service/InteractiveBrokers/WireCapture.hpp"
+#include "service/InteractiveBrokers/tws/DefaultEWrapper.h"
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s capture.bin [repeat]\n", argv[0]);
+    return 2;
+  }
+  size_t repeat = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+
+  premia::tws::WireReplay replay;
+  if (!replay.Load(argv[1])) {
+    std::fprintf(stderr, "%s is not a wire capture\n", argv[1]);
+    return 1;
+  }
+
+  const auto &messages = replay.messages();
+  double span = messages.empty() ? 0.0 : messages.back().timestamp_ns / 1e9;
+  std::printf("server version %d, %zu messages over %.3f s of session\n",
+              replay.server_version(), replay.size(), span);
+
+  DefaultEWrapper wrapper;
+  premia::tws::ReplayStats stats = replay.Run(&wrapper, repeat);
+  std::printf("decoded %zu msgs (%zu failed) in %.3f s: %.0f msgs/s, "
+              "%.1f MB/s\n",
+              stats.messages, stats.failed, stats.seconds,
+              stats.MessagesPerSecond(),
+              stats.seconds > 0 ? stats.bytes / stats.seconds / 1e6 : 0.0);
+
+  std::vector<std::pair<long long, int>> busiest;
+  for (size_t id = 0; id < stats.by_msg_id.size(); ++id) {
+    if (stats.by_msg_id[id] > 0) {
+      busiest.emplace_back(stats.by_msg_id[id], static_cast<int>(id));
+    }
+  }
+  std::sort(busiest.rbegin(), busiest.rend());
+  for (const auto &entry : busiest) {
+    std::printf("  msg id %3d %12lld %6.2f%%\n", entry.second, entry.first,
+                100.0 * entry.first / stats.messages);
+  }
+  return stats.failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,1238 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "service/InteractiveBrokers/BarAggregator.hpp"
+#include "service/InteractiveBrokers/Client.hpp"
+#include "service/InteractiveBrokers/ConnectionPool.hpp"
+#include "service/InteractiveBrokers/ContractCache.hpp"
+#include "service/InteractiveBrokers/MarketDataCache.hpp"
+#ifndef _WIN32
+#include "service/InteractiveBrokers/MockServer.hpp"
+#endif
+#include "service/InteractiveBrokers/OptionSurface.hpp"
+#include "service/InteractiveBrokers/OrderBook.hpp"
+#include "service/InteractiveBrokers/PnlEngine.hpp"
+#include "service/InteractiveBrokers/RequestPacer.hpp"
+#include "service/InteractiveBrokers/RequestRouter.hpp"
+#include "service/InteractiveBrokers/ScannerEngine.hpp"
+#include "service/InteractiveBrokers/TickBackfill.hpp"
+#include "service/InteractiveBrokers/TickFile.hpp"
+#include "service/InteractiveBrokers/WireCapture.hpp"
+#include "service/InteractiveBrokers/tws/EDecoder.h"
+#include "service/InteractiveBrokers/tws/DefaultEWrapper.h"
+
+namespace premiatests {
+namespace ServiceTestSuite {
+namespace IBTests {
+
+using premia::tws::ContractCache;
+using premia::tws::MarketDataCache;
+using premia::tws::OptionSurface;
+using premia::tws::OrderBook;
+using premia::tws::OrderBookTable;
+using premia::tws::PnlEngine;
+using premia::tws::RequestPacer;
+using premia::tws::RequestRouter;
+using premia::tws::ScanEvent;
+using premia::tws::ScannerEngine;
+using premia::tws::TickBackfill;
+using premia::tws::TopOfBook;
+
+TEST(MarketDataCacheTest, TicksLandInTypedFields) {
+  MarketDataCache cache;
+  cache.OnTickPrice(1001, BID, 99.5);
+  cache.OnTickPrice(1001, ASK, 99.75);
+  cache.OnTickSize(1001, BID_SIZE, 300);
+  cache.OnTickOptionComputation(1001, MODEL_OPTION, 0, 0.25, 0.5, 1.2, 0.0,
+                                0.04, 0.1, -0.05, 100.0);
+
+  TopOfBook tob;
+  uint64_t version = 0;
+  ASSERT_TRUE(cache.Snapshot(1001, &tob, &version));
+  EXPECT_DOUBLE_EQ(tob.bid, 99.5);
+  EXPECT_DOUBLE_EQ(tob.ask, 99.75);
+  EXPECT_DOUBLE_EQ(tob.bid_size, 300);
+  EXPECT_DOUBLE_EQ(tob.greeks[premia::tws::kGreeksModel].gamma, 0.04);
+  EXPECT_EQ(tob.changed, premia::tws::kTickGreeks);
+
+  EXPECT_FALSE(cache.SnapshotIfChanged(1001, &version, &tob));
+  cache.OnTickPrice(1001, LAST, 99.6);
+  EXPECT_TRUE(cache.SnapshotIfChanged(1001, &version, &tob));
+  EXPECT_DOUBLE_EQ(tob.last, 99.6);
+
+  // each kind of open interest keeps its own value
+  cache.OnTickSize(1001, OPTION_CALL_OPEN_INTEREST, 1200);
+  cache.OnTickSize(1001, OPTION_PUT_OPEN_INTEREST, 800);
+  cache.OnTickSize(1001, FUTURES_OPEN_INTEREST, 50);
+  ASSERT_TRUE(cache.Snapshot(1001, &tob));
+  EXPECT_DOUBLE_EQ(tob.call_open_interest, 1200);
+  EXPECT_DOUBLE_EQ(tob.put_open_interest, 800);
+  EXPECT_DOUBLE_EQ(tob.futures_open_interest, 50);
+  EXPECT_EQ(tob.changed, premia::tws::kTickOpenInterest);
+
+  EXPECT_FALSE(cache.Snapshot(42, &tob));
+}
+
+TEST(MarketDataCacheTest, RemovedLinesGiveTheirSlotBack) {
+  MarketDataCache cache(16);
+  ASSERT_EQ(cache.capacity(), 16u);
+  for (TickerId id = 1; id <= 16; ++id) cache.OnTickPrice(id, BID, id);
+
+  // a full table drops the tick but says so
+  TopOfBook tob;
+  cache.OnTickPrice(17, BID, 17);
+  EXPECT_FALSE(cache.Snapshot(17, &tob));
+  EXPECT_EQ(cache.DroppedTicks(), 1u);
+
+  cache.Remove(5);
+  EXPECT_FALSE(cache.Snapshot(5, &tob));
+  cache.OnTickPrice(17, ASK, 17.5);
+  ASSERT_TRUE(cache.Snapshot(17, &tob));
+  EXPECT_DOUBLE_EQ(tob.ask, 17.5);
+  // nothing of the removed line leaks into the new one
+  EXPECT_DOUBLE_EQ(tob.bid, 0.0);
+  EXPECT_EQ(cache.DroppedTicks(), 1u);
+
+  // lines probed past the tombstone are still found
+  for (TickerId id = 1; id <= 16; ++id) {
+    if (id == 5) continue;
+    ASSERT_TRUE(cache.Snapshot(id, &tob)) << id;
+    EXPECT_DOUBLE_EQ(tob.bid, id);
+  }
+
+  // a long session keeps cycling ids through the same slot, even with no
+  // never-used slot left to end a probe
+  cache.Remove(6);
+  for (TickerId id = 100; id < 10000; ++id) {
+    cache.OnTickPrice(id, LAST, 1.0);
+    cache.Remove(id);
+  }
+  EXPECT_EQ(cache.DroppedTicks(), 1u);
+}
+
+TEST(MarketDataCacheTest, ReadersNeverSeeTornQuotes) {
+  MarketDataCache cache;
+  std::atomic<bool> done(false);
+  cache.OnTickPrice(7, BID, 0);
+  cache.OnTickPrice(7, ASK, 0);
+
+  std::thread writer([&]() {
+    for (int i = 1; i <= 200000; ++i) {
+      cache.OnTickOptionComputation(7, MODEL_OPTION, 0, i, i, i, i, i, i, i,
+                                    i);
+    }
+    done = true;
+  });
+
+  size_t torn = 0;
+  TopOfBook tob;
+  while (!done) {
+    if (cache.Snapshot(7, &tob)) {
+      const auto &g = tob.greeks[premia::tws::kGreeksModel];
+      if (g.delta != g.und_price || g.gamma != g.implied_vol) ++torn;
+    }
+  }
+  writer.join();
+  EXPECT_EQ(torn, 0u);
+}
+
+TEST(OrderBookTest, RowsShiftOnInsertAndDelete) {
+  OrderBookTable books;
+  books.OnUpdateMktDepthL2(5, 0, "ARCA", 0, 1, 10.00, 100, true);
+  books.OnUpdateMktDepthL2(5, 0, "NSDQ", 0, 1, 10.01, 200, true);
+  books.OnUpdateMktDepthL2(5, 0, "BATS", 0, 0, 10.03, 50, true);
+  books.OnUpdateMktDepthL2(5, 1, "EDGX", 0, 0, 10.04, 150, true);
+
+  premia::tws::BestBidOffer bbo;
+  ASSERT_TRUE(books.Bbo(5, &bbo));
+  EXPECT_DOUBLE_EQ(bbo.bid_price, 10.01);
+  EXPECT_DOUBLE_EQ(bbo.ask_price, 10.03);
+
+  OrderBook book;
+  ASSERT_TRUE(books.Snapshot(5, &book));
+  EXPECT_EQ(book.bid_rows, 2);
+  EXPECT_STREQ(book.bids[1].market_maker, "ARCA");
+  EXPECT_DOUBLE_EQ(book.TotalImbalance(), (300.0 - 200.0) / 500.0);
+
+  double cumulative[premia::tws::kMaxDepthRows];
+  ASSERT_EQ(book.CumulativeDepth(premia::tws::kDepthAsk, cumulative, 8), 2);
+  EXPECT_DOUBLE_EQ(cumulative[1], 200.0);
+
+  books.OnUpdateMktDepth(5, 0, 2, 1, 0, 0);
+  books.OnUpdateMktDepth(5, 0, 1, 0, 10.02, 75);
+  ASSERT_TRUE(books.Snapshot(5, &book));
+  EXPECT_EQ(book.bid_rows, 1);
+  EXPECT_DOUBLE_EQ(book.bids[0].price, 10.00);
+  EXPECT_DOUBLE_EQ(book.asks[0].price, 10.02);
+  EXPECT_DOUBLE_EQ(book.Imbalance(1), (100.0 - 75.0) / 175.0);
+}
+
+TEST(BarAggregatorTest, TimeVolumeAndTickBars) {
+  premia::tws::BarAggregator bars;
+  int seconds = bars.AddSeries(9, {premia::tws::kTimeBars, 5});
+  int volume = bars.AddSeries(9, {premia::tws::kVolumeBars, 300});
+  int ticks = bars.AddSeries(9, {premia::tws::kTickBars, 2});
+
+  bars.OnTrade(9, 1000, 10.0, 100);
+  bars.OnTrade(9, 1002, 10.5, 100);
+  bars.OnTrade(9, 1004, 9.5, 100);
+  bars.OnTrade(9, 1006, 10.2, 50);
+
+  std::vector<premia::tda::Candle> out;
+  ASSERT_EQ(bars.Drain(seconds, &out), 1u);
+  EXPECT_DOUBLE_EQ(out[0].open, 10.0);
+  EXPECT_DOUBLE_EQ(out[0].high, 10.5);
+  EXPECT_DOUBLE_EQ(out[0].low, 9.5);
+  EXPECT_DOUBLE_EQ(out[0].close, 9.5);
+  EXPECT_DOUBLE_EQ(out[0].volume, 300);
+  EXPECT_EQ(out[0].raw_datetime, 1000 * 1000);
+
+  out.clear();
+  ASSERT_EQ(bars.Drain(volume, &out), 1u);
+  EXPECT_DOUBLE_EQ(out[0].close, 9.5);
+
+  out.clear();
+  EXPECT_EQ(bars.Drain(ticks, &out), 2u);
+
+  bars.Flush(1011);
+  out.clear();
+  ASSERT_EQ(bars.Drain(seconds, &out), 1u);
+  EXPECT_DOUBLE_EQ(out[0].open, 10.2);
+
+  // the sink runs unlocked, so it may read the aggregator back
+  std::vector<int> closed;
+  bars.SetSink([&](TickerId, int series, const premia::tda::Candle &) {
+    premia::tda::Candle current;
+    bars.Current(series, &current);
+    bars.Flush(0);
+    closed.push_back(series);
+  });
+  bars.OnTrade(9, 1020, 10.0, 100);
+  bars.OnTrade(9, 1021, 10.1, 100);
+  EXPECT_EQ(closed, std::vector<int>({ticks}));
+}
+
+TEST(RequestPacerTest, BudgetsDuplicatesAndCancel) {
+  premia::tws::PacingLimits limits;
+  limits.messages_per_second = 10;
+  limits.message_burst = 2;
+  limits.historical_per_window = 1;
+  RequestPacer pacer(limits);
+
+  auto t0 = RequestPacer::Clock::now();
+  std::vector<int> sent;
+  auto send = [&](int id) { return [&sent, id] { sent.push_back(id); }; };
+  pacer.Submit(premia::tws::kPaceHistorical, 1, "AAPL|1 D", send(1), t0);
+  pacer.Submit(premia::tws::kPaceHistorical, 2, "MSFT|1 D", send(2), t0);
+  pacer.Submit(premia::tws::kPaceOrders, 3, "", send(3), t0);
+  pacer.Submit(premia::tws::kPaceGeneral, 4, "", send(4), t0);
+  EXPECT_FALSE(
+      pacer.Submit(premia::tws::kPaceHistorical, 5, "AAPL|1 D", send(5), t0));
+
+  // orders and general requests take the burst, historical waits for tokens
+  EXPECT_EQ(pacer.Pump(t0), 2u);
+  EXPECT_EQ(sent, std::vector<int>({3, 4}));
+  EXPECT_EQ(pacer.NextDelay(t0), std::chrono::milliseconds(100));
+
+  // one token later only one historical request fits in the window
+  auto t1 = t0 + std::chrono::milliseconds(300);
+  EXPECT_EQ(pacer.Pump(t1), 1u);
+  EXPECT_EQ(sent.back(), 1);
+  EXPECT_TRUE(pacer.Cancel(2));
+  EXPECT_FALSE(pacer.Cancel(1));
+  EXPECT_EQ(pacer.Pending(), 0u);
+
+  // an identical historical request inside 15 seconds is still suppressed
+  EXPECT_FALSE(
+      pacer.Submit(premia::tws::kPaceHistorical, 6, "AAPL|1 D", send(6), t1));
+
+  premia::tws::PacingStats stats = pacer.Stats(premia::tws::kPaceHistorical);
+  EXPECT_EQ(stats.sent, 1u);
+  EXPECT_EQ(stats.deferred, 1u);
+  EXPECT_EQ(stats.suppressed, 2u);
+  EXPECT_DOUBLE_EQ(stats.max_wait_ms, 300.0);
+}
+
+TEST(RequestPacerTest, CategoriesSpendTheirOwnBuckets) {
+  premia::tws::PacingLimits limits;
+  limits.category[premia::tws::kPaceGeneral] = {10.0, 1.0};
+  RequestPacer pacer(limits);
+
+  auto t0 = RequestPacer::Clock::now();
+  std::vector<int> sent;
+  auto send = [&](int id) { return [&sent, id] { sent.push_back(id); }; };
+  for (int id = 1; id <= 3; ++id) {
+    pacer.Submit(premia::tws::kPaceGeneral, id, "", send(id), t0);
+  }
+
+  // alone, general spends the idle shares of the shared budget
+  EXPECT_EQ(pacer.Pump(t0), 3u);
+
+  // with historical work ready it keeps to its own, spent, bucket; orders
+  // are not held back by the general backlog
+  pacer.Submit(premia::tws::kPaceGeneral, 4, "", send(4), t0);
+  pacer.Submit(premia::tws::kPaceGeneral, 5, "", send(5), t0);
+  pacer.Submit(premia::tws::kPaceHistorical, 6, "", send(6), t0);
+  pacer.Submit(premia::tws::kPaceOrders, 7, "", send(7), t0);
+  EXPECT_EQ(pacer.Pump(t0), 2u);
+  EXPECT_EQ(sent, std::vector<int>({1, 2, 3, 7, 6}));
+
+  // with the historical queue empty again the next pump lends general the
+  // rest
+  EXPECT_EQ(pacer.NextDelay(t0), RequestPacer::Clock::duration::zero());
+  EXPECT_EQ(pacer.Pump(t0), 2u);
+  EXPECT_EQ(pacer.Pending(), 0u);
+}
+
+TEST(RequestRouterTest, RepliesErrorsAndTimeouts) {
+  RequestRouter router;
+  std::vector<int> sent;
+  std::vector<int> cancelled;
+  auto send = [&](int id) { sent.push_back(id); };
+  auto cancel = [&](int id) { cancelled.push_back(id); };
+
+  auto bars = router.RequestHistoricalData(send, cancel, std::chrono::hours(1));
+  auto details =
+      router.RequestContractDetails(send, cancel, std::chrono::hours(1));
+  auto summary =
+      router.RequestAccountSummary(send, cancel, std::chrono::seconds(0));
+  EXPECT_EQ(sent, std::vector<int>({bars.id, details.id, summary.id}));
+
+  // replies for the two requests interleave, as they do on the wire
+  Bar bar = {};
+  bar.close = 1.5;
+  ContractDetails cd;
+  cd.contract.conId = 265598;
+  router.OnHistoricalData(bars.id, bar);
+  router.OnContractDetails(details.id, cd);
+  router.OnHistoricalData(bars.id, bar);
+  router.OnContractDetails(bars.id, cd);  // wrong type for the id, ignored
+  router.OnError(bars.id, 2106, "HMDS data farm connection is OK");
+  router.OnHistoricalDataEnd(bars.id, "20240102", "20240103");
+
+  premia::tws::HistoricalBars result = bars.result.get();
+  ASSERT_EQ(result.bars.size(), 2u);
+  EXPECT_DOUBLE_EQ(result.bars[1].close, 1.5);
+  EXPECT_EQ(result.end, "20240103");
+
+  EXPECT_TRUE(router.OnError(details.id, 200, "No security definition"));
+  try {
+    details.result.get();
+    FAIL();
+  } catch (const premia::tws::RequestError &e) {
+    EXPECT_EQ(e.code(), 200);
+  }
+
+  EXPECT_EQ(router.Expire(), 1u);
+  EXPECT_EQ(cancelled, std::vector<int>({summary.id}));
+  EXPECT_THROW(summary.result.get(), premia::tws::RequestError);
+  EXPECT_FALSE(router.Cancel(summary.id));
+  EXPECT_EQ(router.Outstanding(), 0u);
+
+  // with a callback the result is handed over on completion
+  std::vector<ContractDetails> rows;
+  std::exception_ptr error;
+  int id = router.RequestContractDetails(
+      send, cancel, std::chrono::hours(1),
+      [&](std::vector<ContractDetails> r, std::exception_ptr e) {
+        rows = std::move(r);
+        error = e;
+      });
+  router.OnContractDetails(id, cd);
+  router.OnContractDetailsEnd(id);
+  ASSERT_EQ(rows.size(), 1u);
+  EXPECT_EQ(rows[0].contract.conId, 265598);
+  EXPECT_FALSE(error);
+}
+
+TEST(ContractCacheTest, CoalescesFetchesAndPersists) {
+  ContractCache cache;
+  int fetches = 0;
+  std::vector<ContractCache::Done> replies;
+  cache.SetFetch([&](const Contract &, ContractCache::Done done) {
+    ++fetches;
+    replies.push_back(std::move(done));
+  });
+
+  Contract call;
+  call.symbol = "SPY";
+  call.secType = "OPT";
+  call.lastTradeDateOrContractMonth = "20240119";
+  call.strike = 470;
+  call.right = "CALL";
+  call.exchange = "SMART";
+  call.currency = "USD";
+
+  auto first = cache.Resolve(call);
+  auto second = cache.Resolve(call);
+  EXPECT_EQ(fetches, 1);
+
+  ContractDetails details;
+  details.contract = call;
+  details.contract.right = "C";
+  details.contract.conId = 658123456;
+  details.minTick = 0.01;
+  replies[0]({details}, nullptr);
+
+  // settled by the reply itself, not by the first get()
+  EXPECT_EQ(first.wait_for(std::chrono::seconds(0)),
+            std::future_status::ready);
+  ASSERT_EQ(second.get().size(), 1u);
+  EXPECT_EQ(first.get()[0].con_id, 658123456);
+
+  // warm now: no fetch, found by key or by conId
+  EXPECT_EQ(cache.Resolve(call).get()[0].right, "C");
+  EXPECT_EQ(fetches, 1);
+
+  // a failed fetch is not kept in flight, the next Resolve() asks again
+  Contract put = call;
+  put.right = "P";
+  auto failed = cache.Resolve(put);
+  ASSERT_EQ(fetches, 2);
+  replies[1]({}, std::make_exception_ptr(std::runtime_error("timed out")));
+  EXPECT_THROW(failed.get(), std::runtime_error);
+  cache.Resolve(put);
+  EXPECT_EQ(fetches, 3);
+
+  std::string path = ::testing::TempDir() + "ib_contracts.tsv";
+  ASSERT_TRUE(cache.Save(path));
+  ContractCache loaded;
+  ASSERT_TRUE(loaded.Load(path));
+  premia::tws::CachedContract cached;
+  ASSERT_TRUE(loaded.FindByConId(658123456, &cached));
+  EXPECT_DOUBLE_EQ(cached.strike, 470);
+  EXPECT_DOUBLE_EQ(cached.min_tick, 0.01);
+  premia::tws::ContractMatches matches;
+  EXPECT_TRUE(loaded.Find(call, &matches));
+}
+
+TEST(OptionSurfaceTest, ExposureSkewAndTermStructureFollowTicks) {
+  OptionSurface surface(64);
+  const int near = 20991218, far = 20991231;
+  ASSERT_TRUE(surface.Register(1, "SPY", near, 450, true));
+  ASSERT_TRUE(surface.Register(2, "SPY", near, 450, false));
+  ASSERT_TRUE(surface.Register(3, "SPY", near, 460, true));
+  Contract put;
+  put.symbol = "SPY";
+  put.lastTradeDateOrContractMonth = "20991231";
+  put.strike = 440;
+  put.right = "P";
+  ASSERT_TRUE(surface.Register(4, put));
+  EXPECT_FALSE(surface.Register(1, "SPY", near, 455, true));
+  EXPECT_TRUE(surface.Register(1, "SPY", near, 450, true));
+
+  surface.OnOpenInterest(1, 1000);
+  surface.OnTickSize(2, OPTION_PUT_OPEN_INTEREST, 500);
+  // a call line's put open interest is the underlying's, not its own
+  surface.OnTickSize(3, OPTION_PUT_OPEN_INTEREST, 9999);
+  surface.OnOpenInterest(4, 200);
+  surface.OnTickOptionComputation(1, MODEL_OPTION, 0.20, 0.55, 0.02, 0.3,
+                                  -0.1, 452);
+  surface.OnTickOptionComputation(2, MODEL_OPTION, 0.22, -0.45, 0.02, 0.3,
+                                  -0.1, 452);
+  surface.OnTickOptionComputation(3, MODEL_OPTION, 0.18, 0.3, 0.01, 0.2,
+                                  -0.1, DBL_MAX);
+  surface.OnTickOptionComputation(4, MODEL_OPTION, 0.25, -0.2, 0.01, 0.2,
+                                  -0.1, 452);
+  surface.OnTickOptionComputation(1, BID_OPTION_COMPUTATION, 0.9, 0.9, 0.9,
+                                  0.9, 0.9, 1);
+
+  // gamma * open interest * 100 * S^2 * 1%
+  const double dollar_gamma = 100 * 452.0 * 452.0 * 0.01;
+  auto strikes = surface.ExposureByStrike("SPY");
+  ASSERT_EQ(strikes.size(), 3u);
+  EXPECT_DOUBLE_EQ(strikes[0].strike, 440);
+  EXPECT_DOUBLE_EQ(strikes[0].net_gamma, -0.01 * 200 * dollar_gamma);
+  EXPECT_DOUBLE_EQ(strikes[1].call_gamma, 0.02 * 1000 * dollar_gamma);
+  EXPECT_DOUBLE_EQ(strikes[1].put_gamma, -0.02 * 500 * dollar_gamma);
+  EXPECT_DOUBLE_EQ(strikes[2].call_open_interest, 0);
+
+  // only the leg's change moves the bucket
+  surface.OnTickOptionComputation(1, MODEL_OPTION, 0.20, 0.6, 0.03, 0.3,
+                                  -0.1, 452);
+  strikes = surface.ExposureByStrike("SPY", near);
+  ASSERT_EQ(strikes.size(), 2u);
+  EXPECT_NEAR(strikes[0].net_gamma, (0.03 * 1000 - 0.02 * 500) * dollar_gamma,
+              1e-6);
+  EXPECT_NE(strikes[0].net_vanna, 0);
+
+  auto expiries = surface.ExposureByExpiry("SPY");
+  ASSERT_EQ(expiries.size(), 2u);
+  EXPECT_EQ(expiries[1].expiry, far);
+  EXPECT_DOUBLE_EQ(expiries[1].put_open_interest, 200);
+
+  auto skew = surface.Skew("SPY", near);
+  ASSERT_EQ(skew.size(), 2u);
+  EXPECT_DOUBLE_EQ(skew[0].put_vol, 0.22);
+  EXPECT_DOUBLE_EQ(skew[1].call_vol, 0.18);
+  EXPECT_NEAR(skew[1].log_moneyness, std::log(460 / 452.0), 1e-12);
+
+  // out-of-the-money vols at 450 and 460 interpolated at 452
+  auto term = surface.TermStructure("SPY");
+  ASSERT_EQ(term.size(), 2u);
+  EXPECT_NEAR(term[0].atm_vol, 0.8 * 0.22 + 0.2 * 0.18, 1e-12);
+  EXPECT_DOUBLE_EQ(term[1].atm_vol, 0.25);
+  EXPECT_GT(term[1].years, term[0].years);
+
+  premia::tws::OptionLeg leg;
+  ASSERT_TRUE(surface.Leg(3, &leg));
+  EXPECT_EQ(leg.underlying, "SPY");
+  EXPECT_DOUBLE_EQ(leg.und_price, 0);
+  EXPECT_DOUBLE_EQ(surface.Spot("SPY"), 452);
+  EXPECT_FALSE(surface.Leg(99, &leg));
+
+  // a cancelled line leaves its bucket and later ticks are dropped
+  EXPECT_TRUE(surface.Unregister(2));
+  EXPECT_FALSE(surface.Unregister(2));
+  EXPECT_FALSE(surface.Unregister(99));
+  EXPECT_FALSE(surface.Leg(2, &leg));
+  surface.OnOpenInterest(2, 800);
+  surface.OnTickOptionComputation(2, MODEL_OPTION, 0.22, -0.45, 0.05, 0.3,
+                                  -0.1, 452);
+  strikes = surface.ExposureByStrike("SPY", near);
+  ASSERT_EQ(strikes.size(), 2u);
+  EXPECT_DOUBLE_EQ(strikes[0].put_gamma, 0);
+  EXPECT_DOUBLE_EQ(strikes[0].put_open_interest, 0);
+  EXPECT_NEAR(strikes[0].net_gamma, 0.03 * 1000 * dollar_gamma, 1e-6);
+  EXPECT_DOUBLE_EQ(surface.Skew("SPY", near)[0].put_vol, 0);
+
+  // the id can come back, as the same option or another
+  ASSERT_TRUE(surface.Register(2, "SPY", near, 455, false));
+  surface.OnOpenInterest(2, 300);
+  ASSERT_TRUE(surface.Leg(2, &leg));
+  EXPECT_DOUBLE_EQ(leg.strike, 455);
+  EXPECT_DOUBLE_EQ(leg.open_interest, 300);
+}
+
+TEST(OptionSurfaceTest, CancelledLinesMakeRoomForNewOnes) {
+  OptionSurface surface(16);
+  const int expiry = 20991218;
+  for (TickerId id = 1; id <= 16; ++id) {
+    ASSERT_TRUE(surface.Register(id, "SPY", expiry, 400 + id % 4, true));
+  }
+  EXPECT_FALSE(surface.Register(17, "SPY", expiry, 400, true));
+  EXPECT_EQ(surface.size(), 16u);
+
+  // a long session keeps opening and cancelling chains
+  for (TickerId id = 100; id < 10000; ++id) {
+    ASSERT_TRUE(surface.Unregister(id == 100 ? 1 : id - 1));
+    ASSERT_TRUE(surface.Register(id, "SPY", expiry, 400 + id % 4, false))
+        << id;
+  }
+  EXPECT_EQ(surface.size(), 16u);
+
+  // the option in a reused row starts clean and keeps its own exposure
+  surface.OnOpenInterest(9999, 10);
+  surface.OnTickOptionComputation(9999, MODEL_OPTION, 0.2, -0.4, 0.01, 0.3,
+                                  -0.1, 400);
+  premia::tws::OptionLeg leg;
+  ASSERT_TRUE(surface.Leg(9999, &leg));
+  EXPECT_FALSE(leg.call);
+  EXPECT_DOUBLE_EQ(leg.strike, 403);
+  EXPECT_DOUBLE_EQ(leg.open_interest, 10);
+  auto strikes = surface.ExposureByStrike("SPY");
+  ASSERT_EQ(strikes.size(), 4u);
+  EXPECT_DOUBLE_EQ(strikes[3].put_open_interest, 10);
+  EXPECT_DOUBLE_EQ(strikes[3].net_gamma, leg.gamma_exposure);
+
+  // buckets are never freed, so they are what still runs out
+  ASSERT_TRUE(surface.Unregister(9999));
+  for (int strike = 0; strike < 12; ++strike) {
+    ASSERT_TRUE(surface.Register(20000 + strike, "QQQ", expiry, strike + 1,
+                                 true));
+    ASSERT_TRUE(surface.Unregister(20000 + strike));
+  }
+  EXPECT_FALSE(surface.Register(30000, "QQQ", expiry, 99, true));
+  EXPECT_TRUE(surface.Register(30000, "QQQ", expiry, 1, true));
+}
+
+TEST(PnlEngineTest, FillsCommissionsAndMarksRollUpPerAccount) {
+  MarketDataCache quotes(64);
+  PnlEngine pnl(quotes);
+  Contract stock;
+  stock.conId = 265598;
+  stock.symbol = "AAPL";
+  stock.secType = "STK";
+  Contract option;
+  option.conId = 500001;
+  option.symbol = "AAPL";
+  option.secType = "OPT";
+  option.multiplier = "100";
+
+  auto fill = [](const std::string &id, const std::string &side,
+                 double shares, double price) {
+    Execution execution;
+    execution.execId = id;
+    execution.acctNumber = "DU1";
+    execution.side = side;
+    execution.shares = shares;
+    execution.price = price;
+    return execution;
+  };
+  CommissionReport early;
+  early.execId = "e1";
+  early.commission = 1.0;
+  pnl.OnCommission(early);
+
+  pnl.OnExecution(stock, fill("e1", "BOT", 100, 10.0));
+  pnl.OnExecution(stock, fill("e2", "BOT", 100, 12.0));
+  pnl.OnExecution(stock, fill("e2", "BOT", 100, 12.0));  // repeated
+  premia::tws::PositionLine line;
+  ASSERT_TRUE(pnl.Position("DU1", 265598, &line));
+  EXPECT_DOUBLE_EQ(line.quantity, 200);
+  EXPECT_DOUBLE_EQ(line.average_price, 11.0);
+  EXPECT_DOUBLE_EQ(line.fees, 1.0);
+
+  // sell through zero: 200 closed at +2, 50 opened short at 13
+  pnl.OnExecution(stock, fill("e3", "SLD", 250, 13.0));
+  CommissionReport late;
+  late.execId = "e3";
+  late.commission = 2.5;
+  pnl.OnCommission(late);
+  ASSERT_TRUE(pnl.Position("DU1", 265598, &line));
+  EXPECT_DOUBLE_EQ(line.quantity, -50);
+  EXPECT_DOUBLE_EQ(line.average_price, 13.0);
+  EXPECT_DOUBLE_EQ(line.realized, 400);
+  EXPECT_DOUBLE_EQ(line.fees, 3.5);
+  EXPECT_EQ(line.fills, 3u);
+
+  // marks come from the cache, fed first as Client does
+  auto tick = [&](TickerId id, TickType field, double price) {
+    quotes.OnTickPrice(id, field, price);
+    pnl.OnTickPrice(id, field);
+  };
+  pnl.WatchTicker(7, 265598);
+  tick(7, LAST, 12.0);
+  tick(8, LAST, 99.0);  // not watched
+  ASSERT_TRUE(pnl.Position("DU1", 265598, &line));
+  EXPECT_DOUBLE_EQ(line.unrealized, 50);
+  tick(7, BID, 12.4);
+  tick(7, HIGH, 14.0);
+  ASSERT_TRUE(pnl.Position("DU1", 265598, &line));
+  EXPECT_DOUBLE_EQ(line.mark, 12.0);  // last until both sides are known
+  tick(7, ASK, 12.6);
+  ASSERT_TRUE(pnl.Position("DU1", 265598, &line));
+  EXPECT_DOUBLE_EQ(line.mark, 12.5);
+  EXPECT_DOUBLE_EQ(line.market_value, -625);
+
+  // IB reports option cost with the multiplier included
+  pnl.OnPosition("DU1", option, 2, 350.0);
+  pnl.Mark(500001, 4.0);
+  ASSERT_TRUE(pnl.Position("DU1", 500001, &line));
+  EXPECT_DOUBLE_EQ(line.average_price, 3.5);
+  EXPECT_DOUBLE_EQ(line.unrealized, 100);
+
+  pnl.OnPortfolio("DU2", stock, 10, 12.0, 11.0);
+  ASSERT_TRUE(pnl.Position("DU1", 265598, &line));
+  EXPECT_DOUBLE_EQ(line.mark, 12.0);  // one mark for both accounts
+
+  premia::tws::AccountPnl total;
+  ASSERT_TRUE(pnl.Account("DU1", &total));
+  EXPECT_DOUBLE_EQ(total.realized, 400);
+  EXPECT_DOUBLE_EQ(total.unrealized, 50 + 100);
+  EXPECT_DOUBLE_EQ(total.fees, 3.5);
+  EXPECT_DOUBLE_EQ(total.market_value, -600 + 800);
+  EXPECT_DOUBLE_EQ(total.net(), 546.5);
+  ASSERT_TRUE(pnl.Account("DU2", &total));
+  EXPECT_DOUBLE_EQ(total.unrealized, 10);
+  EXPECT_EQ(pnl.Positions("DU1").size(), 2u);
+  EXPECT_EQ(pnl.Accounts().size(), 2u);
+
+  pnl.TrackPnlSingle(9001, "DU2", 265598);
+  pnl.OnPnlSingle(9001, 42.0);
+  ASSERT_TRUE(pnl.Position("DU2", 265598, &line));
+  EXPECT_DOUBLE_EQ(line.ib_daily_pnl, 42.0);
+}
+
+TEST(PnlEngineTest, TrackingBeforeThePositionKeepsTheMultiplier) {
+  MarketDataCache quotes(64);
+  PnlEngine pnl(quotes);
+  Contract option;
+  option.conId = 500002;
+  option.symbol = "SPY";
+  option.secType = "OPT";
+  option.multiplier = "100";
+
+  pnl.TrackPnlSingle(9002, "DU1", 500002);
+  pnl.OnPosition("DU1", option, 1, 500.0);
+  pnl.Mark(500002, 6.0);
+  pnl.OnPnlSingle(9002, 100.0);
+
+  premia::tws::PositionLine line;
+  ASSERT_TRUE(pnl.Position("DU1", 500002, &line));
+  EXPECT_EQ(line.symbol, "SPY");
+  EXPECT_EQ(line.sec_type, "OPT");
+  EXPECT_DOUBLE_EQ(line.multiplier, 100);
+  EXPECT_DOUBLE_EQ(line.average_price, 5.0);
+  EXPECT_DOUBLE_EQ(line.unrealized, 100);
+  EXPECT_DOUBLE_EQ(line.ib_daily_pnl, 100.0);
+}
+
+TEST(ScannerEngineTest, RefreshesBecomeEnteredExitedAndMovedRows) {
+  ScannerEngine scanners(1000);
+  std::map<TickerId, long> lines;
+  scanners.SetMarketData(
+      [&](TickerId id, const Contract &contract) {
+        lines[id] = contract.conId;
+      },
+      [&](TickerId id) { lines.erase(id); });
+
+  std::vector<ScanEvent> seen;
+  auto listener = [&](int, const std::vector<ScanEvent> &events) {
+    seen = events;
+  };
+  scanners.Watch(1, listener);
+  scanners.Watch(2, nullptr);
+
+  auto refresh = [&](int req_id, std::vector<long> con_ids) {
+    for (size_t rank = 0; rank < con_ids.size(); ++rank) {
+      Contract contract;
+      contract.conId = con_ids[rank];
+      scanners.OnRow(req_id, static_cast<int>(rank), contract, "", "", "",
+                     "");
+    }
+    scanners.OnEnd(req_id);
+  };
+  auto count = [&](ScanEvent::Kind kind) {
+    return std::count_if(seen.begin(), seen.end(), [&](const ScanEvent &e) {
+      return e.kind == kind;
+    });
+  };
+
+  refresh(1, {10, 20, 30});
+  EXPECT_EQ(seen.size(), 3u);
+  EXPECT_EQ(count(ScanEvent::kEntered), 3);
+  EXPECT_EQ(lines.size(), 3u);
+
+  // unchanged refresh: no events at all
+  seen.clear();
+  refresh(1, {10, 20, 30});
+  EXPECT_TRUE(seen.empty());
+
+  refresh(1, {30, 10, 40});
+  ASSERT_EQ(seen.size(), 4u);
+  EXPECT_EQ(count(ScanEvent::kEntered), 1);
+  EXPECT_EQ(count(ScanEvent::kMoved), 2);
+  EXPECT_EQ(count(ScanEvent::kExited), 1);
+  for (const ScanEvent &event : seen) {
+    if (event.kind == ScanEvent::kExited) {
+      EXPECT_EQ(event.row.contract.conId, 20);
+      EXPECT_EQ(event.old_rank, 1);
+    }
+    if (event.row.contract.conId == 30) {
+      EXPECT_EQ(event.old_rank, 2);
+      EXPECT_EQ(event.new_rank, 0);
+    }
+  }
+  EXPECT_EQ(lines.size(), 3u);  // 20 closed, 40 opened
+
+  // a contract listed by two scanners keeps one line until both drop it
+  refresh(2, {40, 50});
+  EXPECT_EQ(lines.size(), 4u);
+  auto rows = scanners.Rows(2);
+  ASSERT_EQ(rows.size(), 2u);
+  EXPECT_EQ(rows[0].ticker, scanners.Rows(1)[2].ticker);
+  scanners.Cancel(1);
+  EXPECT_EQ(count(ScanEvent::kExited), 3);
+  EXPECT_EQ(lines.size(), 2u);
+  EXPECT_EQ(lines[rows[0].ticker], 40);
+  EXPECT_EQ(scanners.refreshes(2), 1u);
+  EXPECT_EQ(scanners.subscriptions(), 2u);
+}
+
+TEST(TickBackfillTest, PagesWindowsDedupesAndStoresColumns) {
+  using premia::tws::HistoricalTickRow;
+  using premia::tws::HistoricalTicks;
+  using premia::tws::RequestError;
+  using premia::tws::RequestTicket;
+
+  int64_t start = TickBackfill::ParseTime("20240102-14:30:00");
+  EXPECT_EQ(start, 1704205800);
+  EXPECT_EQ(TickBackfill::FormatTime(start), "20240102-14:30:00");
+  EXPECT_EQ(TickBackfill::ParseTime("20240102"), 1704153600);
+  EXPECT_EQ(TickBackfill::ParseTime("2024-01-02"), -1);
+
+  // three trades every other second over 20 minutes
+  std::vector<HistoricalTickRow> tape;
+  for (int64_t t = start - 60; t < start + 1260; t += 2) {
+    for (int i = 0; i < 3; ++i) {
+      HistoricalTickRow row;
+      row.time = t;
+      row.price = 100.0 + (t % 97) * 0.01 + i * 0.25;
+      row.size = 100 * (i + 1);
+      row.exchange = i == 0 ? "ARCA" : "NYSE";
+      tape.push_back(row);
+    }
+  }
+
+  // like TWS: count ticks from the start second on, finishing the last
+  // second; the first request fails once
+  std::mutex mutex;
+  int calls = 0;
+  auto fetch = [&](const Contract &, const std::string &from, int count,
+                   const std::string &, int) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::promise<HistoricalTicks> promise;
+    if (calls++ == 0) {
+      promise.set_exception(
+          std::make_exception_ptr(RequestError(162, "pacing violation")));
+      return RequestTicket<HistoricalTicks>{calls, promise.get_future()};
+    }
+    HistoricalTicks page;
+    int64_t begin = TickBackfill::ParseTime(from);
+    for (const HistoricalTickRow &row : tape) {
+      if (row.time < begin) continue;
+      if (static_cast<int>(page.ticks.size()) >= count &&
+          row.time != page.ticks.back().time) {
+        break;
+      }
+      page.ticks.push_back(row);
+    }
+    promise.set_value(page);
+    return RequestTicket<HistoricalTicks>{calls, promise.get_future()};
+  };
+
+  premia::tws::BackfillOptions options;
+  options.window_seconds = 300;
+  options.ticks_per_request = 100;
+  options.max_in_flight = 3;
+  options.retry_delay = std::chrono::milliseconds(0);
+  TickBackfill backfill(fetch, options);
+
+  std::string path = ::testing::TempDir() + "ib_ticks.bin";
+  premia::tws::TickFileInfo info;
+  info.symbol = "SPY";
+  info.what_to_show = "TRADES";
+  info.price_scale = 100;
+  premia::tws::TickFileWriter writer;
+  ASSERT_TRUE(writer.Open(path, info));
+
+  Contract contract;
+  auto stats = backfill.Run(
+      contract, start, start + 1200,
+      [&](const std::vector<HistoricalTickRow> &rows) { writer.Append(rows); });
+  writer.Close();
+
+  EXPECT_EQ(stats.windows, 4u);
+  EXPECT_EQ(stats.failed_windows, 0u);
+  EXPECT_EQ(stats.retries, 1u);
+  EXPECT_GT(stats.duplicates, 0u);
+  ASSERT_EQ(stats.ticks, 1800u);
+  EXPECT_EQ(writer.rows(), 1800u);
+  EXPECT_LT(writer.bytes(), 1800u * 6);
+
+  premia::tws::TickFileInfo read_info;
+  std::vector<HistoricalTickRow> rows;
+  ASSERT_TRUE(premia::tws::ReadTickFile(path, &read_info, &rows));
+  EXPECT_EQ(read_info.symbol, "SPY");
+  EXPECT_DOUBLE_EQ(read_info.price_scale, 100);
+  ASSERT_EQ(rows.size(), 1800u);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    const HistoricalTickRow &want = tape[90 + i];
+    ASSERT_EQ(rows[i].time, want.time) << i;
+    EXPECT_NEAR(rows[i].price, want.price, 1e-9);
+    EXPECT_EQ(rows[i].size, want.size);
+    EXPECT_EQ(rows[i].exchange, want.exchange);
+    EXPECT_DOUBLE_EQ(rows[i].bid, 0);
+  }
+  EXPECT_EQ(stats.truncated_seconds, 0u);
+
+  // a second TWS will not page past is skipped, and counted
+  auto capped = [&](const Contract &, const std::string &from, int count,
+                    const std::string &, int) {
+    std::promise<HistoricalTicks> promise;
+    HistoricalTicks page;
+    HistoricalTickRow row;
+    row.time = start;
+    row.price = 100;
+    if (TickBackfill::ParseTime(from) == start) page.ticks.assign(count, row);
+    promise.set_value(page);
+    return RequestTicket<HistoricalTicks>{0, promise.get_future()};
+  };
+  TickBackfill busy(capped, options);
+  size_t kept = 0;
+  stats = busy.Run(contract, start, start + 10,
+                   [&](const std::vector<HistoricalTickRow> &rows) {
+                     kept += rows.size();
+                   });
+  EXPECT_EQ(stats.truncated_seconds, 1u);
+  EXPECT_EQ(stats.ticks, 100u);
+  EXPECT_EQ(kept, 100u);
+}
+
+TEST(TickFileTest, RejectsAStringTableLargerThanItsBlock) {
+  using premia::tws::HistoricalTickRow;
+
+  premia::tws::TickFileInfo info;
+  info.symbol = "SPY";
+  info.price_scale = 100;
+  std::string path = ::testing::TempDir() + "ib_ticks_bad.bin";
+  premia::tws::TickFileWriter writer;
+  ASSERT_TRUE(writer.Open(path, info));
+  HistoricalTickRow row;
+  row.time = 1704205800;
+  row.exchange = "ARCA";
+  writer.Append({row});
+  writer.Close();
+
+  std::string data;
+  {
+    std::ifstream file(path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+  }
+  // the one-entry table's count becomes 2^28, far past the block
+  size_t at = data.rfind(std::string("\x01\x04" "ARCA", 6));
+  ASSERT_NE(at, std::string::npos);
+  data.replace(at, 1, "\x80\x80\x80\x80\x01", 5);
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+  }
+
+  std::vector<HistoricalTickRow> rows;
+  EXPECT_FALSE(premia::tws::ReadTickFile(path, &info, &rows));
+}
+
+#ifndef _WIN32
+using premia::tws::ConnectionPool;
+using premia::tws::ConnectionStatus;
+using premia::tws::MockTwsServer;
+using premia::tws::PoolOptions;
+
+TEST(MockTwsServerTest, ClientRoundTripsThroughTheWireProtocol) {
+  MockTwsServer server;
+  ASSERT_TRUE(server.Start());
+
+  server.OnRequest(1, [](MockTwsServer &tws, const MockTwsServer::Fields &req) {
+    TickerId id = std::stol(req[2]);
+    tws.Send(tws.TickPrice(id, BID, 101.25, 300));
+    tws.Send(tws.TickPrice(id, ASK, 101.5, 200));
+  });
+  server.OnRequest(20, [](MockTwsServer &tws,
+                          const MockTwsServer::Fields &req) {
+    Bar bar = {"20240102", 11, 9, 10, 10.5, 10.2, 5000, 42};
+    tws.Send(tws.HistoricalData(std::stoi(req[1]), "20240101", "20240103",
+                                {bar, bar}));
+  });
+
+  Client client;
+  ASSERT_TRUE(client.connect("127.0.0.1", server.port(), 0));
+  ASSERT_TRUE(server.WaitForClient(std::chrono::seconds(5)));
+
+  std::atomic<bool> done(false);
+  std::thread loop([&]() {
+    while (!done && client.isConnected()) client.processMessages();
+  });
+
+  Contract contract;
+  contract.symbol = "SPY";
+  client.subscribeMarketData(7, contract);
+  auto bars = client.fetchHistoricalData(contract, "", "2 D", "1 day",
+                                         "TRADES", 1);
+
+  ASSERT_EQ(bars.result.wait_for(std::chrono::seconds(5)),
+            std::future_status::ready);
+  EXPECT_EQ(bars.result.get().bars.size(), 2u);
+
+  TopOfBook tob;
+  ASSERT_TRUE(client.marketData().Snapshot(7, &tob));
+  EXPECT_DOUBLE_EQ(tob.bid, 101.25);
+  EXPECT_DOUBLE_EQ(tob.ask_size, 200);
+
+  done = true;
+  client.disconnect();
+  loop.join();
+}
+
+TEST(MockTwsServerTest, DeferredRequestsGoOutWithoutInboundTraffic) {
+  MockTwsServer server;
+  ASSERT_TRUE(server.Start());
+
+  Client client;
+  client.setRunSamples(false);
+  ASSERT_TRUE(client.connect("127.0.0.1", server.port(), 0));
+  ASSERT_TRUE(server.WaitForClient(std::chrono::seconds(5)));
+
+  std::atomic<bool> done(false);
+  std::thread loop([&]() {
+    while (!done && client.isConnected()) client.processMessages();
+  });
+
+  // past the 45 message burst; the rest leaves at 45/s, not on the 2 s
+  // signal timeout, and the idle order and historical shares are used
+  Contract contract;
+  contract.symbol = "SPY";
+  auto start = std::chrono::steady_clock::now();
+  for (TickerId id = 1; id <= 80; ++id) client.subscribeMarketData(id, contract);
+  while (server.RequestCount(1) < 80 &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(server.RequestCount(1), 80u);
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(1500));
+  EXPECT_LT(client.pacer().Stats(premia::tws::kPaceGeneral).max_wait_ms,
+            1500.0);
+
+  done = true;
+  client.disconnect();
+  loop.join();
+}
+
+TEST(ConnectionPoolTest, SpreadsLinesMergesTicksAndFailsOver) {
+  MockTwsServer first, second;
+  ASSERT_TRUE(first.Start());
+  ASSERT_TRUE(second.Start());
+  for (MockTwsServer *server : {&first, &second}) {
+    server->OnRequest(1, [](MockTwsServer &tws,
+                            const MockTwsServer::Fields &req) {
+      tws.Send(tws.TickPrice(std::stol(req[2]), BID, 50.5, 100));
+    });
+  }
+
+  PoolOptions options;
+  options.lines_per_connection = 2;
+  options.retry_seconds = 60;
+  ConnectionPool pool({{"127.0.0.1", first.port(), 0},
+                       {"127.0.0.1", second.port(), 0}},
+                      options);
+
+  std::mutex mutex;
+  std::condition_variable ticked;
+  std::map<TickerId, int> tick_from;
+  pool.SetTickListener([&](int connection, TickerId id, const TopOfBook &) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tick_from[id] = connection;
+    ticked.notify_all();
+  });
+  auto wait_for_ticks = [&](size_t count) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return ticked.wait_for(lock, std::chrono::seconds(5),
+                           [&] { return tick_from.size() >= count; });
+  };
+  auto connected = [&pool]() {
+    size_t up = 0;
+    for (const ConnectionStatus &status : pool.Status()) {
+      up += status.connected;
+    }
+    return up;
+  };
+
+  pool.Start();
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (connected() < 2 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(connected(), 2u);
+
+  Contract contract;
+  contract.symbol = "SPY";
+  TickerId a = pool.Subscribe(contract);
+  TickerId b = pool.Subscribe(contract);
+  ASSERT_GE(a, 0);
+  ASSERT_GE(b, 0);
+  EXPECT_NE(a, b);
+
+  // one line on each connection, both merged into the one listener
+  ASSERT_TRUE(wait_for_ticks(2));
+  EXPECT_EQ(first.RequestCount(1), 1u);
+  EXPECT_EQ(second.RequestCount(1), 1u);
+  // pooled sessions leave the account's FA setup alone
+  for (MockTwsServer *server : {&first, &second}) {
+    EXPECT_EQ(server->RequestCount(ibapi::client_constants::REQ_FA), 0u);
+    EXPECT_EQ(server->RequestCount(ibapi::client_constants::REPLACE_FA), 0u);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_NE(tick_from[a], tick_from[b]);
+  }
+  TopOfBook tob;
+  ASSERT_TRUE(pool.Snapshot(a, &tob));
+  EXPECT_DOUBLE_EQ(tob.bid, 50.5);
+
+  // the dropped connection's line moves to the one still up
+  int moved;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    moved = tick_from[a];
+    tick_from.clear();
+  }
+  (moved == 0 ? first : second).DropClient();
+  MockTwsServer &survivor = moved == 0 ? second : first;
+  deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (survivor.RequestCount(1) < 2 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(survivor.RequestCount(1), 2u);
+  {
+    // the dropped connection may still be finishing its last tick message,
+    // so wait for the survivor's tick rather than for any
+    std::unique_lock<std::mutex> lock(mutex);
+    EXPECT_TRUE(ticked.wait_for(lock, std::chrono::seconds(5), [&] {
+      auto found = tick_from.find(a);
+      return found != tick_from.end() && found->second == 1 - moved;
+    }));
+  }
+
+  // Stop() wakes the loops rather than waiting out the signal timeout
+  auto stop_started = std::chrono::steady_clock::now();
+  pool.Stop();
+  EXPECT_LT(std::chrono::steady_clock::now() - stop_started,
+            std::chrono::seconds(1));
+  EXPECT_EQ(connected(), 0u);
+}
+
+class ReplayCounter : public DefaultEWrapper {
+ public:
+  void tickPrice(TickerId, TickType, double price,
+                 const TickAttrib &) override {
+    last_price = price;
+    ++ticks;
+  }
+  void historicalData(TickerId, const Bar &) override { ++bars; }
+
+  double last_price = 0;
+  int ticks = 0;
+  int bars = 0;
+};
+
+TEST(WireCaptureTest, ReplaysACapturedSessionThroughTheDecoder) {
+  MockTwsServer server;
+  ASSERT_TRUE(server.Start());
+  server.OnRequest(20, [](MockTwsServer &tws,
+                          const MockTwsServer::Fields &req) {
+    Bar bar = {"20240102", 11, 9, 10, 10.5, 10.2, 5000, 42};
+    tws.Send(tws.HistoricalData(std::stoi(req[1]), "20240101", "20240103",
+                                {bar, bar, bar}));
+  });
+
+  Client client;
+  ASSERT_TRUE(client.connect("127.0.0.1", server.port(), 0));
+  ASSERT_TRUE(server.WaitForClient(std::chrono::seconds(5)));
+  std::string path = ::testing::TempDir() + "ib_wire_capture.bin";
+  ASSERT_TRUE(client.startCapture(path));
+
+  std::atomic<bool> done(false);
+  std::thread loop([&]() {
+    while (!done && client.isConnected()) client.processMessages();
+  });
+
+  for (int i = 0; i < 50; ++i) server.Send(server.TickPrice(9, LAST, i, 1));
+  Contract contract;
+  contract.symbol = "QQQ";
+  auto bars = client.fetchHistoricalData(contract, "", "3 D", "1 day",
+                                         "TRADES", 1);
+  ASSERT_EQ(bars.result.wait_for(std::chrono::seconds(5)),
+            std::future_status::ready);
+  client.stopCapture();
+
+  done = true;
+  client.disconnect();
+  loop.join();
+
+  premia::tws::WireReplay replay;
+  ASSERT_TRUE(replay.Load(path));
+  EXPECT_EQ(replay.server_version(), server.version());
+  ASSERT_GE(replay.size(), 51u);
+  const auto &messages = replay.messages();
+  for (size_t i = 1; i < messages.size(); ++i) {
+    EXPECT_LE(messages[i - 1].timestamp_ns, messages[i].timestamp_ns);
+  }
+
+  ReplayCounter counter;
+  premia::tws::ReplayStats stats = replay.Run(&counter, 2);
+  EXPECT_EQ(stats.failed, 0u);
+  EXPECT_EQ(stats.messages, replay.size() * 2);
+  EXPECT_EQ(counter.ticks, 100);
+  EXPECT_DOUBLE_EQ(counter.last_price, 49);
+  EXPECT_EQ(counter.bars, 6);
+
+  // reframed, the capture is what the server sent after the handshake
+  EXPECT_EQ(replay.Framed().size(),
+            stats.bytes / 2 + replay.size() * sizeof(int32_t));
+}
+
+class DecodeRecorder : public DefaultEWrapper {
+ public:
+  void tickPrice(TickerId, TickType, double price,
+                 const TickAttrib &attrib) override {
+    last_price = price;
+    last_attrib = attrib;
+  }
+  void updateMktDepthL2(TickerId, int, const std::string &maker, int, int,
+                        double, int size, bool smart) override {
+    depth_maker = maker;
+    depth_size = size;
+    smart_depth = smart;
+  }
+  void error(int, int code, const std::string &) override { last_error = code; }
+
+  double last_price = 0;
+  TickAttrib last_attrib = {};
+  std::string depth_maker;
+  int depth_size = 0;
+  bool smart_depth = false;
+  int last_error = 0;
+};
+
+int Decode(EDecoder &decoder, const MockTwsServer::Fields &fields) {
+  std::string framed = MockTwsServer::Frame(fields);
+  const char *begin = framed.data() + 4;
+  return decoder.parseAndProcessMsg(begin, framed.data() + framed.size());
+}
+
+TEST(EDecoderTest, DispatchTableFollowsTheServerVersion) {
+  // attrMask 6 is pastLimit | preOpen
+  MockTwsServer::Fields tick = {"1", "6", "5", "1", "101.5", "300", "6"};
+  MockTwsServer::Fields depth = {"13", "1", "5", "0", "IEX", "0",
+                                 "1", "101.25", "+200", "1"};
+
+  DecodeRecorder current;
+  EDecoder decoder(MIN_SERVER_VER_SMART_DEPTH, &current);
+  EXPECT_GT(Decode(decoder, tick), 0);
+  EXPECT_DOUBLE_EQ(current.last_price, 101.5);
+  EXPECT_TRUE(current.last_attrib.pastLimit);
+  EXPECT_TRUE(current.last_attrib.preOpen);
+  EXPECT_GT(Decode(decoder, depth), 0);
+  EXPECT_EQ(current.depth_maker, "IEX");
+  // not plain digits, decoded by the atoi fallback
+  EXPECT_EQ(current.depth_size, 200);
+  EXPECT_TRUE(current.smart_depth);
+  EXPECT_EQ(decoder.msgCount(TICK_PRICE), 1);
+  EXPECT_EQ(decoder.msgCount(MARKET_DEPTH_L2), 1);
+
+  // before preOpen and smart depth existed neither is read
+  DecodeRecorder older;
+  EDecoder old_decoder(MIN_SERVER_VER_PAST_LIMIT, &older);
+  EXPECT_GT(Decode(old_decoder, tick), 0);
+  EXPECT_TRUE(older.last_attrib.pastLimit);
+  EXPECT_FALSE(older.last_attrib.preOpen);
+  depth.pop_back();
+  EXPECT_GT(Decode(old_decoder, depth), 0);
+  EXPECT_FALSE(older.smart_depth);
+
+  Decode(decoder, {"250", "1"});
+  EXPECT_EQ(current.last_error, 505);  // UNKNOWN_ID
+  decoder.resetMsgCounts();
+  EXPECT_EQ(decoder.msgCount(TICK_PRICE), 0);
+}
+#endif
+
+}  // namespace IBTests
+}  // namespace ServiceTestSuite
+}  // namespace premiatests
@@ -1,7 +1,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <sstream>
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "app/core/TDA.hpp"
@@ -57,6 +59,67 @@ TEST_F(TDAFixture, GetPriceHistoryOk) {
               absl::OkStatus());
 }
 
+TEST(TDAParserTest, AccountsParseIntoATypedPositionsTable) {
+  const std::string account = R"({"securitiesAccount": {
+    "accountId": "123",
+    "positions": [
+      {"longQuantity": 20, "shortQuantity": 0, "averagePrice": 150.5,
+       "currentDayProfitLoss": -12.5, "marketValue": 3100,
+       "instrument": {"assetType": "EQUITY", "symbol": "AAPL"}},
+      {"longQuantity": 0, "shortQuantity": 2, "averagePrice": 3.2,
+       "marketValue": -500,
+       "instrument": {"assetType": "OPTION", "symbol": "SPY_011924C480",
+                      "putCall": "CALL", "underlyingSymbol": "SPY"}}],
+    "currentBalances": {"cashBalance": 1000.25, "buyingPower": "9000"}}})";
+  premia::tda::Parser parser;
+  auto single = parser.parse_account(parser.read_response(account));
+  ASSERT_EQ(2u, single.get_position_vector_size());
+  EXPECT_EQ("123", single.get_account_variable("accountId"));
+  EXPECT_DOUBLE_EQ(1000.25, single.get_balances().cashBalance);
+  EXPECT_DOUBLE_EQ(9000.0, single.get_balances().buyingPower);
+  const auto* option = single.find_position("SPY_011924C480");
+  ASSERT_NE(nullptr, option);
+  EXPECT_EQ("OPTION", option->assetType);
+  EXPECT_EQ("SPY", option->underlyingSymbol);
+  EXPECT_DOUBLE_EQ(-2.0, option->quantity());
+  EXPECT_EQ(nullptr, single.find_position("MSFT"));
+
+  // the same account twice sums into one row per symbol
+  auto both = parser.parse_all_accounts(
+      parser.read_response("[" + account + "," + account + "]"));
+  ASSERT_EQ(2u, both.get_position_vector_size());
+  const auto* shares = both.find_position("AAPL");
+  ASSERT_NE(nullptr, shares);
+  EXPECT_DOUBLE_EQ(40.0, shares->quantity());
+  EXPECT_DOUBLE_EQ(150.5, shares->averagePrice);
+  EXPECT_DOUBLE_EQ(6200.0, shares->marketValue);
+  EXPECT_DOUBLE_EQ(-25.0, shares->currentDayProfitLoss);
+  EXPECT_DOUBLE_EQ(2000.5, both.get_balances().cashBalance);
+}
+
+TEST(TDAParserTest, AccountIdsListThePrimaryAccountOnce) {
+  // TDA sends primaryAccountId ahead of accounts, which repeats it
+  const std::string principals = R"({
+    "userId": "user",
+    "primaryAccountId": "111",
+    "accounts": [
+      {"accountId": "222", "displayName": "ira"},
+      {"accountId": "111", "displayName": "individual"},
+      {"accountId": "333"}],
+    "streamerInfo": {"appId": "app"}})";
+  premia::tda::Parser parser;
+  EXPECT_EQ((std::vector<std::string>{"111", "222", "333"}),
+            parser.parse_account_ids(parser.read_response(principals)));
+
+  // the other key order gives the same list
+  const std::string reordered = R"({
+    "accounts": [{"accountId": "222"}, {"accountId": "111"}],
+    "primaryAccountId": "111"})";
+  EXPECT_EQ((std::vector<std::string>{"111", "222"}),
+            parser.parse_account_ids(parser.read_response(reordered)));
+  EXPECT_TRUE(parser.parse_account_ids(parser.read_response("{}")).empty());
+}
+
 }  // namespace TDATests
 }  // namespace ServiceTestSuite
 }  // namespace premiatests
\ No newline at end of file